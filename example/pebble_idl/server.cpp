@@ -31,7 +31,8 @@ public:
     virtual ~MyUserInfoManagerEx() {}
 
     virtual void get_user(const uint64_t id,
-        cxx::function<void(int32_t ret_code, const example::Message& response)>& rsp) {
+        pebble::Function<void(int32_t ret_code, const example::Message& response),
+            pebble::RPC_RESPONSE_INLINE_SIZE>& rsp) {
         std::cout << "[server] " << __FUNCTION__ << std::endl;
 
         example::Message response;
@@ -41,7 +42,8 @@ public:
     }
 
     virtual void add_user(const example::UserInfo& user, const std::string& comment,
-        cxx::function<void(int32_t ret_code, uint64_t response)>& rsp) {
+        pebble::Function<void(int32_t ret_code, uint64_t response),
+            pebble::RPC_RESPONSE_INLINE_SIZE>& rsp) {
         std::cout << "[server] " << __FUNCTION__ << std::endl;
 
         User new_user;
@@ -60,7 +62,8 @@ public:
     }
 
     virtual void get_user_list(const std::vector<uint64_t> & ids,
-        cxx::function<void(int32_t ret_code, const std::vector< ::example::Message> & response)>& rsp) {
+        pebble::Function<void(int32_t ret_code, const std::vector< ::example::Message> & response),
+            pebble::RPC_RESPONSE_INLINE_SIZE>& rsp) {
         std::cout << "[server] " << __FUNCTION__ << std::endl;
 
         std::vector< ::example::Message> response;
@@ -30,7 +30,8 @@ public:
     virtual ~CalculatorImp() {}
 
     virtual void add(const ::example::CalRequest& request,
-        cxx::function<void(int32_t ret_code, const ::example::CalResponse& response)>& rsp)
+        pebble::Function<void(int32_t ret_code, const ::example::CalResponse& response),
+            pebble::RPC_RESPONSE_INLINE_SIZE>& rsp)
     {
         int32_t a = request.a();
         int32_t b = request.b();
@@ -27,6 +27,7 @@
 #include "framework/pebble_rpc.h"
 #include "framework/register_error.h"
 #include "framework/session.h"
+#include "framework/shm_message_driver.h"
 #include "framework/stat.h"
 #include "framework/stat_manager.h"
 #include "pebble_version.inh"
@@ -112,6 +113,14 @@ int32_t PebbleClient::Init() {
     ret = Message::Init();
     CHECK_RETURN(ret);
 
+    if (m_options._app_use_shm) {
+        ShmMessageDriver* shm_driver = ShmMessageDriver::Instance();
+        ret = shm_driver->Init(Message::GetMessageDriver());
+        CHECK_RETURN(ret);
+        shm_driver->SetSpinUs(m_options._app_shm_spin_us);
+        Message::SetMessageDriver(shm_driver);
+    }
+
     signal(SIGPIPE, SIG_IGN);
 
     return 0;
@@ -151,7 +160,7 @@ int32_t PebbleClient::Attach(Router* router, IProcessor* processor) {
 }
 
 PebbleRpc* PebbleClient::GetPebbleRpc(ProtocolType protocol_type) {
-    if (protocol_type < kPEBBLE_RPC_BINARY || protocol_type > kPEBBLE_RPC_PROTOBUF) {
+    if (protocol_type < kPEBBLE_RPC_BINARY || protocol_type > kPEBBLE_RPC_COMPACT) {
         PLOG_ERROR("param protocol_type invalid(%d)", protocol_type);
         return NULL;
     }
@@ -179,6 +188,10 @@ PebbleRpc* PebbleClient::GetPebbleRpc(ProtocolType protocol_type) {
             rpc_code_type = kCODE_PB;
             break;
 
+        case kPEBBLE_RPC_COMPACT:
+            rpc_code_type = kCODE_COMPACT;
+            break;
+
         default:
             PLOG_FATAL("unsupport protocol type %d", protocol_type);
             return NULL;
@@ -240,7 +253,8 @@ Router* PebbleClient::GetRouter(const std::string& name, RouterType router_type)
 int32_t PebbleClient::Update() {
     int32_t num = 0;
 
-    int64_t old = TimeUtility::GetCurrentMS();
+    TimeUtility::UpdateCachedTime();
+    int64_t old = TimeUtility::GetCachedMS();
 
     for (uint32_t i = 0; i < m_options._max_msg_num_per_loop; ++i) {
         if (ProcessMessage() <= 0) {
@@ -269,9 +283,11 @@ int32_t PebbleClient::Update() {
         num += m_session_mgr->CheckTimeout();
     }
 
+    Message::Flush();
+
     if (m_stat_manager) {
         num += m_stat_manager->Update();
-        m_stat_manager->GetStat()->AddResourceItem("_loop", TimeUtility::GetCurrentMS() - old);
+        m_stat_manager->GetStat()->AddResourceItem("_loop", TimeUtility::GetMonotonicMS() - old);
     }
 
     return num;
@@ -433,7 +449,7 @@ Stat* PebbleClient::GetStat() {
     return NULL;
 }
 
-int32_t PebbleClient::MakeCoroutine(const cxx::function<void()>& routine) {
+int32_t PebbleClient::MakeCoroutine(const Function<void()>& routine) {
     if (!m_coroutine_schedule) {
         PLOG_ERROR("coroutine schedule is null");
         return -1;
@@ -67,6 +67,7 @@ typedef enum {
     kPEBBLE_RPC_BINARY = 0, // thrift binary编码协议
     kPEBBLE_RPC_JSON,       // thrift json编码协议
     kPEBBLE_RPC_PROTOBUF,   // protobuf编码协议
+    kPEBBLE_RPC_COMPACT,    // thrift compact编码协议
     kPEBBLE_PIPE,           // pipe协议，pipe是接入gconnd的私有协议，上面承载其他rpc编码协议
     kPROTOCOL_TYPE_BUTT
 } ProtocolType;
@@ -148,7 +149,7 @@ public:
     /// @param routine 协程执行入口函数
     /// @return 0 成功
     /// @return <0 失败
-    int32_t MakeCoroutine(const cxx::function<void()>& routine);
+    int32_t MakeCoroutine(const Function<void()>& routine);
 
     /// @brief 返回最近一个消息的详细信息
     /// @return 保证非空
@@ -0,0 +1,125 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#include "common/compress.h"
+
+#ifdef PEBBLE_USE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef PEBBLE_USE_ZSTD
+#include <zstd.h>
+#endif
+
+
+namespace pebble {
+
+// zstd默认压缩级别，跨机房的大消息更看重压缩率，但级别过高CPU开销增长很快
+static const int ZSTD_LEVEL = 3;
+
+bool Compressor::IsSupport(CompressType type) {
+    switch (type) {
+#ifdef PEBBLE_USE_LZ4
+        case kCOMPRESS_LZ4:
+            return true;
+#endif
+#ifdef PEBBLE_USE_ZSTD
+        case kCOMPRESS_ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+uint32_t Compressor::SupportMask() {
+    uint32_t mask = 0;
+    for (int32_t i = kCOMPRESS_NONE + 1; i < kCOMPRESS_BUTT; i++) {
+        if (IsSupport(static_cast<CompressType>(i))) {
+            mask |= (1u << i);
+        }
+    }
+    return mask;
+}
+
+uint32_t Compressor::CompressBound(CompressType type, uint32_t src_len) {
+    switch (type) {
+#ifdef PEBBLE_USE_LZ4
+        case kCOMPRESS_LZ4:
+            return static_cast<uint32_t>(LZ4_compressBound(static_cast<int>(src_len)));
+#endif
+#ifdef PEBBLE_USE_ZSTD
+        case kCOMPRESS_ZSTD:
+            return static_cast<uint32_t>(ZSTD_compressBound(src_len));
+#endif
+        default:
+            return 0;
+    }
+}
+
+int32_t Compressor::Compress(CompressType type, const uint8_t* src, uint32_t src_len,
+    uint8_t* dst, uint32_t dst_len) {
+    switch (type) {
+#ifdef PEBBLE_USE_LZ4
+        case kCOMPRESS_LZ4:
+            return LZ4_compress_default(reinterpret_cast<const char*>(src),
+                reinterpret_cast<char*>(dst), static_cast<int>(src_len), static_cast<int>(dst_len));
+#endif
+#ifdef PEBBLE_USE_ZSTD
+        case kCOMPRESS_ZSTD: {
+            // 每个线程复用一个压缩上下文，避免每次分配
+            static __thread ZSTD_CCtx* s_cctx = NULL;
+            if (NULL == s_cctx) {
+                s_cctx = ZSTD_createCCtx();
+                if (NULL == s_cctx) {
+                    return -1;
+                }
+            }
+            size_t ret = ZSTD_compressCCtx(s_cctx, dst, dst_len, src, src_len, ZSTD_LEVEL);
+            return ZSTD_isError(ret) ? -1 : static_cast<int32_t>(ret);
+        }
+#endif
+        default:
+            return -1;
+    }
+}
+
+int32_t Compressor::Decompress(CompressType type, const uint8_t* src, uint32_t src_len,
+    uint8_t* dst, uint32_t raw_len) {
+    switch (type) {
+#ifdef PEBBLE_USE_LZ4
+        case kCOMPRESS_LZ4: {
+            int ret = LZ4_decompress_safe(reinterpret_cast<const char*>(src),
+                reinterpret_cast<char*>(dst), static_cast<int>(src_len), static_cast<int>(raw_len));
+            return ret == static_cast<int>(raw_len) ? 0 : -1;
+        }
+#endif
+#ifdef PEBBLE_USE_ZSTD
+        case kCOMPRESS_ZSTD: {
+            static __thread ZSTD_DCtx* s_dctx = NULL;
+            if (NULL == s_dctx) {
+                s_dctx = ZSTD_createDCtx();
+                if (NULL == s_dctx) {
+                    return -1;
+                }
+            }
+            size_t ret = ZSTD_decompressDCtx(s_dctx, dst, raw_len, src, src_len);
+            return (!ZSTD_isError(ret) && ret == raw_len) ? 0 : -1;
+        }
+#endif
+        default:
+            return -1;
+    }
+}
+
+} // namespace pebble
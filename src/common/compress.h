@@ -0,0 +1,57 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#ifndef _PEBBLE_COMMON_COMPRESS_H_
+#define _PEBBLE_COMMON_COMPRESS_H_
+
+#include <stdint.h>
+
+namespace pebble {
+
+/// @brief 压缩算法类型，取值会写入消息头，不能修改已有的值
+typedef enum {
+    kCOMPRESS_NONE = 0,
+    kCOMPRESS_LZ4  = 1,     // 速度优先
+    kCOMPRESS_ZSTD = 2,     // 压缩率优先
+    kCOMPRESS_BUTT
+} CompressType;
+
+/// @brief lz4/zstd的简单封装，编译时定义PEBBLE_USE_LZ4/PEBBLE_USE_ZSTD并链接对应的库才可用
+class Compressor {
+public:
+    /// @brief 当前编译是否支持该压缩算法
+    static bool IsSupport(CompressType type);
+
+    /// @brief 当前编译支持的压缩算法掩码，第i位表示支持CompressType i
+    static uint32_t SupportMask();
+
+    /// @brief src_len长度的数据压缩后的最大长度
+    /// @return 0 不支持该压缩算法
+    static uint32_t CompressBound(CompressType type, uint32_t src_len);
+
+    /// @return >0 压缩后的长度
+    /// @return <=0 失败
+    static int32_t Compress(CompressType type, const uint8_t* src, uint32_t src_len,
+        uint8_t* dst, uint32_t dst_len);
+
+    /// @param raw_len 原始数据长度，由调用者记录，解压出的长度必须与之相等
+    /// @return 0 成功
+    /// @return <0 失败
+    static int32_t Decompress(CompressType type, const uint8_t* src, uint32_t src_len,
+        uint8_t* dst, uint32_t raw_len);
+};
+
+} // namespace pebble
+
+#endif // _PEBBLE_COMMON_COMPRESS_H_
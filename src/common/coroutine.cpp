@@ -17,7 +17,6 @@
 #include <cstdlib>
 #include <errno.h>
 #include <iostream>
-#include <set>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
@@ -29,6 +28,7 @@
 #include <sys/syscall.h>
 #include "common/coroutine.h"
 #include "common/log.h"
+#include "common/memory.h"
 #include "common/timer.h"
 
 namespace pebble {
@@ -201,23 +201,74 @@ static pid_t GetPid()
     return tid;
 }
 
-struct coroutine *
-_co_new(struct schedule *S, cxx::function<void()>& std_func) {
-    if (NULL == S) {
-        assert(0);
-        return NULL;
-    }
+static const int64_t CO_SLOT_MASK = 0xFFFFFFFF;
+static const uint32_t CO_GENERATION_MASK = 0x7FFFFFFF;
 
+// 从缓存中取一个协程(没有时新建)，分配slot并生成协程ID
+static struct coroutine *
+_co_alloc(struct schedule *S) {
     struct coroutine * co = NULL;
     if (S->co_free_list.empty()) {
         co = new coroutine;
         co->stack = new char[S->stack_size];
     } else {
-        co = S->co_free_list.front();
-        S->co_free_list.pop_front();
+        co = S->co_free_list.back();
+        S->co_free_list.pop_back();
+    }
+
+    uint32_t slot = 0;
+    if (S->co_free_slots.empty()) {
+        slot = S->co_slots.size();
+        S->co_slots.push_back(NULL);
+        S->co_generations.push_back(0);
+    } else {
+        slot = S->co_free_slots.back();
+        S->co_free_slots.pop_back();
+    }
+    S->co_slots[slot] = co;
+    co->id = (static_cast<int64_t>(S->co_generations[slot]) << 32) | slot;
+
+    return co;
+}
 
-        S->co_free_num--;
+// 按ID查找协程，ID的generation与slot当前的不一致时说明协程已结束
+static inline struct coroutine *
+_co_find(struct schedule *S, int64_t id) {
+    if (id < 0) {
+        return NULL;
+    }
+    uint32_t slot = static_cast<uint32_t>(id & CO_SLOT_MASK);
+    if (slot >= S->co_slots.size()) {
+        return NULL;
+    }
+    struct coroutine *co = S->co_slots[slot];
+    if (NULL == co || co->id != id) {
+        return NULL;
     }
+    return co;
+}
+
+// 协程结束，释放slot，协程放回缓存，超出缓存上限的在回到主协程后释放
+static void
+_co_release(struct schedule *S, struct coroutine *co) {
+    uint32_t slot = static_cast<uint32_t>(co->id & CO_SLOT_MASK);
+    S->co_slots[slot] = NULL;
+    S->co_generations[slot] = (S->co_generations[slot] + 1) & CO_GENERATION_MASK;
+    S->co_free_slots.push_back(slot);
+
+    co->status = COROUTINE_DEAD;
+    co->id = INVALID_CO_ID;
+    S->co_free_list.push_back(co);
+}
+
+struct coroutine *
+_co_new(struct schedule *S, cxx::function<void()>& std_func) {
+    if (NULL == S) {
+        assert(0);
+        return NULL;
+    }
+
+    struct coroutine * co = _co_alloc(S);
 
     co->std_func = std_func;
     co->func = NULL;
@@ -235,17 +286,8 @@ _co_new(struct schedule *S, coroutine_func func, void *ud) {
         return NULL;
     }
 
-    struct coroutine * co = NULL;
+    struct coroutine * co = _co_alloc(S);
 
-    if (S->co_free_list.empty()) {
-        co = new coroutine;
-        co->stack = new char[S->stack_size];
-    } else {
-        co = S->co_free_list.front();
-        S->co_free_list.pop_front();
-
-        S->co_free_num--;
-    }
     co->func = func;
     co->ud = ud;
     co->sch = S;
@@ -259,6 +301,14 @@ void _co_delete(struct coroutine *co) {
     delete co;
 }
 
+// 只能在主协程调用，不能释放正在使用的栈
+static void _co_trim_free_list(struct schedule *S) {
+    while (S->co_free_list.size() > S->co_free_max) {
+        _co_delete(S->co_free_list.back());
+        S->co_free_list.pop_back();
+    }
+}
+
 struct schedule *
 coroutine_open(uint32_t stack_size) {
     if (0 == stack_size) {
@@ -276,9 +326,8 @@ coroutine_open(uint32_t stack_size) {
     PLOG_INFO("init pid %ld env %p\n", (long)pid, env);
 
     struct schedule *S = new schedule;
-    S->nco = 0;
     S->running = -1;
-    S->co_free_num = 0;
+    S->co_free_max = MAX_FREE_CO_NUM;
     S->stack_size = stack_size;
 
     env->co_schedule = S;
@@ -305,14 +354,14 @@ void coroutine_close(struct schedule *S) {
     FreeEpoll(env->pEpoll);
 
     // 遍历所有的协程，逐个释放
-    cxx::unordered_map<int64_t, coroutine*>::iterator pos = S->co_hash_map.begin();
-    for (; pos != S->co_hash_map.end(); pos++) {
-        if (pos->second) {
-            _co_delete(pos->second);
+    std::vector<coroutine*>::iterator pos = S->co_slots.begin();
+    for (; pos != S->co_slots.end(); pos++) {
+        if (*pos) {
+            _co_delete(*pos);
         }
     }
 
-    std::list<coroutine*>::iterator p = S->co_free_list.begin();
+    std::vector<coroutine*>::iterator p = S->co_free_list.begin();
     for (; p != S->co_free_list.end(); p++) {
         _co_delete(*p);
     }
@@ -326,14 +375,35 @@ void coroutine_close(struct schedule *S) {
 
     SetCoEnv(pid, NULL);
 }
+int32_t coroutine_prewarm(struct schedule *S, uint32_t num, bool lock) {
+    if (NULL == S) {
+        return kCO_INVALID_PARAM;
+    }
+
+    if (num > S->co_free_max) {
+        S->co_free_max = num;
+    }
+
+    bool lock_failed = false;
+    while (S->co_free_list.size() < num) {
+        struct coroutine *co = new coroutine;
+        co->stack = new char[S->stack_size];
+        if (PrefaultMemory(co->stack, S->stack_size, lock) != 0 && !lock_failed) {
+            lock_failed = true;
+            PLOG_ERROR("mlock coroutine stack failed(%d:%s)", errno, strerror(errno));
+        }
+        S->co_free_list.push_back(co);
+    }
+
+    return S->co_free_list.size();
+}
+
 int64_t coroutine_new(struct schedule *S, cxx::function<void()>& std_func) {
     if (NULL == S) {
         return -1;
     }
     struct coroutine *co = _co_new(S, std_func);
-    int64_t id = S->nco;
-    S->co_hash_map[id] = co;
-    S->nco++;
+    int64_t id = co->id;
 
     PLOG_TRACE("coroutine %ld is created.", id);
     return id;
@@ -344,9 +414,7 @@ int64_t coroutine_new(struct schedule *S, coroutine_func func, void *ud) {
         return -1;
     }
     struct coroutine *co = _co_new(S, func, ud);
-    int64_t id = S->nco;
-    S->co_hash_map[id] = co;
-    S->nco++;
+    int64_t id = co->id;
 
     PLOG_TRACE("coroutine %ld is created.", id);
     return id;
@@ -356,24 +424,14 @@ static void mainfunc(uint32_t low32, uint32_t hi32) {
     uintptr_t ptr = (uintptr_t) low32 | ((uintptr_t) hi32 << 32);
     struct schedule *S = (struct schedule *) ptr;
     int64_t id = S->running;
-    struct coroutine *C = S->co_hash_map[id];
+    struct coroutine *C = _co_find(S, id);
     if (C->func != NULL) {
         C->func(S, C->ud);
     } else {
         C->std_func();
     }
-    S->co_free_list.push_back(C);
-    S->co_free_num++;
-
-    if (S->co_free_num > MAX_FREE_CO_NUM) {
-        coroutine* co = S->co_free_list.front();
-        _co_delete(co);
-
-        S->co_free_list.pop_front();
-        S->co_free_num--;
-    }
 
-    S->co_hash_map.erase(id);
+    _co_release(S, C);
     S->running = -1;
     PLOG_TRACE("coroutine %ld is deleted.", id);
 }
@@ -385,17 +443,11 @@ int32_t coroutine_resume(struct schedule * S, int64_t id, int32_t result) {
     if (S->running != -1) {
         return kCO_CANNOT_RESUME_IN_COROUTINE;
     }
-    cxx::unordered_map<int64_t, coroutine*>::iterator pos = S->co_hash_map.find(id);
-
-    // 如果在协程哈希表中没有找到，或者找到的协程内容为空
-    if (pos == S->co_hash_map.end()) {
-        PLOG_ERROR("coroutine %ld can't find in co_map", id);
-        return kCO_COROUTINE_UNEXIST;
-    }
+    struct coroutine *C = _co_find(S, id);
 
-    struct coroutine *C = pos->second;
+    // 如果没有找到，或者ID已过期(协程已结束，slot被复用)
     if (NULL == C) {
-        PLOG_ERROR("coroutine %ld instance is NULL", id);
+        PLOG_ERROR("coroutine %ld can't find in co_slots", id);
         return kCO_COROUTINE_UNEXIST;
     }
 
@@ -418,6 +470,7 @@ int32_t coroutine_resume(struct schedule * S, int64_t id, int32_t result) {
             (uint32_t)(ptr>>32));  // NOLINT
 
             swapcontext(&S->main, &C->ctx);
+            _co_trim_free_list(S);
 
             break;
         }
@@ -428,6 +481,7 @@ int32_t coroutine_resume(struct schedule * S, int64_t id, int32_t result) {
             S->running = id;
             C->status = COROUTINE_RUNNING;
             swapcontext(&S->main, &C->ctx);
+            _co_trim_free_list(S);
 
             break;
         }
@@ -452,7 +506,7 @@ int32_t coroutine_yield(struct schedule * S) {
     }
 
     assert(id >= 0);
-    struct coroutine * C = S->co_hash_map[id];
+    struct coroutine * C = _co_find(S, id);
 
     if (C->status != COROUTINE_RUNNING) {
         PLOG_ERROR("coroutine %ld status is SUSPEND, can't yield again.", id);
@@ -469,25 +523,19 @@ int32_t coroutine_yield(struct schedule * S) {
 }
 
 int coroutine_status(struct schedule * S, int64_t id) {
-    // assert(id >= 0 && id <= S->nco);
     if (NULL == S) {
         return COROUTINE_DEAD;
     }
 
-    if (id < 0 || id > S->nco) {
-        PLOG_DEBUG("coroutine %ld not exist", id);
-        return COROUTINE_DEAD;
-    }
-
-    cxx::unordered_map<int64_t, coroutine*>::iterator pos = S->co_hash_map.find(id);
+    struct coroutine *C = _co_find(S, id);
 
-    // 如果在协程哈希表中没有找到，或者找到的协程内容为空
-    if (pos == S->co_hash_map.end()) {
+    // 如果没有找到，或者ID已过期(协程已结束，slot被复用)
+    if (NULL == C) {
         PLOG_DEBUG("cann't find coroutine %ld", id);
         return COROUTINE_DEAD;
     }
 
-    return (pos->second)->status;
+    return C->status;
 }
 
 int64_t coroutine_running(struct schedule * S) {
@@ -503,28 +551,29 @@ coroutine* get_curr_coroutine(struct schedule * S) {
         return NULL;
     }
 
-    cxx::unordered_map<int64_t, coroutine*>::iterator pos = S->co_hash_map.find(S->running);
+    struct coroutine *C = _co_find(S, S->running);
 
-    // 如果在协程哈希表中没有找到，或者找到的协程内容为空
-    if (pos == S->co_hash_map.end()) {
-        PLOG_FATAL("coroutine %ld can't find in co_map", S->running);
+    if (NULL == C) {
+        PLOG_FATAL("coroutine %ld can't find in co_slots", S->running);
         return NULL;
     }
 
-    return pos->second;
+    return C;
 }
 
 
-void DoTask(struct schedule*, void *ud) {
+void CoroutineSchedule::DoTask(struct schedule*, void *ud) {
     CoroutineTask* task = static_cast<CoroutineTask*>(ud);
     assert(task != NULL);
     task->Run();
-    delete task;
+    DeleteTask(task);
 }
 
 CoroutineTask::CoroutineTask()
         : id_(-1),
-          schedule_obj_(NULL) {
+          schedule_obj_(NULL),
+          pre_start_index_(-1),
+          recycler_(NULL) {
     // DO NOTHING
 }
 
@@ -535,25 +584,31 @@ CoroutineTask::~CoroutineTask() {
     // 如果schedule_obj_没进入Close()流程
     if (schedule_obj_->schedule_ != NULL) {
         if (id_ == -1) {
-            schedule_obj_->pre_start_task_.erase(this);
+            schedule_obj_->RemovePreStartTask(this);
         } else {
             // 防止schedule_在清理时重复delete自己
-            schedule_obj_->task_map_.erase(id_);
+            schedule_obj_->RemoveTask(this);
         }
     }
 }
 
 int64_t CoroutineTask::Start(bool is_immediately) {
     if (is_immediately && schedule_obj_->CurrentTaskId() != INVALID_CO_ID) {
-        delete this;
+        CoroutineSchedule::DeleteTask(this);
         return -1;
     }
-    id_ = coroutine_new(schedule_obj_->schedule_, DoTask, this);
-    if (id_ < 0)
-        id_ = -1;
-    int64_t id = id_;
-    schedule_obj_->task_map_[id_] = this;
-    schedule_obj_->pre_start_task_.erase(this);
+    int64_t id = coroutine_new(schedule_obj_->schedule_, CoroutineSchedule::DoTask, this);
+    if (id < 0) {
+        return -1;
+    }
+    schedule_obj_->RemovePreStartTask(this);
+    id_ = id;
+    uint32_t slot = static_cast<uint32_t>(id_ & CO_SLOT_MASK);
+    if (slot >= schedule_obj_->tasks_.size()) {
+        schedule_obj_->tasks_.resize(slot + 1, NULL);
+    }
+    schedule_obj_->tasks_[slot] = this;
+    schedule_obj_->task_num_++;
     if (is_immediately) {
         int32_t ret = coroutine_resume(schedule_obj_->schedule_, id_);
         if (ret != 0) {
@@ -566,8 +621,9 @@ int64_t CoroutineTask::Start(bool is_immediately) {
 CoroutineSchedule::CoroutineSchedule()
         : schedule_(NULL),
           timer_(NULL),
-          task_map_(),
-          pre_start_task_() {
+          tasks_(),
+          task_num_(0),
+          pre_start_tasks_() {
     // DO NOTHING
 }
 
@@ -593,55 +649,107 @@ int CoroutineSchedule::Close() {
 
     timer_ = NULL;
 
-    ret += pre_start_task_.size();
-    std::set<CoroutineTask*>::iterator pre_it;
-    for (pre_it = pre_start_task_.begin(); pre_it != pre_start_task_.end();
+    ret += pre_start_tasks_.size();
+    std::vector<CoroutineTask*>::iterator pre_it;
+    for (pre_it = pre_start_tasks_.begin(); pre_it != pre_start_tasks_.end();
             ++pre_it) {
         delete *pre_it;
     }
+    pre_start_tasks_.clear();
 
-    ret += task_map_.size();
-    cxx::unordered_map<int64_t, CoroutineTask*>::iterator it;
-    for (it = task_map_.begin(); it != task_map_.end();) {
-        delete it->second;
-
-        // 为了安全的删除迭代器指向的对象，所以先++后调用
-        task_map_.erase(it++);
+    ret += task_num_;
+    std::vector<CoroutineTask*>::iterator it;
+    for (it = tasks_.begin(); it != tasks_.end(); ++it) {
+        if (*it != NULL) {
+            delete *it;
+        }
     }
+    tasks_.clear();
+    task_num_ = 0;
 
     return ret;
 }
 
 int CoroutineSchedule::Size() const {
     int ret = 0;
-    ret += task_map_.size();
-    ret += pre_start_task_.size();
+    ret += task_num_;
+    ret += pre_start_tasks_.size();
     return ret;
 }
 
+int CoroutineSchedule::IdleSize() const {
+    if (NULL == schedule_) {
+        return 0;
+    }
+    return schedule_->co_free_list.size();
+}
+
+int32_t CoroutineSchedule::Prewarm(uint32_t num, bool lock) {
+    return coroutine_prewarm(schedule_, num, lock);
+}
+
 CoroutineTask* CoroutineSchedule::CurrentTask() const {
     int64_t id = coroutine_running(schedule_);
     return Find(id);
 }
 
 CoroutineTask* CoroutineSchedule::Find(int64_t id) const {
-    CoroutineTask* ret = NULL;
-    cxx::unordered_map<int64_t, CoroutineTask*>::const_iterator it = task_map_.find(id);
-    if (it != task_map_.end())
-        ret = it->second;
-    return ret;
+    if (id < 0) {
+        return NULL;
+    }
+    uint32_t slot = static_cast<uint32_t>(id & CO_SLOT_MASK);
+    if (slot >= tasks_.size()) {
+        return NULL;
+    }
+    CoroutineTask* task = tasks_[slot];
+    if (task != NULL && task->id_ == id) {
+        return task;
+    }
+    return NULL;
 }
 
 int64_t CoroutineSchedule::CurrentTaskId() const {
     return coroutine_running(schedule_);
 }
 
-int CoroutineSchedule::AddTaskToSchedule(CoroutineTask* task) {
+int CoroutineSchedule::AddTaskToSchedule(CoroutineTask* task, CoroutineTaskRecycler recycler) {
     task->schedule_obj_ = this;
-    pre_start_task_.insert(task);
+    task->recycler_ = recycler;
+    task->pre_start_index_ = pre_start_tasks_.size();
+    pre_start_tasks_.push_back(task);
     return 0;
 }
 
+void CoroutineSchedule::RemovePreStartTask(CoroutineTask* task) {
+    int32_t index = task->pre_start_index_;
+    if (index < 0 || index >= static_cast<int32_t>(pre_start_tasks_.size())
+        || pre_start_tasks_[index] != task) {
+        return;
+    }
+    // 与最后一个交换后删除
+    CoroutineTask* last = pre_start_tasks_.back();
+    pre_start_tasks_[index] = last;
+    last->pre_start_index_ = index;
+    pre_start_tasks_.pop_back();
+    task->pre_start_index_ = -1;
+}
+
+void CoroutineSchedule::RemoveTask(CoroutineTask* task) {
+    uint32_t slot = static_cast<uint32_t>(task->id_ & CO_SLOT_MASK);
+    if (slot < tasks_.size() && tasks_[slot] == task) {
+        tasks_[slot] = NULL;
+        task_num_--;
+    }
+}
+
+void CoroutineSchedule::DeleteTask(CoroutineTask* task) {
+    if (task->recycler_ != NULL) {
+        task->recycler_(task);
+    } else {
+        delete task;
+    }
+}
+
 int32_t CoroutineSchedule::Yield(int32_t timeout_ms) {
     int64_t timerid = -1;
     int64_t co_id   = INVALID_CO_ID;
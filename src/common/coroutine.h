@@ -15,13 +15,15 @@
 #ifndef _PEBBLE_COMMON_COROUTINE_H_
 #define _PEBBLE_COMMON_COROUTINE_H_
 
-#include <list>
-#include <set>
+#include <new>
+#include <pthread.h>
 #include <string.h>
 #include <sys/poll.h>
 #include <ucontext.h>
+#include <vector>
 
 #include "common/error.h"
+#include "common/function.h"
 #include "common/platform.h"
 
 
@@ -75,8 +77,10 @@ struct coroutine {
     bool enable_hook;
     char* stack;                // 协程栈的内容
     int32_t result;             // 携带resume结果
+    int64_t id;                 // 协程ID
 
     coroutine() {
+        id = INVALID_CO_ID;
         func = NULL;
         ud = NULL;
         sch = NULL;
@@ -89,13 +93,16 @@ struct coroutine {
 };
 
 /// @brief struct schedule 协程调度器的数据结构
+/// @note 协程ID低32位为slot下标，高位为该slot的generation，slot复用时generation加1，
+///     已结束协程的ID不会误指向复用slot的新协程
 struct schedule {
     ucontext_t main;
-    int64_t nco;                // 下一个要创建的协程ID
     int64_t running;            // 当前正在运行的协程ID
-    cxx::unordered_map<int64_t, coroutine*> co_hash_map;
-    std::list<coroutine*> co_free_list;
-    int32_t co_free_num;
+    std::vector<coroutine*> co_slots;       // 按slot下标索引的协程，空闲slot为NULL
+    std::vector<uint32_t> co_generations;   // 各slot当前的generation
+    std::vector<uint32_t> co_free_slots;    // 空闲的slot下标
+    std::vector<coroutine*> co_free_list;   // 已结束可复用的协程(含栈)，后进先出复用最近用过的栈
+    uint32_t co_free_max;                   // 缓存的协程数上限，默认MAX_FREE_CO_NUM，预热时按预热数调大
     uint32_t stack_size;
 };
 
@@ -151,6 +158,14 @@ int64_t coroutine_running(struct schedule *);
 /// @note 只能够在协程内调用
 int32_t coroutine_yield(struct schedule *);
 
+/// @brief 预先创建协程放入缓存，并写入协程栈的每一页，避免启动后首批请求的缺页中断
+/// @param[in] 协程调度器结构体指针
+/// @param[in] num 缓存中至少要有的协程数
+/// @param[in] lock 是否mlock锁定协程栈
+/// @return 缓存中的协程数
+/// @note 只能够在主线程调用
+int32_t coroutine_prewarm(struct schedule *, uint32_t num, bool lock);
+
 coroutine* get_curr_coroutine(struct schedule *);
 struct stCoEpoll_t;
 
@@ -164,8 +179,12 @@ bool co_is_enable_sys_hook();
 void co_log_err(const char *fmt, ...);
 
 class CoroutineSchedule;
+class CoroutineTask;
 class Timer;
 
+/// @brief 任务对象的回收函数，NewTask创建的任务在协程结束后由它释放
+typedef void (*CoroutineTaskRecycler)(CoroutineTask* task);
+
 /// @brief 类:CoroutineTask, 协程任务类
 ///
 /// 与协程调度类CoroutineSchedule是友员\n
@@ -207,8 +226,76 @@ public:
 private:
     int64_t id_;
     CoroutineSchedule* schedule_obj_;
+    int32_t pre_start_index_;           // 在未启动任务表中的下标
+    CoroutineTaskRecycler recycler_;    // 为NULL时直接delete
+};
+
+/// @brief 按任务类型缓存已释放任务对象的内存，NewTask时复用，避免每个协程任务都分配内存
+/// @note 每个线程独立，线程退出时释放；内存由::operator new分配，对NewTask得到的任务直接delete也是安全的
+template<typename TASK>
+class CoroutineTaskPool {
+public:
+    static TASK* Alloc() {
+        std::vector<void*>* free_list = FreeList();
+        void* mem = NULL;
+        if (free_list->empty()) {
+            mem = ::operator new(sizeof(TASK));
+        } else {
+            mem = free_list->back();
+            free_list->pop_back();
+        }
+        return new (mem) TASK();
+    }
+
+    static void Recycle(CoroutineTask* task) {
+        TASK* obj = static_cast<TASK*>(task);
+        obj->~TASK();
+        std::vector<void*>* free_list = FreeList();
+        if (free_list->size() < MAX_FREE_CO_NUM) {
+            free_list->push_back(obj);
+        } else {
+            ::operator delete(obj);
+        }
+    }
+
+private:
+    static std::vector<void*>* FreeList() {
+        if (NULL == s_free_list) {
+            static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+            pthread_once(&s_once, CreateKey);
+            s_free_list = new std::vector<void*>();
+            // 线程退出时由key的析构函数释放缓存的内存
+            pthread_setspecific(Key(), s_free_list);
+        }
+        return s_free_list;
+    }
+
+    static pthread_key_t& Key() {
+        static pthread_key_t s_key;
+        return s_key;
+    }
+
+    static void CreateKey() {
+        pthread_key_create(&Key(), OnThreadExit);
+    }
+
+    static void OnThreadExit(void* arg) {
+        std::vector<void*>* free_list = static_cast<std::vector<void*>*>(arg);
+        for (std::vector<void*>::iterator it = free_list->begin(); it != free_list->end(); ++it) {
+            ::operator delete(*it);
+        }
+        delete free_list;
+        // 之后的线程私有数据析构中仍可能回收任务，届时重新创建并再次登记
+        s_free_list = NULL;
+    }
+
+private:
+    static __thread std::vector<void*>* s_free_list;
 };
 
+template<typename TASK>
+__thread std::vector<void*>* CoroutineTaskPool<TASK>::s_free_list = NULL;
+
 /// @brief 基于function的通用的协程任务实现
 class CommonCoroutineTask : public CoroutineTask {
 public:
@@ -216,14 +303,19 @@ public:
 
     virtual ~CommonCoroutineTask() {}
 
-    void Init(const cxx::function<void(void)>& run) { m_run = run; }
+    void Init(const Function<void(void)>& run) { m_run = run; }
+
+#if __cplusplus >= 201103L
+    /// @brief 传入临时对象(如cxx::bind的结果)时直接转移，不再复制一次
+    void Init(Function<void(void)>&& run) { m_run = std::move(run); }
+#endif
 
     virtual void Run() {
         m_run();
     }
 
 private:
-    cxx::function<void(void)> m_run;
+    Function<void(void)> m_run;
 };
 
 /// @brief 类:CoroutineSchedule 协程调度类
@@ -255,6 +347,13 @@ public:
     /// @return 当前的协程数量
     int Size() const;
 
+    /// @brief 返回已缓存可复用的协程数量(含栈)
+    int IdleSize() const;
+
+    /// @brief 预热，预先创建num个协程并写入协程栈，@see coroutine_prewarm
+    /// @return 缓存中的协程数
+    int32_t Prewarm(uint32_t num, bool lock = false);
+
     /// @brief 获取当前正在运行的协程任务
     /// @return 正在运行的协程任务对象的指针
     /// @note 此函数必须在协程中调用
@@ -283,29 +382,41 @@ public:
     int Status(int64_t id);
 
     /// @brief 模版方法, 新建一个协程任务
-    /// @note 使用此种方法生成的task对象指针会在协程结束后自动delete掉
+    /// @note 使用此种方法生成的task对象指针会在协程结束后自动释放，对象内存按类型缓存复用
     template<typename TASK>
     TASK* NewTask() {
         if (CurrentTaskId() != INVALID_CO_ID) {
             return NULL;
         }
-        TASK* task = new TASK();
-        if (AddTaskToSchedule(task)) {
-            delete task;
+        TASK* task = CoroutineTaskPool<TASK>::Alloc();
+        if (AddTaskToSchedule(task, CoroutineTaskPool<TASK>::Recycle)) {
+            CoroutineTaskPool<TASK>::Recycle(task);
             task = NULL;
         }
         return task;
     }
 
 private:
-    int AddTaskToSchedule(CoroutineTask* task);
+    int AddTaskToSchedule(CoroutineTask* task, CoroutineTaskRecycler recycler);
     CoroutineTask* Find(int64_t id) const;
     int32_t OnTimeout(int64_t id);
 
+    void RemovePreStartTask(CoroutineTask* task);
+    void RemoveTask(CoroutineTask* task);
+
+    /// @brief 释放任务对象，NewTask创建的回收到对应类型的缓存
+    static void DeleteTask(CoroutineTask* task);
+
+    /// @brief 协程执行体，执行任务的Run，结束后释放任务
+    static void DoTask(struct schedule*, void *ud);
+
     struct schedule* schedule_;
     Timer* timer_;
-    cxx::unordered_map<int64_t, CoroutineTask*> task_map_;
-    std::set<CoroutineTask*> pre_start_task_;
+    // 已启动的任务，按协程ID的slot下标索引
+    std::vector<CoroutineTask*> tasks_;
+    int32_t task_num_;
+    // NewTask后还未Start的任务
+    std::vector<CoroutineTask*> pre_start_tasks_;
 };
 
 } // namespace pebble
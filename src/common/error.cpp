@@ -12,31 +12,36 @@
  */
 
 #include "common/error.h"
+#include "common/mutex.h"
 
 
 namespace pebble {
 
 // 避免全局变量构造、析构顺序问题
-static cxx::unordered_map<int32_t, const char*> * g_error_string_map = NULL;
+struct ErrorInfo;
+static ErrorInfo* g_error_info = NULL;
 struct ErrorInfo {
     ErrorInfo() {
-        g_error_string_map = &_error_info;
+        g_error_info = this;
     }
     ~ErrorInfo() {
-        g_error_string_map = NULL;
+        g_error_info = NULL;
     }
     cxx::unordered_map<int32_t, const char*> _error_info;
+    // 多worker线程可能同时查询和注册错误描述
+    ReadWriteLock _lock;
 };
 
 const char* GetErrorString(int32_t error_code) {
     if (0 == error_code) return "no error";
 
-    if (!g_error_string_map) {
+    if (!g_error_info) {
         return "error module not inited.";
     }
 
-    cxx::unordered_map<int32_t, const char*>::iterator it = g_error_string_map->find(error_code);
-    if (it != g_error_string_map->end()) {
+    ReadAutoLocker lock(&g_error_info->_lock);
+    cxx::unordered_map<int32_t, const char*>::iterator it = g_error_info->_error_info.find(error_code);
+    if (it != g_error_info->_error_info.end()) {
         return it->second;
     }
 
@@ -45,7 +50,8 @@ const char* GetErrorString(int32_t error_code) {
 
 void SetErrorString(int32_t error_code, const char* error_string) {
     static ErrorInfo s_error_info;
-    (*g_error_string_map)[error_code] = error_string;
+    WriteAutoLocker lock(&s_error_info._lock);
+    s_error_info._error_info[error_code] = error_string;
 }
 
 } // namespace pebble
@@ -0,0 +1,343 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#ifndef _PEBBLE_COMMON_FUNCTION_H_
+#define _PEBBLE_COMMON_FUNCTION_H_
+
+#include <new>
+#if __cplusplus >= 201103L
+#include <utility>
+#endif
+#include "common/platform.h"
+
+
+namespace pebble {
+
+/// @brief Function默认的内联存储大小，加上管理函数和调用函数指针，整个Function为64字节
+static const uint32_t FUNCTION_INLINE_SIZE = 48;
+
+template <typename Signature, uint32_t kInlineSize = FUNCTION_INLINE_SIZE>
+class Function;
+
+/// @brief Function的存储部分，与调用签名无关
+/// @note 可调用对象不超过kInlineSize字节(且对齐满足)时直接存放在对象内，不在堆上分配，
+///     默认大小下常见的cxx::bind(&Class::Method, this, 占位符..., 1~3个整数/指针)和同样大小的lambda都在此范围内
+template <uint32_t kInlineSize>
+class FunctionBase {
+protected:
+    typedef void (FunctionBase::*SafeBool)() const;
+
+public:
+    /// @brief 判空，支持if (f)、!f的写法，空Function不能调用
+    operator SafeBool() const { return m_manager ? &FunctionBase::SafeBoolTrue : NULL; }
+
+protected:
+    typedef enum {
+        kFUNCTION_CLONE = 0,    // 复制到dst
+        kFUNCTION_MOVE,         // 移动到dst，src不再持有
+        kFUNCTION_DESTROY,      // 析构src
+    } FunctionOperation;
+
+    union Storage {
+        void*       _heap;
+        int64_t     _align_int;
+        long double _align_float;
+        void        (*_align_func)();
+        uint8_t     _inline[kInlineSize];
+    };
+
+    typedef void (*Manager)(int32_t op, Storage* dst, Storage* src);
+    typedef void (*GenericInvoker)();
+
+    template <typename F>
+    struct IsInline {
+        static const bool value = sizeof(F) <= kInlineSize
+            && __alignof__(Storage) % __alignof__(F) == 0;
+    };
+
+    /// @brief 内联存放的可调用对象
+    template <typename F, bool kInline = IsInline<F>::value>
+    struct Handler {
+        static F* Get(const Storage& storage) {
+            return reinterpret_cast<F*>(const_cast<uint8_t*>(storage._inline));
+        }
+
+        static void Create(Storage* storage, const F& f) {
+            new (storage->_inline) F(f);
+        }
+
+        static void Manage(int32_t op, Storage* dst, Storage* src) {
+            switch (op) {
+                case kFUNCTION_CLONE:
+                    new (dst->_inline) F(*Get(*src));
+                    break;
+                case kFUNCTION_MOVE:
+#if __cplusplus >= 201103L
+                    new (dst->_inline) F(std::move(*Get(*src)));
+#else
+                    new (dst->_inline) F(*Get(*src));
+#endif
+                    Get(*src)->~F();
+                    break;
+                default:
+                    Get(*src)->~F();
+                    break;
+            }
+        }
+    };
+
+    /// @brief 超过内联大小的可调用对象放在堆上，移动时只转移指针
+    template <typename F>
+    struct Handler<F, false> {
+        static F* Get(const Storage& storage) {
+            return static_cast<F*>(storage._heap);
+        }
+
+        static void Create(Storage* storage, const F& f) {
+            storage->_heap = new F(f);
+        }
+
+        static void Manage(int32_t op, Storage* dst, Storage* src) {
+            switch (op) {
+                case kFUNCTION_CLONE:
+                    dst->_heap = new F(*Get(*src));
+                    break;
+                case kFUNCTION_MOVE:
+                    dst->_heap = src->_heap;
+                    src->_heap = NULL;
+                    break;
+                default:
+                    delete Get(*src);
+                    break;
+            }
+        }
+    };
+
+    FunctionBase() : m_manager(NULL), m_invoker(NULL) {}
+
+    FunctionBase(const FunctionBase& rhs) : m_manager(NULL), m_invoker(NULL) {
+        if (rhs.m_manager) {
+            rhs.m_manager(kFUNCTION_CLONE, &m_storage, const_cast<Storage*>(&rhs.m_storage));
+            m_manager = rhs.m_manager;
+            m_invoker = rhs.m_invoker;
+        }
+    }
+
+    /// @note 直接在原处复制，rhs不能是当前持有对象的一部分
+    FunctionBase& operator=(const FunctionBase& rhs) {
+        if (this != &rhs) {
+            Reset();
+            if (rhs.m_manager) {
+                rhs.m_manager(kFUNCTION_CLONE, &m_storage, const_cast<Storage*>(&rhs.m_storage));
+                m_manager = rhs.m_manager;
+                m_invoker = rhs.m_invoker;
+            }
+        }
+        return *this;
+    }
+
+#if __cplusplus >= 201103L
+    FunctionBase(FunctionBase&& rhs) : m_manager(NULL), m_invoker(NULL) {
+        MoveFrom(&rhs);
+    }
+
+    FunctionBase& operator=(FunctionBase&& rhs) {
+        if (this != &rhs) {
+            Reset();
+            MoveFrom(&rhs);
+        }
+        return *this;
+    }
+#endif
+
+    ~FunctionBase() {
+        Reset();
+    }
+
+    template <typename F, typename Invoker>
+    void Assign(const F& f, Invoker invoker) {
+        if (IsNull(f)) {
+            return;
+        }
+        Handler<F>::Create(&m_storage, f);
+        m_manager = &Handler<F>::Manage;
+        m_invoker = reinterpret_cast<GenericInvoker>(invoker);
+    }
+
+    void MoveFrom(FunctionBase* rhs) {
+        if (rhs->m_manager) {
+            rhs->m_manager(kFUNCTION_MOVE, &m_storage, &rhs->m_storage);
+            m_manager = rhs->m_manager;
+            m_invoker = rhs->m_invoker;
+            rhs->m_manager = NULL;
+            rhs->m_invoker = NULL;
+        }
+    }
+
+    void Reset() {
+        if (m_manager) {
+            m_manager(kFUNCTION_DESTROY, NULL, &m_storage);
+            m_manager = NULL;
+            m_invoker = NULL;
+        }
+    }
+
+    void SafeBoolTrue() const {}
+
+    /// @brief 空函数指针、空cxx::function和空Function(内联大小不同时)构造出空Function，和cxx::function的行为一致
+    template <typename F>
+    static bool IsNull(const F&) { return false; }
+
+    template <typename T>
+    static bool IsNull(T* f) { return NULL == f; }
+
+    template <typename Signature>
+    static bool IsNull(const cxx::function<Signature>& f) { return !f; }
+
+    template <typename Signature, uint32_t kSize>
+    static bool IsNull(const Function<Signature, kSize>& f) { return !f; }
+
+    Storage         m_storage;
+    Manager         m_manager;
+    GenericInvoker  m_invoker;
+};
+
+// 以下辅助宏按参数个数N(0~5)展开模板参数、参数类型、形参和实参列表，生成Function<R(A1, ..., AN)>的特化
+#define PEBBLE_FUNCTION_COMMA_0
+#define PEBBLE_FUNCTION_COMMA_1 ,
+#define PEBBLE_FUNCTION_COMMA_2 ,
+#define PEBBLE_FUNCTION_COMMA_3 ,
+#define PEBBLE_FUNCTION_COMMA_4 ,
+#define PEBBLE_FUNCTION_COMMA_5 ,
+
+#define PEBBLE_FUNCTION_TYPENAMES_0
+#define PEBBLE_FUNCTION_TYPENAMES_1 typename A1
+#define PEBBLE_FUNCTION_TYPENAMES_2 PEBBLE_FUNCTION_TYPENAMES_1, typename A2
+#define PEBBLE_FUNCTION_TYPENAMES_3 PEBBLE_FUNCTION_TYPENAMES_2, typename A3
+#define PEBBLE_FUNCTION_TYPENAMES_4 PEBBLE_FUNCTION_TYPENAMES_3, typename A4
+#define PEBBLE_FUNCTION_TYPENAMES_5 PEBBLE_FUNCTION_TYPENAMES_4, typename A5
+
+#define PEBBLE_FUNCTION_TYPES_0
+#define PEBBLE_FUNCTION_TYPES_1 A1
+#define PEBBLE_FUNCTION_TYPES_2 PEBBLE_FUNCTION_TYPES_1, A2
+#define PEBBLE_FUNCTION_TYPES_3 PEBBLE_FUNCTION_TYPES_2, A3
+#define PEBBLE_FUNCTION_TYPES_4 PEBBLE_FUNCTION_TYPES_3, A4
+#define PEBBLE_FUNCTION_TYPES_5 PEBBLE_FUNCTION_TYPES_4, A5
+
+#define PEBBLE_FUNCTION_PARAMS_0
+#define PEBBLE_FUNCTION_PARAMS_1 A1 a1
+#define PEBBLE_FUNCTION_PARAMS_2 PEBBLE_FUNCTION_PARAMS_1, A2 a2
+#define PEBBLE_FUNCTION_PARAMS_3 PEBBLE_FUNCTION_PARAMS_2, A3 a3
+#define PEBBLE_FUNCTION_PARAMS_4 PEBBLE_FUNCTION_PARAMS_3, A4 a4
+#define PEBBLE_FUNCTION_PARAMS_5 PEBBLE_FUNCTION_PARAMS_4, A5 a5
+
+#define PEBBLE_FUNCTION_ARGS_0
+#define PEBBLE_FUNCTION_ARGS_1 a1
+#define PEBBLE_FUNCTION_ARGS_2 PEBBLE_FUNCTION_ARGS_1, a2
+#define PEBBLE_FUNCTION_ARGS_3 PEBBLE_FUNCTION_ARGS_2, a3
+#define PEBBLE_FUNCTION_ARGS_4 PEBBLE_FUNCTION_ARGS_3, a4
+#define PEBBLE_FUNCTION_ARGS_5 PEBBLE_FUNCTION_ARGS_4, a5
+
+#define PEBBLE_FUNCTION_SPECIALIZATION(N) \
+template <typename R PEBBLE_FUNCTION_COMMA_##N PEBBLE_FUNCTION_TYPENAMES_##N, \
+    uint32_t kInlineSize> \
+class Function<R(PEBBLE_FUNCTION_TYPES_##N), kInlineSize> : public FunctionBase<kInlineSize> { \
+    typedef FunctionBase<kInlineSize> Base; \
+    typedef typename Base::Storage Storage; \
+    typedef R (*Invoker)(const Storage& PEBBLE_FUNCTION_COMMA_##N PEBBLE_FUNCTION_TYPES_##N); \
+ \
+    template <typename F> \
+    static R Invoke(const Storage& storage PEBBLE_FUNCTION_COMMA_##N PEBBLE_FUNCTION_PARAMS_##N) { \
+        F* f = Base::template Handler<F>::Get(storage); \
+        return static_cast<R>((*f)(PEBBLE_FUNCTION_ARGS_##N)); \
+    } \
+ \
+public: \
+    typedef R result_type; \
+ \
+    Function() {} \
+ \
+    template <typename F> \
+    Function(const F& f) { this->Assign(f, &Invoke<F>); } \
+ \
+    Function(R (*f)(PEBBLE_FUNCTION_TYPES_##N)) { \
+        this->Assign(f, &Invoke<R (*)(PEBBLE_FUNCTION_TYPES_##N)>); \
+    } \
+ \
+    template <typename F> \
+    Function& operator=(const F& f) { \
+        this->Reset(); \
+        this->Assign(f, &Invoke<F>); \
+        return *this; \
+    } \
+ \
+    Function& operator=(R (*f)(PEBBLE_FUNCTION_TYPES_##N)) { \
+        this->Reset(); \
+        this->Assign(f, &Invoke<R (*)(PEBBLE_FUNCTION_TYPES_##N)>); \
+        return *this; \
+    } \
+ \
+    R operator()(PEBBLE_FUNCTION_PARAMS_##N) const { \
+        return reinterpret_cast<Invoker>(this->m_invoker)( \
+            this->m_storage PEBBLE_FUNCTION_COMMA_##N PEBBLE_FUNCTION_ARGS_##N); \
+    } \
+}
+
+/// @brief 小对象优化的可调用对象，用法和cxx::function相同，用于RPC回调、定时器回调等每个请求都会构造的回调
+/// @note 与cxx::function(tr1实现只内联16字节)相比，常见的bind结果不在堆上分配，调用只有一次间接调用
+/// @note 可以和cxx::function互相转换(会多一层包装)，热路径上应直接使用Function
+/// @note 需要保存另一个Function的回调(如绑定了OnRpcResponse的服务端应答)可以通过kInlineSize加大内联存储
+/// @note 直接传入或赋值函数名时按函数指针保存；调用空Function的行为未定义，调用前需检查
+PEBBLE_FUNCTION_SPECIALIZATION(0);
+PEBBLE_FUNCTION_SPECIALIZATION(1);
+PEBBLE_FUNCTION_SPECIALIZATION(2);
+PEBBLE_FUNCTION_SPECIALIZATION(3);
+PEBBLE_FUNCTION_SPECIALIZATION(4);
+PEBBLE_FUNCTION_SPECIALIZATION(5);
+
+#undef PEBBLE_FUNCTION_SPECIALIZATION
+#undef PEBBLE_FUNCTION_COMMA_0
+#undef PEBBLE_FUNCTION_COMMA_1
+#undef PEBBLE_FUNCTION_COMMA_2
+#undef PEBBLE_FUNCTION_COMMA_3
+#undef PEBBLE_FUNCTION_COMMA_4
+#undef PEBBLE_FUNCTION_COMMA_5
+#undef PEBBLE_FUNCTION_TYPENAMES_0
+#undef PEBBLE_FUNCTION_TYPENAMES_1
+#undef PEBBLE_FUNCTION_TYPENAMES_2
+#undef PEBBLE_FUNCTION_TYPENAMES_3
+#undef PEBBLE_FUNCTION_TYPENAMES_4
+#undef PEBBLE_FUNCTION_TYPENAMES_5
+#undef PEBBLE_FUNCTION_TYPES_0
+#undef PEBBLE_FUNCTION_TYPES_1
+#undef PEBBLE_FUNCTION_TYPES_2
+#undef PEBBLE_FUNCTION_TYPES_3
+#undef PEBBLE_FUNCTION_TYPES_4
+#undef PEBBLE_FUNCTION_TYPES_5
+#undef PEBBLE_FUNCTION_PARAMS_0
+#undef PEBBLE_FUNCTION_PARAMS_1
+#undef PEBBLE_FUNCTION_PARAMS_2
+#undef PEBBLE_FUNCTION_PARAMS_3
+#undef PEBBLE_FUNCTION_PARAMS_4
+#undef PEBBLE_FUNCTION_PARAMS_5
+#undef PEBBLE_FUNCTION_ARGS_0
+#undef PEBBLE_FUNCTION_ARGS_1
+#undef PEBBLE_FUNCTION_ARGS_2
+#undef PEBBLE_FUNCTION_ARGS_3
+#undef PEBBLE_FUNCTION_ARGS_4
+#undef PEBBLE_FUNCTION_ARGS_5
+
+} // namespace pebble
+
+#endif // _PEBBLE_COMMON_FUNCTION_H_
@@ -140,6 +140,9 @@ void InstallSignalHandler()
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // log实现部分:
 
+__thread bool    Log::m_isset_time   = false;
+__thread int64_t Log::m_current_time = 0;
+
 Log::Log() {
     m_device_type  = DEV_FILE;
     m_log_priority = LOG_PRIORITY_INFO;
@@ -148,9 +151,6 @@ Log::Log() {
     m_log_array[kLOG_LOG]   = new RollUtil("./log", self_name + ".log");
     m_log_array[kLOG_ERROR] = new RollUtil("./log", self_name + ".error");
     m_log_array[kLOG_STAT]  = new RollUtil("./log", self_name + ".stat");
-
-    m_isset_time    = false;
-    m_current_time  = TimeUtility::GetCurrentUS();
 }
 
 Log::Log(const Log& rhs) {
@@ -160,9 +160,6 @@ Log::Log(const Log& rhs) {
     for (int i = 0; i < kLOG_BUTT; i++) {
         m_log_array[i] = NULL;
     }
-
-    m_isset_time    = false;
-    m_current_time  = 0;
 }
 
 Log::~Log() {
@@ -180,7 +177,7 @@ void Log::Write(LOG_PRIORITY pri, const char* file, uint32_t line,
         return;
     }
 
-    static char buff[4096] = {0};
+    static __thread char buff[4096] = {0};
 
     // log前缀，接入其他log时不用组装
     int pre_len = 0;
@@ -227,6 +224,8 @@ void Log::Write(LOG_PRIORITY pri, const char* file, uint32_t line,
         return;
     }
 
+    AutoLocker lock(&m_write_mutex);
+
     // 输出到ERROR文件
     if (pri >= LOG_PRIORITY_ERROR && m_log_array[kLOG_ERROR] != NULL) {
         FILE* error = m_log_array[kLOG_ERROR]->GetFile();
@@ -250,6 +249,8 @@ void Log::Write(const char* data)
         return;
     }
 
+    AutoLocker lock(&m_write_mutex);
+
     FILE* stat = m_log_array[kLOG_STAT]->GetFile();
     if (stat != NULL) {
         char buff[64] = {0};
@@ -261,6 +262,7 @@ void Log::Write(const char* data)
 
 void Log::Close()
 {
+    AutoLocker lock(&m_write_mutex);
     for (int i = 0; i < kLOG_BUTT; i++) {
         if (m_log_array[i]) {
             m_log_array[i]->Close();
@@ -280,6 +282,7 @@ void Log::EnableCrashRecord()
 
 void Log::Flush()
 {
+    AutoLocker lock(&m_write_mutex);
     for (int i = 0; i < kLOG_BUTT; i++) {
         if (m_log_array[i]) {
             m_log_array[i]->Flush();
@@ -376,7 +379,7 @@ int64_t Log::GetCurrentTime() {
     if (m_isset_time) {
         return m_current_time;
     }
-    return TimeUtility::GetCurrentUS();
+    return TimeUtility::GetMonotonicUS();
 }
 
 } // namespace pebble
@@ -15,6 +15,7 @@
 #ifndef _PEBBLE_COMMON_LOG_H_
 #define _PEBBLE_COMMON_LOG_H_
 
+#include "common/mutex.h"
 #include "common/platform.h"
 
 namespace pebble {
@@ -116,7 +117,8 @@ public:
     void Flush();
 
 public:
-    /// @brief 设置当前时间，应该在上层框架主循环中不断的调用，以及时刷新时间
+    /// @brief 设置当前线程的当前时间，应该在上层框架主循环中不断的调用，以及时刷新时间
+    /// @note 时间按线程保存，多worker时各worker线程设置自己的时间
     void SetCurrentTime(int64_t timestamp);
 
     /// @brief 返回当前时间戳
@@ -139,8 +141,11 @@ private:
     RollUtil*       m_log_array[kLOG_BUTT];
     LogWriteFunc    m_log_write_func;
 
-    bool            m_isset_time;
-    int64_t         m_current_time;
+    // 按线程缓存的当前时间，避免多worker线程同时读写
+    static __thread bool    m_isset_time;
+    static __thread int64_t m_current_time;
+
+    Mutex           m_write_mutex; // 多worker线程写同一组log文件时互斥
 };
 
 } // namespace pebble
@@ -179,7 +184,7 @@ private:
 #define PLOG_N_EVERY_SECOND(num, pri, fmt, args...) \
     do { \
         if (pri >= pebble::Log::Instance().GetPriority()) { \
-            static int32_t LOG_CNT_VAR = 0; static int64_t START_TIME_VAR = 0; \
+            static __thread int32_t LOG_CNT_VAR = 0; static __thread int64_t START_TIME_VAR = 0; \
             if (START_TIME_VAR == 0) { START_TIME_VAR = pebble::Log::Instance().GetCurrentTime(); } \
             int64_t NOW_TIME_VAR = pebble::Log::Instance().GetCurrentTime(); \
             if (START_TIME_VAR + 1000000 < NOW_TIME_VAR) { \
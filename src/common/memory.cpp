@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -57,4 +58,22 @@ int GetCurMemoryUsage(int* vm_size_kb, int* rss_size_kb) {
     return ret;
 }
 
+int PrefaultMemory(void* addr, size_t len, bool lock) {
+    if (NULL == addr || 0 == len) {
+        return 0;
+    }
+
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    volatile char* p = static_cast<volatile char*>(addr);
+    for (size_t offset = 0; offset < len; offset += page_size) {
+        p[offset] = 0;
+    }
+    p[len - 1] = 0;
+
+    if (lock && mlock(addr, len) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
 } // namespace pebble
@@ -15,6 +15,7 @@
 #ifndef _PEBBLE_COMMON_MEMORY_H_
 #define _PEBBLE_COMMON_MEMORY_H_
 
+#include <stddef.h>
 
 namespace pebble {
 
@@ -23,6 +24,14 @@ namespace pebble {
 /// @param rss_size_kb 输出参数，物理内存，单位为K
 int GetCurMemoryUsage(int* vm_size_kb, int* rss_size_kb);
 
+/// @brief 预先写入内存的每一页，使其提前分配物理页，避免首次使用时的缺页中断
+/// @param addr 内存起始地址，内容会被改写，只用于新分配的内存
+/// @param len 内存长度
+/// @param lock 是否mlock锁定在物理内存中，不被换出
+/// @return 0 成功
+/// @return -1 锁定失败(如超过RLIMIT_MEMLOCK)，原因见errno，内存已写入只是未锁定
+int PrefaultMemory(void* addr, size_t len, bool lock);
+
 } // namespace pebble
 
 #endif // _PEBBLE_COMMON_MEMORY_H_
\ No newline at end of file
@@ -14,6 +14,7 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,15 +24,28 @@
 #include <net/if.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <sys/ioctl.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
 
 #include "common/error.h"
+#include "common/time_utility.h"
 #include "net_util.h"
 
+// 低版本glibc头文件中可能未定义SO_REUSEPORT(内核3.9+支持)
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT 15
+#endif
+
+// 低版本glibc头文件中可能未定义UDP_SEGMENT(内核4.18+支持)
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
 namespace pebble {
 
 
@@ -119,7 +133,7 @@ static int32_t net_log_level = NET_LOG_DEBUG_LEVEL;
             log_tm.tm_min, log_tm.tm_sec, log_now.tv_usec, __FILE__, __LINE__, ##__VA_ARGS__);\
     } while (false)
 #else
-    // ⲻlogļ
+    // 基础库不输出log到文件
     #define DBG(fmt, ...)
     #define INFO(fmt, ...)
     #define ERR(fmt, ...) LOG_MESSAGE((m_last_error), (sizeof(m_last_error)), fmt, ##__VA_ARGS__)
@@ -142,6 +156,64 @@ void UINToNetAddress(uint64_t net_uin, std::string* ip, uint16_t* port)
     *port = ntohs(static_cast<uint16_t>(net_uin & 0xFFFF));
 }
 
+static inline int32_t SocketFamily(uint8_t state)
+{
+    return (state & UNIX_DOMAIN) ? AF_UNIX : ((state & IPV6_ADDR) ? AF_INET6 : AF_INET);
+}
+
+int32_t IpToSockAddr(const std::string& ip, uint16_t port, struct sockaddr_in6* addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    struct sockaddr_in* in_addr = reinterpret_cast<struct sockaddr_in*>(addr);
+    if (std::string::npos == ip.find(':'))
+    {
+        in_addr->sin_family = AF_INET;
+        in_addr->sin_port = htons(port);
+        return (1 == inet_pton(AF_INET, ip.c_str(), &in_addr->sin_addr)) ? 0 : -1;
+    }
+
+    std::string host(ip);
+    if (!host.empty() && '[' == host[0])
+    {
+        if (']' != host[host.size() - 1])
+        {
+            return -1;
+        }
+        host = host.substr(1, host.size() - 2);
+    }
+    // 链路本地地址需要指定网卡，"fe80::1%eth0"或"fe80::1%2"
+    uint32_t scope_id = 0;
+    size_t scope_pos = host.find('%');
+    if (std::string::npos != scope_pos)
+    {
+        std::string scope(host, scope_pos + 1);
+        scope_id = if_nametoindex(scope.c_str());
+        if (0 == scope_id)
+        {
+            scope_id = static_cast<uint32_t>(strtoul(scope.c_str(), NULL, 10));
+        }
+        host.erase(scope_pos);
+    }
+
+    struct in6_addr in6;
+    if (1 != inet_pton(AF_INET6, host.c_str(), &in6))
+    {
+        return -1;
+    }
+    if (IN6_IS_ADDR_V4MAPPED(&in6))
+    {
+        in_addr->sin_family = AF_INET;
+        in_addr->sin_port = htons(port);
+        memcpy(&in_addr->sin_addr, in6.s6_addr + 12, 4);
+        return 0;
+    }
+    addr->sin6_family = AF_INET6;
+    addr->sin6_port = htons(port);
+    addr->sin6_addr = in6;
+    addr->sin6_scope_id = scope_id;
+    return 0;
+}
+
 void SetLogOut(FILE* log_fp)
 {
     net_log_fp = log_fp;
@@ -244,6 +316,7 @@ int32_t Epoll::GetEvent(uint32_t *events, uint64_t *data)
 
 bool NetIO::NON_BLOCK = true;
 bool NetIO::ADDR_REUSE = true;
+bool NetIO::REUSE_PORT = false;
 bool NetIO::KEEP_ALIVE = true;
 bool NetIO::USE_NAGLE = false;
 bool NetIO::USE_LINGER = false;
@@ -251,15 +324,126 @@ int32_t NetIO::LINGER_TIME = 0;
 int32_t NetIO::LISTEN_BACKLOG = 10240;
 uint32_t NetIO::MAX_SOCKET_NUM = 1000000;
 uint8_t NetIO::AUTO_RECONNECT = 3;
+bool NetIO::USE_UDP_GSO = true;
+bool NetIO::IPV6_ONLY = false;
+
+// 热重启时从旧进程继承的监听socket，每个线程一份，多worker时各worker只取自己接管的socket
+// 只在登记时创建，取完或关闭后释放，没有热重启的线程不分配
+static __thread std::vector<int32_t>* s_inherited_fds = NULL;
+
+static void ReleaseInheritedFds()
+{
+    delete s_inherited_fds;
+    s_inherited_fds = NULL;
+}
+
+// 比较两个socket地址，getsockname返回的unix域路径地址长度可能不同，按路径比较
+static bool IsSameSockAddr(const struct sockaddr* lhs, socklen_t lhs_len,
+    const struct sockaddr* rhs, socklen_t rhs_len)
+{
+    if (lhs->sa_family != rhs->sa_family)
+    {
+        return false;
+    }
+    if (AF_UNIX == lhs->sa_family)
+    {
+        const struct sockaddr_un* lhs_un = reinterpret_cast<const struct sockaddr_un*>(lhs);
+        const struct sockaddr_un* rhs_un = reinterpret_cast<const struct sockaddr_un*>(rhs);
+        if ('\0' != lhs_un->sun_path[0] || '\0' != rhs_un->sun_path[0])
+        {
+            return 0 == strncmp(lhs_un->sun_path, rhs_un->sun_path, sizeof(lhs_un->sun_path));
+        }
+        // 抽象命名空间的名字可以含'\0'，按长度比较
+        return lhs_len == rhs_len && 0 == memcmp(lhs_un->sun_path, rhs_un->sun_path,
+            lhs_len - offsetof(struct sockaddr_un, sun_path));
+    }
+    if (AF_INET6 == lhs->sa_family)
+    {
+        const struct sockaddr_in6* lhs_in6 = reinterpret_cast<const struct sockaddr_in6*>(lhs);
+        const struct sockaddr_in6* rhs_in6 = reinterpret_cast<const struct sockaddr_in6*>(rhs);
+        return lhs_in6->sin6_port == rhs_in6->sin6_port
+            && 0 == memcmp(&lhs_in6->sin6_addr, &rhs_in6->sin6_addr, sizeof(lhs_in6->sin6_addr));
+    }
+    const struct sockaddr_in* lhs_in = reinterpret_cast<const struct sockaddr_in*>(lhs);
+    const struct sockaddr_in* rhs_in = reinterpret_cast<const struct sockaddr_in*>(rhs);
+    return lhs_in->sin_port == rhs_in->sin_port && lhs_in->sin_addr.s_addr == rhs_in->sin_addr.s_addr;
+}
+
+void NetIO::AddInheritedFd(int32_t fd)
+{
+    if (NULL == s_inherited_fds)
+    {
+        s_inherited_fds = new std::vector<int32_t>();
+    }
+    s_inherited_fds->push_back(fd);
+}
+
+int32_t NetIO::TakeInheritedFd(const struct sockaddr* addr, socklen_t addr_len, int32_t type)
+{
+    if (NULL == s_inherited_fds)
+    {
+        return -1;
+    }
+    std::vector<int32_t>& fds = *s_inherited_fds;
+    for (std::vector<int32_t>::iterator it = fds.begin(); it != fds.end(); ++it)
+    {
+        struct sockaddr_storage local_addr;
+        socklen_t local_len = sizeof(local_addr);
+        int32_t sock_type = 0;
+        socklen_t type_len = sizeof(sock_type);
+        if (0 != getsockname(*it, reinterpret_cast<struct sockaddr*>(&local_addr), &local_len)
+            || 0 != getsockopt(*it, SOL_SOCKET, SO_TYPE, &sock_type, &type_len)
+            || sock_type != type
+            || !IsSameSockAddr(reinterpret_cast<struct sockaddr*>(&local_addr), local_len, addr, addr_len))
+        {
+            continue;
+        }
+        int32_t fd = *it;
+        fds.erase(it);
+        if (fds.empty())
+        {
+            ReleaseInheritedFds();
+        }
+        return fd;
+    }
+    return -1;
+}
+
+uint32_t NetIO::CloseInheritedFds()
+{
+    if (NULL == s_inherited_fds)
+    {
+        return 0;
+    }
+    uint32_t num = static_cast<uint32_t>(s_inherited_fds->size());
+    for (std::vector<int32_t>::iterator it = s_inherited_fds->begin(); it != s_inherited_fds->end(); ++it)
+    {
+        close(*it);
+    }
+    ReleaseInheritedFds();
+    return num;
+}
 
 NetIO::NetIO()
-    :   m_epoll(NULL), m_used_id(0), m_sockets(NULL)
+    :   m_epoll(NULL), m_edge_trigger(false), m_used_id(0), m_udp_gso_state(kGSO_UNKNOWN),
+        m_socket_pages(NULL), m_socket_page_num(0),
+        m_free_head(UINT32_MAX), m_free_tail(UINT32_MAX), m_ipv6_pages(NULL), m_ipv6_peer_seq(0)
 {
 }
 
 NetIO::~NetIO()
 {
     CloseAll();
+    for (uint32_t i = 0 ; i < m_socket_page_num ; ++i)
+    {
+        delete [] m_socket_pages[i];
+        if (NULL != m_ipv6_pages)
+        {
+            delete [] m_ipv6_pages[i];
+        }
+    }
+    delete [] m_socket_pages;
+    delete [] m_ipv6_pages;
 }
 
 int32_t NetIO::Init(Epoll* epoll)
@@ -270,17 +454,24 @@ int32_t NetIO::Init(Epoll* epoll)
     {
         m_epoll->m_bind_net_io = this;
     }
-    m_sockets = new SocketInfo[MAX_SOCKET_NUM];
-    memset(m_sockets, 0, MAX_SOCKET_NUM * sizeof(SocketInfo));
+    // socket表按页分配，只预先分配页表，用到时才分配页，避免启动时占用大量内存
+    if (NULL == m_socket_pages)
+    {
+        m_socket_page_num = (MAX_SOCKET_NUM + SOCKET_PAGE_SIZE - 1) / SOCKET_PAGE_SIZE;
+        m_socket_pages = new SocketInfo*[m_socket_page_num];
+        memset(m_socket_pages, 0, m_socket_page_num * sizeof(SocketInfo*));
+        m_ipv6_pages = new struct sockaddr_in6*[m_socket_page_num];
+        memset(m_ipv6_pages, 0, m_socket_page_num * sizeof(struct sockaddr_in6*));
+    }
 
-    // max_socket_num޸ϵͳãǷɹ
+    // 根据max_socket_num尝试修改系统设置，不管是否成功
     struct rlimit limit_val;
     int32_t ret = getrlimit(RLIMIT_NOFILE, &limit_val);
     if (0 == ret
         && limit_val.rlim_cur < MAX_SOCKET_NUM
         && limit_val.rlim_cur < limit_val.rlim_max)
     {
-        limit_val.rlim_cur = MAX_SOCKET_NUM + 1024; // 1024ʹ
+        limit_val.rlim_cur = MAX_SOCKET_NUM + 1024; // 保留1024供其它使用
         limit_val.rlim_cur = ((limit_val.rlim_cur > limit_val.rlim_max)
                               ? limit_val.rlim_max : limit_val.rlim_cur);
         ret = setrlimit(RLIMIT_NOFILE, &limit_val);
@@ -303,8 +494,8 @@ NetAddr NetIO::Listen(const std::string& ip, uint16_t port)
 
     do
     {
-        SocketInfo *socket_info = &m_sockets[static_cast<uint32_t>(net_addr)];
-        if (0 != InitSocketInfo(ip, port, socket_info))
+        SocketInfo *socket_info = &SocketAt(static_cast<uint32_t>(net_addr));
+        if (0 != InitSocketInfo(net_addr, ip, port, socket_info))
         {
             ERR("invalid address[%s:%u]", ip.c_str(), port);
             break;
@@ -323,6 +514,13 @@ NetAddr NetIO::Listen(const std::string& ip, uint16_t port)
 }
 
 NetAddr NetIO::Accept(NetAddr listen_addr)
+{
+    NetAddr net_addr = INVAILD_NETADDR;
+    AcceptBatch(listen_addr, &net_addr, 1);
+    return net_addr;
+}
+
+uint32_t NetIO::AcceptBatch(NetAddr listen_addr, NetAddr* accepted, uint32_t num)
 {
     SocketInfo* socket_info = RawGetSocketInfo(listen_addr);
     if (NULL == socket_info
@@ -330,66 +528,82 @@ NetAddr NetIO::Accept(NetAddr listen_addr)
         || 0 == (socket_info->_state & TCP_PROTOCOL))
     {
         ERR("accept an addr[%lu] not be listened", listen_addr);
-        return INVAILD_NETADDR;
+        return 0;
     }
-    // fdرˣ´򿪼
+    // 如果监听的fd关闭了，尝试重新打开监听
     if (socket_info->_socket_fd < 0)
     {
         RawListen(listen_addr, socket_info);
         if (socket_info->_socket_fd < 0)
         {
             ERR("addr[%lu] redo listen failed", listen_addr);
-            return INVAILD_NETADDR;
+            return 0;
         }
     }
 
-    struct sockaddr_in cli_addr;
-    socklen_t addr_len = sizeof(cli_addr);
-    int32_t new_socket = accept(socket_info->_socket_fd,
-        reinterpret_cast<struct sockaddr*>(&cli_addr), &addr_len);
-    if (new_socket < 0)
+    // accept4直接设置O_NONBLOCK，省去每个连接两次fcntl
+    int32_t flags = SOCK_CLOEXEC | (NetIO::NON_BLOCK ? SOCK_NONBLOCK : 0);
+    uint32_t count = 0;
+    while (count < num)
     {
-        if (errno == EBADF || errno == ENOTSOCK)
+        struct sockaddr_storage cli_addr;
+        socklen_t addr_len = sizeof(cli_addr);
+        int32_t new_socket = accept4(socket_info->_socket_fd,
+            reinterpret_cast<struct sockaddr*>(&cli_addr), &addr_len, flags);
+        if (new_socket < 0)
         {
-            ERR("unexpect errno[%d] when accept addr[%lu], close socket[%d]",
-                errno, listen_addr, socket_info->_socket_fd);
-            RawClose(socket_info);
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno == EBADF || errno == ENOTSOCK)
+            {
+                ERR("unexpect errno[%d] when accept addr[%lu], close socket[%d]",
+                    errno, listen_addr, socket_info->_socket_fd);
+                RawClose(socket_info);
+            }
+            if (0 == count)
+            {
+                INFO("accept none from addr[%lu]", listen_addr);
+            }
+            break;
         }
-        INFO("accept none from addr[%lu]", listen_addr);
-        return INVAILD_NETADDR;
-    }
-    // O_NONBLOCKacceptʱ̳У
-    if (true == NetIO::NON_BLOCK)
-    {
-        int32_t flags_val = fcntl(new_socket, F_GETFL);
-        if (-1 != flags_val)
+
+        NetAddr net_addr = AllocNetAddr();
+        if (INVAILD_NETADDR == net_addr)
         {
-            if (fcntl(new_socket, F_SETFL, flags_val | O_NONBLOCK) == -1) {
-                ERR("fcntl socket failed in %d", errno);
-                close(new_socket);
-                return INVAILD_NETADDR;
-            }
+            ERR("open net addr max then %u", MAX_SOCKET_NUM);
+            close(new_socket);
+            break;
+        }
+        SocketInfo *new_socket_info = &SocketAt(static_cast<uint32_t>(net_addr));
+        new_socket_info->_socket_fd = new_socket;
+        new_socket_info->_addr_info = static_cast<uint32_t>(listen_addr);
+        if (AF_INET == cli_addr.ss_family)
+        {
+            const struct sockaddr_in* in_addr = reinterpret_cast<struct sockaddr_in*>(&cli_addr);
+            new_socket_info->_ip = in_addr->sin_addr.s_addr;
+            new_socket_info->_port = in_addr->sin_port;
         }
+        else if (AF_INET6 == cli_addr.ss_family)
+        {
+            SetSocketAddr(net_addr, new_socket_info, reinterpret_cast<struct sockaddr_in6*>(&cli_addr));
+        }
+        new_socket_info->_state |= (TCP_PROTOCOL | ACCEPT_ADDR | (socket_info->_state & UNIX_DOMAIN));
+        accepted[count++] = net_addr;
     }
 
-    NetAddr net_addr = AllocNetAddr();
-    if (INVAILD_NETADDR == net_addr)
-    {
-        ERR("open net addr max then %u", MAX_SOCKET_NUM);
-        close(new_socket);
-        return INVAILD_NETADDR;
-    }
-    SocketInfo *new_socket_info = &m_sockets[static_cast<uint32_t>(net_addr)];
-    new_socket_info->_socket_fd = new_socket;
-    new_socket_info->_addr_info = static_cast<uint32_t>(listen_addr);
-    new_socket_info->_ip = cli_addr.sin_addr.s_addr;
-    new_socket_info->_port = cli_addr.sin_port;
-    new_socket_info->_state |= (TCP_PROTOCOL | ACCEPT_ADDR);
+    // 积压的连接全部取出后再统一注册到epoll
     if (NULL != m_epoll)
     {
-        m_epoll->AddFd(new_socket, EPOLLIN | EPOLLERR, net_addr);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            SocketInfo& new_socket_info = SocketAt(static_cast<uint32_t>(accepted[i]));
+            m_epoll->AddFd(new_socket_info._socket_fd,
+                EpollEvents(&new_socket_info, EPOLLIN | EPOLLERR), accepted[i]);
+        }
     }
-    return net_addr;
+    return count;
 }
 
 NetAddr NetIO::ConnectPeer(const std::string& ip, uint16_t port)
@@ -403,8 +617,8 @@ NetAddr NetIO::ConnectPeer(const std::string& ip, uint16_t port)
 
     do
     {
-        SocketInfo *socket_info = &m_sockets[static_cast<uint32_t>(net_addr)];
-        if (0 != InitSocketInfo(ip, port, socket_info))
+        SocketInfo *socket_info = &SocketAt(static_cast<uint32_t>(net_addr));
+        if (0 != InitSocketInfo(net_addr, ip, port, socket_info))
         {
             ERR("invalid address[%s:%u]", ip.c_str(), port);
             break;
@@ -431,7 +645,7 @@ int32_t NetIO::Send(NetAddr dst_addr, const char* data, uint32_t data_len)
         ERR("send an invalid addr[%lu]", dst_addr);
         return -1;
     }
-    // fdرˣ
+    // 如果fd关闭了，尝试重新
     if (socket_info->_socket_fd < 0)
     {
         if (socket_info->_state & CONNECT_ADDR)
@@ -440,7 +654,7 @@ int32_t NetIO::Send(NetAddr dst_addr, const char* data, uint32_t data_len)
         }
         if (socket_info->_socket_fd < 0)
         {
-            // Բ͵socketѾرյ
+            // 绝对不会出现其它待发送的socket类型已经关闭的情况
             ERR("cannot connect addr[%lu] for send", dst_addr);
             return -1;
         }
@@ -448,34 +662,34 @@ int32_t NetIO::Send(NetAddr dst_addr, const char* data, uint32_t data_len)
 
     int32_t send_ret = 0;
     uint32_t send_cnt = 0;
-    // Ծܵķ
+    // 尝试尽可能的发送数据
     while (send_cnt < data_len)
     {
         send_ret = send(socket_info->_socket_fd, data + send_cnt, data_len - send_cnt, 0);
-        // ӿʱܻᴥEINTRҪ
-        // ӿһᴥEINTRʧʱ
+        // 如果阻塞接口时可能会触发EINTR，需要重试
+        // 非阻塞接口一定不会触发EINTR，失败时不会重试
         if ((send_ret < 0 && errno != EINTR) || send_ret == 0)
         {
             break;
         }
         send_cnt += send_ret;
     }
-    if (send_cnt == data_len) // ȫͳɹ
+    if (send_cnt == data_len) // 完全发送成功
     {
         return static_cast<int32_t>(send_cnt);
     }
-    if (send_ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) // ʧܣⲿر
+    if (send_ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) // 发送失败，由外部关闭连接
     {
         ERR("send failed in %d, need close the socket[%d]", errno, socket_info->_socket_fd);
         RawClose(socket_info);
         return -1;
     }
-    // ʵʷڴûдsocketҪEPOLLOUT¼
+    // 实际发送数据少于待发送数据且没有错误，socket进入阻塞，需要添加EPOLLOUT事件
     if (m_epoll != NULL)
     {
         socket_info->_state |= IN_BLOCKED;
         m_epoll->ModFd(socket_info->_socket_fd,
-            EPOLLIN | EPOLLOUT | EPOLLERR, dst_addr);
+            EpollEvents(socket_info, EPOLLIN | EPOLLOUT | EPOLLERR), dst_addr);
     }
     return static_cast<int32_t>(send_cnt);
 }
@@ -490,7 +704,7 @@ int32_t NetIO::SendV(NetAddr dst_addr, uint32_t data_num,
         ERR("send an invalid addr[%lu]", dst_addr);
         return -1;
     }
-    // fdرˣ
+    // 如果fd关闭了，尝试重新
     if (socket_info->_socket_fd < 0)
     {
         if (socket_info->_state & CONNECT_ADDR)
@@ -499,7 +713,7 @@ int32_t NetIO::SendV(NetAddr dst_addr, uint32_t data_num,
         }
         if (socket_info->_socket_fd < 0)
         {
-            // Բ͵socketѾرյ
+            // 绝对不会出现其它待发送的socket类型已经关闭的情况
             ERR("cannot connect addr[%lu] for send", dst_addr);
             return -1;
         }
@@ -525,13 +739,13 @@ int32_t NetIO::SendV(NetAddr dst_addr, uint32_t data_num,
     }
     if (offset >= need_send_cnt)
     {
-        return 0; // ͵ƫƴ͵ݣֱӷ0
+        return 0; // 发送的偏移大于整个待发送的数据，直接返回0
     }
     need_send_cnt -= offset;
-    // Ծܵķ
+    // 尝试尽可能的发送数据
     while (send_cnt < need_send_cnt)
     {
-        // ѷ͵Ĳ
+        // 跳过已发送的部分
         while (send_ret > 0)
         {
             if (msg.msg_iov->iov_len <= static_cast<uint32_t>(send_ret))
@@ -548,29 +762,29 @@ int32_t NetIO::SendV(NetAddr dst_addr, uint32_t data_num,
             }
         }
         send_ret = sendmsg(socket_info->_socket_fd, &msg, 0);
-        // EINTRҪ
+        // EINTR，需要重试
         if ((send_ret < 0 && errno != EINTR) || send_ret == 0)
         {
             break;
         }
         send_cnt += send_ret;
     }
-    if (send_cnt == need_send_cnt) // ȫͳɹ
+    if (send_cnt == need_send_cnt) // 完全发送成功
     {
         return static_cast<int32_t>(send_cnt);
     }
-    if (send_ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) // ʧܣر
+    if (send_ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) // 发送失败，关闭连接
     {
         ERR("send failed in %d, close the socket[%d]", errno, socket_info->_socket_fd);
         RawClose(socket_info);
         return -1;
     }
-    // ʵʷڴûдsocketҪEPOLLOUT¼
+    // 实际发送数据少于待发送数据且没有错误，socket进入阻塞，需要添加EPOLLOUT事件
     if (m_epoll != NULL)
     {
         socket_info->_state |= IN_BLOCKED;
         m_epoll->ModFd(socket_info->_socket_fd,
-            EPOLLIN | EPOLLOUT | EPOLLERR, dst_addr);
+            EpollEvents(socket_info, EPOLLIN | EPOLLOUT | EPOLLERR), dst_addr);
     }
     return static_cast<int32_t>(send_cnt);
 }
@@ -585,7 +799,7 @@ int32_t NetIO::SendTo(NetAddr local_addr, NetAddr remote_addr, const char* data,
         ERR("sendto an invalid local_addr[%lu]", local_addr);
         return -1;
     }
-    // fdرˣ´
+    // 如果fd关闭了，尝试重新打开
     if (socket_info->_socket_fd < 0)
     {
         RawListen(local_addr, socket_info);
@@ -596,38 +810,40 @@ int32_t NetIO::SendTo(NetAddr local_addr, NetAddr remote_addr, const char* data,
         }
     }
 
-    struct sockaddr_in rmt_sock_addr;
-    socklen_t addr_len = sizeof(rmt_sock_addr);
-    rmt_sock_addr.sin_family = AF_INET;
-    rmt_sock_addr.sin_addr.s_addr = static_cast<uint32_t>(remote_addr >> 32);
-    rmt_sock_addr.sin_port = static_cast<uint16_t>(remote_addr & 0xFFFF);
+    struct sockaddr_in6 rmt_sock_addr;
+    socklen_t addr_len = MakeRemoteSockAddr(socket_info, remote_addr, &rmt_sock_addr);
+    if (0 == addr_len)
+    {
+        ERR("sendto an expired ipv6 remote_addr[0x%lx]", remote_addr);
+        return -1;
+    }
 
     int32_t send_ret = 0;
     uint32_t send_cnt = 0;
-    // Ծܵķ
+    // 尝试尽可能的发送数据
     while (send_cnt < data_len)
     {
         send_ret = sendto(socket_info->_socket_fd, data + send_cnt, data_len - send_cnt, 0,
                           reinterpret_cast<struct sockaddr*>(&rmt_sock_addr), addr_len);
-        // ӿʱܻᴥEINTRҪ
-        // ӿһᴥEINTRʧʱ
+        // 如果阻塞接口时可能会触发EINTR，需要重试
+        // 非阻塞接口一定不会触发EINTR，失败时不会重试
         if ((send_ret < 0 && errno != EINTR) || send_ret == 0)
         {
             break;
         }
         send_cnt += send_ret;
     }
-    if (send_cnt == data_len) // ȫͳɹ
+    if (send_cnt == data_len) // 完全发送成功
     {
         return static_cast<int32_t>(send_cnt);
     }
-    if (send_ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) // ʧܣر
+    if (send_ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) // 发送失败，关闭连接
     {
         ERR("sendto failed in %d, close the socket[%d]", errno, socket_info->_socket_fd);
         RawClose(socket_info);
         return -1;
     }
-    // ʵʷڴûдsocketҪEPOLLOUT¼
+    // 实际发送数据少于待发送数据且没有错误，socket进入阻塞，需要添加EPOLLOUT事件
     if (m_epoll != NULL)
     {
         socket_info->_state |= IN_BLOCKED;
@@ -646,22 +862,22 @@ int32_t NetIO::Recv(NetAddr dst_addr, char* buff, uint32_t buff_len)
         ERR("recv an invalid addr[%lu]", dst_addr);
         return -1;
     }
-    // fdѾرˣ0
+    // 如果fd已经关闭了，返回0
     if (socket_info->_socket_fd < 0)
     {
         return 0;
     }
 
     int32_t recv_ret = 0;
-    // ԾܵĶȡ
+    // 尝试尽可能的读取数据
     do
     {
         recv_ret = recv(socket_info->_socket_fd, buff, buff_len, 0);
-        // ӿʱܻᴥEINTRҪ
-        // ӿһᴥEINTRʧʱ
+        // 如果阻塞接口时可能会触发EINTR，需要重试
+        // 非阻塞接口一定不会触发EINTR，失败时不会重试
     } while (recv_ret < 0 && errno == EINTR);
 
-    // ȡfinʱر
+    // 读取到fin或错误时，关闭连接
     if (recv_ret == 0 || (recv_ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
     {
         RawClose(socket_info);
@@ -684,7 +900,7 @@ int32_t NetIO::RecvFrom(NetAddr local_addr, NetAddr* remote_addr, char* buff, ui
         ERR("recvfrom an invalid addr[%lu]", local_addr);
         return -1;
     }
-    // fdرˣ´
+    // 如果fd关闭了，尝试重新打开
     if (socket_info->_socket_fd < 0)
     {
         RawListen(local_addr, socket_info);
@@ -695,42 +911,283 @@ int32_t NetIO::RecvFrom(NetAddr local_addr, NetAddr* remote_addr, char* buff, ui
         }
     }
 
-    struct sockaddr_in rmt_sock_addr;
+    struct sockaddr_in6 rmt_sock_addr;
     socklen_t addr_len = sizeof(rmt_sock_addr);
     int32_t recv_ret = 0;
-    // ԾܵĶȡ
+    // 尝试尽可能的读取数据
     do
     {
         recv_ret = recvfrom(socket_info->_socket_fd, buff, buff_len, 0,
                             reinterpret_cast<struct sockaddr*>(&rmt_sock_addr), &addr_len);
-        // ӿʱܻᴥEINTRҪ
-        // ӿһᴥEINTRʧʱ
+        // 如果阻塞接口时可能会触发EINTR，需要重试
+        // 非阻塞接口一定不会触发EINTR，失败时不会重试
     } while (recv_ret < 0 && errno == EINTR);
 
-    // ȡʱر
+    // 读取到错误时，关闭连接
     if (recv_ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
     {
         RawClose(socket_info);
     }
 
-    if (NULL != remote_addr)
+    if (NULL != remote_addr && recv_ret >= 0)
     {
-        *remote_addr = (static_cast<uint64_t>(rmt_sock_addr.sin_addr.s_addr) << 32);
-        *remote_addr |= rmt_sock_addr.sin_port;
+        *remote_addr = ToRemoteAddr(&rmt_sock_addr);
     }
     return recv_ret;
 }
 
+int32_t NetIO::RecvFromBatch(NetAddr local_addr, UdpDatagram* datagrams, uint32_t num)
+{
+    SocketInfo *socket_info = RawGetSocketInfo(local_addr);
+    if (NULL == socket_info
+        || 0 == (UDP_PROTOCOL & socket_info->_state)
+        || 0 == (LISTEN_ADDR & socket_info->_state))
+    {
+        ERR("recvfrom an invalid addr[%lu]", local_addr);
+        return -1;
+    }
+    // 如果fd关闭了，尝试重新打开
+    if (socket_info->_socket_fd < 0)
+    {
+        RawListen(local_addr, socket_info);
+        if (socket_info->_socket_fd < 0)
+        {
+            ERR("cannot bind addr[%lu] for recvfrom", local_addr);
+            return -1;
+        }
+    }
+
+    if (num > MAX_UDP_BATCH_NUM)
+    {
+        num = MAX_UDP_BATCH_NUM;
+    }
+
+    struct mmsghdr msgs[MAX_UDP_BATCH_NUM];
+    struct iovec iovs[MAX_UDP_BATCH_NUM];
+    struct sockaddr_in6 rmt_sock_addrs[MAX_UDP_BATCH_NUM];
+    char ctrls[MAX_UDP_BATCH_NUM][CMSG_SPACE(sizeof(struct timeval))];
+    memset(msgs, 0, sizeof(msgs[0]) * num);
+    for (uint32_t i = 0; i < num; i++)
+    {
+        iovs[i].iov_base = datagrams[i]._buff;
+        iovs[i].iov_len  = datagrams[i]._len;
+        msgs[i].msg_hdr.msg_name       = &rmt_sock_addrs[i];
+        msgs[i].msg_hdr.msg_namelen    = sizeof(rmt_sock_addrs[i]);
+        msgs[i].msg_hdr.msg_iov        = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen     = 1;
+        msgs[i].msg_hdr.msg_control    = ctrls[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(ctrls[i]);
+    }
+
+    int32_t recv_ret = 0;
+    // 阻塞模式下只等待第一个数据报
+    do
+    {
+        recv_ret = recvmmsg(socket_info->_socket_fd, msgs, num, MSG_WAITFORONE, NULL);
+    } while (recv_ret < 0 && errno == EINTR);
+
+    if (recv_ret < 0)
+    {
+        // 读取到错误时，关闭连接
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            RawClose(socket_info);
+            return -1;
+        }
+        return 0;
+    }
+
+    // 内核时间戳是系统时间，按差值换算到单调时钟，与超时计算使用的时钟一致
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    int64_t now_ms = TimeUtility::GetCachedMS();
+    for (int32_t i = 0; i < recv_ret; i++)
+    {
+        datagrams[i]._len = msgs[i].msg_len;
+        datagrams[i]._remote_addr = ToRemoteAddr(&rmt_sock_addrs[i]);
+
+        const struct timeval* tv = &now;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg != NULL;
+            cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg))
+        {
+            if (SOL_SOCKET == cmsg->cmsg_level && SO_TIMESTAMP == cmsg->cmsg_type)
+            {
+                tv = reinterpret_cast<const struct timeval*>(CMSG_DATA(cmsg));
+                break;
+            }
+        }
+        int64_t delay_ms = (static_cast<int64_t>(now.tv_sec) - tv->tv_sec) * 1000
+            + (now.tv_usec - tv->tv_usec) / 1000;
+        datagrams[i]._arrived_ms = now_ms - (delay_ms > 0 ? delay_ms : 0);
+    }
+    return recv_ret;
+}
+
+int32_t NetIO::SendToBatch(NetAddr local_addr, const UdpDatagram* datagrams, uint32_t num)
+{
+    SocketInfo *socket_info = RawGetSocketInfo(local_addr);
+    if (NULL == socket_info
+        || 0 == (UDP_PROTOCOL & socket_info->_state)
+        || 0 == (LISTEN_ADDR & socket_info->_state))
+    {
+        ERR("sendto an invalid local_addr[%lu]", local_addr);
+        return -1;
+    }
+    // 如果fd关闭了，尝试重新打开
+    if (socket_info->_socket_fd < 0)
+    {
+        RawListen(local_addr, socket_info);
+        if (socket_info->_socket_fd < 0)
+        {
+            ERR("cannot bind addr[%lu] for sendto", local_addr);
+            return -1;
+        }
+    }
+
+    // GSO单个包的数据不能超过一个IP包，分段数不能超过64
+    static const uint32_t MAX_GSO_SIZE = 65000;
+    static const uint32_t MAX_GSO_SEGMENTS = 64;
+    // 分段大小不能超过路径MTU，按以太网1500减去IP/UDP头计算，超过时内核拒绝发送(EINVAL)
+    static const uint32_t MAX_GSO_SEG_IPV4 = 1500 - 20 - 8;
+    static const uint32_t MAX_GSO_SEG_IPV6 = 1500 - 40 - 8;
+
+    struct mmsghdr msgs[MAX_UDP_BATCH_NUM];
+    struct iovec iovs[MAX_UDP_BATCH_NUM];
+    struct sockaddr_in6 rmt_sock_addrs[MAX_UDP_BATCH_NUM];
+    char ctrls[MAX_UDP_BATCH_NUM][CMSG_SPACE(sizeof(uint16_t))];
+    uint32_t msg_datagram_num[MAX_UDP_BATCH_NUM];
+    bool msg_segmented[MAX_UDP_BATCH_NUM];
+
+    uint32_t sent_num = 0;
+    while (sent_num < num)
+    {
+        // 组装一批mmsghdr，同一远端的连续数据报在长度满足GSO要求时合并
+        uint32_t msg_num = 0;
+        uint32_t pos = sent_num;
+        uint32_t end = (num - sent_num > MAX_UDP_BATCH_NUM) ? sent_num + MAX_UDP_BATCH_NUM : num;
+        // 远端地址已失效的数据报直接丢弃，计入下一个发送的消息
+        uint32_t dropped = 0;
+        while (pos < end)
+        {
+            const UdpDatagram& first = datagrams[pos];
+            socklen_t addr_len = MakeRemoteSockAddr(socket_info, first._remote_addr,
+                &rmt_sock_addrs[msg_num]);
+            if (0 == addr_len)
+            {
+                ERR("sendto an expired ipv6 remote_addr[0x%lx]", first._remote_addr);
+                ++dropped;
+                ++pos;
+                continue;
+            }
+            uint32_t seg_num = 1;
+            uint32_t total = first._len;
+            uint32_t max_seg = (first._remote_addr & UDP_IPV6_REMOTE) ? MAX_GSO_SEG_IPV6 : MAX_GSO_SEG_IPV4;
+            bool gso = NetIO::USE_UDP_GSO && m_udp_gso_state != kGSO_UNSUPPORTED
+                && first._len > 0 && first._len <= max_seg;
+            while (gso && pos + seg_num < end && seg_num < MAX_GSO_SEGMENTS
+                && datagrams[pos + seg_num - 1]._len == first._len
+                && datagrams[pos + seg_num]._remote_addr == first._remote_addr
+                && datagrams[pos + seg_num]._len <= first._len
+                && total + datagrams[pos + seg_num]._len <= MAX_GSO_SIZE)
+            {
+                total += datagrams[pos + seg_num]._len;
+                ++seg_num;
+            }
+
+            struct msghdr* hdr = &msgs[msg_num].msg_hdr;
+            memset(hdr, 0, sizeof(*hdr));
+            for (uint32_t i = 0; i < seg_num; i++)
+            {
+                iovs[pos - sent_num + i].iov_base = datagrams[pos + i]._buff;
+                iovs[pos - sent_num + i].iov_len  = datagrams[pos + i]._len;
+            }
+            hdr->msg_name    = &rmt_sock_addrs[msg_num];
+            hdr->msg_namelen = addr_len;
+            hdr->msg_iov     = &iovs[pos - sent_num];
+            hdr->msg_iovlen  = seg_num;
+            if (seg_num > 1)
+            {
+                hdr->msg_control    = ctrls[msg_num];
+                hdr->msg_controllen = sizeof(ctrls[msg_num]);
+                struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr);
+                cmsg->cmsg_level = IPPROTO_UDP;
+                cmsg->cmsg_type  = UDP_SEGMENT;
+                cmsg->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+                *reinterpret_cast<uint16_t*>(CMSG_DATA(cmsg)) = static_cast<uint16_t>(first._len);
+            }
+            msg_segmented[msg_num] = seg_num > 1;
+            msg_datagram_num[msg_num] = seg_num + dropped;
+            dropped = 0;
+            ++msg_num;
+            pos += seg_num;
+        }
+        if (0 == msg_num)
+        {
+            sent_num += dropped;
+            continue;
+        }
+        msg_datagram_num[msg_num - 1] += dropped;
+
+        int32_t send_ret = RawSendMMsg(socket_info->_socket_fd, msgs, msg_num);
+        // 出错的是第一个消息，只有它是GSO消息、且本NetIO上GSO还没有成功过时才认为是GSO不支持
+        if (send_ret < 0 && msg_segmented[0] && kGSO_UNKNOWN == m_udp_gso_state
+            && (ENOPROTOOPT == errno || EIO == errno))
+        {
+            ERR("udp gso not support(%d), disable it on this thread", errno);
+            m_udp_gso_state = kGSO_UNSUPPORTED;
+            // sent_num未变，以不合并的方式重发本批
+            continue;
+        }
+        if (send_ret < 0)
+        {
+            // 发送缓冲区满时丢弃剩余数据报，udp不缓存
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                ERR("sendmmsg failed in %d, socket[%d]", errno, socket_info->_socket_fd);
+                return sent_num > 0 ? static_cast<int32_t>(sent_num) : -1;
+            }
+            break;
+        }
+
+        for (int32_t i = 0; i < send_ret; i++)
+        {
+            sent_num += msg_datagram_num[i];
+            if (msg_segmented[i])
+            {
+                m_udp_gso_state = kGSO_VERIFIED;
+            }
+        }
+        if (static_cast<uint32_t>(send_ret) < msg_num)
+        {
+            break;
+        }
+    }
+
+    return static_cast<int32_t>(sent_num);
+}
+
+int32_t NetIO::RawSendMMsg(int32_t fd, struct mmsghdr* msgs, uint32_t num)
+{
+    int32_t send_ret = 0;
+    do
+    {
+        send_ret = sendmmsg(fd, msgs, num, 0);
+        // 如果阻塞接口时可能会触发EINTR，需要重试
+    } while (send_ret < 0 && errno == EINTR);
+    return send_ret;
+}
+
 int32_t NetIO::Close(NetAddr dst_addr)
 {
     SocketInfo* socket_info = RawGetSocketInfo(dst_addr);
     if (NULL == socket_info || 0 == socket_info->_state)
     {
         ERR("close an invalid addr[0x%lx]", dst_addr);
-        return 0; // ˼Ϊɹˣ0
+        return 0; // 不存在了即认为成功了，返回0
     }
 
     int32_t ret = RawClose(socket_info);
+    UnlinkUnixPath(dst_addr, socket_info);
     FreeNetAddr(dst_addr);
     return ret;
 }
@@ -741,15 +1198,15 @@ int32_t NetIO::Reset(NetAddr dst_addr)
     if (NULL == socket_info)
     {
         ERR("close an invalid addr[0x%lx]", dst_addr);
-        return -1; // ˼Ϊɹˣ0
+        return -1; // 不存在了即认为成功了，返回0
     }
 
-    if (socket_info->_state != (CONNECT_ADDR | TCP_PROTOCOL)) {
+    if ((socket_info->_state & ~(UNIX_DOMAIN | IPV6_ADDR)) != (CONNECT_ADDR | TCP_PROTOCOL)) {
         ERR("cannt reset state = 0x%x", socket_info->_state);
         return -2;
     }
 
-    // closeǷɹ
+    // 不管close是否成功，都尝试重连
     RawClose(socket_info);
     return RawConnect(dst_addr, socket_info);
 }
@@ -758,12 +1215,17 @@ void NetIO::CloseAll()
 {
     for (NetAddr idx = 0 ; idx < m_used_id ; ++idx)
     {
-        if (0 != m_sockets[idx]._state)
+        if (0 != SocketAt(idx)._state)
         {
-            RawClose(&m_sockets[idx]);
+            RawClose(&SocketAt(idx));
+            UnlinkUnixPath(idx, &SocketAt(idx));
         }
     }
-    m_free_sockets.clear();
+    m_unix_paths.clear();
+    m_ipv6_peers.clear();
+    m_ipv6_peer_seq = 0;
+    m_free_head = UINT32_MAX;
+    m_free_tail = UINT32_MAX;
     m_used_id = 0;
 }
 
@@ -771,57 +1233,141 @@ const SocketInfo* NetIO::GetSocketInfo(NetAddr dst_addr) const
 {
     static SocketInfo INVALID_SOCKET_INFO = { 0 };
     uint32_t idx = static_cast<uint32_t>(dst_addr);
-    if (idx >= MAX_SOCKET_NUM
-        || m_sockets[idx]._uin != static_cast<uint8_t>(dst_addr >> 32))
+    if (idx >= m_used_id
+        || SocketAt(idx)._uin != static_cast<uint8_t>(dst_addr >> 32))
     {
         return &INVALID_SOCKET_INFO;
     }
-    return &m_sockets[idx];
+    return &SocketAt(idx);
 }
 
 const SocketInfo* NetIO::GetLocalListenSocketInfo(NetAddr dst_addr) const
 {
     static SocketInfo INVALID_LISTEN_SOCKET_INFO = { 0 };
     uint32_t idx = static_cast<uint32_t>(dst_addr);
-    if (idx >= MAX_SOCKET_NUM
-        || m_sockets[idx]._uin != static_cast<uint8_t>(dst_addr >> 32)
-        || m_sockets[idx]._addr_info >= MAX_SOCKET_NUM
-        || 0 == (m_sockets[idx]._state & ACCEPT_ADDR))
+    if (idx >= m_used_id
+        || SocketAt(idx)._uin != static_cast<uint8_t>(dst_addr >> 32)
+        || SocketAt(idx)._addr_info >= m_used_id
+        || 0 == (SocketAt(idx)._state & ACCEPT_ADDR))
     {
         return &INVALID_LISTEN_SOCKET_INFO;
     }
-    return &m_sockets[m_sockets[idx]._addr_info];
+    return &SocketAt(SocketAt(idx)._addr_info);
 }
 
 NetAddr NetIO::GetLocalListenAddr(NetAddr dst_addr)
 {
     uint32_t idx = static_cast<uint32_t>(dst_addr);
-    if (idx >= MAX_SOCKET_NUM
-        || m_sockets[idx]._uin != static_cast<uint8_t>(dst_addr >> 32)
-        || m_sockets[idx]._addr_info >= MAX_SOCKET_NUM
-        || 0 == (m_sockets[idx]._state & ACCEPT_ADDR))
+    if (idx >= m_used_id
+        || SocketAt(idx)._uin != static_cast<uint8_t>(dst_addr >> 32)
+        || SocketAt(idx)._addr_info >= m_used_id
+        || 0 == (SocketAt(idx)._state & ACCEPT_ADDR))
     {
         return INVAILD_NETADDR;
     }
 
-    uint32_t addr_info = m_sockets[idx]._addr_info;
-    return (static_cast<uint64_t>(m_sockets[addr_info]._uin) << 32) | addr_info;
+    uint32_t addr_info = SocketAt(idx)._addr_info;
+    return (static_cast<uint64_t>(SocketAt(addr_info)._uin) << 32) | addr_info;
+}
+
+int32_t NetIO::GetPeerCred(NetAddr dst_addr, int32_t* pid, uint32_t* uid, uint32_t* gid)
+{
+    SocketInfo* socket_info = RawGetSocketInfo(dst_addr);
+    if (NULL == socket_info
+        || 0 == (socket_info->_state & UNIX_DOMAIN)
+        || 0 != (socket_info->_state & LISTEN_ADDR)
+        || socket_info->_socket_fd < 0)
+    {
+        ERR("get peer cred of an invalid unix addr[%lu]", dst_addr);
+        return -1;
+    }
+
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(socket_info->_socket_fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0)
+    {
+        ERR("getsockopt SO_PEERCRED failed in %d", errno);
+        return -1;
+    }
+    if (pid) *pid = cred.pid;
+    if (uid) *uid = cred.uid;
+    if (gid) *gid = cred.gid;
+    return 0;
+}
+
+int32_t NetIO::ExportListenFd(NetAddr listen_addr)
+{
+    SocketInfo* socket_info = RawGetSocketInfo(listen_addr);
+    if (NULL == socket_info
+        || 0 == (socket_info->_state & LISTEN_ADDR)
+        || socket_info->_socket_fd < 0)
+    {
+        ERR("export an invalid listen addr[%lu]", listen_addr);
+        return -1;
+    }
+    // 新进程Ready前交接可能失败，本进程仍继续监听，unix域socket的路径在StopListen时才交出
+    return socket_info->_socket_fd;
+}
+
+int32_t NetIO::StopListen(NetAddr listen_addr)
+{
+    SocketInfo* socket_info = RawGetSocketInfo(listen_addr);
+    if (NULL == socket_info || 0 == (socket_info->_state & LISTEN_ADDR))
+    {
+        ERR("stop an invalid listen addr[%lu]", listen_addr);
+        return -1;
+    }
+    if (socket_info->_socket_fd < 0)
+    {
+        return 0;
+    }
+    if (NULL != m_epoll)
+    {
+        m_epoll->DelFd(socket_info->_socket_fd);
+    }
+    // udp的回包还要通过这个socket发送
+    if (socket_info->_state & UDP_PROTOCOL)
+    {
+        return 0;
+    }
+    // 不经过RawClose，地址保持有效，已accept的连接仍能找到监听地址
+    close(socket_info->_socket_fd);
+    socket_info->_socket_fd = -1;
+    // 路径已归新进程使用，之后关闭该地址时不能删除
+    if (socket_info->_state & UNIX_DOMAIN)
+    {
+        m_unix_paths.erase(static_cast<uint32_t>(listen_addr));
+    }
+    return 0;
 }
 
 
 NetAddr NetIO::AllocNetAddr()
 {
     NetAddr ret = INVAILD_NETADDR;
-    if (0 != m_free_sockets.size())
+    if (UINT32_MAX != m_free_head)
     {
-        ret = m_free_sockets.front();
-        m_free_sockets.pop_front();
+        ret = m_free_head;
+        m_free_head = SocketAt(ret)._addr_info;
+        if (UINT32_MAX == m_free_head)
+        {
+            m_free_tail = UINT32_MAX;
+        }
+        SocketAt(ret)._addr_info = UINT32_MAX;
+        ret |= (static_cast<uint64_t>(SocketAt(ret)._uin) << 32);
     }
     else if (m_used_id < MAX_SOCKET_NUM)
     {
+        // 新的一页首次使用时分配
+        uint32_t page = static_cast<uint32_t>(m_used_id >> SOCKET_PAGE_SHIFT);
+        if (NULL == m_socket_pages[page])
+        {
+            m_socket_pages[page] = new SocketInfo[SOCKET_PAGE_SIZE];
+            memset(m_socket_pages[page], 0, SOCKET_PAGE_SIZE * sizeof(SocketInfo));
+        }
         ret = (m_used_id++);
-        m_sockets[ret].Reset();
-        ret |= (static_cast<uint64_t>(m_sockets[ret]._uin) << 32);
+        SocketAt(ret).Reset();
+        ret |= (static_cast<uint64_t>(SocketAt(ret)._uin) << 32);
     }
     return ret;
 }
@@ -829,18 +1375,29 @@ NetAddr NetIO::AllocNetAddr()
 void NetIO::FreeNetAddr(NetAddr net_addr)
 {
     uint32_t idx = static_cast<uint32_t>(net_addr);
-    m_sockets[idx].Reset();
-    net_addr = (static_cast<uint64_t>(m_sockets[idx]._uin) << 32) | idx;
-    m_free_sockets.push_back(net_addr);
+    if (SocketAt(idx)._state & UNIX_DOMAIN)
+    {
+        m_unix_paths.erase(idx);
+    }
+    SocketAt(idx).Reset();
+    if (UINT32_MAX == m_free_tail)
+    {
+        m_free_head = idx;
+    }
+    else
+    {
+        SocketAt(m_free_tail)._addr_info = idx;
+    }
+    m_free_tail = idx;
 }
 
 SocketInfo* NetIO::RawGetSocketInfo(NetAddr net_addr)
 {
-    if (static_cast<uint32_t>(net_addr) >= MAX_SOCKET_NUM)
+    if (static_cast<uint32_t>(net_addr) >= m_used_id)
     {
         return NULL;
     }
-    SocketInfo* sock_info = &m_sockets[static_cast<uint32_t>(net_addr)];
+    SocketInfo* sock_info = &SocketAt(static_cast<uint32_t>(net_addr));
     if (sock_info->_uin != static_cast<uint8_t>(net_addr >> 32))
     {
         return NULL;
@@ -848,34 +1405,187 @@ SocketInfo* NetIO::RawGetSocketInfo(NetAddr net_addr)
     return sock_info;
 }
 
-int32_t NetIO::InitSocketInfo(const std::string& ip, uint16_t port, SocketInfo* socket_info)
+int32_t NetIO::InitSocketInfo(NetAddr net_addr, const std::string& ip, uint16_t port,
+    SocketInfo* socket_info)
 {
+    if (0 == ip.compare(0, 7, "unix://"))
+    {
+        // 以'@'开头的为抽象命名空间，不在文件系统中创建路径
+        std::string path(ip, 7);
+        if (path.empty() || path.size() >= sizeof(((struct sockaddr_un*)0)->sun_path))
+        {
+            ERR("invalid unix socket path[%s]", ip.c_str());
+            return -1;
+        }
+        socket_info->_state |= (TCP_PROTOCOL | UNIX_DOMAIN);
+        m_unix_paths[static_cast<uint32_t>(net_addr)] = path;
+        return 0;
+    }
+
+    size_t host_pos = 0;
     if (0 == ip.compare(0, 6, "tcp://"))
     {
         socket_info->_state |= TCP_PROTOCOL;
-        socket_info->_ip = inet_addr(ip.c_str() + 6);
+        host_pos = 6;
     }
     else if (0 == ip.compare(0, 6, "udp://"))
     {
         socket_info->_state |= UDP_PROTOCOL;
-        socket_info->_ip = inet_addr(ip.c_str() + 6);
+        host_pos = 6;
     }
     else
     {
         DBG("ip[%s] default as tcp protocol", ip.c_str());
         socket_info->_state |= TCP_PROTOCOL;
-        socket_info->_ip = inet_addr(ip.c_str());
     }
 
-    socket_info->_port = htons(port);
-    if (socket_info->_ip == 0xFFFFFFFFU)
+    struct sockaddr_in6 addr;
+    if (0 != IpToSockAddr(ip.substr(host_pos), port, &addr))
     {
-        ERR("unknown ip[%s] address, it should be ipv4 xx.xx.xx.xx", ip.c_str());
+        ERR("unknown ip[%s] address, it should be ipv4 xx.xx.xx.xx or ipv6 [xx::xx]", ip.c_str());
         return -1;
     }
+    SetSocketAddr(net_addr, socket_info, &addr);
     return 0;
 }
 
+void NetIO::SetSocketAddr(NetAddr net_addr, SocketInfo* socket_info, const struct sockaddr_in6* addr)
+{
+    if (AF_INET6 == addr->sin6_family && !IN6_IS_ADDR_V4MAPPED(&addr->sin6_addr))
+    {
+        socket_info->_state |= IPV6_ADDR;
+        socket_info->_ip = 0;
+        socket_info->_port = addr->sin6_port;
+        uint32_t page = static_cast<uint32_t>(net_addr) >> SOCKET_PAGE_SHIFT;
+        if (NULL == m_ipv6_pages[page])
+        {
+            m_ipv6_pages[page] = new struct sockaddr_in6[SOCKET_PAGE_SIZE];
+        }
+        Ipv6AddrAt(static_cast<uint32_t>(net_addr)) = *addr;
+        return;
+    }
+
+    // ipv4映射地址只出现在ipv6监听接受的ipv4连接上，按ipv4记录
+    if (AF_INET6 == addr->sin6_family)
+    {
+        memcpy(&socket_info->_ip, addr->sin6_addr.s6_addr + 12, sizeof(socket_info->_ip));
+        socket_info->_port = addr->sin6_port;
+        return;
+    }
+    const struct sockaddr_in* in_addr = reinterpret_cast<const struct sockaddr_in*>(addr);
+    socket_info->_ip = in_addr->sin_addr.s_addr;
+    socket_info->_port = in_addr->sin_port;
+}
+
+NetAddr NetIO::ToRemoteAddr(const struct sockaddr_in6* addr)
+{
+    if (AF_INET6 != addr->sin6_family)
+    {
+        const struct sockaddr_in* in_addr = reinterpret_cast<const struct sockaddr_in*>(addr);
+        return (static_cast<uint64_t>(in_addr->sin_addr.s_addr) << 32) | in_addr->sin_port;
+    }
+    if (IN6_IS_ADDR_V4MAPPED(&addr->sin6_addr))
+    {
+        uint32_t ip = 0;
+        memcpy(&ip, addr->sin6_addr.s6_addr + 12, sizeof(ip));
+        return (static_cast<uint64_t>(ip) << 32) | addr->sin6_port;
+    }
+
+    // 只保留用于比较的字段
+    struct sockaddr_in6 key;
+    memset(&key, 0, sizeof(key));
+    key.sin6_family = AF_INET6;
+    key.sin6_port = addr->sin6_port;
+    key.sin6_addr = addr->sin6_addr;
+    key.sin6_scope_id = addr->sin6_scope_id;
+
+    // 首次收到ipv6数据报时分配远端地址表
+    if (m_ipv6_peers.empty())
+    {
+        Ipv6Peer empty;
+        memset(&empty, 0, sizeof(empty));
+        m_ipv6_peers.resize(MAX_UDP_IPV6_PEER_NUM, empty);
+    }
+
+    // 从地址的哈希位置开始探测，命中则复用，否则取空闲表项或淘汰其中最久未用的
+    uint32_t hash = 2166136261u;
+    const uint8_t* bytes = key.sin6_addr.s6_addr;
+    for (uint32_t i = 0; i < sizeof(key.sin6_addr); ++i)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    hash = (hash ^ key.sin6_port ^ key.sin6_scope_id) * 16777619u;
+
+    uint32_t idx = UINT32_MAX;
+    uint32_t victim = hash % MAX_UDP_IPV6_PEER_NUM;
+    for (uint32_t i = 0; i < IPV6_PEER_PROBE_NUM; ++i)
+    {
+        uint32_t pos = (hash + i) % MAX_UDP_IPV6_PEER_NUM;
+        Ipv6Peer& peer = m_ipv6_peers[pos];
+        if (peer._used && 0 == memcmp(&peer._addr, &key, sizeof(key)))
+        {
+            idx = pos;
+            break;
+        }
+        const Ipv6Peer& old = m_ipv6_peers[victim];
+        if (old._used && (!peer._used
+            || m_ipv6_peer_seq - peer._last_used > m_ipv6_peer_seq - old._last_used))
+        {
+            victim = pos;
+        }
+    }
+    if (UINT32_MAX == idx)
+    {
+        // 淘汰的表项generation变化，使旧的远端地址失效
+        idx = victim;
+        if (m_ipv6_peers[idx]._used)
+        {
+            ++m_ipv6_peers[idx]._generation;
+        }
+        m_ipv6_peers[idx]._addr = key;
+        m_ipv6_peers[idx]._used = true;
+    }
+    m_ipv6_peers[idx]._last_used = m_ipv6_peer_seq++;
+
+    return (static_cast<uint64_t>(m_ipv6_peers[idx]._generation) << 48)
+        | (static_cast<uint64_t>(idx) << 32) | UDP_IPV6_REMOTE | addr->sin6_port;
+}
+
+socklen_t NetIO::MakeRemoteSockAddr(const SocketInfo* socket_info, NetAddr remote_addr,
+    struct sockaddr_in6* addr)
+{
+    if (remote_addr & UDP_IPV6_REMOTE)
+    {
+        uint32_t idx = static_cast<uint32_t>((remote_addr >> 32) & 0xFFFF);
+        if (idx >= m_ipv6_peers.size() || !m_ipv6_peers[idx]._used
+            || m_ipv6_peers[idx]._generation != static_cast<uint16_t>(remote_addr >> 48))
+        {
+            return 0;
+        }
+        *addr = m_ipv6_peers[idx]._addr;
+        return sizeof(*addr);
+    }
+
+    uint32_t ip = static_cast<uint32_t>(remote_addr >> 32);
+    uint16_t port = static_cast<uint16_t>(remote_addr & 0xFFFF);
+    if (socket_info->_state & IPV6_ADDR)
+    {
+        // 双栈的ipv6 socket发给ipv4远端时使用映射地址
+        memset(addr, 0, sizeof(*addr));
+        addr->sin6_family = AF_INET6;
+        addr->sin6_port = port;
+        addr->sin6_addr.s6_addr[10] = 0xFF;
+        addr->sin6_addr.s6_addr[11] = 0xFF;
+        memcpy(addr->sin6_addr.s6_addr + 12, &ip, sizeof(ip));
+        return sizeof(*addr);
+    }
+    struct sockaddr_in* in_addr = reinterpret_cast<struct sockaddr_in*>(addr);
+    in_addr->sin_family = AF_INET;
+    in_addr->sin_addr.s_addr = ip;
+    in_addr->sin_port = port;
+    return sizeof(*in_addr);
+}
+
 int32_t NetIO::OnEvent(NetAddr net_addr, uint32_t events)
 {
     SocketInfo* socket_info = RawGetSocketInfo(net_addr);
@@ -883,19 +1593,20 @@ int32_t NetIO::OnEvent(NetAddr net_addr, uint32_t events)
     {
         return -1;
     }
-    // EPOLLOUT - ȥǣϲԼ
+    // EPOLLOUT - 去掉阻塞标记，上层可以继续发送了
     if ((EPOLLOUT & events) && m_epoll != NULL)
     {
         socket_info->_state &= (~IN_BLOCKED);
-        m_epoll->ModFd(socket_info->_socket_fd, EPOLLIN | EPOLLERR, net_addr);
+        m_epoll->ModFd(socket_info->_socket_fd,
+            EpollEvents(socket_info, EPOLLIN | EPOLLERR), net_addr);
     }
-    // 
+    // 出错了
     if (EPOLLERR & events)
     {
-        // Ƴepollرsocket
+        // 移除epoll并关闭socket
         RawClose(socket_info);
-        // TCPԶִ
-        if (socket_info->_state == (CONNECT_ADDR | TCP_PROTOCOL))
+        // 对TCP的主动连接自动执行重连
+        if ((socket_info->_state & ~(UNIX_DOMAIN | IPV6_ADDR)) == (CONNECT_ADDR | TCP_PROTOCOL))
         {
             if (socket_info->_addr_info > 0)
             {
@@ -909,35 +1620,70 @@ int32_t NetIO::OnEvent(NetAddr net_addr, uint32_t events)
 
 int32_t NetIO::RawListen(NetAddr net_addr, SocketInfo* socket_info)
 {
-    int32_t s_fd = socket(AF_INET,
-        ((socket_info->_state & TCP_PROTOCOL) ? SOCK_STREAM : SOCK_DGRAM), 0);
+    struct sockaddr_storage addr;
+    socklen_t addrlen = 0;
+    MakeSockAddr(net_addr, socket_info, &addr, &addrlen);
+    int32_t sock_type = ((socket_info->_state & TCP_PROTOCOL) ? SOCK_STREAM : SOCK_DGRAM);
+
+    // 热重启时直接使用旧进程的监听socket，监听队列中的连接不会丢失
+    int32_t s_fd = TakeInheritedFd(reinterpret_cast<struct sockaddr*>(&addr), addrlen, sock_type);
+    if (s_fd >= 0)
+    {
+        int32_t flags = fcntl(s_fd, F_GETFL);
+        if (flags >= 0 && NetIO::NON_BLOCK)
+        {
+            fcntl(s_fd, F_SETFL, flags | O_NONBLOCK);
+        }
+        fcntl(s_fd, F_SETFD, FD_CLOEXEC);
+        INFO("use inherited listen socket[%d]", s_fd);
+        socket_info->_socket_fd = s_fd;
+        if (NULL != m_epoll)
+        {
+            m_epoll->AddFd(s_fd, EPOLLIN | EPOLLERR, net_addr);
+        }
+        return 0;
+    }
+
+    s_fd = socket(SocketFamily(socket_info->_state), sock_type, 0);
     if (s_fd < 0)
     {
         ERR("socket failed in %d", errno);
         return -1;
     }
 
-    // socket
+    // 设置socket属性
     int32_t ret = fcntl(s_fd, F_GETFL);
     int flags = 1;
     struct linger linger_val;
     linger_val.l_onoff = (NetIO::USE_LINGER ? 1 : 0);
     linger_val.l_linger = static_cast<u_short>(NetIO::LINGER_TIME);
-    // ÷ʽдϵͳĬΪfalse
+    // 设置非阻塞式读写，系统默认为false
     ret = ((ret < 0 || false == NetIO::NON_BLOCK)
         ? ret : (fcntl(s_fd, F_SETFL, ret | O_NONBLOCK)));
-    // õַãϵͳĬΪfalse
+    // 设置地址复用，系统默认为false
     ret = ((ret < 0 || false == NetIO::ADDR_REUSE)
         ? ret : setsockopt(s_fd, SOL_SOCKET, SO_REUSEADDR, &flags, sizeof(flags)));
-    // ӶʱϵͳĬΪtrue
-    ret = ((ret < 0 || false == NetIO::KEEP_ALIVE || 0 == (TCP_PROTOCOL & socket_info->_state))
+    // 设置端口复用，由内核将连接分散到监听同一地址的多个socket，系统默认为false
+    ret = ((ret < 0 || false == NetIO::REUSE_PORT || (UNIX_DOMAIN & socket_info->_state))
+        ? ret : setsockopt(s_fd, SOL_SOCKET, SO_REUSEPORT, &flags, sizeof(flags)));
+    // 设置连接定时保活，系统默认为true
+    ret = ((ret < 0 || false == NetIO::KEEP_ALIVE || 0 == (TCP_PROTOCOL & socket_info->_state)
+        || (UNIX_DOMAIN & socket_info->_state))
         ? ret : setsockopt(s_fd, SOL_SOCKET, SO_KEEPALIVE, &flags, sizeof(flags)));
-    // lingerϵͳĬΪfalse
+    // 设置linger，系统默认为false
     ret = ((ret < 0 || false == NetIO::USE_LINGER)
         ? ret : setsockopt(s_fd, SOL_SOCKET, SO_LINGER, &linger_val, sizeof(linger_val)));
-    // ýnagle㷨ϵͳĬΪtrue
-    ret = ((ret < 0 || true == NetIO::USE_NAGLE || 0 == (TCP_PROTOCOL & socket_info->_state))
+    // 设置禁用nagle算法，系统默认为true
+    ret = ((ret < 0 || true == NetIO::USE_NAGLE || 0 == (TCP_PROTOCOL & socket_info->_state)
+        || (UNIX_DOMAIN & socket_info->_state))
         ? ret : setsockopt(s_fd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags)));
+    // udp监听打开接收时间戳，批量收包时作为每个数据报的到达时间
+    ret = ((ret < 0 || 0 == (UDP_PROTOCOL & socket_info->_state))
+        ? ret : setsockopt(s_fd, SOL_SOCKET, SO_TIMESTAMP, &flags, sizeof(flags)));
+    // ipv6监听是否同时接受ipv4，不依赖系统的net.ipv6.bindv6only设置
+    int32_t v6_only = (NetIO::IPV6_ONLY ? 1 : 0);
+    ret = ((ret < 0 || 0 == (IPV6_ADDR & socket_info->_state))
+        ? ret : setsockopt(s_fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6_only, sizeof(v6_only)));
     if (ret < 0)
     {
         ERR("socket set opt failed in %d", errno);
@@ -945,12 +1691,13 @@ int32_t NetIO::RawListen(NetAddr net_addr, SocketInfo* socket_info)
         return -1;
     }
 
-    struct sockaddr_in addr = { 0 };
-    socklen_t addrlen = sizeof(addr);
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = socket_info->_ip;
-    addr.sin_port = socket_info->_port;
     ret = bind(s_fd, reinterpret_cast<struct sockaddr*>(&addr), addrlen);
+    // unix域socket的路径在进程异常退出时不会删除，确认没有进程在监听后删除再绑定
+    if (ret < 0 && EADDRINUSE == errno && (UNIX_DOMAIN & socket_info->_state)
+        && UnlinkStaleUnixPath(m_unix_paths[static_cast<uint32_t>(net_addr)]))
+    {
+        ret = bind(s_fd, reinterpret_cast<struct sockaddr*>(&addr), addrlen);
+    }
     if (ret < 0)
     {
         ERR("bind failed in %d", errno);
@@ -970,7 +1717,7 @@ int32_t NetIO::RawListen(NetAddr net_addr, SocketInfo* socket_info)
     }
 
     socket_info->_socket_fd = s_fd;
-    // ӵepoll
+    // 添加到epoll
     if (NULL != m_epoll)
     {
         m_epoll->AddFd(s_fd, EPOLLIN | EPOLLERR, net_addr);
@@ -980,7 +1727,7 @@ int32_t NetIO::RawListen(NetAddr net_addr, SocketInfo* socket_info)
 
 int32_t NetIO::RawConnect(NetAddr net_addr, SocketInfo* socket_info)
 {
-    int32_t s_fd = socket(AF_INET,
+    int32_t s_fd = socket(SocketFamily(socket_info->_state),
         ((socket_info->_state & TCP_PROTOCOL) ? SOCK_STREAM : SOCK_DGRAM), 0);
     if (s_fd < 0)
     {
@@ -988,23 +1735,25 @@ int32_t NetIO::RawConnect(NetAddr net_addr, SocketInfo* socket_info)
         return -1;
     }
 
-    // socket
+    // 设置socket属性
     int32_t ret = fcntl(s_fd, F_GETFL);
     int flags = 1;
     struct linger linger_val;
     linger_val.l_onoff = (NetIO::USE_LINGER ? 1 : 0);
     linger_val.l_linger = static_cast<u_short>(NetIO::LINGER_TIME);
-    // ÷ʽдϵͳĬΪfalse
+    // 设置非阻塞式读写，系统默认为false
     ret = ((ret < 0 || false == NetIO::NON_BLOCK)
         ? ret : (fcntl(s_fd, F_SETFL, ret | O_NONBLOCK)));
-    // ӶʱϵͳĬΪtrue
-    ret = ((ret < 0 || false == NetIO::KEEP_ALIVE || 0 == (TCP_PROTOCOL & socket_info->_state))
+    // 设置连接定时保活，系统默认为true
+    ret = ((ret < 0 || false == NetIO::KEEP_ALIVE || 0 == (TCP_PROTOCOL & socket_info->_state)
+        || (UNIX_DOMAIN & socket_info->_state))
         ? ret : setsockopt(s_fd, SOL_SOCKET, SO_KEEPALIVE, &flags, sizeof(flags)));
-    // lingerϵͳĬΪfalse
+    // 设置linger，系统默认为false
     ret = ((ret < 0 || false == NetIO::USE_LINGER)
         ? ret : setsockopt(s_fd, SOL_SOCKET, SO_LINGER, &linger_val, sizeof(linger_val)));
-    // ýnagle㷨ϵͳĬΪtrue
-    ret = ((ret < 0 || true == NetIO::USE_NAGLE || 0 == (TCP_PROTOCOL & socket_info->_state))
+    // 设置禁用nagle算法，系统默认为true
+    ret = ((ret < 0 || true == NetIO::USE_NAGLE || 0 == (TCP_PROTOCOL & socket_info->_state)
+        || (UNIX_DOMAIN & socket_info->_state))
         ? ret : setsockopt(s_fd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags)));
     if (ret < 0)
     {
@@ -1013,11 +1762,10 @@ int32_t NetIO::RawConnect(NetAddr net_addr, SocketInfo* socket_info)
         return -1;
     }
 
-    struct sockaddr_in addr = { 0 };
-    socklen_t addrlen = sizeof(addr);
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = socket_info->_ip;
-    addr.sin_port = socket_info->_port;
+    // unix域socket对端backlog满时非阻塞connect返回EAGAIN，按失败处理
+    struct sockaddr_storage addr;
+    socklen_t addrlen = 0;
+    MakeSockAddr(net_addr, socket_info, &addr, &addrlen);
     ret = connect(s_fd, reinterpret_cast<struct sockaddr*>(&addr), addrlen);
     if (ret < 0 && errno != EINPROGRESS)
     {
@@ -1027,13 +1775,13 @@ int32_t NetIO::RawConnect(NetAddr net_addr, SocketInfo* socket_info)
     }
 
     socket_info->_socket_fd = s_fd;
-    // ӵepoll
+    // 添加到epoll
     if (NULL != m_epoll)
     {
-        // δɣҪEPOLLOUT¼
-        // ӽɣҪEPOLLIN¼
+        // 如果连接未建立完成，则需要加入EPOLLOUT的事件
+        // 如果连接建立完成，则需要加入EPOLLIN的事件
         uint32_t events = EPOLLERR | (ret < 0 ? EPOLLOUT : EPOLLIN);
-        m_epoll->AddFd(s_fd, events, net_addr);
+        m_epoll->AddFd(s_fd, EpollEvents(socket_info, events), net_addr);
         if (ret < 0)
         {
             socket_info->_state |= IN_BLOCKED;
@@ -1043,7 +1791,7 @@ int32_t NetIO::RawConnect(NetAddr net_addr, SocketInfo* socket_info)
             socket_info->_state &= (~IN_BLOCKED);
         }
     }
-    // TCPԶִ
+    // 对TCP的主动连接自动执行重连
     if (socket_info->_state & TCP_PROTOCOL)
     {
         socket_info->_addr_info = AUTO_RECONNECT;
@@ -1066,5 +1814,84 @@ int32_t NetIO::RawClose(SocketInfo* socket_info)
     return ret;
 }
 
+int32_t NetIO::MakeSockAddr(NetAddr net_addr, const SocketInfo* socket_info,
+    struct sockaddr_storage* addr, socklen_t* addr_len)
+{
+    memset(addr, 0, sizeof(*addr));
+    if (socket_info->_state & UNIX_DOMAIN)
+    {
+        const std::string& path = m_unix_paths[static_cast<uint32_t>(net_addr)];
+        struct sockaddr_un* un_addr = reinterpret_cast<struct sockaddr_un*>(addr);
+        un_addr->sun_family = AF_UNIX;
+        memcpy(un_addr->sun_path, path.data(), path.size());
+        // 抽象命名空间以'\0'开头，地址长度不含结尾的'\0'
+        if ('@' == path[0])
+        {
+            un_addr->sun_path[0] = '\0';
+            *addr_len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + path.size());
+        }
+        else
+        {
+            *addr_len = sizeof(struct sockaddr_un);
+        }
+        return 0;
+    }
+
+    if (socket_info->_state & IPV6_ADDR)
+    {
+        memcpy(addr, &Ipv6AddrAt(static_cast<uint32_t>(net_addr)), sizeof(struct sockaddr_in6));
+        *addr_len = sizeof(struct sockaddr_in6);
+        return 0;
+    }
+
+    struct sockaddr_in* in_addr = reinterpret_cast<struct sockaddr_in*>(addr);
+    in_addr->sin_family = AF_INET;
+    in_addr->sin_addr.s_addr = socket_info->_ip;
+    in_addr->sin_port = socket_info->_port;
+    *addr_len = sizeof(struct sockaddr_in);
+    return 0;
+}
+
+bool NetIO::UnlinkStaleUnixPath(const std::string& path)
+{
+    if (path.empty() || '@' == path[0])
+    {
+        return false;
+    }
+
+    int32_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.data(), path.size());
+    // 能连上说明有进程在监听，不能删除
+    int32_t ret = connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    bool stale = (ret < 0 && ECONNREFUSED == errno);
+    close(fd);
+    if (stale && 0 == unlink(path.c_str()))
+    {
+        INFO("unlink stale unix socket path[%s]", path.c_str());
+        return true;
+    }
+    return false;
+}
+
+void NetIO::UnlinkUnixPath(NetAddr net_addr, const SocketInfo* socket_info)
+{
+    if ((UNIX_DOMAIN | LISTEN_ADDR) != (socket_info->_state & (UNIX_DOMAIN | LISTEN_ADDR)))
+    {
+        return;
+    }
+    std::map<uint32_t, std::string>::iterator it = m_unix_paths.find(static_cast<uint32_t>(net_addr));
+    if (it != m_unix_paths.end() && !it->second.empty() && '@' != it->second[0])
+    {
+        unlink(it->second.c_str());
+    }
+}
+
 } // namespace pebble
 
@@ -15,9 +15,13 @@
 #ifndef _PEBBLE_COMMON_NET_UTIL_H_
 #define _PEBBLE_COMMON_NET_UTIL_H_
 
-#include <list>
+#include <map>
 #include <string>
+#include <string.h>
+#include <vector>
+#include <netinet/in.h>
 #include <sys/epoll.h>
+#include <sys/socket.h>
 
 namespace pebble {
 
@@ -39,6 +43,12 @@ uint64_t NetAddressToUIN(const std::string& ip, uint16_t port);
 
 void UINToNetAddress(uint64_t net_uin, std::string* ip, uint16_t* port);
 
+/// @brief 解析ip地址(不含协议前缀)，支持ipv4和ipv6，ipv6可写为"[::1]"或"::1"，可带"%网卡名"
+/// @param addr 返回地址，ipv4时按sockaddr_in填写，ipv4映射的ipv6地址(::ffff:a.b.c.d)也按ipv4返回
+/// @return 0 成功
+/// @return -1 地址非法
+int32_t IpToSockAddr(const std::string& ip, uint16_t port, struct sockaddr_in6* addr);
+
 void SetLogOut(FILE* log_fp);
 
 #define NET_LOG_DEBUG_LEVEL 0
@@ -46,13 +56,15 @@ void SetLogOut(FILE* log_fp);
 #define NET_LOG_ERROR_LEVEL 2
 void SetLogLevel(int32_t log_level);
 
-static const uint8_t TCP_PROTOCOL = 0x80;   ///< Protocol: tcpЭ
-static const uint8_t UDP_PROTOCOL = 0x40;   ///< Protocol: udpЭ
-static const uint8_t IN_BLOCKED = 0x10;     ///< 
-static const uint8_t ADDR_TYPE = 0x07;      ///< AddrType: ַ
-static const uint8_t CONNECT_ADDR = 0x04;   ///<           
-static const uint8_t LISTEN_ADDR = 0x02;    ///<           
-static const uint8_t ACCEPT_ADDR = 0x01;    ///<           
+static const uint8_t TCP_PROTOCOL = 0x80;   ///< Protocol: tcp协议
+static const uint8_t UDP_PROTOCOL = 0x40;   ///< Protocol: udp协议
+static const uint8_t UNIX_DOMAIN = 0x20;    ///< unix域socket，与TCP_PROTOCOL同时设置，按流式连接处理
+static const uint8_t IN_BLOCKED = 0x10;     ///< 阻塞中
+static const uint8_t IPV6_ADDR = 0x08;      ///< ipv6地址，地址按槽位存放在NetIO的ipv6地址页中，_ip不使用
+static const uint8_t ADDR_TYPE = 0x07;      ///< AddrType: 地址类型
+static const uint8_t CONNECT_ADDR = 0x04;   ///<           主动连接
+static const uint8_t LISTEN_ADDR = 0x02;    ///<           监听
+static const uint8_t ACCEPT_ADDR = 0x01;    ///<           被动连接
 
 struct SocketInfo
 {
@@ -62,11 +74,20 @@ struct SocketInfo
     uint8_t GetAddrType() const { return (_state & 0x7); }
 
     int32_t _socket_fd;
-    uint32_t _addr_info;                    ///< _addr_info acceptʱؼĵַϢTCPʱΪԶ
-    uint32_t _ip;
+    uint32_t _addr_info;                    ///< _addr_info accept时本地监听的地址信息，TCP的主动连接时为可自动重连次数，空闲时为下一个空闲槽位
+    uint32_t _ip;                           ///< ipv4地址，ipv6地址不放在这里，保持表项16字节
     uint16_t _port;
     uint8_t _state;
-    uint8_t _uin;                           ///< ʱı
+    uint8_t _uin;                           ///< 复用时的标记
+};
+
+/// @brief 批量收发UDP数据报时单个数据报的描述
+struct UdpDatagram
+{
+    NetAddr  _remote_addr;                  ///< 远端地址，格式同RecvFrom
+    char*    _buff;                         ///< 数据
+    uint32_t _len;                          ///< 接收时传入buff长度并返回数据长度，发送时为数据长度
+    int64_t  _arrived_ms;                   ///< 接收时间(单调时钟ms)，优先使用内核时间戳
 };
 
 class Epoll
@@ -78,9 +99,9 @@ public:
 
     int32_t Init(uint32_t max_event);
 
-    /// @brief ȴ¼
-    /// @return >=0 ¼
-    /// @return -1 ԭerrno
+    /// @brief 等待事件触发
+    /// @return >=0 触发的事件数
+    /// @return -1 错误，原因见errno
     int32_t Wait(int32_t timeout_ms);
 
     int32_t AddFd(int32_t fd, uint32_t events, uint64_t data);
@@ -89,15 +110,20 @@ public:
 
     int32_t ModFd(int32_t fd, uint32_t events, uint64_t data);
 
-    /// @brief ȡ¼
-    /// @return 0 ȡɹ
-    /// @return -1 ȡʧܣû¼Ϣ
+    /// @brief 获取事件
+    /// @return 0 获取成功
+    /// @return -1 获取失败，没有事件信息
     int32_t GetEvent(uint32_t *events, uint64_t *data);
 
     const char* GetLastError() const {
         return m_last_error;
     }
 
+    /// @brief 获取epoll fd，有事件触发时fd可读，可加入其他事件循环中等待
+    int32_t GetFd() const {
+        return m_epoll_fd;
+    }
+
 private:
     char    m_last_error[256];
     int32_t m_epoll_fd;
@@ -107,8 +133,8 @@ private:
     NetIO*  m_bind_net_io;
 };
 
-/// @brief IO࣬socketװ
-/// @note ʹõַsocketϲ㲻ÿ
+/// @brief 网络IO处理类，管理socket、封装网络操作
+/// @note 使用地址忽略socket，上层不用考虑重连
 class NetIO
 {
     friend class Epoll;
@@ -116,89 +142,166 @@ public:
     NetIO();
     ~NetIO();
 
-    /// @brief ʼ
+    /// @brief 初始化
     int32_t Init(Epoll* epoll);
 
-    /// @brief 򿪼
-    /// @note 쳣ʱԶԻָ
+    /// @brief 打开监听
+    /// @param ip "tcp://ip"、"udp://ip"，或unix域socket "unix:///path"、"unix://@name"(抽象命名空间)，
+    ///     unix域socket忽略port；ip可以是ipv6地址，如"tcp://[::1]"、"tcp://[::]"
+    /// @note 主动创建的连接异常时会自动尝试恢复
+    /// @note unix域socket的路径在关闭监听时删除，不支持多个进程监听同一路径
+    /// @note ipv6监听地址是否同时接受ipv4连接由IPV6_ONLY决定，ipv4连接的对端按ipv4地址记录
     NetAddr Listen(const std::string& ip, uint16_t port);
 
-    /// @brief ܷ
-    /// @note 򿪵쳣ʱԶͷ
+    /// @brief 接受服务连接
+    /// @note 被动打开的连接在连接异常时会自动释放
     NetAddr Accept(NetAddr listen_addr);
 
-    /// @brief ӵַ
-    /// @note 쳣ʱԶԻָ
+    /// @brief 批量接受服务连接，一次取出积压的连接直到没有新连接或达到num个
+    /// @param accepted 返回接受的连接地址，至少能放num个
+    /// @return 接受的连接个数
+    /// @note 新连接由accept4直接设置为非阻塞，全部取出后再注册到epoll
+    uint32_t AcceptBatch(NetAddr listen_addr, NetAddr* accepted, uint32_t num);
+
+    /// @brief 连接地址
+    /// @param ip 格式同Listen
+    /// @note 主动创建的连接异常时会自动尝试恢复
     NetAddr ConnectPeer(const std::string& ip, uint16_t port);
 
-    /// @brief 
-    /// @note ֻͣκηͲ
+    /// @brief 发送数据
+    /// @note 只负责发送，不保存任何发送残渣数据
     int32_t Send(NetAddr dst_addr, const char* data, uint32_t data_len);
 
-    /// @brief 
-    /// @note ֻͣκηͲ
+    /// @brief 发送数据
+    /// @note 只负责发送，不保存任何发送残渣数据
     int32_t SendV(NetAddr dst_addr, uint32_t data_num,
                   const char* data[], uint32_t data_len[], uint32_t offset = 0);
 
-    /// @brief 
+    /// @brief 发送数据
     /// @note only for udp server send rsp
     int32_t SendTo(NetAddr local_addr, NetAddr remote_addr, const char* data, uint32_t data_len);
 
-    /// @brief 
-    /// @return -1 ȡʧܻӹرˣerrno
-    /// @return >= 0 ȡݳȣΪ
-    /// @note ֻͣκνյĲ
+    /// @brief 接收数据
+    /// @return -1 读取失败或连接关闭了，错误见errno
+    /// @return >= 0 读取的内容长度，可能为空
+    /// @note 只负责发送，不保存任何接收的残渣数据
     int32_t Recv(NetAddr dst_addr, char* buff, uint32_t buff_len);
 
-    /// @brief 
+    /// @brief 接收数据
+    /// @param remote_addr ipv4为"ip << 32 | port"，ipv6为远端地址表中的编号(带UDP_IPV6_REMOTE标记)，
+    ///     都只能在本NetIO的SendTo中使用，发送时忽略UDP_REMOTE_TAG_SHIFT起的上层标记位
     /// @note only for udp listen
     int32_t RecvFrom(NetAddr local_addr, NetAddr* remote_addr, char* buff, uint32_t buff_len);
 
-    /// @brief ر
-    /// @return -1 رպ󷵻ش󣬴ԭerrno
-    /// @return 0  ӹر
-    /// @note ʧܵͬclose
+    /// @brief 批量接收数据(recvmmsg)，一次系统调用最多收取num个数据报
+    /// @return -1 读取失败
+    /// @return >= 0 收到的数据报个数
+    /// @note only for udp listen
+    int32_t RecvFromBatch(NetAddr local_addr, UdpDatagram* datagrams, uint32_t num);
+
+    /// @brief 批量发送数据(sendmmsg)，同一远端的连续等长数据报合并为一个GSO包发送
+    /// @note 只合并不超过一个以太网MTU(去掉IP/UDP头)的数据报，更大的数据报单独发送由IP层分片
+    /// @note 首次GSO发送因内核或网卡不支持失败时，本NetIO关闭GSO并以不合并的方式重发
+    /// @return -1 发送失败
+    /// @return >= 0 发送成功的数据报个数
+    /// @note only for udp server send rsp
+    int32_t SendToBatch(NetAddr local_addr, const UdpDatagram* datagrams, uint32_t num);
+
+    /// @brief 关闭连接
+    /// @return -1 关闭后返回错误，错误原因见errno
+    /// @return 0  连接关闭了
+    /// @note 失败的意义同close
     int32_t Close(NetAddr dst_addr);
 
-    /// @brief (ȹغʱֻCONNECT_ADDR)
-    /// @return -1 رպ󷵻ش󣬴ԭerrno
-    /// @return 0  óɹ
+    /// @brief 重置连接(先关后连，暂时只针对CONNECT_ADDR类型)
+    /// @return -1 关闭后返回错误，错误原因见errno
+    /// @return 0  重置成功
     int32_t Reset(NetAddr dst_addr); // TODO: -> ReConnect
 
-    /// @brief ر
+    /// @brief 关闭所有连接
     void CloseAll();
 
-    /// @brief ȡַsocketϢ
-    /// @return NULLָ
-    /// @note ַʱصInfoȫΪ0
+    /// @brief 设置TCP数据连接(accept和connect的连接)以边缘触发方式注册epoll，监听和UDP仍为水平触发
+    /// @note 边缘触发时上层必须把数据读到EAGAIN(或读到短读)，否则剩余数据不会再有事件通知；
+    ///     需要在创建连接前设置
+    void SetEdgeTrigger(bool edge_trigger)
+    {
+        m_edge_trigger = edge_trigger;
+    }
+
+    /// @brief 获取地址的socket相关信息
+    /// @return 非NULL对象指针
+    /// @note 地址不存在时返回的Info中数据全为0
     const SocketInfo* GetSocketInfo(NetAddr dst_addr) const;
 
-    /// @brief ȡַsocketϢ
-    /// @return NULLָ
-    /// @note ַڻַǱӵĵַʱصInfoȫΪ0
-    /// @note ڱӵĵַȡıصļַϢ
+    /// @brief 获取监听地址的socket相关信息
+    /// @return 非NULL对象指针
+    /// @note 地址不存在或地址不是被动连接的地址时，返回的Info中数据全为0
+    /// @note 用于被动连接的地址获取关联的本地的监听地址信息
     const SocketInfo* GetLocalListenSocketInfo(NetAddr dst_addr) const;
 
-    /// @brief ȡַľϢ
+    /// @brief 获取监听地址的句柄信息
     NetAddr GetLocalListenAddr(NetAddr dst_addr);
 
+    /// @brief 获取unix域socket连接对端进程的身份(SO_PEERCRED)
+    /// @return 0 成功
+    /// @return -1 地址无效或不是unix域socket连接
+    int32_t GetPeerCred(NetAddr dst_addr, int32_t* pid, uint32_t* uid, uint32_t* gid);
+
+    /// @brief 取监听地址的socket，用于热重启时交给新进程
+    /// @return >=0 socket fd，仍归本NetIO所有
+    /// @return -1 地址不是监听地址或socket已关闭
+    /// @note 取出后unix域socket的路径仍归本进程，交接完成调用StopListen后才交给新进程
+    int32_t ExportListenFd(NetAddr listen_addr);
+
+    /// @brief 停止在监听地址上接收新连接(热重启交接后)，地址仍有效，已建立的连接不受影响
+    /// @return 0 成功
+    /// @return -1 地址不是监听地址
+    /// @note udp只停止接收，socket保留用于发送在途请求的回包
+    /// @note unix域socket的路径此后归新进程使用，关闭该地址时不再删除
+    int32_t StopListen(NetAddr listen_addr);
+
+    /// @brief 登记从旧进程继承的监听socket(热重启)，之后监听相同地址时直接使用，不再新建socket
+    /// @note 每个线程独立，接管和监听需在同一线程中进行(与Message的驱动一样按线程区分)
+    static void AddInheritedFd(int32_t fd);
+
+    /// @brief 取出与地址和类型都相同的继承socket，不经过NetIO的驱动(如io_uring)也从这里取
+    /// @return >=0 socket fd，归调用方所有
+    /// @return -1 没有
+    static int32_t TakeInheritedFd(const struct sockaddr* addr, socklen_t addr_len, int32_t type);
+
+    /// @brief 关闭本线程没有被取走的继承socket
+    /// @return 关闭的个数
+    static uint32_t CloseInheritedFds();
+
     const char* GetLastError() const {
         return m_last_error;
     }
 
-    // 
-    static bool NON_BLOCK;              ///< NON_BLOCK ǷΪдĬΪtrue
-    static bool ADDR_REUSE;             ///< ADDR_REUSE Ƿ򿪵ַãĬΪtrue
-    static bool KEEP_ALIVE;             ///< KEEP_ALIVE ǷӶʱԼ⣬ĬΪtrue
-    static bool USE_NAGLE;              ///< USE_NAGLE Ƿʹnagle㷨ϲСĬΪfalse
-    static bool USE_LINGER;             ///< USE_LINGER ǷʹlingerʱرӣĬΪfalse
-    static int32_t LINGER_TIME;         ///< LINGER_TIME ʹlingetʱʱʱãĬΪ0
-    static int32_t LISTEN_BACKLOG;      ///< LISTEN_BACKLOG backlogгȣĬΪ10240
-    static uint32_t MAX_SOCKET_NUM;     ///< MAX_SOCKET_NUM ĬΪ1000000
-    static uint8_t AUTO_RECONNECT;      ///< AUTO_RECONNECT TCPԶĬֵΪ3
-
-    // 
-    static const uint32_t MAX_SENDV_DATA_NUM = 32;   ///< SendVӿ͵ݶ
+    // 配置项
+    static bool NON_BLOCK;              ///< NON_BLOCK 是否为非阻塞读写，默认为true
+    static bool ADDR_REUSE;             ///< ADDR_REUSE 是否打开地址复用，默认为true
+    static bool REUSE_PORT;             ///< REUSE_PORT 是否打开端口复用(多线程/进程监听同一地址)，默认为false
+    static bool KEEP_ALIVE;             ///< KEEP_ALIVE 是否打开连接定时活性检测，默认为true
+    static bool USE_NAGLE;              ///< USE_NAGLE 是否使用nagle算法合并小包，默认为false
+    static bool USE_LINGER;             ///< USE_LINGER 是否使用linger延时关闭连接，默认为false
+    static int32_t LINGER_TIME;         ///< LINGER_TIME 使用linget时延时时间设置，默认为0
+    static int32_t LISTEN_BACKLOG;      ///< LISTEN_BACKLOG 监听的backlog队列长度，默认为10240
+    static uint32_t MAX_SOCKET_NUM;     ///< MAX_SOCKET_NUM 最大的连接数，默认为1000000
+    static uint8_t AUTO_RECONNECT;      ///< AUTO_RECONNECT 对TCP的主动连接自动重连，默认值为3
+    static bool USE_UDP_GSO;            ///< USE_UDP_GSO 批量发送UDP时是否使用GSO(内核4.18+)，默认为true，运行时不修改
+    static bool IPV6_ONLY;              ///< IPV6_ONLY ipv6监听地址是否只接受ipv6(IPV6_V6ONLY)，默认为false
+
+    // 常数
+    static const uint32_t MAX_SENDV_DATA_NUM = 32;   ///< SendV接口最大发送的数据段数量
+    static const uint32_t MAX_UDP_BATCH_NUM = 64;    ///< 批量收发UDP时单次系统调用最大的数据报数量
+    static const uint32_t SOCKET_PAGE_SHIFT = 12;
+    static const uint32_t SOCKET_PAGE_SIZE = 1 << SOCKET_PAGE_SHIFT;   ///< socket表每页的SocketInfo个数
+    static const uint64_t UDP_IPV6_REMOTE = 0x10000;  ///< udp远端地址为ipv6的标记，ipv4远端地址此位总是0
+    static const uint32_t UDP_REMOTE_TAG_SHIFT = 17;  ///< udp远端地址的17~31位NetIO不使用，上层可在此标记(如收包的本地监听)
+    static const uint64_t MAX_UDP_REMOTE_TAG = 0x7FFF; ///< udp远端地址中上层标记的最大值
+    static const uint32_t MAX_UDP_IPV6_PEER_NUM = 65536; ///< udp的ipv6远端地址表大小，冲突时淘汰最久未用的表项
+    static const uint32_t IPV6_PEER_PROBE_NUM = 8;       ///< udp的ipv6远端地址表每个地址最多探测的表项数
 
 private:
     NetAddr AllocNetAddr();
@@ -207,7 +310,42 @@ private:
 
     SocketInfo* RawGetSocketInfo(NetAddr net_addr);
 
-    int32_t InitSocketInfo(const std::string& ip, uint16_t port, SocketInfo* socket_info);
+    /// @brief 按槽位取socket表项，调用方保证idx < m_used_id
+    SocketInfo& SocketAt(uint32_t idx) const
+    {
+        return m_socket_pages[idx >> SOCKET_PAGE_SHIFT][idx & (SOCKET_PAGE_SIZE - 1)];
+    }
+
+    /// @brief 按槽位取ipv6地址，调用方保证该槽位为ipv6地址(所在页已分配)
+    struct sockaddr_in6& Ipv6AddrAt(uint32_t idx) const
+    {
+        return m_ipv6_pages[idx >> SOCKET_PAGE_SHIFT][idx & (SOCKET_PAGE_SIZE - 1)];
+    }
+
+    int32_t InitSocketInfo(NetAddr net_addr, const std::string& ip, uint16_t port,
+        SocketInfo* socket_info);
+
+    /// @brief 记录socket的ip地址，ipv4映射的ipv6地址按ipv4记录
+    void SetSocketAddr(NetAddr net_addr, SocketInfo* socket_info, const struct sockaddr_in6* addr);
+
+    /// @brief 由udp来源地址生成远端地址，ipv6地址登记到远端地址表
+    NetAddr ToRemoteAddr(const struct sockaddr_in6* addr);
+
+    /// @brief 由udp远端地址生成目的地址，本地为ipv6 socket时ipv4远端转为映射地址
+    /// @return 0 远端地址无效(ipv6远端地址表项已被复用)
+    /// @return >0 地址长度
+    socklen_t MakeRemoteSockAddr(const SocketInfo* socket_info, NetAddr remote_addr,
+        struct sockaddr_in6* addr);
+
+    /// @brief 由socket信息生成地址，unix域socket的路径取自m_unix_paths
+    int32_t MakeSockAddr(NetAddr net_addr, const SocketInfo* socket_info,
+        struct sockaddr_storage* addr, socklen_t* addr_len);
+
+    /// @brief unix域socket绑定路径时，如路径被已退出进程残留的socket文件占用则删除
+    bool UnlinkStaleUnixPath(const std::string& path);
+
+    /// @brief 关闭unix域socket监听时删除路径
+    void UnlinkUnixPath(NetAddr net_addr, const SocketInfo* socket_info);
 
     int32_t OnEvent(NetAddr net_addr, uint32_t events);
 
@@ -217,13 +355,57 @@ private:
 
     int32_t RawClose(SocketInfo* socket_info);
 
+    int32_t RawSendMMsg(int32_t fd, struct mmsghdr* msgs, uint32_t num);
+
+    /// @brief socket注册epoll的事件，边缘触发时TCP数据连接附加EPOLLET和EPOLLRDHUP
+    uint32_t EpollEvents(const SocketInfo* socket_info, uint32_t events) const
+    {
+        if (m_edge_trigger && (socket_info->_state & TCP_PROTOCOL)
+            && 0 == (socket_info->_state & LISTEN_ADDR))
+        {
+            return events | EPOLLET | EPOLLRDHUP;
+        }
+        return events;
+    }
+
     char            m_last_error[256];
 
     Epoll           *m_epoll;
 
+    bool            m_edge_trigger;
+
     NetAddr         m_used_id;
-    SocketInfo      *m_sockets;
-    std::list<NetAddr>  m_free_sockets;
+
+    // 本NetIO上GSO的可用状态，探测失败只影响本NetIO(每个worker一个)，不修改全局配置
+    enum { kGSO_UNKNOWN = 0, kGSO_VERIFIED, kGSO_UNSUPPORTED };
+    uint8_t         m_udp_gso_state;
+
+    // socket表分页存放，页按需分配，地址稳定
+    SocketInfo      **m_socket_pages;
+    uint32_t        m_socket_page_num;
+
+    // 空闲槽位链表，通过SocketInfo::_addr_info串联，先进先出以推迟槽位复用
+    uint32_t        m_free_head;
+    uint32_t        m_free_tail;
+
+    // unix域socket的路径，按槽位索引，不占用SocketInfo的空间
+    std::map<uint32_t, std::string> m_unix_paths;
+
+    // ipv6地址，与socket表相同的分页按槽位存放，页在其中首次出现ipv6地址时分配，ipv4的连接不使用
+    struct sockaddr_in6 **m_ipv6_pages;
+
+    struct Ipv6Peer
+    {
+        struct sockaddr_in6 _addr;
+        uint32_t _last_used;                ///< 最近使用的序号，冲突时淘汰最久未用的表项
+        uint16_t _generation;
+        bool     _used;
+    };
+
+    // udp的ipv6远端地址表，按地址哈希开放寻址，首次收到ipv6数据报时分配
+    // 远端地址中带表项的generation，表项被淘汰后旧的远端地址失效
+    std::vector<Ipv6Peer> m_ipv6_peers;
+    uint32_t m_ipv6_peer_seq;
 };
 
 } // namespace pebble
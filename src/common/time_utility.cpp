@@ -35,6 +35,36 @@ int64_t TimeUtility::GetCurrentUS() {
     return timestamp;
 }
 
+// 线程私有，多worker线程各自的主循环分别刷新，0表示本线程未启用缓存
+static __thread int64_t s_cached_us = 0;
+
+int64_t TimeUtility::GetMonotonicMS() {
+    return GetMonotonicUS() / 1000;
+}
+
+int64_t TimeUtility::GetMonotonicUS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    int64_t timestamp = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    return timestamp;
+}
+
+void TimeUtility::UpdateCachedTime() {
+    s_cached_us = GetMonotonicUS();
+}
+
+int64_t TimeUtility::GetCachedMS() {
+    return GetCachedUS() / 1000;
+}
+
+int64_t TimeUtility::GetCachedUS() {
+    if (0 == s_cached_us) {
+        return GetMonotonicUS();
+    }
+    return s_cached_us;
+}
+
 std::string TimeUtility::GetStringTime()
 {
     time_t now = time(NULL);
@@ -57,24 +87,27 @@ std::string TimeUtility::GetStringTime()
 }
 
 const char* TimeUtility::GetStringTimeDetail() {
-    static char buff[64] = {0};
-    static struct timeval tv_now;
-    static time_t now;
-    static struct tm tm_now;
-    static struct tm* p_tm_now;
+    // 线程私有，多worker线程同时写log时互不影响
+    static __thread char buff[64] = {0};
+    static __thread struct timeval tv_now;
+    static __thread time_t now = -1;
+    static __thread struct tm tm_now;
+    static __thread int prefix_len = 0;
 
     gettimeofday(&tv_now, NULL);
-    now = (time_t)tv_now.tv_sec;
-    p_tm_now = localtime_r(&now, &tm_now);
-
-    snprintf(buff, sizeof(buff), "%04d-%02d-%02d %02d:%02d:%02d.%06d",
-        1900 + p_tm_now->tm_year,
-        p_tm_now->tm_mon + 1,
-        p_tm_now->tm_mday,
-        p_tm_now->tm_hour,
-        p_tm_now->tm_min,
-        p_tm_now->tm_sec,
-        static_cast<int>(tv_now.tv_usec));
+    // 同一秒内只更新微秒部分，localtime_r需要加锁，不必每条log都调用
+    if (now != (time_t)tv_now.tv_sec) {
+        now = (time_t)tv_now.tv_sec;
+        localtime_r(&now, &tm_now);
+        prefix_len = snprintf(buff, sizeof(buff), "%04d-%02d-%02d %02d:%02d:%02d.",
+            1900 + tm_now.tm_year,
+            tm_now.tm_mon + 1,
+            tm_now.tm_mday,
+            tm_now.tm_hour,
+            tm_now.tm_min,
+            tm_now.tm_sec);
+    }
+    snprintf(buff + prefix_len, sizeof(buff) - prefix_len, "%06d", static_cast<int>(tv_now.tv_usec));
 
     return buff;
 }
@@ -29,6 +29,22 @@ public:
     // 得到当前的微妙
     static int64_t GetCurrentUS();
 
+    // 得到单调时钟(CLOCK_MONOTONIC)的毫秒，不受系统时间调整影响，超时和耗时都应使用单调时钟
+    static int64_t GetMonotonicMS();
+
+    // 得到单调时钟的微秒
+    static int64_t GetMonotonicUS();
+
+    // 刷新本线程缓存的单调时钟，由主循环在每次Update开始时调用
+    static void UpdateCachedTime();
+
+    // 得到本线程缓存的单调时钟(ms)，精度为一次主循环，省去逐消息读时钟
+    // 本线程从未调用UpdateCachedTime时直接读时钟；需要精确耗时的地方用GetMonotonicMS
+    static int64_t GetCachedMS();
+
+    // 得到本线程缓存的单调时钟(us)
+    static int64_t GetCachedUS();
+
     // 得到字符串形式的时间 格式：2015-04-10 10:11:12
     static std::string GetStringTime();
 
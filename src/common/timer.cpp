@@ -71,7 +71,7 @@ int64_t FdTimer::StartTimer(uint32_t timeout_ms, const TimeoutCallback& cb) {
     }
 
     // 创建timer fd
-    int32_t fd = timerfd_create(CLOCK_REALTIME, 0);
+    int32_t fd = timerfd_create(CLOCK_MONOTONIC, 0);
     if (fd < 0) {
         _LOG_LAST_ERROR("timerfd_create failed(%s)", strerror(errno));
         return kSYSTEM_ERROR;
@@ -201,7 +201,7 @@ int64_t SequenceTimer::StartTimer(uint32_t timeout_ms, const TimeoutCallback& cb
     cxx::shared_ptr<TimerItem> item(new TimerItem);
     item->stoped   = false;
     item->id       = m_timer_seqid;
-    item->timeout  = TimeUtility::GetCurrentMS() + timeout_ms;
+    item->timeout  = TimeUtility::GetCachedMS() + timeout_ms;
     item->cb       = cb;
 
     m_timers[timeout_ms].push_back(item);
@@ -226,7 +226,7 @@ int32_t SequenceTimer::StopTimer(int64_t timer_id) {
 
 int32_t SequenceTimer::Update() {
     int32_t num = 0;
-    int64_t now = TimeUtility::GetCurrentMS();
+    int64_t now = TimeUtility::GetCachedMS();
     int32_t ret = 0;
     uint32_t old_timeout = 0;
     uint32_t timer_map_size = m_timers.size();
@@ -282,5 +282,35 @@ int32_t SequenceTimer::Update() {
     return num;
 }
 
+int64_t SequenceTimer::GetNextTimeoutMS() {
+    if (m_id_2_timer.empty()) {
+        return -1;
+    }
+
+    int64_t next_timeout = -1;
+    cxx::unordered_map<uint32_t, std::list<cxx::shared_ptr<TimerItem> > >::iterator mit =
+        m_timers.begin();
+    for (; mit != m_timers.end(); ++mit) {
+        std::list<cxx::shared_ptr<TimerItem> >& timer_list = mit->second;
+        // 顺便清理队列头部已停止的定时器
+        while (!timer_list.empty() && timer_list.front()->stoped) {
+            timer_list.pop_front();
+        }
+        if (timer_list.empty()) {
+            continue;
+        }
+        if (next_timeout < 0 || timer_list.front()->timeout < next_timeout) {
+            next_timeout = timer_list.front()->timeout;
+        }
+    }
+
+    if (next_timeout < 0) {
+        return -1;
+    }
+
+    int64_t now = TimeUtility::GetMonotonicMS();
+    return next_timeout > now ? next_timeout - now : 0;
+}
+
 }  // namespace pebble
 
@@ -17,6 +17,7 @@
 #include <list>
 
 #include "common/error.h"
+#include "common/function.h"
 #include "common/platform.h"
 
 
@@ -56,7 +57,7 @@ typedef enum {
 /// @return >0 使用返回值作为新的超时时间(ms)重启定时器
 /// @note 超时回调中不能有阻塞操作
 /// @see OnTimerCallbackReturnCode
-typedef cxx::function<int32_t()> TimeoutCallback;
+typedef Function<int32_t()> TimeoutCallback;
 
 
 /// @brief 定时器接口
@@ -86,6 +87,11 @@ public:
 
     /// @brief 获取定时器数目
     virtual int64_t GetTimerNum() { return 0; }
+
+    /// @brief 获取距离最近一个定时器超时的时间，供事件循环决定最长等待时间
+    /// @return <0 无定时器
+    /// @return >=0 最近一个定时器超时的剩余时间，单位为毫秒，已超时返回0
+    virtual int64_t GetNextTimeoutMS() { return -1; }
 };
 
 #if 0
@@ -171,6 +177,10 @@ public:
         return m_id_2_timer.size();
     }
 
+    /// @see Timer::GetNextTimeoutMS
+    /// @note 每个超时时间的列表按超时先后有序，只需比较各列表头，复杂度为O(超时时间种类数)
+    virtual int64_t GetNextTimeoutMS();
+
 private:
     struct TimerItem {
         TimerItem() {
@@ -0,0 +1,464 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#include <string.h>
+
+#include "common/log.h"
+#include "common/time_utility.h"
+#include "extension/redis/redis_cache.h"
+#include "extension/redis/redis_co.h"
+#include "extension/redis/redis_pool.h"
+
+
+namespace pebble {
+
+// 每个缓存项除key和value外的估算开销(节点、链表、哈希表)
+static const size_t ENTRY_OVERHEAD_BYTES = 128;
+
+static const char KEYSPACE_PREFIX[] = "__keyspace@";
+
+struct RedisCacheEntry {
+    RedisCacheEntry() : _exists(false), _protected(false), _expire_ms(0), _bytes(0) {}
+
+    std::string _key;
+    std::string _value;
+    bool        _exists;    // false为负缓存
+    bool        _protected; // 所在的段
+    int64_t     _expire_ms;
+    size_t      _bytes;
+    std::list<RedisCacheEntry*>::iterator _pos;
+};
+
+/// 一次进行中的回源，发起的协程执行回源，其他协程挂在_waiters上等待结果
+struct RedisCacheFlight {
+    RedisCacheFlight() : _done(false), _invalidated(false), _ret(0), _exists(false) {}
+
+    bool        _done;
+    bool        _invalidated;   // 回源期间被失效，结果不写入缓存
+    int         _ret;
+    bool        _exists;
+    std::string _value;
+    std::vector<int64_t> _waiters;
+};
+
+static int ParseGetReply(redisReply* reply, std::string* value, bool* exists) {
+    if (reply == NULL) {
+        return -1;
+    }
+    if (reply->type == REDIS_REPLY_STRING) {
+        value->assign(reply->str, reply->len);
+        *exists = true;
+        return 0;
+    }
+    if (reply->type == REDIS_REPLY_NIL) {
+        value->clear();
+        *exists = false;
+        return 0;
+    }
+    PLOG_ERROR_N_EVERY_SECOND(1, "GET reply type %d: %.*s", reply->type,
+        reply->type == REDIS_REPLY_ERROR ? reply->len : 0, reply->str);
+    return -1;
+}
+
+static int PoolGet(RedisPool* pool, const std::string& key, std::string* value, bool* exists) {
+    return ParseGetReply(pool->Command("GET %b", key.data(), key.size()), value, exists);
+}
+
+static int CoroutineGet(RedisCoroutine* redis, redisAsyncContext* ac,
+    const std::string& key, std::string* value, bool* exists) {
+    return ParseGetReply(redis->RedisAsyncCommand(ac, "GET %b", key.data(), key.size()),
+        value, exists);
+}
+
+static void KeyspaceCallback(redisAsyncContext* ac, void* r, void* privdata) {
+    redisReply* reply = (redisReply*)r;
+    if (reply == NULL || privdata == NULL) {
+        return;
+    }
+    // 订阅成功的回复为 psubscribe pattern count，通知为 pmessage pattern channel event
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 4
+        || reply->element[0]->type != REDIS_REPLY_STRING
+        || strcmp(reply->element[0]->str, "pmessage") != 0
+        || reply->element[2]->type != REDIS_REPLY_STRING) {
+        return;
+    }
+    RedisCache* cache = (RedisCache*)privdata;
+    cache->OnKeyspaceEvent(std::string(reply->element[2]->str, reply->element[2]->len));
+}
+
+RedisCache::RedisCache() {
+    m_co_sche             = NULL;
+    m_protected_max_bytes = 0;
+    m_probation_bytes     = 0;
+    m_protected_bytes     = 0;
+}
+
+RedisCache::~RedisCache() {
+    Clear();
+    m_co_sche = NULL;
+}
+
+int RedisCache::Init(CoroutineSchedule* co_sche, const RedisCacheLoader& loader,
+    const RedisCacheOptions& options) {
+    if (co_sche == NULL || !loader || options._max_bytes == 0
+        || options._protected_percent > 100 || options._ttl_ms <= 0
+        || options._negative_ttl_ms < 0 || options._wait_timeout_ms <= 0) {
+        PLOG_ERROR("param invalid co_sche=%p, max_bytes=%lu, protected_percent=%u, ttl_ms=%ld, "
+            "negative_ttl_ms=%ld, wait_timeout_ms=%d", co_sche, options._max_bytes,
+            options._protected_percent, options._ttl_ms, options._negative_ttl_ms,
+            options._wait_timeout_ms);
+        return kREDIS_CACHE_INVALID_PARAM;
+    }
+
+    m_co_sche             = co_sche;
+    m_loader              = loader;
+    m_options             = options;
+    m_protected_max_bytes = options._max_bytes / 100 * options._protected_percent;
+
+    return 0;
+}
+
+RedisCacheLoader RedisCache::PoolLoader(RedisPool* pool) {
+    return cxx::bind(PoolGet, pool, cxx::placeholders::_1,
+        cxx::placeholders::_2, cxx::placeholders::_3);
+}
+
+RedisCacheLoader RedisCache::CoroutineLoader(RedisCoroutine* redis, redisAsyncContext* ac) {
+    return cxx::bind(CoroutineGet, redis, ac, cxx::placeholders::_1,
+        cxx::placeholders::_2, cxx::placeholders::_3);
+}
+
+int RedisCache::Update() {
+    if (m_done_flights.empty()) {
+        return 0;
+    }
+
+    // 被唤醒的协程可能再次回源并同步失败，先换出
+    std::vector<cxx::shared_ptr<RedisCacheFlight> > done_flights;
+    done_flights.swap(m_done_flights);
+
+    int num = 0;
+    std::vector<int64_t> waiters;
+    for (size_t i = 0; i < done_flights.size(); ++i) {
+        waiters.clear();
+        waiters.swap(done_flights[i]->_waiters);
+        for (size_t j = 0; j < waiters.size(); ++j) {
+            int ret = m_co_sche->Resume(waiters[j]);
+            PLOG_IF_ERROR(ret != 0, "resume %ld failed(%d)", waiters[j], ret);
+            ++num;
+        }
+    }
+    return num;
+}
+
+int RedisCache::Get(const std::string& key, std::string* value, bool* exists) {
+    if (value == NULL) {
+        return kREDIS_CACHE_INVALID_PARAM;
+    }
+    if (m_co_sche == NULL || m_co_sche->CurrentTaskId() == INVALID_CO_ID) {
+        PLOG_ERROR("not in coroutine");
+        return kREDIS_CACHE_NOT_IN_COROUTINE;
+    }
+
+    RedisCacheEntry* entry = Lookup(key, TimeUtility::GetCachedMS());
+    if (entry != NULL) {
+        ++m_stat._hits;
+        if (!entry->_exists) {
+            ++m_stat._negative_hits;
+        }
+        value->assign(entry->_value);
+        if (exists != NULL) {
+            *exists = entry->_exists;
+        }
+        return 0;
+    }
+
+    FlightMap::iterator it = m_flights.find(key);
+    if (it != m_flights.end()) {
+        ++m_stat._collapsed;
+        // 先持有，回源结束后flight会从m_flights中移除
+        cxx::shared_ptr<RedisCacheFlight> flight = it->second;
+        return WaitFlight(flight, value, exists);
+    }
+
+    return Load(key, value, exists);
+}
+
+void RedisCache::Set(const std::string& key, const std::string& value, int64_t ttl_ms) {
+    if (ttl_ms <= 0) {
+        ttl_ms = m_options._ttl_ms;
+    }
+    Insert(key, value, true, TimeUtility::GetCachedMS() + ttl_ms);
+
+    // 进行中的回源可能读到写之前的值
+    FlightMap::iterator it = m_flights.find(key);
+    if (it != m_flights.end()) {
+        it->second->_invalidated = true;
+    }
+}
+
+void RedisCache::Invalidate(const std::string& key) {
+    ++m_stat._invalidations;
+
+    EntryMap::iterator eit = m_entries.find(key);
+    if (eit != m_entries.end()) {
+        Remove(eit->second);
+    }
+
+    FlightMap::iterator fit = m_flights.find(key);
+    if (fit != m_flights.end()) {
+        fit->second->_invalidated = true;
+    }
+}
+
+void RedisCache::Clear() {
+    for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+        delete it->second;
+    }
+    m_entries.clear();
+    m_probation.clear();
+    m_protected.clear();
+    m_probation_bytes = 0;
+    m_protected_bytes = 0;
+
+    for (FlightMap::iterator it = m_flights.begin(); it != m_flights.end(); ++it) {
+        it->second->_invalidated = true;
+    }
+}
+
+int RedisCache::SubscribeKeyspace(redisAsyncContext* ac, int db) {
+    if (ac == NULL || db < 0) {
+        PLOG_ERROR("param invalid ac=%p, db=%d", ac, db);
+        return kREDIS_CACHE_INVALID_PARAM;
+    }
+
+    int ret = redisAsyncCommand(ac, KeyspaceCallback, this, "PSUBSCRIBE __keyspace@%d__:*", db);
+    if (ret != REDIS_OK) {
+        PLOG_ERROR("redisAsyncCommand PSUBSCRIBE failed(%d)", ret);
+        return kREDIS_CACHE_LOAD_FAILED;
+    }
+    return 0;
+}
+
+void RedisCache::OnKeyspaceEvent(const std::string& channel) {
+    if (channel.compare(0, sizeof(KEYSPACE_PREFIX) - 1, KEYSPACE_PREFIX) != 0) {
+        return;
+    }
+    size_t pos = channel.find("__:", sizeof(KEYSPACE_PREFIX) - 1);
+    if (pos == std::string::npos) {
+        return;
+    }
+    Invalidate(channel.substr(pos + 3));
+}
+
+void RedisCache::GetResourceUsed(cxx::unordered_map<std::string, int64_t>* resource_info) {
+    if (resource_info == NULL) {
+        return;
+    }
+
+    uint64_t hits   = m_stat._hits - m_last_stat._hits;
+    uint64_t misses = m_stat._misses - m_last_stat._misses;
+    uint64_t total  = hits + misses + (m_stat._collapsed - m_last_stat._collapsed);
+    uint64_t load_us = m_stat._load_us - m_last_stat._load_us;
+
+    const std::string& name = m_options._name;
+    (*resource_info)[name + "_hit(%)"]    = total > 0 ? hits * 100 / total : 0;
+    (*resource_info)[name + "_load(us)"]  = misses > 0 ? load_us / misses : 0;
+    (*resource_info)[name + "_load_max(us)"] = m_stat._max_load_us;
+    (*resource_info)[name + "_keys"]      = m_entries.size();
+    (*resource_info)[name + "_mem(K)"]    = Bytes() / 1024;
+    (*resource_info)[name + "_evictions"] = m_stat._evictions - m_last_stat._evictions;
+
+    // 最大值按周期统计
+    m_stat._max_load_us = 0;
+    m_last_stat = m_stat;
+}
+
+RedisCacheEntry* RedisCache::Lookup(const std::string& key, int64_t now) {
+    EntryMap::iterator it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        return NULL;
+    }
+
+    RedisCacheEntry* entry = it->second;
+    if (entry->_expire_ms <= now) {
+        Remove(entry);
+        return NULL;
+    }
+
+    if (entry->_protected) {
+        m_protected.splice(m_protected.begin(), m_protected, entry->_pos);
+        return entry;
+    }
+
+    // 试用段中再次被访问，晋升到保护段，保护段超出部分降回试用段头部
+    m_probation.erase(entry->_pos);
+    m_probation_bytes -= entry->_bytes;
+    entry->_protected = true;
+    entry->_pos = m_protected.insert(m_protected.begin(), entry);
+    m_protected_bytes += entry->_bytes;
+
+    while (m_protected_bytes > m_protected_max_bytes && m_protected.size() > 1) {
+        RedisCacheEntry* demoted = m_protected.back();
+        m_protected.pop_back();
+        m_protected_bytes -= demoted->_bytes;
+        demoted->_protected = false;
+        demoted->_pos = m_probation.insert(m_probation.begin(), demoted);
+        m_probation_bytes += demoted->_bytes;
+    }
+
+    return entry;
+}
+
+void RedisCache::Insert(const std::string& key, const std::string& value, bool exists,
+    int64_t expire_ms) {
+    size_t bytes = EntryBytes(key, value);
+    if (bytes > m_options._max_bytes) {
+        // 单项超过容量时不缓存，同时去掉旧值
+        EntryMap::iterator it = m_entries.find(key);
+        if (it != m_entries.end()) {
+            Remove(it->second);
+        }
+        return;
+    }
+
+    RedisCacheEntry* entry = NULL;
+    EntryMap::iterator it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        entry = it->second;
+        EntryList& list = entry->_protected ? m_protected : m_probation;
+        size_t& list_bytes = entry->_protected ? m_protected_bytes : m_probation_bytes;
+        list.splice(list.begin(), list, entry->_pos);
+        list_bytes = list_bytes - entry->_bytes + bytes;
+    } else {
+        entry = new RedisCacheEntry();
+        entry->_key = key;
+        entry->_pos = m_probation.insert(m_probation.begin(), entry);
+        m_probation_bytes += bytes;
+        m_entries[key] = entry;
+    }
+
+    entry->_value.assign(value);
+    entry->_exists    = exists;
+    entry->_expire_ms = expire_ms;
+    entry->_bytes     = bytes;
+
+    Evict();
+}
+
+void RedisCache::Remove(RedisCacheEntry* entry) {
+    if (entry->_protected) {
+        m_protected.erase(entry->_pos);
+        m_protected_bytes -= entry->_bytes;
+    } else {
+        m_probation.erase(entry->_pos);
+        m_probation_bytes -= entry->_bytes;
+    }
+    m_entries.erase(entry->_key);
+    delete entry;
+}
+
+void RedisCache::Evict() {
+    while (Bytes() > m_options._max_bytes) {
+        // 优先淘汰试用段尾部，试用段为空时才淘汰保护段
+        EntryList& list = m_probation.empty() ? m_protected : m_probation;
+        if (list.empty()) {
+            break;
+        }
+        Remove(list.back());
+        ++m_stat._evictions;
+    }
+}
+
+int RedisCache::Load(const std::string& key, std::string* value, bool* exists) {
+    cxx::shared_ptr<RedisCacheFlight> flight(new RedisCacheFlight());
+    m_flights[key] = flight;
+    ++m_stat._misses;
+
+    int64_t begin_us = TimeUtility::GetMonotonicUS();
+    int ret = m_loader(key, &flight->_value, &flight->_exists);
+    uint64_t cost_us = TimeUtility::GetMonotonicUS() - begin_us;
+    m_stat._load_us += cost_us;
+    if (cost_us > m_stat._max_load_us) {
+        m_stat._max_load_us = cost_us;
+    }
+
+    // Clear后同key可能已经有新的回源，只移除自己
+    FlightMap::iterator it = m_flights.find(key);
+    if (it != m_flights.end() && it->second == flight) {
+        m_flights.erase(it);
+    }
+
+    flight->_done = true;
+    if (ret != 0) {
+        ++m_stat._load_failed;
+        flight->_ret = kREDIS_CACHE_LOAD_FAILED;
+    } else if (!flight->_invalidated) {
+        if (flight->_exists) {
+            Insert(key, flight->_value, true, TimeUtility::GetCachedMS() + m_options._ttl_ms);
+        } else if (m_options._negative_ttl_ms > 0) {
+            Insert(key, "", false, TimeUtility::GetCachedMS() + m_options._negative_ttl_ms);
+        }
+    }
+
+    if (!flight->_waiters.empty()) {
+        m_done_flights.push_back(flight);
+    }
+
+    if (flight->_ret != 0) {
+        return flight->_ret;
+    }
+    value->assign(flight->_value);
+    if (exists != NULL) {
+        *exists = flight->_exists;
+    }
+    return 0;
+}
+
+int RedisCache::WaitFlight(const cxx::shared_ptr<RedisCacheFlight>& flight,
+    std::string* value, bool* exists) {
+    int64_t co_id = m_co_sche->CurrentTaskId();
+    flight->_waiters.push_back(co_id);
+
+    int ret = m_co_sche->Yield(m_options._wait_timeout_ms);
+
+    // 超时返回时自己还在等待列表中，需要移除，避免之后被Update错误唤醒
+    std::vector<int64_t>& waiters = flight->_waiters;
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        if (waiters[i] == co_id) {
+            waiters.erase(waiters.begin() + i);
+            break;
+        }
+    }
+
+    if (!flight->_done) {
+        PLOG_ERROR("wait load timeout(%d)", ret);
+        return kREDIS_CACHE_WAIT_TIMEOUT;
+    }
+    if (flight->_ret != 0) {
+        return flight->_ret;
+    }
+    value->assign(flight->_value);
+    if (exists != NULL) {
+        *exists = flight->_exists;
+    }
+    return 0;
+}
+
+size_t RedisCache::EntryBytes(const std::string& key, const std::string& value) {
+    // key在哈希表和缓存项中各存一份
+    return key.size() * 2 + value.size() + ENTRY_OVERHEAD_BYTES;
+}
+
+} // namespace pebble
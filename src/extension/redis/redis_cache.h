@@ -0,0 +1,193 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#ifndef PEBBLE_EXTENSION_REDIS_CACHE_H
+#define PEBBLE_EXTENSION_REDIS_CACHE_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include "async.h"
+#include "common/coroutine.h"
+#include "common/platform.h"
+
+// pebble 发布包本身不提供redis的库
+
+namespace pebble {
+
+class RedisCoroutine;
+class RedisPool;
+struct RedisCacheEntry;
+struct RedisCacheFlight;
+
+typedef enum {
+    kREDIS_CACHE_INVALID_PARAM     = -1,
+    kREDIS_CACHE_NOT_IN_COROUTINE  = -2,
+    kREDIS_CACHE_LOAD_FAILED       = -3,  // 回源失败(redis错误、超时、连接断开)
+    kREDIS_CACHE_WAIT_TIMEOUT      = -4,  // 等待同key的回源超时
+} RedisCacheErrorCode;
+
+/// @brief 回源函数，在协程中执行
+/// @param value key存在时返回其值
+/// @param exists 返回key是否存在
+/// @return 0成功，非0失败
+typedef cxx::function<int(const std::string& key, std::string* value, bool* exists)> RedisCacheLoader;
+
+struct RedisCacheOptions {
+    RedisCacheOptions()
+        : _max_bytes(64 * 1024 * 1024), _protected_percent(80), _ttl_ms(60000),
+          _negative_ttl_ms(5000), _wait_timeout_ms(3000), _name("redis_cache") {}
+
+    /// 缓存占用内存上限(key、value及节点开销)
+    size_t _max_bytes;
+    /// 保护段占总容量的百分比，被再次访问的key从试用段晋升到保护段，淘汰只从试用段发生，
+    /// 一次性扫描的key不会把热点挤出缓存
+    uint32_t _protected_percent;
+    /// 默认过期时间，单位ms
+    int64_t _ttl_ms;
+    /// 不存在的key的缓存时间(负缓存)，单位ms，0表示不缓存不存在的key
+    int64_t _negative_ttl_ms;
+    /// 等待同key回源的最长时间，应大于回源本身的超时，单位ms
+    int32_t _wait_timeout_ms;
+    /// 统计项名字前缀
+    std::string _name;
+};
+
+/// @brief 缓存统计，计数从Init开始累计
+struct RedisCacheStat {
+    RedisCacheStat()
+        : _hits(0), _negative_hits(0), _misses(0), _collapsed(0), _load_failed(0),
+          _evictions(0), _invalidations(0), _load_us(0), _max_load_us(0) {}
+
+    uint64_t _hits;           // 命中(含负缓存命中)
+    uint64_t _negative_hits;  // 负缓存命中
+    uint64_t _misses;         // 回源次数
+    uint64_t _collapsed;      // 未命中但合并到同key进行中回源的请求数
+    uint64_t _load_failed;
+    uint64_t _evictions;
+    uint64_t _invalidations;
+    uint64_t _load_us;        // 回源总耗时
+    uint64_t _max_load_us;
+};
+
+/// @brief RedisCoroutine/RedisPool前的进程内读缓存(read-through)
+/// @note 未命中时由第一个协程回源，同时请求同一key的其他协程等待其结果，
+///     同一key同一时刻最多一条redis命令(single-flight)
+/// @note 容量按字节限制，分段LRU淘汰；每个key有独立的过期时间，不存在的key做负缓存
+/// @note 接口Get必须在协程中调用；Update需要在主循环中每个tick调用，用于唤醒等待回源的协程
+///     (协程中不能直接resume其他协程)
+class RedisCache {
+public:
+    RedisCache();
+    ~RedisCache();
+
+    /// @param co_sche pebble提供的协程调度器
+    /// @param loader 回源函数，可用PoolLoader/CoroutineLoader生成
+    /// @return 0成功，非0失败
+    int Init(CoroutineSchedule* co_sche, const RedisCacheLoader& loader,
+             const RedisCacheOptions& options = RedisCacheOptions());
+
+    /// @brief 以RedisPool的GET命令回源
+    static RedisCacheLoader PoolLoader(RedisPool* pool);
+
+    /// @brief 以RedisCoroutine在指定连接上的GET命令回源
+    static RedisCacheLoader CoroutineLoader(RedisCoroutine* redis, redisAsyncContext* ac);
+
+    /// @brief 唤醒已拿到回源结果的等待协程，需要在主循环中每个tick调用
+    /// @return 本次唤醒的协程数
+    int Update();
+
+    /// @brief 读取key，未命中时回源，必须在协程中执行
+    /// @param value key存在时返回其值
+    /// @param exists 可选，返回key是否存在，为NULL时不存在的key返回空串
+    /// @return 0成功，非0失败 @see RedisCacheErrorCode
+    int Get(const std::string& key, std::string* value, bool* exists = NULL);
+
+    /// @brief 直接写入缓存(如业务写redis后同步更新本地)，不访问redis
+    /// @param ttl_ms 过期时间，<=0时使用默认过期时间
+    void Set(const std::string& key, const std::string& value, int64_t ttl_ms = 0);
+
+    /// @brief 失效key，正在进行的同key回源结果也不会写入缓存
+    void Invalidate(const std::string& key);
+
+    /// @brief 清空缓存
+    void Clear();
+
+    /// @brief 订阅redis的keyspace通知，key被修改、删除或过期时失效本地缓存
+    /// @param ac 专用于订阅的连接(订阅后该连接不能再执行普通命令)，由使用者驱动收发
+    /// @param db 订阅的库
+    /// @return 0成功，非0失败
+    /// @note redis需要开启通知，如 CONFIG SET notify-keyspace-events Kgx$
+    int SubscribeKeyspace(redisAsyncContext* ac, int db = 0);
+
+    /// @brief 处理一条keyspace通知(如业务自行订阅)，channel形如 __keyspace@0__:key
+    void OnKeyspaceEvent(const std::string& channel);
+
+    /// @brief 获取统计计数
+    const RedisCacheStat& GetStat() const { return m_stat; }
+
+    /// @brief 获取缓存的key数和占用内存
+    size_t Size() const { return m_entries.size(); }
+    size_t Bytes() const { return m_probation_bytes + m_protected_bytes; }
+
+    /// @brief 获取上次调用以来的命中率、回源延时及当前内存，格式同Processor::GetResourceUsed
+    /// @note 可定时逐项写入PebbleServer::GetStat()->AddResourceItem导出到统计
+    void GetResourceUsed(cxx::unordered_map<std::string, int64_t>* resource_info);
+
+private:
+    typedef std::list<RedisCacheEntry*> EntryList;
+    typedef cxx::unordered_map<std::string, RedisCacheEntry*> EntryMap;
+    typedef cxx::unordered_map<std::string, cxx::shared_ptr<RedisCacheFlight> > FlightMap;
+
+    // 查找未过期的缓存项，命中时调整其在分段LRU中的位置
+    RedisCacheEntry* Lookup(const std::string& key, int64_t now);
+
+    void Insert(const std::string& key, const std::string& value, bool exists, int64_t expire_ms);
+
+    void Remove(RedisCacheEntry* entry);
+
+    // 淘汰直到不超过容量
+    void Evict();
+
+    int Load(const std::string& key, std::string* value, bool* exists);
+
+    int WaitFlight(const cxx::shared_ptr<RedisCacheFlight>& flight,
+                   std::string* value, bool* exists);
+
+    static size_t EntryBytes(const std::string& key, const std::string& value);
+
+private:
+    CoroutineSchedule* m_co_sche;
+    RedisCacheLoader m_loader;
+    RedisCacheOptions m_options;
+    size_t m_protected_max_bytes;
+
+    EntryMap m_entries;
+    EntryList m_probation;
+    EntryList m_protected;
+    size_t m_probation_bytes;
+    size_t m_protected_bytes;
+
+    // 进行中的回源
+    FlightMap m_flights;
+    // 已完成、等待Update唤醒等待者的回源
+    std::vector<cxx::shared_ptr<RedisCacheFlight> > m_done_flights;
+
+    RedisCacheStat m_stat;
+    RedisCacheStat m_last_stat;
+};
+
+} // namespace pebble
+
+#endif // PEBBLE_EXTENSION_REDIS_CACHE_H
@@ -0,0 +1,516 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#include <poll.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/log.h"
+#include "common/time_utility.h"
+#include "extension/redis/redis_pool.h"
+
+
+namespace pebble {
+
+struct RedisConnection {
+    RedisConnection() : _pool(NULL), _ac(NULL), _events(0), _connected(false), _next_connect_ms(0) {}
+
+    RedisPool*          _pool;
+    redisAsyncContext*  _ac;        // NULL表示未连接，等待重连
+    int16_t             _events;    // hiredis关注的poll事件
+    bool                _connected;
+    int64_t             _next_connect_ms;
+};
+
+/// 每次Command/Exec一个上下文，回包直接交给发起的协程，不经过共享的成员变量
+struct RedisPoolCtx {
+    RedisPoolCtx() : _co_id(INVALID_CO_ID), _wait_num(0), _reply_idx(0),
+        _reply(NULL), _pipeline(NULL) {}
+
+    int64_t         _co_id;         // INVALID_CO_ID表示等待方已超时离开，由最后一个回调释放
+    uint32_t        _wait_num;      // 未回包的命令数
+    uint32_t        _reply_idx;     // 下一个回包在pipeline中的下标，同一连接上回包按序到达
+    redisReply*     _reply;         // 单条命令的回包，引用hiredis的对象，回调返回后即释放
+    RedisPipeline*  _pipeline;      // 批量命令，回包拷贝到pipeline中
+};
+
+static redisReply* DupReply(const redisReply* reply) {
+    redisReply* dup = (redisReply*)calloc(1, sizeof(redisReply));
+    dup->type     = reply->type;
+    dup->integer  = reply->integer;
+    if (reply->str != NULL) {
+        dup->len = reply->len;
+        dup->str = (char*)malloc(reply->len + 1);
+        memcpy(dup->str, reply->str, reply->len);
+        dup->str[reply->len] = '\0';
+    }
+    if (reply->element != NULL) {
+        dup->elements = reply->elements;
+        dup->element  = (redisReply**)calloc(reply->elements, sizeof(redisReply*));
+        for (size_t i = 0; i < reply->elements; i++) {
+            dup->element[i] = DupReply(reply->element[i]);
+        }
+    }
+    return dup;
+}
+
+static void RedisPoolCallbackFn(redisAsyncContext* ac, void* reply, void* privdata) {
+    RedisConnection* conn = (RedisConnection*)ac->data;
+    conn->_pool->OnReply((RedisPoolCtx*)privdata, (redisReply*)reply);
+}
+
+static void RedisPoolConnectFn(const redisAsyncContext* ac, int status) {
+    RedisConnection* conn = (RedisConnection*)ac->data;
+    conn->_pool->OnConnect(conn, status);
+}
+
+static void RedisPoolDisconnectFn(const redisAsyncContext* ac, int status) {
+    RedisConnection* conn = (RedisConnection*)ac->data;
+    conn->_pool->OnDisconnect(conn, status);
+}
+
+// hiredis事件钩子，只记录关注的事件，由RedisPool::Update统一poll
+static void RedisPoolAddRead(void* privdata) {
+    ((RedisConnection*)privdata)->_events |= POLLIN;
+}
+
+static void RedisPoolDelRead(void* privdata) {
+    ((RedisConnection*)privdata)->_events &= ~POLLIN;
+}
+
+static void RedisPoolAddWrite(void* privdata) {
+    ((RedisConnection*)privdata)->_events |= POLLOUT;
+}
+
+static void RedisPoolDelWrite(void* privdata) {
+    ((RedisConnection*)privdata)->_events &= ~POLLOUT;
+}
+
+// 连接释放时(断开、连接失败或主动释放)调用，之后等待重连
+static void RedisPoolCleanup(void* privdata) {
+    RedisConnection* conn = (RedisConnection*)privdata;
+    conn->_ac        = NULL;
+    conn->_events    = 0;
+    conn->_connected = false;
+    conn->_next_connect_ms = TimeUtility::GetCachedMS() + RedisPool::RECONNECT_INTERVAL_MS;
+}
+
+RedisPipeline::~RedisPipeline() {
+    Clear();
+}
+
+int RedisPipeline::AddCommand(const char* format, ...) {
+    char* cmd = NULL;
+    va_list ap;
+    va_start(ap, format);
+    int len = redisvFormatCommand(&cmd, format, ap);
+    va_end(ap);
+    if (len < 0) {
+        PLOG_ERROR("format command failed(%d)", len);
+        return -1;
+    }
+    m_cmds.push_back(std::string(cmd, len));
+    free(cmd);
+    return 0;
+}
+
+int RedisPipeline::AddCommandArgv(int argc, const char** argv, const size_t* argvlen) {
+    char* cmd = NULL;
+    int len = redisFormatCommandArgv(&cmd, argc, argv, argvlen);
+    if (len < 0) {
+        PLOG_ERROR("format command failed(%d)", len);
+        return -1;
+    }
+    m_cmds.push_back(std::string(cmd, len));
+    free(cmd);
+    return 0;
+}
+
+redisReply* RedisPipeline::GetReply(size_t idx) const {
+    return idx < m_replies.size() ? m_replies[idx] : NULL;
+}
+
+void RedisPipeline::Clear() {
+    for (std::vector<redisReply*>::iterator it = m_replies.begin(); it != m_replies.end(); ++it) {
+        if (*it != NULL) {
+            freeReplyObject(*it);
+        }
+    }
+    m_replies.clear();
+    m_cmds.clear();
+}
+
+RedisPool::RedisPool() {
+    m_co_sche    = NULL;
+    m_port       = 0;
+    m_timeout_ms = DEFAULT_REDIS_TIMEOUT_MS;
+    m_next_conn  = 0;
+}
+
+RedisPool::~RedisPool() {
+    for (std::vector<RedisConnection*>::iterator it = m_conns.begin(); it != m_conns.end(); ++it) {
+        // 释放时未完成的命令以NULL回包回调
+        if ((*it)->_ac != NULL) {
+            redisAsyncFree((*it)->_ac);
+        }
+        delete *it;
+    }
+    m_conns.clear();
+}
+
+int RedisPool::Init(CoroutineSchedule* co_sche, const std::string& ip, int port,
+    int conn_num, int timeout_ms) {
+    if (co_sche == NULL || ip.empty() || port <= 0 || conn_num <= 0 || timeout_ms <= 0) {
+        PLOG_ERROR("param invalid co_sche=%p, ip=%s, port=%d, conn_num=%d, timeout_ms=%d",
+            co_sche, ip.c_str(), port, conn_num, timeout_ms);
+        return -1;
+    }
+    if (!m_conns.empty()) {
+        PLOG_ERROR("already inited");
+        return -1;
+    }
+
+    m_co_sche    = co_sche;
+    m_ip         = ip;
+    m_port       = port;
+    m_timeout_ms = timeout_ms;
+
+    for (int i = 0; i < conn_num; i++) {
+        RedisConnection* conn = new RedisConnection();
+        conn->_pool = this;
+        m_conns.push_back(conn);
+        Connect(conn);
+    }
+
+    return 0;
+}
+
+int RedisPool::Connect(RedisConnection* conn) {
+    redisAsyncContext* ac = redisAsyncConnect(m_ip.c_str(), m_port);
+    if (ac == NULL || ac->err) {
+        PLOG_ERROR("connect redis %s:%d failed(%s)", m_ip.c_str(), m_port,
+            ac ? ac->errstr : "alloc failed");
+        if (ac != NULL) {
+            redisAsyncFree(ac);
+        }
+        conn->_next_connect_ms = TimeUtility::GetCachedMS() + RECONNECT_INTERVAL_MS;
+        return -1;
+    }
+
+    conn->_ac     = ac;
+    conn->_events = 0;
+    ac->data        = conn;
+    ac->ev.data     = conn;
+    ac->ev.addRead  = RedisPoolAddRead;
+    ac->ev.delRead  = RedisPoolDelRead;
+    ac->ev.addWrite = RedisPoolAddWrite;
+    ac->ev.delWrite = RedisPoolDelWrite;
+    ac->ev.cleanup  = RedisPoolCleanup;
+    redisAsyncSetConnectCallback(ac, RedisPoolConnectFn);
+    redisAsyncSetDisconnectCallback(ac, RedisPoolDisconnectFn);
+
+    // 非阻塞连接，连接完成前发出的命令缓存在连接上
+    RedisPoolAddWrite(conn);
+    return 0;
+}
+
+int RedisPool::Update() {
+    int64_t now = TimeUtility::GetCachedMS();
+    std::vector<pollfd> fds;
+    std::vector<RedisConnection*> polled;
+    fds.reserve(m_conns.size());
+    polled.reserve(m_conns.size());
+
+    for (std::vector<RedisConnection*>::iterator it = m_conns.begin(); it != m_conns.end(); ++it) {
+        RedisConnection* conn = *it;
+        if (conn->_ac == NULL) {
+            if (now >= conn->_next_connect_ms) {
+                Connect(conn);
+            }
+            continue;
+        }
+        if (conn->_events == 0) {
+            continue;
+        }
+        pollfd pfd;
+        pfd.fd      = conn->_ac->c.fd;
+        pfd.events  = conn->_events;
+        pfd.revents = 0;
+        fds.push_back(pfd);
+        polled.push_back(conn);
+    }
+
+    if (fds.empty() || poll(&fds[0], fds.size(), 0) <= 0) {
+        return 0;
+    }
+
+    int num = 0;
+    for (size_t i = 0; i < fds.size(); i++) {
+        RedisConnection* conn = polled[i];
+        // 本tick内缓存的所有命令一次write发出
+        if ((fds[i].revents & POLLOUT) && conn->_ac != NULL) {
+            redisAsyncHandleWrite(conn->_ac);
+            num++;
+        }
+        // 回调中会唤醒协程，连接可能在回调中断开释放
+        if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && conn->_ac != NULL) {
+            redisAsyncHandleRead(conn->_ac);
+            num++;
+        }
+    }
+    return num;
+}
+
+redisReply* RedisPool::Command(const char* format, ...) {
+    char* cmd = NULL;
+    va_list ap;
+    va_start(ap, format);
+    int len = redisvFormatCommand(&cmd, format, ap);
+    va_end(ap);
+    if (len < 0) {
+        PLOG_ERROR("format command failed(%d)", len);
+        return NULL;
+    }
+
+    RedisPoolCtx* ctx = CreateCtx(1);
+    RedisConnection* conn = (ctx != NULL ? GetConnection() : NULL);
+    int ret = REDIS_ERR;
+    if (conn != NULL) {
+        ret = redisAsyncFormattedCommand(conn->_ac, RedisPoolCallbackFn, ctx, cmd, len);
+        PLOG_IF_ERROR(ret != REDIS_OK, "redisAsyncFormattedCommand failed(%d)", ret);
+    }
+    free(cmd);
+    if (ret != REDIS_OK) {
+        delete ctx;
+        return NULL;
+    }
+
+    // 回包在回调中唤醒本协程，在回调返回前读取
+    if (Wait(ctx) != 0) {
+        return NULL;
+    }
+    redisReply* reply = ctx->_reply;
+    delete ctx;
+    return reply;
+}
+
+redisReply* RedisPool::CommandArgv(int argc, const char** argv, const size_t* argvlen) {
+    RedisPoolCtx* ctx = CreateCtx(1);
+    if (ctx == NULL) {
+        return NULL;
+    }
+    RedisConnection* conn = GetConnection();
+    if (conn == NULL) {
+        delete ctx;
+        return NULL;
+    }
+    int ret = redisAsyncCommandArgv(conn->_ac, RedisPoolCallbackFn, ctx, argc, argv, argvlen);
+    if (ret != REDIS_OK) {
+        PLOG_ERROR("redisAsyncCommandArgv failed(%d)", ret);
+        delete ctx;
+        return NULL;
+    }
+
+    if (Wait(ctx) != 0) {
+        return NULL;
+    }
+    redisReply* reply = ctx->_reply;
+    delete ctx;
+    return reply;
+}
+
+int RedisPool::Exec(RedisPipeline* pipeline) {
+    if (pipeline == NULL || pipeline->m_cmds.empty()) {
+        return -1;
+    }
+
+    RedisPoolCtx* ctx = CreateCtx(0);
+    if (ctx == NULL) {
+        return -1;
+    }
+    RedisConnection* conn = GetConnection();
+    if (conn == NULL) {
+        delete ctx;
+        return -1;
+    }
+
+    for (std::vector<redisReply*>::iterator it = pipeline->m_replies.begin();
+        it != pipeline->m_replies.end(); ++it) {
+        if (*it != NULL) {
+            freeReplyObject(*it);
+        }
+    }
+    pipeline->m_replies.assign(pipeline->m_cmds.size(), NULL);
+    ctx->_pipeline = pipeline;
+
+    // 同一连接上的命令按序回包，回调按_reply_idx依次填入
+    for (std::vector<std::string>::iterator it = pipeline->m_cmds.begin();
+        it != pipeline->m_cmds.end(); ++it) {
+        int ret = redisAsyncFormattedCommand(conn->_ac, RedisPoolCallbackFn, ctx,
+            it->data(), it->size());
+        if (ret != REDIS_OK) {
+            PLOG_ERROR("redisAsyncFormattedCommand failed(%d)", ret);
+            break;
+        }
+        ctx->_wait_num++;
+    }
+    if (ctx->_wait_num == 0) {
+        delete ctx;
+        return -1;
+    }
+
+    if (Wait(ctx) != 0) {
+        return -1;
+    }
+    delete ctx;
+
+    // 未发出或连接断开的命令没有回包
+    for (std::vector<redisReply*>::iterator it = pipeline->m_replies.begin();
+        it != pipeline->m_replies.end(); ++it) {
+        if (*it == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int RedisPool::MGet(const std::vector<std::string>& keys, std::vector<std::string>* values,
+    std::vector<bool>* exists) {
+    if (keys.empty() || values == NULL) {
+        return -1;
+    }
+
+    std::vector<const char*> argv(keys.size() + 1);
+    std::vector<size_t> argvlen(keys.size() + 1);
+    argv[0]    = "MGET";
+    argvlen[0] = 4;
+    for (size_t i = 0; i < keys.size(); i++) {
+        argv[i + 1]    = keys[i].data();
+        argvlen[i + 1] = keys[i].size();
+    }
+
+    redisReply* reply = CommandArgv(argv.size(), &argv[0], &argvlen[0]);
+    if (reply == NULL) {
+        return -1;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != keys.size()) {
+        PLOG_ERROR("mget reply invalid type=%d, elements=%lu", reply->type, reply->elements);
+        return -1;
+    }
+
+    values->resize(keys.size());
+    if (exists != NULL) {
+        exists->resize(keys.size());
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+        const redisReply* element = reply->element[i];
+        bool found = (element->type == REDIS_REPLY_STRING);
+        (*values)[i].assign(found ? element->str : "", found ? element->len : 0);
+        if (exists != NULL) {
+            (*exists)[i] = found;
+        }
+    }
+    return 0;
+}
+
+int RedisPool::GetConnectedNum() const {
+    int num = 0;
+    for (std::vector<RedisConnection*>::const_iterator it = m_conns.begin(); it != m_conns.end(); ++it) {
+        if ((*it)->_connected) {
+            num++;
+        }
+    }
+    return num;
+}
+
+void RedisPool::OnReply(RedisPoolCtx* ctx, redisReply* reply) {
+    if (ctx->_pipeline != NULL) {
+        if (ctx->_co_id != INVALID_CO_ID && reply != NULL) {
+            ctx->_pipeline->m_replies[ctx->_reply_idx] = DupReply(reply);
+        }
+        ctx->_reply_idx++;
+    } else {
+        ctx->_reply = reply;
+    }
+
+    if (--ctx->_wait_num > 0) {
+        return;
+    }
+
+    if (ctx->_co_id == INVALID_CO_ID) {
+        delete ctx;
+        return;
+    }
+    int ret = m_co_sche->Resume(ctx->_co_id);
+    PLOG_IF_ERROR(ret != 0, "resume failed(%d)", ret);
+}
+
+void RedisPool::OnConnect(RedisConnection* conn, int status) {
+    if (status != REDIS_OK) {
+        PLOG_ERROR("connect redis %s:%d failed(%s)", m_ip.c_str(), m_port,
+            conn->_ac ? conn->_ac->errstr : "");
+        return;
+    }
+    conn->_connected = true;
+}
+
+void RedisPool::OnDisconnect(RedisConnection* conn, int status) {
+    PLOG_IF_ERROR(status != REDIS_OK, "redis %s:%d disconnected", m_ip.c_str(), m_port);
+    conn->_connected = false;
+}
+
+RedisConnection* RedisPool::GetConnection() {
+    // 连接中的连接也可以发命令，连接建立后一起发出
+    for (size_t i = 0; i < m_conns.size(); i++) {
+        RedisConnection* conn = m_conns[m_next_conn++ % m_conns.size()];
+        if (conn->_ac != NULL) {
+            return conn;
+        }
+    }
+    PLOG_ERROR("no redis connection available %s:%d", m_ip.c_str(), m_port);
+    return NULL;
+}
+
+RedisPoolCtx* RedisPool::CreateCtx(uint32_t reply_num) {
+    if (!m_co_sche) {
+        PLOG_ERROR("coroutine schedule is null");
+        return NULL;
+    }
+
+    int64_t co_id = m_co_sche->CurrentTaskId();
+    if (co_id == INVALID_CO_ID) {
+        PLOG_ERROR("not in coroutine");
+        return NULL;
+    }
+
+    RedisPoolCtx* ctx = new RedisPoolCtx();
+    ctx->_co_id    = co_id;
+    ctx->_wait_num = reply_num;
+    return ctx;
+}
+
+int RedisPool::Wait(RedisPoolCtx* ctx) {
+    int ret = m_co_sche->Yield(m_timeout_ms);
+    if (ctx->_wait_num > 0) {
+        // 超时，ctx留给之后的回包(或连接释放时的NULL回包)释放，不能再唤醒本协程
+        PLOG_ERROR("yield return failed(%d), %u replies left", ret, ctx->_wait_num);
+        ctx->_co_id = INVALID_CO_ID;
+        return -1;
+    }
+    return 0;
+}
+
+} // namespace pebble
+
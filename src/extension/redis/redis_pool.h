@@ -0,0 +1,132 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#ifndef PEBBLE_EXTENSION_REDIS_POOL_H
+#define PEBBLE_EXTENSION_REDIS_POOL_H
+
+#include <string>
+#include <vector>
+#include "async.h"
+#include "common/coroutine.h"
+
+// pebble 发布包本身不提供redis的库
+
+namespace pebble {
+
+struct RedisConnection;
+struct RedisPoolCtx;
+
+/// @brief 批量命令，由RedisPool::Exec在同一连接上一次发出，按添加顺序取回结果
+class RedisPipeline {
+public:
+    RedisPipeline() {}
+    ~RedisPipeline();
+
+    /// @brief 添加命令，参数同redisCommand
+    /// @return 0成功，非0失败(格式化失败)
+    int AddCommand(const char* format, ...);
+
+    int AddCommandArgv(int argc, const char** argv, const size_t* argvlen);
+
+    size_t Size() const { return m_cmds.size(); }
+
+    /// @brief 获取第idx条命令的结果，Exec之前或执行失败的命令返回NULL
+    /// @note 结果由pipeline持有，析构或Clear时释放
+    redisReply* GetReply(size_t idx) const;
+
+    /// @brief 清除命令和结果，可复用
+    void Clear();
+
+private:
+    friend class RedisPool;
+    std::vector<std::string> m_cmds;
+    std::vector<redisReply*> m_replies;
+};
+
+/// @brief redis连接池，持有多个hiredis异步连接，由服务主循环调用Update驱动收发
+/// @note 同一个tick内各协程发出的命令先缓存在连接上，Update时每个连接一次write发出，
+///     即自动pipeline；每条命令有独立的上下文，回包直接交给发起命令的协程
+/// @note 接口必须在协程中调用，与RedisCoroutine一样，协程在等待回包期间让出
+class RedisPool {
+public:
+    static const int DEFAULT_CONN_NUM = 4;
+    static const int DEFAULT_REDIS_TIMEOUT_MS = 2000;
+    // 连接断开后的重连间隔
+    static const int RECONNECT_INTERVAL_MS = 1000;
+
+    RedisPool();
+    ~RedisPool();
+
+    /// @param co_sche pebble提供的协程调度器
+    /// @param ip redis地址
+    /// @param port redis端口
+    /// @param conn_num 连接数，命令按连接轮流分配
+    /// @param timeout_ms 命令执行的超时时间，单位ms，默认2s
+    /// @return 0成功，非0失败
+    int Init(CoroutineSchedule* co_sche, const std::string& ip, int port,
+             int conn_num = DEFAULT_CONN_NUM, int timeout_ms = DEFAULT_REDIS_TIMEOUT_MS);
+
+    /// @brief 驱动连接收发和重连，需要在主循环中每个tick调用(如AppEventHandler::OnUpdate)
+    /// @return 本次处理的事件数
+    int Update();
+
+    /// @brief 执行单条命令，必须在协程中执行
+    /// @return NULL失败(未连接、超时或连接断开)，非空成功
+    /// @note 结果由连接池持有，在协程下一次让出前有效，调用者不要释放
+    redisReply* Command(const char* format, ...);
+    redisReply* CommandArgv(int argc, const char** argv, const size_t* argvlen);
+
+    /// @brief 在同一连接上一次发出pipeline中的所有命令，全部回包后返回，必须在协程中执行
+    /// @return 0全部命令都有回包(单条命令的redis错误见对应reply)，非0失败
+    int Exec(RedisPipeline* pipeline);
+
+    /// @brief 批量读取，单条MGET命令
+    /// @param values 按keys的顺序返回值，不存在的key返回空串
+    /// @param exists 可选，按keys的顺序返回key是否存在
+    /// @return 0成功，非0失败
+    int MGet(const std::vector<std::string>& keys, std::vector<std::string>* values,
+             std::vector<bool>* exists = NULL);
+
+    /// @brief 当前已连接的连接数
+    int GetConnectedNum() const;
+
+public:
+    /// @note 内部使用
+    void OnReply(RedisPoolCtx* ctx, redisReply* reply);
+    void OnConnect(RedisConnection* conn, int status);
+    void OnDisconnect(RedisConnection* conn, int status);
+
+private:
+    int Connect(RedisConnection* conn);
+
+    // 按轮转选取一个已连接的连接
+    RedisConnection* GetConnection();
+
+    RedisPoolCtx* CreateCtx(uint32_t reply_num);
+
+    // 等待ctx上的所有回包，返回时ctx已交由回调释放或由本函数释放
+    int Wait(RedisPoolCtx* ctx);
+
+private:
+    CoroutineSchedule* m_co_sche;
+    std::string m_ip;
+    int m_port;
+    int m_timeout_ms;
+    uint32_t m_next_conn;
+    std::vector<RedisConnection*> m_conns;
+};
+
+} // namespace pebble
+
+#endif // PEBBLE_EXTENSION_REDIS_POOL_H
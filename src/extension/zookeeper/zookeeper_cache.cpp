@@ -13,6 +13,7 @@
 
 
 #include "common/log.h"
+#include "common/time_utility.h"
 #include "extension/zookeeper/zookeeper_cache.inh"
 
 namespace pebble {
@@ -170,10 +171,7 @@ void ZookeeperCache::OnWatchCb(const std::string& req_name,
 
 void ZookeeperCache::Update()
 {
-    timeval now;
-    gettimeofday(&now, NULL);
-
-    m_curr_time = now.tv_sec * 1000 + now.tv_usec / 1000;
+    m_curr_time = TimeUtility::GetCachedMS();
     if (m_curr_time > m_last_refresh + m_refresh_time_ms) {
         std::map<std::string, bool>::iterator it = m_cache_keys.begin();
         for ( ; it != m_cache_keys.end() ; ++it) {
@@ -14,6 +14,7 @@
 
 #include <poll.h>
 #include <string.h>
+#include <sys/epoll.h>
 
 #include "common/base64.h"
 #include "common/log.h"
@@ -374,7 +375,8 @@ EphemeralNodeInfo& EphemeralNodeInfo::operator = (const EphemeralNodeInfo& rhs)
 
 ZookeeperClient::ZookeeperClient()
     :   m_time_out_ms(30000), m_last_update_time(0), m_zk_path("/"),
-        m_zk_handle(NULL), m_watch_cb(NULL), m_last_resume_time(0), m_state(0)
+        m_zk_handle(NULL), m_watch_cb(NULL), m_last_resume_time(0), m_state(0),
+        m_watched_fd(-1), m_watched_interest(0), m_fd_interest(0)
 {
 }
 
@@ -447,7 +449,7 @@ void ZookeeperClient::OnConnected()
         AExists(it->c_str(), 1, NULL);
     }
     // 恢复临时节点
-    m_last_resume_time = TimeUtility::GetCurrentMS();
+    m_last_resume_time = TimeUtility::GetCachedMS();
     std::set<EphemeralNodeInfo> resume_nodes;
     for (std::set<EphemeralNodeInfo>::iterator it = m_ephemeral_node.begin() ;
         it != m_ephemeral_node.end() ; ++it)
@@ -872,9 +874,9 @@ int ZookeeperClient::Update(bool is_block)
 {
     pebble::ZookeeperLog::Instance()->Update();
 
-    // 未连接成功时，异步update频率控制为1s/次
+    // 未连接成功时，异步update频率控制为1s/次，fd已在外部事件循环中时由事件驱动
     int state = zoo_state(m_zk_handle);
-    if (false == is_block && ZOO_CONNECTED_STATE != state)
+    if (false == is_block && ZOO_CONNECTED_STATE != state && m_watched_fd < 0)
     {
         int now = static_cast<int>(time(NULL));
         if (now <= m_last_update_time)
@@ -889,16 +891,29 @@ int ZookeeperClient::Update(bool is_block)
     timeval timeout = { 0, 0 };
     zookeeper_interest(m_zk_handle, &pfd.fd, &interest, &timeout);
     if (pfd.fd < 0)
+    {
+        m_watched_fd = -1;
         return -1;
+    }
 
-    int wait_time = (is_block ? (timeout.tv_sec * 1000 + timeout.tv_usec / 1000) : 0);
-    pfd.events = ((interest & ZOOKEEPER_WRITE) ? POLLOUT : 0);
-    pfd.events |= ((interest & ZOOKEEPER_READ) ? POLLIN : 0);
-    poll(&pfd, 1, wait_time);
+    if (false == is_block && WatchFd(pfd.fd, interest))
+    {
+        // fd已在外部事件循环的epoll中，只处理事件循环收到的事件，省去每次的poll调用
+        interest = m_fd_interest;
+        m_fd_interest = 0;
+    }
+    else
+    {
+        int wait_time = (is_block ? (timeout.tv_sec * 1000 + timeout.tv_usec / 1000) : 0);
+        pfd.events = ((interest & ZOOKEEPER_WRITE) ? POLLOUT : 0);
+        pfd.events |= ((interest & ZOOKEEPER_READ) ? POLLIN : 0);
+        poll(&pfd, 1, wait_time);
 
-    interest = ((pfd.revents & POLLIN) ? ZOOKEEPER_READ : 0);
-    interest |= ((pfd.revents & POLLOUT) ? ZOOKEEPER_WRITE : 0);
-    interest |= ((pfd.revents & POLLHUP) ? ZOOKEEPER_WRITE : 0);
+        interest = ((pfd.revents & POLLIN) ? ZOOKEEPER_READ : 0);
+        interest |= ((pfd.revents & POLLOUT) ? ZOOKEEPER_WRITE : 0);
+        interest |= ((pfd.revents & POLLHUP) ? ZOOKEEPER_WRITE : 0);
+        m_fd_interest = 0;
+    }
     zookeeper_process(m_zk_handle, interest);
 
     ResumeEphemeralNode();
@@ -906,13 +921,64 @@ int ZookeeperClient::Update(bool is_block)
     return (interest == 0 ? -1 : 0);
 }
 
+bool ZookeeperClient::WatchFd(int fd, int interest)
+{
+    if (!m_watch_fd)
+    {
+        return false;
+    }
+
+    // 重连时zk可能复用相同的fd号，未连接成功期间每次都重新注册
+    if (fd == m_watched_fd && interest == m_watched_interest
+        && ZOO_CONNECTED_STATE == zoo_state(m_zk_handle))
+    {
+        return true;
+    }
+
+    uint32_t events = ((interest & ZOOKEEPER_READ) ? static_cast<uint32_t>(EPOLLIN) : 0);
+    events |= ((interest & ZOOKEEPER_WRITE) ? static_cast<uint32_t>(EPOLLOUT) : 0);
+    if (0 == events)
+    {
+        return false;
+    }
+
+    // fd变化时旧连接已被zk关闭并自动移出epoll，fd号可能已被复用，不能再按旧fd注销
+    int ret = m_watch_fd(fd, events, cxx::bind(&ZookeeperClient::OnFdEvent, this, _1, _2));
+    if (0 != ret)
+    {
+        m_watched_fd = -1;
+        return false;
+    }
+
+    if (fd != m_watched_fd)
+    {
+        m_fd_interest = 0;
+    }
+    m_watched_fd = fd;
+    m_watched_interest = interest;
+    return true;
+}
+
+void ZookeeperClient::OnFdEvent(int32_t fd, uint32_t events)
+{
+    if (fd != m_watched_fd)
+    {
+        return;
+    }
+    m_fd_interest |= ((events & EPOLLIN) ? ZOOKEEPER_READ : 0);
+    m_fd_interest |= ((events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) ? ZOOKEEPER_WRITE : 0);
+}
+
 int ZookeeperClient::Close(bool is_clean)
 {
     if (m_zk_handle != NULL)
     {
+        // 关闭fd时内核自动将其移出外部事件循环的epoll
         zookeeper_close(m_zk_handle);
     }
     m_zk_handle = NULL;
+    m_watched_fd = -1;
+    m_fd_interest = 0;
 
     if (true == is_clean)
     {
@@ -1003,7 +1069,7 @@ void ZookeeperClient::ResumeEphemeralNode()
         return;
     }
 
-    int64_t now = TimeUtility::GetCurrentMS();
+    int64_t now = TimeUtility::GetCachedMS();
     if (m_last_resume_time + m_time_out_ms > now) {
         // 恢复重试周期和会话超时时间保持一致
         return;
@@ -27,6 +27,7 @@
 #include "common/error.h"
 #include "common/platform.h"
 #include "extension/zookeeper/zookeeper_error.h"
+#include "framework/naming.h"
 #include "zookeeper/include/zookeeper.h"
 #include "zookeeper/include/zookeeper_log.h"
 
@@ -151,6 +152,7 @@ public:
     int SetAcl(const char *path, int version, ACL_vector* acl);
 
     // 异步驱动更新
+    /// @note 设置了WatchFdFunc且注册成功时，非阻塞更新直接处理事件循环收到的fd事件，不再poll
     /// @return -1 不需要做任何动作
     /// @return 0 有更新动作
     int Update(bool is_block = false);
@@ -180,6 +182,15 @@ public:
 
     void SetConnectionState(int state) { m_state = state; }
 
+    /// @brief 设置把zk连接fd注册到外部事件循环(epoll)的函数，连接fd变化时在Update中重新注册
+    void SetWatchFdFunc(const WatchFdFunc& watch_fd) { m_watch_fd = watch_fd; }
+
+private:
+    // 把连接fd及关注的事件同步到外部事件循环，返回fd是否已在外部事件循环中
+    bool WatchFd(int fd, int interest);
+
+    void OnFdEvent(int32_t fd, uint32_t events);
+
 private:
     std::string m_zk_host;
     int m_time_out_ms;
@@ -197,6 +208,11 @@ private:
     std::set<EphemeralNodeInfo> m_ephemeral_node;
     int64_t m_last_resume_time;
     int m_state;
+    // 外部事件循环注册信息，m_fd_interest为事件循环收到的待处理事件(ZOOKEEPER_READ/WRITE)
+    WatchFdFunc m_watch_fd;
+    int m_watched_fd;
+    int m_watched_interest;
+    int m_fd_interest;
 };
 
 } // namespace pebble
@@ -127,6 +127,11 @@ struct CoroutineWaitAdaptor : public SyncWaitAdaptor
 
     virtual void WaitRsp()
     {
+        // 结果可能在发起请求时已同步返回，此时不能再让出，否则协程无人唤醒
+        if (_rc != 999)
+        {
+            return;
+        }
         _cor_id = _cor_sche->CurrentTaskId();
         _cor_sche->Yield();
     }
@@ -134,14 +139,20 @@ struct CoroutineWaitAdaptor : public SyncWaitAdaptor
     void OnCodeRsp(int32_t rc)
     {
         _rc = rc;
-        _cor_sche->Resume(_cor_id);
+        if (_cor_id >= 0)
+        {
+            _cor_sche->Resume(_cor_id);
+        }
     }
 
     void OnRsp(int32_t rc, const std::vector<std::string>& urls)
     {
         _rc = rc;
         *_urls = urls;
-        _cor_sche->Resume(_cor_id);
+        if (_cor_id >= 0)
+        {
+            _cor_sche->Resume(_cor_id);
+        }
     }
 };
 
@@ -198,6 +209,13 @@ int32_t ZookeeperNaming::SetCorSchedule(CoroutineSchedule* cor_sche)
     return 0;
 }
 
+int32_t ZookeeperNaming::AttachEventLoop(CoroutineSchedule* cor_sche, const WatchFdFunc& watch_fd)
+{
+    m_cor_schedule = cor_sche;
+    m_zk_client->SetWatchFdFunc(watch_fd);
+    return 0;
+}
+
 int32_t ZookeeperNaming::SetCache(bool use_cache, int32_t refresh_time_ms, int32_t invaild_time_ms)
 {
     if (refresh_time_ms < 5000 ||
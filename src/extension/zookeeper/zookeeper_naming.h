@@ -70,6 +70,12 @@ public:
     /// @return 0成功
     int32_t SetCorSchedule(CoroutineSchedule* cor_sche);
 
+    /// @brief 接入框架的事件循环，设置协程调度器并把zk连接fd注册到框架的epoll
+    /// @param cor_sche 协程调度器句柄，协程内调用同步接口时让出协程，不阻塞事件循环
+    /// @param watch_fd 注册zk连接fd的函数，zk有网络事件时及时唤醒事件循环，Update不再轮询fd
+    /// @return 0成功
+    virtual int32_t AttachEventLoop(CoroutineSchedule* cor_sche, const WatchFdFunc& watch_fd);
+
     /// @brief 设置查询的缓存
     /// @param use_cache 是否启动查询的缓存
     /// @param refresh_time_ms 缓存的自动刷新时间，最小为5000
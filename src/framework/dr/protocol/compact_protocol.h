@@ -0,0 +1,305 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PEBBLE_DR_PROTOCOL_COMPACTPROTOCOL_H
+#define PEBBLE_DR_PROTOCOL_COMPACTPROTOCOL_H
+
+#include "framework/dr/protocol/protocol.h"
+#include "framework/dr/protocol/virtual_protocol.h"
+#include <stack>
+
+namespace pebble { namespace dr { namespace protocol {
+
+/**
+ * C++ Implementation of the Compact Protocol as described in THRIFT-110
+ *
+ * 整数使用varint + zigzag编码，字段id使用与前一字段的差值编码，bool值合入字段头；
+ * 与thrift官方compact协议的差异仅在于seqid为int64(varint64编码)，seqid小于2^31时两者互通
+ */
+template <class Transport_>
+class TCompactProtocolT
+  : public TVirtualProtocol< TCompactProtocolT<Transport_> > {
+ protected:
+  static const int8_t  PROTOCOL_ID        = (int8_t)0x82u;
+  static const int8_t  VERSION_N          = 1;
+  static const int8_t  VERSION_MASK       = 0x1f; // 0001 1111
+  static const int8_t  TYPE_MASK          = (int8_t)0xE0u; // 1110 0000
+  static const int8_t  TYPE_BITS          = 0x07; // 0000 0111
+  static const int32_t TYPE_SHIFT_AMOUNT  = 5;
+  static const int MAX_STRING_SIZE        = (8 * 1024 * 1024); // 8M
+  static const int MAX_CONTAINER_SIZE     = (8 * 1024 * 1024); // 8M
+
+  /**
+   * (Writing) If we encounter a boolean field begin, save the TField here
+   * so it can have the value incorporated.
+   */
+  struct {
+    const char* name;
+    TType fieldType;
+    int16_t fieldId;
+  } booleanField_;
+
+  /**
+   * (Reading) If we read a field header, and it's a boolean field, save
+   * the boolean value here so that readBool can use it.
+   */
+  struct {
+    bool hasBoolValue;
+    bool boolValue;
+  } boolValue_;
+
+  /**
+   * Used to keep track of the last field for the current and previous structs,
+   * so we can do the delta stuff.
+   */
+  std::stack<int16_t> lastField_;
+  int16_t lastFieldId_;
+
+ public:
+  TCompactProtocolT(cxx::shared_ptr<Transport_> trans) :
+    TVirtualProtocol< TCompactProtocolT<Transport_> >(trans),
+    lastFieldId_(0),
+    trans_(trans.get()),
+    string_limit_(MAX_STRING_SIZE),
+    container_limit_(MAX_CONTAINER_SIZE) {
+    booleanField_.name = NULL;
+    boolValue_.hasBoolValue = false;
+  }
+
+  TCompactProtocolT(cxx::shared_ptr<Transport_> trans,
+                    int32_t string_limit,
+                    int32_t container_limit) :
+    TVirtualProtocol< TCompactProtocolT<Transport_> >(trans),
+    lastFieldId_(0),
+    trans_(trans.get()),
+    string_limit_(string_limit),
+    container_limit_(container_limit) {
+    booleanField_.name = NULL;
+    boolValue_.hasBoolValue = false;
+  }
+
+  ~TCompactProtocolT() {}
+
+  void setStringSizeLimit(int32_t string_limit) {
+    string_limit_ = string_limit;
+  }
+
+  void setContainerSizeLimit(int32_t container_limit) {
+    container_limit_ = container_limit;
+  }
+
+  /**
+   * 清除字段id差值等编解码状态，编解码异常中断后复用本对象前需调用
+   */
+  void clearState() {
+    while (!lastField_.empty()) {
+      lastField_.pop();
+    }
+    lastFieldId_ = 0;
+    booleanField_.name = NULL;
+    boolValue_.hasBoolValue = false;
+  }
+
+  /**
+   * Writing functions
+   */
+
+  /*ol*/ uint32_t writeMessageBegin(const std::string& name,
+                                    const TMessageType messageType,
+                                    const int64_t seqid);
+
+  /*ol*/ uint32_t writeMessageEnd();
+
+  uint32_t writeStructBegin(const char* name);
+
+  uint32_t writeStructEnd();
+
+  uint32_t writeFieldBegin(const char* name,
+                           const TType fieldType,
+                           const int16_t fieldId);
+
+  uint32_t writeFieldEnd();
+
+  uint32_t writeFieldStop();
+
+  uint32_t writeMapBegin(const TType keyType,
+                         const TType valType,
+                         const uint32_t size);
+
+  uint32_t writeMapEnd();
+
+  uint32_t writeListBegin(const TType elemType, const uint32_t size);
+
+  uint32_t writeListEnd();
+
+  uint32_t writeSetBegin(const TType elemType, const uint32_t size);
+
+  uint32_t writeSetEnd();
+
+  uint32_t writeBool(const bool value);
+
+  uint32_t writeByte(const int8_t byte);
+
+  uint32_t writeI16(const int16_t i16);
+
+  uint32_t writeI32(const int32_t i32);
+
+  uint32_t writeI64(const int64_t i64);
+
+  uint32_t writeDouble(const double dub);
+
+  template <typename StrType>
+  uint32_t writeString(const StrType& str);
+
+  uint32_t writeBinary(const std::string& str);
+
+  /**
+   * Reading functions
+   */
+
+  /*ol*/ uint32_t readMessageBegin(std::string& name,
+                                   TMessageType& messageType,
+                                   int64_t& seqid);
+
+  /*ol*/ uint32_t readMessageEnd();
+
+  uint32_t readStructBegin(std::string& name);
+
+  uint32_t readStructEnd();
+
+  uint32_t readFieldBegin(std::string& name,
+                          TType& fieldType,
+                          int16_t& fieldId);
+
+  uint32_t readFieldEnd();
+
+  uint32_t readMapBegin(TType& keyType,
+                        TType& valType,
+                        uint32_t& size);
+
+  uint32_t readMapEnd();
+
+  uint32_t readListBegin(TType& elemType, uint32_t& size);
+
+  uint32_t readListEnd();
+
+  uint32_t readSetBegin(TType& elemType, uint32_t& size);
+
+  uint32_t readSetEnd();
+
+  uint32_t readBool(bool& value);
+  // Provide the default readBool() implementation for std::vector<bool>
+  using TVirtualProtocol< TCompactProtocolT<Transport_> >::readBool;
+
+  uint32_t readByte(int8_t& byte);
+
+  uint32_t readI16(int16_t& i16);
+
+  uint32_t readI32(int32_t& i32);
+
+  uint32_t readI64(int64_t& i64);
+
+  uint32_t readDouble(double& dub);
+
+  template<typename StrType>
+  uint32_t readString(StrType& str);
+
+  uint32_t readBinary(std::string& str);
+
+ protected:
+  uint32_t writeFieldBeginInternal(const char* name,
+                                   const TType fieldType,
+                                   const int16_t fieldId,
+                                   int8_t typeOverride);
+  uint32_t writeCollectionBegin(const TType elemType, int32_t size);
+  uint32_t writeVarint32(uint32_t n);
+  uint32_t writeVarint64(uint64_t n);
+  uint64_t i64ToZigzag(const int64_t l);
+  uint32_t i32ToZigzag(const int32_t n);
+  inline int8_t getCompactType(const TType ttype);
+
+  uint32_t readCollectionBegin(TType& elemType, uint32_t& size);
+  uint32_t readVarint32(int32_t& i32);
+  uint32_t readVarint64(int64_t& i64);
+  int32_t zigzagToI32(uint32_t n);
+  int64_t zigzagToI64(uint64_t n);
+  TType getTType(int8_t type);
+
+  template<typename StrType>
+  uint32_t readStringBody(StrType& str, int32_t sz);
+
+  Transport_* trans_;
+
+  int32_t string_limit_;
+  int32_t container_limit_;
+};
+
+typedef TCompactProtocolT<TTransport> TCompactProtocol;
+
+/**
+ * Constructs compact protocol handlers
+ */
+template <class Transport_>
+class TCompactProtocolFactoryT : public TProtocolFactory {
+ public:
+  TCompactProtocolFactoryT() :
+    string_limit_(0),
+    container_limit_(0) {}
+
+  TCompactProtocolFactoryT(int32_t string_limit, int32_t container_limit) :
+    string_limit_(string_limit),
+    container_limit_(container_limit) {}
+
+  virtual ~TCompactProtocolFactoryT() {}
+
+  void setStringSizeLimit(int32_t string_limit) {
+    string_limit_ = string_limit;
+  }
+
+  void setContainerSizeLimit(int32_t container_limit) {
+    container_limit_ = container_limit;
+  }
+
+  cxx::shared_ptr<TProtocol> getProtocol(cxx::shared_ptr<TTransport> trans) {
+    cxx::shared_ptr<Transport_> specific_trans =
+      cxx::dynamic_pointer_cast<Transport_>(trans);
+    TProtocol* prot;
+    if (specific_trans) {
+      prot = new TCompactProtocolT<Transport_>(specific_trans, string_limit_,
+                                               container_limit_);
+    } else {
+      prot = new TCompactProtocol(trans, string_limit_, container_limit_);
+    }
+
+    return cxx::shared_ptr<TProtocol>(prot);
+  }
+
+ private:
+  int32_t string_limit_;
+  int32_t container_limit_;
+
+};
+
+typedef TCompactProtocolFactoryT<TTransport> TCompactProtocolFactory;
+
+}}} // pebble::dr::protocol
+
+#include "framework/dr/protocol/compact_protocol.tcc"
+
+#endif // PEBBLE_DR_PROTOCOL_COMPACTPROTOCOL_H
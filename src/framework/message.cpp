@@ -18,7 +18,7 @@
 namespace pebble {
 
 
-MessageDriver* Message::m_driver = NULL;
+__thread MessageDriver* Message::m_driver = NULL;
 
 int32_t Message::Init()
 {
@@ -133,6 +133,70 @@ const char* Message::GetLastError()
     return "no driver installed.";
 }
 
+int32_t Message::Flush(int64_t handle)
+{
+    if (m_driver) {
+        return m_driver->Flush(handle);
+    }
+    return kMESSAGE_UNINSTALL_DRIVER;
+}
+
+int32_t Message::WatchFd(int32_t fd, uint32_t events, const FdEventCallback& on_event)
+{
+    if (m_driver) {
+        return m_driver->WatchFd(fd, events, on_event);
+    }
+    return kMESSAGE_UNINSTALL_DRIVER;
+}
+
+int32_t Message::UnwatchFd(int32_t fd)
+{
+    if (m_driver) {
+        return m_driver->UnwatchFd(fd);
+    }
+    return kMESSAGE_UNINSTALL_DRIVER;
+}
+
+int32_t Message::GetPeerCred(int64_t handle, int32_t* pid, uint32_t* uid, uint32_t* gid)
+{
+    if (m_driver) {
+        return m_driver->GetPeerCred(handle, pid, uid, gid);
+    }
+    return kMESSAGE_UNINSTALL_DRIVER;
+}
+
+int32_t Message::ExportListenFd(int64_t handle)
+{
+    if (m_driver) {
+        return m_driver->ExportListenFd(handle);
+    }
+    return kMESSAGE_UNINSTALL_DRIVER;
+}
+
+int32_t Message::StopListen(int64_t handle)
+{
+    if (m_driver) {
+        return m_driver->StopListen(handle);
+    }
+    return kMESSAGE_UNINSTALL_DRIVER;
+}
+
+int32_t Message::Prewarm(uint32_t conn_num, bool lock)
+{
+    if (m_driver) {
+        return m_driver->Prewarm(conn_num, lock);
+    }
+    return kMESSAGE_UNINSTALL_DRIVER;
+}
+
+int32_t Message::GetConnectionPoolInfo(uint32_t* used_num, uint32_t* free_num)
+{
+    if (m_driver) {
+        return m_driver->GetConnectionPoolInfo(used_num, free_num);
+    }
+    return kMESSAGE_UNINSTALL_DRIVER;
+}
+
 void Message::SetMessageDriver(MessageDriver* driver)
 {
     m_driver = driver;
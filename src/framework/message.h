@@ -92,11 +92,16 @@ struct MsgExternInfo {
     int64_t         _self_handle;       // bind或connect获得的handle
     int64_t         _remote_handle;     // 远端handle
     // int64_t         _channel;
-    int64_t         _msg_arrived_ms;    // 消息到达时间
+    int64_t         _msg_arrived_ms;    // 消息到达时间，单调时钟(ms) @see TimeUtility::GetCachedMS
 
     IProcessor*     _src;               // 消息源，由消息分发Processor填写，方便消息在各Processor间传递
 };
 
+/// @brief 外部fd上有事件时的回调
+/// @param fd 注册的fd
+/// @param events 发生的epoll事件(EPOLLIN/EPOLLOUT/EPOLLERR等)
+typedef cxx::function<void(int32_t fd, uint32_t events)> FdEventCallback;
+
 /// @brief 网络驱动接口
 class MessageDriver {
 public:
@@ -128,6 +133,33 @@ public:
     virtual int32_t GetUsedSize(int64_t handle, uint32_t* remain_size, uint32_t* max_size) = 0;
 
     virtual const char* GetLastError() = 0;
+
+    /// @brief 发送驱动内部缓存的数据，handle<0表示所有句柄，不缓存发送数据的驱动无需实现
+    virtual int32_t Flush(int64_t handle) { return 0; }
+
+    /// @brief 把外部fd(如名字服务连接)加入驱动的事件等待，不支持的驱动返回kMESSAGE_UNSUPPORT
+    virtual int32_t WatchFd(int32_t fd, uint32_t events, const FdEventCallback& on_event)
+    { return kMESSAGE_UNSUPPORT; }
+
+    virtual int32_t UnwatchFd(int32_t fd) { return kMESSAGE_UNSUPPORT; }
+
+    /// @brief 获取本机(unix域socket)连接对端进程的身份，不支持的驱动返回kMESSAGE_UNSUPPORT
+    virtual int32_t GetPeerCred(int64_t handle, int32_t* pid, uint32_t* uid, uint32_t* gid)
+    { return kMESSAGE_UNSUPPORT; }
+
+    /// @brief 取Bind句柄的监听socket用于热重启，不支持的驱动返回kMESSAGE_UNSUPPORT
+    /// @note 驱动Bind时应先用NetIO::TakeInheritedFd取旧进程传来的同地址socket
+    virtual int32_t ExportListenFd(int64_t handle) { return kMESSAGE_UNSUPPORT; }
+
+    /// @brief 停止在Bind句柄上接收新连接，句柄仍有效，不支持的驱动返回kMESSAGE_UNSUPPORT
+    virtual int32_t StopListen(int64_t handle) { return kMESSAGE_UNSUPPORT; }
+
+    /// @brief 预先分配conn_num个连接的资源并写入内存，不支持的驱动返回kMESSAGE_UNSUPPORT
+    virtual int32_t Prewarm(uint32_t conn_num, bool lock) { return kMESSAGE_UNSUPPORT; }
+
+    /// @brief 获取连接资源的占用情况，不支持的驱动返回kMESSAGE_UNSUPPORT
+    virtual int32_t GetConnectionPoolInfo(uint32_t* used_num, uint32_t* free_num)
+    { return kMESSAGE_UNSUPPORT; }
 };
 
 /// @brief 基于消息的通讯接口类
@@ -143,7 +175,9 @@ public:
     /// @param url 指定url，形式类似：
     ///     "tbuspp://1000.unit_wx.query/inst0",
     ///     "tbus://11.0.0.1",
-    ///     "http://127.0.0.1:8880[/service]"
+    ///     "http://127.0.0.1:8880[/service]",
+    ///     "tcp://[::1]:8880"(ipv6地址写在"[]"中)，
+    ///     "unix:///var/run/app.sock"、"unix://@app"(本机进程间，@表示抽象命名空间)
     /// @return >=0 表示成功
     /// @return <0 表示失败，错误码@see MessageErrorCode
     static int64_t Bind(const std::string &url);
@@ -152,7 +186,9 @@ public:
     /// @param url 指定url，形式类似：
     ///     "tbuspp://1000.unit_wx.query[/inst0]",
     ///     "tbus://11.0.0.1",
-    ///     "http://127.0.0.1:8880[/service]"
+    ///     "http://127.0.0.1:8880[/service]",
+    ///     "tcp://[::1]:8880"(ipv6地址写在"[]"中)，
+    ///     "unix:///var/run/app.sock"、"unix://@app"(本机进程间，@表示抽象命名空间)
     /// @return >=0 表示成功
     /// @return <0 表示失败，错误码@see MessageErrorCode
     static int64_t Connect(const std::string &url);
@@ -215,6 +251,7 @@ public:
     /// @param timeout poll等待的最大时间，单位ms
     /// @return 0 等到事件
     /// @return -1 等待超时
+    /// @return kMESSAGE_SEND_FAILED 之前返回成功的udp攒批回包发送失败，handle为回包的对端handle
     static int32_t Poll(int64_t* handle, int32_t* event, int32_t timeout);
 
     /// @brief 上报网络质量
@@ -238,16 +275,74 @@ public:
     /// @return 返回错误描述
     static const char* GetLastError();
 
+    /// @brief 立即发送驱动缓存的数据(如cork模式)，用于时延敏感的场景
+    /// @param handle 句柄，<0表示所有句柄
+    /// @return 0 成功
+    /// @return <0 表示失败，错误码@see MessageErrorCode
+    static int32_t Flush(int64_t handle = -1);
+
+    /// @brief 把外部fd加入网络驱动的事件等待，fd就绪时Poll会及时返回并回调on_event
+    /// @param fd 外部fd，已注册时更新关注的事件和回调
+    /// @param events 关注的epoll事件(EPOLLIN/EPOLLOUT)
+    /// @param on_event fd有事件时的回调，在Poll内调用，回调中只宜记录事件，不宜做耗时处理
+    /// @return 0 成功
+    /// @return <0 表示失败，错误码@see MessageErrorCode
+    /// @note fd被close后内核会自动将其从epoll中移除，此时无需再调用UnwatchFd
+    static int32_t WatchFd(int32_t fd, uint32_t events, const FdEventCallback& on_event);
+
+    /// @brief 把外部fd从网络驱动的事件等待中移除，需在fd被close前调用
+    /// @return 0 成功
+    /// @return <0 表示失败，错误码@see MessageErrorCode
+    static int32_t UnwatchFd(int32_t fd);
+
+    /// @brief 获取unix域socket连接对端进程的身份(SO_PEERCRED)，可用于本机进程间的访问控制
+    /// @param handle Bind后Recv返回的句柄或Connect返回的句柄
+    /// @param pid/uid/gid 对端进程id、用户id、组id，可为NULL
+    /// @return 0 成功
+    /// @return <0 表示失败(句柄不是unix域socket连接等)，错误码@see MessageErrorCode
+    static int32_t GetPeerCred(int64_t handle, int32_t* pid, uint32_t* uid, uint32_t* gid);
+
+    /// @brief 取Bind返回句柄的监听socket，用于热重启时通过SCM_RIGHTS交给新进程
+    /// @return >=0 socket fd，仍归驱动所有；交接完成调用StopListen后，Close该句柄只关闭本进程的fd，
+    ///     不删除unix域socket的路径，交接失败时路径仍归本进程
+    /// @return <0 表示失败，错误码@see MessageErrorCode
+    static int32_t ExportListenFd(int64_t handle);
+
+    /// @brief 停止在Bind返回的句柄上接收新连接，热重启交接后由旧进程调用
+    /// @note 句柄仍然有效，已建立的连接继续收发，udp可继续回包；之后仍需Close释放
+    /// @return 0 成功
+    /// @return <0 表示失败，错误码@see MessageErrorCode
+    static int32_t StopListen(int64_t handle);
+
+    /// @brief 预热，预先分配conn_num个连接的资源(如接收缓冲区)并写入每一页，
+    ///     避免启动后首批连接的内存分配和缺页中断，之后关闭的连接的资源也缓存复用
+    /// @param conn_num 预热的连接数
+    /// @param lock 是否mlock锁定预热的内存
+    /// @return >=0 缓存中的连接资源个数
+    /// @return <0 表示失败，错误码@see MessageErrorCode
+    static int32_t Prewarm(uint32_t conn_num, bool lock = false);
+
+    /// @brief 获取连接资源的占用情况
+    /// @param used_num 使用中的个数，可为NULL
+    /// @param free_num 缓存中空闲的个数，可为NULL
+    /// @return 0 成功
+    /// @return <0 表示失败，错误码@see MessageErrorCode
+    static int32_t GetConnectionPoolInfo(uint32_t* used_num, uint32_t* free_num);
+
     // -------------------network api end-------------------------
 public:
     /// @brief 设置通信驱动(通信库)，运行时只支持一种通信驱动，如rawudp，tbuspp或第3方网络库
     /// @param driver 对MessageDriver接口实现的网络库
     /// @return 0 表示成功
     /// @return -1 表示失败
+    /// @note 通信驱动为线程私有，多worker模式下每个worker线程各自设置
     static void SetMessageDriver(MessageDriver* driver);
 
+    /// @brief 获取当前的通信驱动，用于在其上叠加驱动(如ShmMessageDriver)
+    static MessageDriver* GetMessageDriver() { return m_driver; }
+
 private:
-    static MessageDriver* m_driver;
+    static __thread MessageDriver* m_driver;
 };
 
 } // namespace pebble
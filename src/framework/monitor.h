@@ -78,7 +78,7 @@ public:
     }
 
     virtual uint32_t IsOverLoad() {
-        return (m_arrived_ms + m_expire_threshold_ms) < TimeUtility::GetCurrentMS()
+        return (m_arrived_ms + m_expire_threshold_ms) < TimeUtility::GetCachedMS()
             ? kMESSAGE_EXPIRED : kNO_OVERLOAD;
     }
 
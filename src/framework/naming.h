@@ -30,6 +30,15 @@ typedef cxx::function<void(int rc)> CbReturnCode;
 /// @param rc 执行结果返回值
 /// @param values 查询结果(url列表)
 typedef cxx::function<void(int rc, const std::vector<std::string>& urls)> CbReturnValue;
+/// @brief 把名字服务的连接fd注册到框架事件循环的函数
+/// @param fd 连接fd
+/// @param events 关注的epoll事件，为0时表示注销(需在fd关闭前调用)
+/// @param on_event fd上有事件时的回调，参数为fd和发生的epoll事件
+/// @return 0 成功，失败时名字服务自行轮询连接
+typedef cxx::function<int32_t(int32_t fd, uint32_t events,
+    const cxx::function<void(int32_t, uint32_t)>& on_event)> WatchFdFunc;
+
+class CoroutineSchedule;
 
 
 typedef enum {
@@ -103,6 +112,12 @@ public:
     /// @brief 获取上次的错误信息
     virtual const char* GetLastError() { return NULL; }
 
+    /// @brief 接入框架的事件循环
+    /// @param cor_sche 协程调度器，在协程内调用同步接口时让出协程等待结果，不阻塞事件循环
+    /// @param watch_fd 把连接fd注册到框架epoll的函数，名字服务有网络事件时及时唤醒事件循环
+    virtual int32_t AttachEventLoop(CoroutineSchedule* cor_sche, const WatchFdFunc& watch_fd)
+    { return kNAMING_NOT_SUPPORTTED; }
+
     /// @brief 兼容升级的适配接口
     static int32_t MakeName(int64_t app_id,
                             const std::string& service_dir,
@@ -11,11 +11,15 @@
  *
  */
 
+#include <algorithm>
 #include <arpa/inet.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 
 #include "common/log.h"
+#include "common/memory.h"
 #include "common/net_util.h"
 #include "common/string_utility.h"
 #include "common/time_utility.h"
@@ -30,9 +34,10 @@ public:
     NetConnection();
     ~NetConnection();
     /// @brief 初始化连接，主要是创建接收缓冲区
+    /// @param buff 大小为buff_len的接收缓冲区，归连接所有，为NULL时新分配
     /// @return 0 成功
     /// @return <0 失败
-    int32_t Init(uint32_t buff_len, uint32_t msg_head_len);
+    int32_t Init(uint32_t buff_len, uint32_t msg_head_len, uint8_t* buff = NULL);
 
     /// @brief cache新的发送数据，添加到发送队列尾部
     /// @return 0 成功
@@ -64,6 +69,24 @@ public:
 
     void Reset();
 
+    /// @brief 把接收缓冲区切分为数据报环，用于udp listen批量收包
+    /// @return 实际的数据报槽位数
+    uint32_t InitDatagramRing(uint32_t slot_num);
+
+    /// @brief 切换到数据报环中的下一个数据报
+    /// @return true 有新的数据报，false 数据报环已处理完
+    bool NextDatagram();
+
+    /// @brief 创建边缘触发模式下的预读缓冲区
+    /// @return 0 成功
+    /// @return <0 失败
+    int32_t InitReadAhead(uint32_t read_ahead_len);
+
+    /// @brief 预读缓冲区中是否还有未处理的数据，或socket中可能还有数据未读
+    bool HasPendingData() const {
+        return _ahead_end > _ahead_begin || !_drained;
+    }
+
     // 每个连接维护一个接收缓冲区，每次只收取一个完整包并持有，直至上层用户消费掉，然后再开始接收新的数据
     uint8_t* _buff;         // 接收缓冲区
     uint32_t _buff_len;     // 接收缓冲区大小
@@ -71,9 +94,21 @@ public:
 
     uint32_t _recv_len;     // 已经接收的数据长度
     uint32_t _cur_msg_len;  // 待接收消息的总长度，这个长度由上层用户解析消息头后给出，连接根据这个去收取一个完整包
+    uint32_t _msg_offset;   // 当前消息在接收缓冲区中的偏移，仅数据报环非0
     int64_t  _arrived_ms;   // 接收消息的时间戳
     uint64_t _peer_addr;    // 记录udp listen收到消息的远端地址
 
+    // udp listen连接一次recvmmsg收取多个数据报，各自记录远端地址和到达时间，逐个交给上层
+    struct Datagram {
+        uint32_t _len;
+        uint64_t _peer_addr;
+        int64_t  _arrived_ms;
+    };
+    uint32_t _datagram_slot_len;        // 每个数据报槽位的大小
+    uint32_t _datagram_num;             // 数据报环中已收取的数据报数
+    uint32_t _datagram_pos;             // 当前处理的数据报
+    std::vector<Datagram> _datagrams;
+
     // 每个连接维护发送消息列表，若一个消息未完全发送成功，需要缓存剩余数据，直至发送完毕
     struct Msg {
         Msg() : _msg_len(0), _msg(NULL), _full_pkg(0) {}
@@ -83,6 +118,29 @@ public:
     };
     uint32_t _max_send_list_size;
     std::list<Msg> _send_msg_list; // 待发送的消息缓存，固定限制大小为1w
+    uint32_t _cork_len;     // cork模式下本周期缓存待发送的数据长度
+    bool     _corked;       // 是否已加入待flush的连接列表
+
+    uint32_t _user_data;    // 上层自定义数据，如压缩能力协商结果
+
+    // 边缘触发模式下，一次recv尽量读满预读缓冲区，再从中逐个切分消息，减少系统调用
+    uint8_t* _ahead_buff;   // 预读缓冲区，为NULL时直接从socket收取
+    uint32_t _ahead_len;    // 预读缓冲区大小，即每个连接每轮最多读取的数据量
+    uint32_t _ahead_begin;  // 未处理数据的起始位置
+    uint32_t _ahead_end;    // 未处理数据的结束位置
+    bool     _drained;      // socket中的数据已读完(最近一次recv未读满)，有新的可读事件时清除
+    bool     _rdhup;        // 对端已关闭写，需要一直读到连接关闭，不能以短读判断读完
+    bool     _in_ready;     // 是否在就绪连接列表中
+
+    // 有完整消息交给过上层的连接串成双向链表，Poll时只检查链表中的连接是否还有缓存消息
+    NetConnection* _buffered_prev;
+    NetConnection* _buffered_next;
+    bool     _in_buffered;
+
+    // udp listen在本NetMessage中的编号，标记在收到的远端地址中，回包时据此直接找到本地监听
+    uint64_t _peer_tag;
+
+    uint64_t _netaddr;      // 连接对应的NetAddr，连接表按槽位存放，用于校验generation
 };
 
 NetConnection::NetConnection() {
@@ -91,20 +149,40 @@ NetConnection::NetConnection() {
     _msg_head_len   = 0;
     _recv_len       = 0;
     _cur_msg_len    = 0;
+    _msg_offset     = 0;
     _arrived_ms     = 0;
     _peer_addr      = INVAILD_HANDLE;
+    _datagram_slot_len = 0;
+    _datagram_num   = 0;
+    _datagram_pos   = 0;
     _max_send_list_size = 1000;
+    _cork_len       = 0;
+    _corked         = false;
+    _user_data      = 0;
+    _ahead_buff     = NULL;
+    _ahead_len      = 0;
+    _ahead_begin    = 0;
+    _ahead_end      = 0;
+    _drained        = true;
+    _rdhup          = false;
+    _in_ready       = false;
+    _buffered_prev  = NULL;
+    _buffered_next  = NULL;
+    _in_buffered    = false;
+    _peer_tag       = 0;
+    _netaddr        = INVAILD_NETADDR;
 }
 
 NetConnection::~NetConnection() {
     free(_buff);
+    free(_ahead_buff);
     for (std::list<Msg>::iterator it = _send_msg_list.begin();
         it != _send_msg_list.end(); ++it) {
         free((*it)._msg);
     }
 }
 
-int32_t NetConnection::Init(uint32_t buff_len, uint32_t msg_head_len) {
+int32_t NetConnection::Init(uint32_t buff_len, uint32_t msg_head_len, uint8_t* buff) {
     if (_buff) {
         return -1;
     }
@@ -113,7 +191,7 @@ int32_t NetConnection::Init(uint32_t buff_len, uint32_t msg_head_len) {
     }
     _buff_len       = buff_len;
     _msg_head_len   = msg_head_len;
-    _buff = (uint8_t*)malloc(_buff_len);
+    _buff = buff != NULL ? buff : (uint8_t*)malloc(_buff_len);
     if (_buff == NULL) {
         return -3;
     }
@@ -169,12 +247,13 @@ int32_t NetConnection::RecvMsg(uint8_t* buff, uint32_t* buff_len) {
         if (*buff_len < _cur_msg_len) {
             return -1;
         }
-        memcpy(buff, _buff, _cur_msg_len);
+        memcpy(buff, _buff + _msg_offset, _cur_msg_len);
         *buff_len = _cur_msg_len;
 
         // 清理接收数据
         _recv_len    = 0;
         _cur_msg_len = 0;
+        NextDatagram();
         return 0;
     }
 
@@ -185,7 +264,7 @@ int32_t NetConnection::RecvMsg(uint8_t* buff, uint32_t* buff_len) {
 int32_t NetConnection::PeekMsg(const uint8_t** msg, uint32_t* msg_len) {
     // 有数据，且消息完整
     if (_recv_len > 0 && _recv_len == _cur_msg_len) {
-        *msg = _buff;
+        *msg = _buff + _msg_offset;
         *msg_len = _cur_msg_len;
         return 0;
     }
@@ -199,6 +278,7 @@ int32_t NetConnection::PopMsg() {
     if (_recv_len > 0 && _recv_len == _cur_msg_len) {
         _recv_len    = 0;
         _cur_msg_len = 0;
+        NextDatagram();
         return 0;
     }
     return -1;
@@ -212,7 +292,17 @@ void NetConnection::Reset() {
     // 接收残渣数据清理
     _recv_len = 0;
     _cur_msg_len = 0;
+    _msg_offset = 0;
     _arrived_ms = 0;
+    _datagram_num = 0;
+    _datagram_pos = 0;
+    // 重连后对端可能已变化，需要重新协商
+    _user_data = 0;
+    // 预读的数据属于旧的socket
+    _ahead_begin = 0;
+    _ahead_end   = 0;
+    _drained     = true;
+    _rdhup       = false;
 
     // 发送残渣数据清理
     if (!_send_msg_list.empty()) {
@@ -224,8 +314,57 @@ void NetConnection::Reset() {
     }
 }
 
+uint32_t NetConnection::InitDatagramRing(uint32_t slot_num) {
+    // udp数据报最大64K
+    static const uint32_t MAX_DATAGRAM_LEN = 64 * 1024;
+    _datagram_slot_len = _buff_len < MAX_DATAGRAM_LEN ? _buff_len : MAX_DATAGRAM_LEN;
+    if (slot_num > _buff_len / _datagram_slot_len) {
+        slot_num = _buff_len / _datagram_slot_len;
+    }
+    _datagrams.resize(slot_num);
+    _datagram_num = 0;
+    _datagram_pos = 0;
+    return slot_num;
+}
+
+int32_t NetConnection::InitReadAhead(uint32_t read_ahead_len) {
+    if (_ahead_buff) {
+        return -1;
+    }
+    _ahead_buff = (uint8_t*)malloc(read_ahead_len);
+    if (_ahead_buff == NULL) {
+        return -2;
+    }
+    _ahead_len = read_ahead_len;
+    return 0;
+}
+
+bool NetConnection::NextDatagram() {
+    if (_datagram_pos + 1 >= _datagram_num) {
+        _datagram_num = 0;
+        _datagram_pos = 0;
+        _msg_offset   = 0;
+        return false;
+    }
+
+    ++_datagram_pos;
+    const Datagram& datagram = _datagrams[_datagram_pos];
+    _msg_offset  = _datagram_pos * _datagram_slot_len;
+    _recv_len    = datagram._len;
+    _cur_msg_len = datagram._len;
+    _arrived_ms  = datagram._arrived_ms;
+    _peer_addr   = datagram._peer_addr;
+    return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// 外部fd在epoll data中的槽位标记，NetAddr的槽位下标不会达到此值，NetIO查不到对应socket会忽略
+static const uint32_t EXTERNAL_FD_SLOT = UINT32_MAX;
+
+// 边缘触发模式下两次查询epoll之间至少处理的就绪连接次数
+static const uint32_t MIN_READY_TURNS = 32;
+
 enum {
     RECV_CONTINUE = 0,  // 继续读
     RECV_END_PKG,       // 读完毕，有新包
@@ -237,9 +376,20 @@ NetMessage::NetMessage() {
     m_netio = NULL;
 
     m_send_buff    = NULL;
+    m_udp_send_buff = NULL;
+    m_udp_send_len = 0;
+    m_udp_send_deferred = false;
+    m_cork_bytes   = 0;
     m_msg_head_len = 0;
     m_msg_buff_len = DEFAULT_MSG_BUFF_LEN;
     m_max_send_list_size = 1000;
+    m_accepted.resize(DEFAULT_ACCEPT_BATCH_NUM);
+    m_edge_trigger   = false;
+    m_read_ahead_len = DEFAULT_READ_AHEAD_LEN;
+    m_ready_turns    = 0;
+    m_buffered_head  = NULL;
+    m_connection_num = 0;
+    m_max_free_buff_num = 0;
 }
 
 NetMessage::~NetMessage() {
@@ -247,6 +397,10 @@ NetMessage::~NetMessage() {
     delete m_netio;
     delete m_epoll;
     free(m_send_buff);
+    free(m_udp_send_buff);
+    for (std::vector<uint8_t*>::iterator it = m_free_buffs.begin(); it != m_free_buffs.end(); ++it) {
+        free(*it);
+    }
 }
 
 int32_t NetMessage::Init(uint32_t msg_head_len, const GetMsgDataLen& get_msg_data_len_func,
@@ -269,6 +423,14 @@ int32_t NetMessage::Init(uint32_t msg_head_len, const GetMsgDataLen& get_msg_dat
     }
     m_send_buff = (uint8_t*)malloc(m_msg_buff_len);
 
+    free(m_udp_send_buff);
+    m_udp_send_buff = (uint8_t*)malloc(m_msg_buff_len);
+    m_udp_send_len  = 0;
+    m_udp_send_datagrams.clear();
+    m_udp_send_locals.clear();
+    m_udp_send_failed.clear();
+    m_udp_send_failed.reserve(NetIO::MAX_UDP_BATCH_NUM);
+
     int32_t ret = 0;
     if (!m_epoll) {
         m_epoll = new Epoll();
@@ -286,6 +448,7 @@ int32_t NetMessage::Init(uint32_t msg_head_len, const GetMsgDataLen& get_msg_dat
             PLOG_ERROR("netio init failed %s", m_netio->GetLastError());
             return kMESSAGE_NETIO_INIT_FAILED;
         }
+        m_netio->SetEdgeTrigger(m_edge_trigger);
     }
 
     return 0;
@@ -301,10 +464,27 @@ uint64_t NetMessage::Bind(const std::string& ip, uint16_t port) {
     const SocketInfo* socket_info = m_netio->GetSocketInfo(netaddr);
     if (socket_info->_state & UDP_PROTOCOL) {
         // udp listen port需要创建connection对象
-        if (CreateConnection(netaddr) == NULL) {
+        NetConnection* connection = CreateConnection(netaddr);
+        if (connection == NULL) {
             m_netio->Close(netaddr);
             return INVAILD_HANDLE;
         }
+        connection->InitDatagramRing(UDP_BATCH_NUM);
+
+        // 分配监听编号，收到的远端地址带上编号，回包时不用再查表
+        std::vector<uint64_t>::iterator it =
+            std::find(m_udp_listens.begin(), m_udp_listens.end(), INVAILD_HANDLE);
+        if (it == m_udp_listens.end()) {
+            if (m_udp_listens.size() >= NetIO::MAX_UDP_REMOTE_TAG) {
+                PLOG_ERROR("too many udp listen(%lu)", m_udp_listens.size());
+                Close(netaddr);
+                return INVAILD_HANDLE;
+            }
+            it = m_udp_listens.insert(m_udp_listens.end(), INVAILD_HANDLE);
+        }
+        *it = netaddr;
+        connection->_peer_tag = static_cast<uint64_t>(it - m_udp_listens.begin() + 1)
+            << NetIO::UDP_REMOTE_TAG_SHIFT;
     }
 
     return netaddr;
@@ -328,25 +508,32 @@ uint64_t NetMessage::Connect(const std::string& ip, uint16_t port) {
 int32_t NetMessage::Send(uint64_t handle, const uint8_t* msg, uint32_t msg_len) {
 
     int32_t send_len = 0;
-    uint64_t local_handle = GetLocalHandle(handle);
+    // 有connection的为本地句柄，否则是udp listen收到的远端地址
+    NetConnection* connection = GetConnection(handle);
+    uint64_t local_handle = connection ? handle : GetLocalHandle(handle);
     const SocketInfo* socket_info = m_netio->GetSocketInfo(local_handle);
-    // UDP直接发，不缓存
+    // UDP不缓存，处理本轮收到的数据报时listen的回包攒批后发送，其他时候直接发送
     if (socket_info->_state & UDP_PROTOCOL) {
         if (socket_info->_state & CONNECT_ADDR) { // udp protocol connect
             send_len = m_netio->Send(handle, (char*)msg, msg_len);
-        } else { // udp protocol listen
+        } else if (m_udp_send_deferred) { // udp protocol listen
+            return AppendUdpSendData(local_handle, handle, 1, &msg, &msg_len);
+        } else {
             send_len = m_netio->SendTo(local_handle, handle, (char*)msg, msg_len);
         }
         return send_len == (int32_t)msg_len ? 0 : kMESSAGE_SEND_FAILED;
     }
 
     // TCP
-    NetConnection* connection = GetConnection(handle);
     if (connection == NULL) {
         PLOG_ERROR_N_EVERY_SECOND(1, "get connection %lu failed", handle);
         return kMESSAGE_UNKNOWN_CONNECTION;
     }
 
+    if (m_cork_bytes > 0) {
+        return CorkSendData(handle, connection, 1, &msg, &msg_len);
+    }
+
     // 有缓存，直接放入缓存中，消息排队
     SendCacheData(handle, connection);
     if (!connection->_send_msg_list.empty()) {
@@ -383,12 +570,17 @@ int32_t NetMessage::Send(uint64_t handle, const uint8_t* msg, uint32_t msg_len)
 int32_t NetMessage::SendV(uint64_t handle, uint32_t msg_frag_num,
                           const uint8_t* msg_frag[], uint32_t msg_frag_len[]) {
 
-    // UDP，组装一个包发送，直接发送到网络，不缓存
-    uint64_t local_handle = GetLocalHandle(handle);
+    // UDP，组装一个包发送，不缓存，处理本轮收到的数据报时listen的回包攒批后发送
+    NetConnection* connection = GetConnection(handle);
+    uint64_t local_handle = connection ? handle : GetLocalHandle(handle);
     uint32_t msg_len = 0;
     int32_t send_len = 0;
     const SocketInfo* socket_info = m_netio->GetSocketInfo(local_handle);
     if (socket_info->_state & UDP_PROTOCOL) {
+        if (m_udp_send_deferred && !(socket_info->_state & CONNECT_ADDR)) { // udp protocol listen
+            return AppendUdpSendData(local_handle, handle, msg_frag_num, msg_frag, msg_frag_len);
+        }
+
         for (uint32_t i = 0; i < msg_frag_num; i++) {
             if (msg_len + msg_frag_len[i] > m_msg_buff_len) {
                 PLOG_ERROR_N_EVERY_SECOND(1, "bufflen(%u) < msglen(%u) i=%d",
@@ -408,12 +600,15 @@ int32_t NetMessage::SendV(uint64_t handle, uint32_t msg_frag_num,
     }
 
     // TCP，支持多段发送
-    NetConnection* connection = GetConnection(handle);
     if (connection == NULL) {
         PLOG_ERROR_N_EVERY_SECOND(1, "get connection %lu failed", handle);
         return kMESSAGE_UNKNOWN_CONNECTION;
     }
 
+    if (m_cork_bytes > 0) {
+        return CorkSendData(handle, connection, msg_frag_num, msg_frag, msg_frag_len);
+    }
+
     // 有缓存，直接放入缓存中，消息排队
     int32_t ret = 0;
     SendCacheData(handle, connection);
@@ -554,11 +749,15 @@ int32_t NetMessage::Pop(uint64_t handle) {
 }
 
 int32_t NetMessage::Close(uint64_t handle) {
+    // 关闭前把攒批的udp回包发出
+    FlushUdpSendData();
+
     // 清理connection数据
-    cxx::unordered_map<uint64_t, NetConnection*>::iterator it = m_connections.find(handle);
-    if (it != m_connections.end()) {
-        delete it->second;
-        m_connections.erase(it);
+    NetConnection* connection = GetConnection(handle);
+    if (connection != NULL) {
+        m_connections[static_cast<uint32_t>(handle)] = NULL;
+        --m_connection_num;
+        DeleteConnection(connection);
     }
     // 关闭socket
     m_netio->Close(handle);
@@ -566,16 +765,51 @@ int32_t NetMessage::Close(uint64_t handle) {
 }
 
 int32_t NetMessage::PollConnectionBuffer(uint64_t* handle) {
-    cxx::unordered_map<uint64_t, NetConnection*>::iterator it = m_connections.begin();
-    for (; it != m_connections.end(); ++it) {
-        if (it->second->HasNewMsg()) {
-            *handle = it->first;
+    // 只检查交给过上层消息的连接，消息已被取走的移出链表
+    NetConnection* connection = m_buffered_head;
+    while (connection != NULL) {
+        if (connection->HasNewMsg()) {
+            *handle = connection->_netaddr;
             return 1;
         }
+        NetConnection* next = connection->_buffered_next;
+        UnlinkBuffered(connection);
+        connection = next;
     }
     return 0;
 }
 
+void NetMessage::LinkBuffered(uint64_t netaddr) {
+    NetConnection* connection = GetConnection(netaddr);
+    if (connection == NULL || connection->_in_buffered) {
+        return;
+    }
+    connection->_in_buffered   = true;
+    connection->_buffered_prev = NULL;
+    connection->_buffered_next = m_buffered_head;
+    if (m_buffered_head != NULL) {
+        m_buffered_head->_buffered_prev = connection;
+    }
+    m_buffered_head = connection;
+}
+
+void NetMessage::UnlinkBuffered(NetConnection* connection) {
+    if (!connection->_in_buffered) {
+        return;
+    }
+    if (connection->_buffered_prev != NULL) {
+        connection->_buffered_prev->_buffered_next = connection->_buffered_next;
+    } else {
+        m_buffered_head = connection->_buffered_next;
+    }
+    if (connection->_buffered_next != NULL) {
+        connection->_buffered_next->_buffered_prev = connection->_buffered_prev;
+    }
+    connection->_buffered_prev = NULL;
+    connection->_buffered_next = NULL;
+    connection->_in_buffered   = false;
+}
+
 // handle一定是数据连接句柄，通过数据关系找到本地监听句柄
 int32_t NetMessage::Poll(uint64_t* handle, int32_t* event, int32_t timeout_ms) {
     // 优先消费缓存消息
@@ -584,6 +818,21 @@ int32_t NetMessage::Poll(uint64_t* handle, int32_t* event, int32_t timeout_ms) {
         return 0;
     }
 
+    // 缓存消息处理完后，本轮产生的udp回包一次sendmmsg发出，此后的回包直接发送
+    FlushUdpSendData();
+    m_udp_send_deferred = false;
+
+    // 攒批回包在Send时已返回成功，发送失败通过Poll报告给上层
+    if (!m_udp_send_failed.empty()) {
+        *handle = m_udp_send_failed.back();
+        m_udp_send_failed.pop_back();
+        return kMESSAGE_SEND_FAILED;
+    }
+
+    if (m_edge_trigger) {
+        return PollReadyConnection(handle, timeout_ms);
+    }
+
     int32_t ret = m_epoll->Wait(timeout_ms);
     if (ret <= 0) {
         return -1;
@@ -596,6 +845,15 @@ int32_t NetMessage::Poll(uint64_t* handle, int32_t* event, int32_t timeout_ms) {
         return -1;
     }
 
+    if (static_cast<uint32_t>(netaddr) == EXTERNAL_FD_SLOT) {
+        int32_t fd = static_cast<int32_t>(netaddr >> 32);
+        cxx::unordered_map<int32_t, FdEventCallback>::iterator it = m_fd_watchers.find(fd);
+        if (it != m_fd_watchers.end()) {
+            it->second(fd, events);
+        }
+        return -1;
+    }
+
     if (events & EPOLLERR) {
         PLOG_ERROR_N_EVERY_SECOND(1, "EPOLLERR get, %lu", netaddr);
         OnSocketError(netaddr);
@@ -613,9 +871,10 @@ int32_t NetMessage::Poll(uint64_t* handle, int32_t* event, int32_t timeout_ms) {
         // 收包处理，区分TCP和UDP的收包逻辑
         if (socket_info->_state & TCP_PROTOCOL) {
             if (socket_info->_state & LISTEN_ADDR) {
-                uint64_t peer_handle = m_netio->Accept(netaddr);
-                if (peer_handle != INVAILD_NETADDR) {
-                    CreateConnection(peer_handle);
+                // 连接风暴时一次取出积压的连接，未取完的listen fd仍可读，下次Poll继续
+                uint32_t num = m_netio->AcceptBatch(netaddr, &m_accepted[0], m_accepted.size());
+                for (uint32_t i = 0; i < num; ++i) {
+                    CreateConnection(m_accepted[i]);
                 }
                 return ret;
             }
@@ -630,6 +889,7 @@ int32_t NetMessage::Poll(uint64_t* handle, int32_t* event, int32_t timeout_ms) {
             return -1;
         }
 
+        LinkBuffered(netaddr);
         ret = 0;
         *handle = netaddr;
     }
@@ -637,32 +897,208 @@ int32_t NetMessage::Poll(uint64_t* handle, int32_t* event, int32_t timeout_ms) {
     return ret;
 }
 
+int32_t NetMessage::PollReadyConnection(uint64_t* handle, int32_t timeout_ms) {
+    // 就绪连接每轮各处理一次，一轮结束后再查询epoll，积压数据的连接和新事件的连接交替得到处理
+    if (0 == m_ready_turns) {
+        int32_t ret = m_epoll->Wait(m_ready_handles.empty() ? timeout_ms : 0);
+        uint32_t events  = 0;
+        uint64_t netaddr = 0;
+        // 边缘触发的事件只通知一次，需要全部取出
+        while (ret > 0 && 0 == m_epoll->GetEvent(&events, &netaddr)) {
+            OnReadyEvent(netaddr, events);
+        }
+        // 就绪连接很少时一轮也至少处理若干次，避免每个消息都查询一次epoll
+        m_ready_turns = m_ready_handles.size() > MIN_READY_TURNS
+            ? m_ready_handles.size() : MIN_READY_TURNS;
+    }
+
+    while (m_ready_turns > 0 && !m_ready_handles.empty()) {
+        --m_ready_turns;
+        uint64_t netaddr = m_ready_handles.front();
+        m_ready_handles.pop_front();
+        if (RecvReadyConnection(netaddr) == RECV_END_PKG) {
+            LinkBuffered(netaddr);
+            *handle = netaddr;
+            return 0;
+        }
+    }
+
+    m_ready_turns = 0;
+    return -1;
+}
+
+void NetMessage::OnReadyEvent(uint64_t netaddr, uint32_t events) {
+    if (static_cast<uint32_t>(netaddr) == EXTERNAL_FD_SLOT) {
+        int32_t fd = static_cast<int32_t>(netaddr >> 32);
+        cxx::unordered_map<int32_t, FdEventCallback>::iterator it = m_fd_watchers.find(fd);
+        if (it != m_fd_watchers.end()) {
+            it->second(fd, events);
+        }
+        return;
+    }
+
+    if (events & EPOLLERR) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "EPOLLERR get, %lu", netaddr);
+        OnSocketError(netaddr);
+        return;
+    }
+
+    if (events & EPOLLOUT) {
+        SendCacheData(netaddr, NULL);
+    }
+
+    if (0 == (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) {
+        return;
+    }
+
+    const SocketInfo* socket_info = m_netio->GetSocketInfo(netaddr);
+    if ((socket_info->_state & TCP_PROTOCOL) && (socket_info->_state & LISTEN_ADDR)) {
+        uint32_t num = m_netio->AcceptBatch(netaddr, &m_accepted[0], m_accepted.size());
+        for (uint32_t i = 0; i < num; ++i) {
+            CreateConnection(m_accepted[i]);
+        }
+        return;
+    }
+
+    NetConnection* connection = GetConnection(netaddr);
+    if (connection == NULL) {
+        return;
+    }
+    connection->_drained = false;
+    if (events & EPOLLRDHUP) {
+        connection->_rdhup = true;
+    }
+    if (!connection->_in_ready) {
+        connection->_in_ready = true;
+        m_ready_handles.push_back(netaddr);
+    }
+}
+
+int32_t NetMessage::RecvReadyConnection(uint64_t netaddr) {
+    NetConnection* connection = GetConnection(netaddr);
+    if (connection == NULL) {
+        // 连接已关闭
+        return -1;
+    }
+    connection->_in_ready = false;
+
+    // udp仍为水平触发，未收完的数据报会再次通知
+    const SocketInfo* socket_info = m_netio->GetSocketInfo(netaddr);
+    if (!(socket_info->_state & TCP_PROTOCOL)) {
+        return RecvUdpData(netaddr);
+    }
+
+    int32_t ret = 0;
+    do {
+        ret = RecvTcpData(netaddr);
+    } while (ret == RECV_CONTINUE);
+
+    // 出错时连接可能已被删除或重置，重新获取
+    connection = GetConnection(netaddr);
+    if (connection != NULL && !connection->_in_ready && connection->HasPendingData()) {
+        connection->_in_ready = true;
+        m_ready_handles.push_back(netaddr);
+    }
+    return ret;
+}
+
 NetConnection* NetMessage::CreateConnection(uint64_t netaddr) {
+    uint8_t* buff = NULL;
+    if (!m_free_buffs.empty()) {
+        buff = m_free_buffs.back();
+        m_free_buffs.pop_back();
+    }
     NetConnection* connection = new NetConnection();
-    int32_t ret = connection->Init(m_msg_buff_len, m_msg_head_len);
+    int32_t ret = connection->Init(m_msg_buff_len, m_msg_head_len, buff);
     if (ret < 0) {
-        delete connection;
+        if (connection->_buff != buff) {
+            free(buff);
+        }
+        DeleteConnection(connection);
         PLOG_ERROR("connection init failed %d", ret);
         return NULL;
     }
 
-    if (m_connections.insert({netaddr, connection}).second == false) {
-        delete connection;
+    // 连接表与NetIO的socket表平行，按槽位存放
+    uint32_t slot = static_cast<uint32_t>(netaddr);
+    if (slot >= m_connections.size()) {
+        m_connections.resize(slot + 1, NULL);
+    }
+    if (m_connections[slot] != NULL) {
+        DeleteConnection(connection);
         PLOG_ERROR("connection insert %lu failed", netaddr);
         return NULL;
     }
+    m_connections[slot] = connection;
+    ++m_connection_num;
 
     connection->_max_send_list_size = m_max_send_list_size;
+    connection->_netaddr = netaddr;
+
+    const SocketInfo* socket_info = m_netio->GetSocketInfo(netaddr);
+    if (m_edge_trigger && m_read_ahead_len > 0 && (socket_info->_state & TCP_PROTOCOL)
+        && 0 == (socket_info->_state & LISTEN_ADDR)) {
+        ret = connection->InitReadAhead(m_read_ahead_len);
+        PLOG_IF_ERROR(ret != 0, "init read ahead buffer failed(%d), recv directly", ret);
+    }
 
     return connection;
 }
 
+void NetMessage::DeleteConnection(NetConnection* connection) {
+    UnlinkBuffered(connection);
+    if (connection->_peer_tag != 0) {
+        m_udp_listens[(connection->_peer_tag >> NetIO::UDP_REMOTE_TAG_SHIFT) - 1] = INVAILD_HANDLE;
+    }
+    if (connection->_buff != NULL && connection->_buff_len == m_msg_buff_len
+        && m_free_buffs.size() < m_max_free_buff_num) {
+        m_free_buffs.push_back(connection->_buff);
+        connection->_buff = NULL;
+    }
+    delete connection;
+}
+
+int32_t NetMessage::Prewarm(uint32_t buff_num, bool lock) {
+    if (buff_num > m_max_free_buff_num) {
+        m_max_free_buff_num = buff_num;
+    }
+
+    bool lock_failed = false;
+    while (m_free_buffs.size() < buff_num) {
+        uint8_t* buff = (uint8_t*)malloc(m_msg_buff_len);
+        if (NULL == buff) {
+            PLOG_ERROR("malloc %u failed", m_msg_buff_len);
+            break;
+        }
+        if (PrefaultMemory(buff, m_msg_buff_len, lock) != 0 && !lock_failed) {
+            lock_failed = true;
+            PLOG_ERROR("mlock connection buffer failed(%d:%s)", errno, strerror(errno));
+        }
+        m_free_buffs.push_back(buff);
+    }
+
+    return m_free_buffs.size();
+}
+
+void NetMessage::GetBuffInfo(uint32_t* used_num, uint32_t* free_num) {
+    if (used_num) {
+        *used_num = m_connection_num;
+    }
+    if (free_num) {
+        *free_num = m_free_buffs.size();
+    }
+}
+
 NetConnection* NetMessage::GetConnection(uint64_t netaddr) {
-    cxx::unordered_map<uint64_t, NetConnection*>::iterator it = m_connections.find(netaddr);
-    if (it == m_connections.end()) {
+    uint32_t slot = static_cast<uint32_t>(netaddr);
+    if (slot >= m_connections.size()) {
+        return NULL;
+    }
+    NetConnection* connection = m_connections[slot];
+    if (connection == NULL || connection->_netaddr != netaddr) {
         return NULL;
     }
-    return it->second;
+    return connection;
 }
 
 void NetMessage::CloseConnection(uint64_t netaddr) {
@@ -680,20 +1116,23 @@ void NetMessage::CloseConnection(uint64_t netaddr) {
 
     // connect的连接重连socket，重置connection资源，对上层屏蔽
     if (socket_info->_state & CONNECT_ADDR) {
-        cxx::unordered_map<uint64_t, NetConnection*>::iterator it = m_connections.find(netaddr);
-        if (it != m_connections.end()) {
-            it->second->Reset();
+        NetConnection* connection = GetConnection(netaddr);
+        if (connection != NULL) {
+            connection->Reset();
         }
         m_netio->Reset(netaddr);
     }
 }
 
 void NetMessage::CloseAllConnections() {
-    cxx::unordered_map<uint64_t, NetConnection*>::iterator it = m_connections.begin();
+    std::vector<NetConnection*>::iterator it = m_connections.begin();
     for (; it != m_connections.end(); ++it) {
-        delete it->second;
+        if (*it != NULL) {
+            DeleteConnection(*it);
+        }
     }
     m_connections.clear();
+    m_connection_num = 0;
     m_netio->CloseAll();
 }
 
@@ -706,34 +1145,126 @@ void NetMessage::SendCacheData(uint64_t netaddr, NetConnection* connection) {
         }
     }
 
+    connection->_cork_len = 0;
+
     // 每个连接默认最多缓存1000个消息，可以直接发完，避免net_util吃掉OUT事件了
+    // 每次最多合并MAX_SENDV_DATA_NUM个缓存消息，一次writev发出
+    const char* data[NetIO::MAX_SENDV_DATA_NUM];
+    uint32_t data_len[NetIO::MAX_SENDV_DATA_NUM];
     while (!connection->_send_msg_list.empty()) {
-        NetConnection::Msg& msg = connection->_send_msg_list.front();
-        int32_t send_len = m_netio->Send(netaddr, (char*)msg._msg, msg._msg_len);
+        uint32_t num = 0;
+        int32_t total_len = 0;
+        std::list<NetConnection::Msg>::iterator it = connection->_send_msg_list.begin();
+        for (; it != connection->_send_msg_list.end() && num < NetIO::MAX_SENDV_DATA_NUM; ++it, ++num) {
+            data[num]     = (const char*)it->_msg;
+            data_len[num] = it->_msg_len;
+            total_len    += it->_msg_len;
+        }
+
+        int32_t send_len = m_netio->SendV(netaddr, num, data, data_len);
         if (send_len < 0) {
             OnSocketError(netaddr);
             break;
         }
 
-        if (send_len == (int32_t)msg._msg_len) {
-            // 发送完整数据，清掉缓存
+        // 发送完整的数据，清掉缓存
+        int32_t left_len = send_len;
+        while (left_len > 0 && left_len >= (int32_t)connection->_send_msg_list.front()._msg_len) {
+            NetConnection::Msg& msg = connection->_send_msg_list.front();
+            left_len -= msg._msg_len;
             free(msg._msg);
             connection->_send_msg_list.pop_front();
-        } else if (send_len > 0) {
+        }
+
+        if (left_len > 0) {
             // 发送部分数据，重新缓存
-            uint8_t* new_buff = (uint8_t*)malloc(msg._msg_len - send_len);
-            memcpy(new_buff, msg._msg + send_len, msg._msg_len - send_len);
+            NetConnection::Msg& msg = connection->_send_msg_list.front();
+            uint8_t* new_buff = (uint8_t*)malloc(msg._msg_len - left_len);
+            memcpy(new_buff, msg._msg + left_len, msg._msg_len - left_len);
             free(msg._msg);
             msg._msg = new_buff;
-            msg._msg_len -= send_len;
+            msg._msg_len -= left_len;
             msg._full_pkg = 0;
+        }
+
+        // 未发完，等待OUT事件
+        if (send_len < total_len) {
             break;
-        } else {// 发送0字节，缓存不变
-            break;
         }
     }
 }
 
+int32_t NetMessage::CorkSendData(uint64_t handle, NetConnection* connection,
+    uint32_t msg_frag_num, const uint8_t* msg_frag[], uint32_t msg_frag_len[]) {
+    uint32_t msg_len = 0;
+    int32_t ret = 0;
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        if (i == 0) {
+            ret = connection->CacheSendData(msg_frag[i], msg_frag_len[i], true);
+        } else {
+            ret = connection->AppendSendData(msg_frag[i], msg_frag_len[i]);
+        }
+
+        if (ret != 0) {
+            PLOG_ERROR_N_EVERY_SECOND(1, "cache msg failed(%d), i = %d", ret, i);
+            return kMESSAGE_CACHE_FAILED;
+        }
+        msg_len += msg_frag_len[i];
+    }
+
+    if (!connection->_corked) {
+        connection->_corked = true;
+        m_cork_handles.push_back(handle);
+    }
+
+    // 超过阈值或缓存消息数达到上限时立即发送
+    connection->_cork_len += msg_len;
+    if (connection->_cork_len >= m_cork_bytes
+        || connection->_send_msg_list.size() >= connection->_max_send_list_size) {
+        SendCacheData(handle, connection);
+    }
+
+    return 0;
+}
+
+void NetMessage::SetSendCork(uint32_t flush_bytes) {
+    if (0 == flush_bytes) {
+        Flush(INVAILD_HANDLE);
+    }
+    m_cork_bytes = flush_bytes;
+}
+
+int32_t NetMessage::Flush(uint64_t handle) {
+    if (handle != INVAILD_HANDLE) {
+        NetConnection* connection = GetConnection(handle);
+        if (connection == NULL) {
+            return kMESSAGE_UNKNOWN_CONNECTION;
+        }
+        SendCacheData(handle, connection);
+        return 0;
+    }
+
+    // 连接可能在发送出错时被关闭，每次都重新查找
+    std::vector<uint64_t> cork_handles;
+    cork_handles.swap(m_cork_handles);
+    for (std::vector<uint64_t>::iterator it = cork_handles.begin(); it != cork_handles.end(); ++it) {
+        NetConnection* connection = GetConnection(*it);
+        if (connection == NULL) {
+            continue;
+        }
+        connection->_corked = false;
+        if (connection->_cork_len > 0) {
+            SendCacheData(*it, connection);
+        }
+    }
+    cork_handles.clear();
+    if (m_cork_handles.empty()) {
+        m_cork_handles.swap(cork_handles);
+    }
+
+    return 0;
+}
+
 int32_t NetMessage::RecvTcpData(uint64_t netaddr) {
     // 每次收取1包，等待用户消费完后再收取下一包
     NetConnection* connection = GetConnection(netaddr);
@@ -761,7 +1292,7 @@ int32_t NetMessage::RecvTcpData(uint64_t netaddr) {
         need_read = connection->_cur_msg_len - old_len;
     }
 
-    int32_t recv_len = m_netio->Recv(netaddr, (char*)connection->_buff + old_len, need_read);
+    int32_t recv_len = RecvStream(netaddr, connection, connection->_buff + old_len, need_read);
     if (recv_len < 0) {
         PLOG_ERROR_N_EVERY_SECOND(1, "recv failed(%d:%s), netaddr=%lu", recv_len, m_netio->GetLastError(), netaddr);
         OnSocketError(netaddr);
@@ -781,16 +1312,70 @@ int32_t NetMessage::RecvTcpData(uint64_t netaddr) {
             return -1;
         }
         connection->_cur_msg_len = m_msg_head_len + msg_data_len;
-        connection->_arrived_ms  = TimeUtility::GetCurrentMS();
+        connection->_arrived_ms  = TimeUtility::GetCachedMS();
     }
 
     if (connection->HasNewMsg()) {
+        if (m_rewrite_msg_func) {
+            int32_t msg_len = m_rewrite_msg_func(netaddr, connection->_buff,
+                connection->_cur_msg_len, connection->_buff_len);
+            if (msg_len < (int32_t)m_msg_head_len || msg_len > (int32_t)connection->_buff_len) {
+                PLOG_ERROR_N_EVERY_SECOND(1, "rewrite msg failed(%d), netaddr=%lu", msg_len, netaddr);
+                CloseConnection(netaddr);
+                return kMESSAGE_RECV_INVALID_DATA;
+            }
+            connection->_recv_len    = msg_len;
+            connection->_cur_msg_len = msg_len;
+        }
         return RECV_END_PKG;
     }
 
     return RECV_CONTINUE;
 }
 
+int32_t NetMessage::RecvStream(uint64_t netaddr, NetConnection* connection,
+    uint8_t* buff, uint32_t len) {
+    if (!m_edge_trigger) {
+        return m_netio->Recv(netaddr, (char*)buff, len);
+    }
+
+    uint32_t got = 0;
+    while (got < len) {
+        uint32_t cached = connection->_ahead_end - connection->_ahead_begin;
+        if (cached > 0) {
+            uint32_t copy_len = cached < len - got ? cached : len - got;
+            memcpy(buff + got, connection->_ahead_buff + connection->_ahead_begin, copy_len);
+            connection->_ahead_begin += copy_len;
+            got += copy_len;
+            continue;
+        }
+        if (connection->_drained) {
+            break;
+        }
+
+        // 需要的数据不小于预读缓冲区时直接收到目标地址，省去一次拷贝
+        bool direct = (len - got >= connection->_ahead_len);
+        uint8_t* dst = direct ? buff + got : connection->_ahead_buff;
+        uint32_t dst_len = direct ? len - got : connection->_ahead_len;
+        int32_t recv_len = m_netio->Recv(netaddr, (char*)dst, dst_len);
+        if (recv_len < 0) {
+            return recv_len;
+        }
+        // 短读说明socket中的数据已读完，之后的新数据会再产生边缘事件；
+        // 对端关闭写时FIN不会再通知，需要一直读到连接关闭
+        if (0 == recv_len || (static_cast<uint32_t>(recv_len) < dst_len && !connection->_rdhup)) {
+            connection->_drained = true;
+        }
+        if (direct) {
+            got += recv_len;
+        } else {
+            connection->_ahead_begin = 0;
+            connection->_ahead_end   = recv_len;
+        }
+    }
+    return got;
+}
+
 int32_t NetMessage::RecvUdpData(uint64_t netaddr) {
     NetConnection* connection = GetConnection(netaddr);
     if (connection == NULL) {
@@ -798,15 +1383,17 @@ int32_t NetMessage::RecvUdpData(uint64_t netaddr) {
         return kMESSAGE_UNKNOWN_CONNECTION;
     }
 
-    uint64_t peer_addr = INVAILD_NETADDR;
-    int32_t recv_len = 0;
+    // 上一批数据报还未消费完，不覆盖
+    if (connection->HasNewMsg()) {
+        return RECV_END_PKG;
+    }
 
     const SocketInfo* socket_info = m_netio->GetSocketInfo(netaddr);
     if (socket_info->_state & LISTEN_ADDR) {
-        recv_len = m_netio->RecvFrom(netaddr, &peer_addr, (char*)connection->_buff, connection->_buff_len);
-    } else {
-        recv_len = m_netio->Recv(netaddr, (char*)connection->_buff, connection->_buff_len);
+        return RecvUdpBatch(netaddr, connection);
     }
+
+    int32_t recv_len = m_netio->Recv(netaddr, (char*)connection->_buff, connection->_buff_len);
     if (recv_len <= 0) {
         PLOG_ERROR_N_EVERY_SECOND(1, "recv failed(%d:%s), netaddr=%lu", recv_len, m_netio->GetLastError(), netaddr);
         return kMESSAGE_RECV_FAILED;
@@ -814,16 +1401,210 @@ int32_t NetMessage::RecvUdpData(uint64_t netaddr) {
 
     connection->_cur_msg_len = recv_len;
     connection->_recv_len    = recv_len;
-    connection->_arrived_ms  = TimeUtility::GetCurrentMS();
-    connection->_peer_addr   = peer_addr;
+    connection->_arrived_ms  = TimeUtility::GetCachedMS();
+    connection->_peer_addr   = INVAILD_NETADDR;
 
-    if (peer_addr != INVAILD_NETADDR) {
-        m_peer_handle_to_local[peer_addr] = netaddr;
+    return RECV_END_PKG;
+}
+
+int32_t NetMessage::RecvUdpBatch(uint64_t netaddr, NetConnection* connection) {
+    UdpDatagram datagrams[NetIO::MAX_UDP_BATCH_NUM];
+    uint32_t num = connection->_datagrams.size();
+    if (num > NetIO::MAX_UDP_BATCH_NUM) {
+        num = NetIO::MAX_UDP_BATCH_NUM;
+    }
+    for (uint32_t i = 0; i < num; i++) {
+        datagrams[i]._buff = (char*)connection->_buff + i * connection->_datagram_slot_len;
+        datagrams[i]._len  = connection->_datagram_slot_len;
+    }
+
+    int32_t recv_num = m_netio->RecvFromBatch(netaddr, datagrams, num);
+    if (recv_num < 0) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "recv failed(%s), netaddr=%lu", m_netio->GetLastError(), netaddr);
+        return kMESSAGE_RECV_FAILED;
+    }
+
+    // 空数据报丢弃，其余按槽位顺序记录
+    uint32_t datagram_num = 0;
+    for (int32_t i = 0; i < recv_num; i++) {
+        if (0 == datagrams[i]._len) {
+            continue;
+        }
+        if (datagram_num != static_cast<uint32_t>(i)) {
+            memmove(connection->_buff + datagram_num * connection->_datagram_slot_len,
+                datagrams[i]._buff, datagrams[i]._len);
+        }
+        NetConnection::Datagram& datagram = connection->_datagrams[datagram_num++];
+        datagram._len        = datagrams[i]._len;
+        datagram._peer_addr  = datagrams[i]._remote_addr | connection->_peer_tag;
+        datagram._arrived_ms = datagrams[i]._arrived_ms;
+    }
+    if (0 == datagram_num) {
+        return RECV_END_PART;
     }
 
+    // 从第一个数据报开始交给上层，处理这批数据报时的回包攒批，在下次Poll时发出
+    m_udp_send_deferred = true;
+    const NetConnection::Datagram& first = connection->_datagrams[0];
+    connection->_datagram_num = datagram_num;
+    connection->_datagram_pos = 0;
+    connection->_msg_offset   = 0;
+    connection->_cur_msg_len  = first._len;
+    connection->_recv_len     = first._len;
+    connection->_arrived_ms   = first._arrived_ms;
+    connection->_peer_addr    = first._peer_addr;
+
     return RECV_END_PKG;
 }
 
+int32_t NetMessage::AppendUdpSendData(uint64_t local_handle, uint64_t peer_handle,
+    uint32_t msg_frag_num, const uint8_t* msg_frag[], uint32_t msg_frag_len[]) {
+    uint32_t msg_len = 0;
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        msg_len += msg_frag_len[i];
+    }
+    if (msg_len > m_msg_buff_len) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "bufflen(%u) < msglen(%u)", m_msg_buff_len, msg_len);
+        return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
+    }
+
+    // 缓冲区或批量数满了先发出
+    if (m_udp_send_len + msg_len > m_msg_buff_len
+        || m_udp_send_datagrams.size() >= NetIO::MAX_UDP_BATCH_NUM) {
+        FlushUdpSendData();
+    }
+
+    UdpDatagram datagram;
+    datagram._remote_addr = peer_handle;
+    datagram._buff        = (char*)m_udp_send_buff + m_udp_send_len;
+    datagram._len         = msg_len;
+    datagram._arrived_ms  = 0;
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        memcpy(m_udp_send_buff + m_udp_send_len, msg_frag[i], msg_frag_len[i]);
+        m_udp_send_len += msg_frag_len[i];
+    }
+
+    m_udp_send_datagrams.push_back(datagram);
+    m_udp_send_locals.push_back(local_handle);
+    return 0;
+}
+
+void NetMessage::FlushUdpSendData() {
+    uint32_t num = m_udp_send_datagrams.size();
+    uint32_t begin = 0;
+    while (begin < num) {
+        // 同一个本地监听地址的连续数据报一起发送
+        uint32_t end = begin + 1;
+        while (end < num && m_udp_send_locals[end] == m_udp_send_locals[begin]) {
+            ++end;
+        }
+
+        int32_t send_num = m_netio->SendToBatch(m_udp_send_locals[begin],
+            &m_udp_send_datagrams[begin], end - begin);
+        ++m_udp_send_stat._batch_num;
+        m_udp_send_stat._datagram_num += end - begin;
+        // 回包已向上层返回成功，发送失败(含发送缓冲区满)的数据报丢弃，记录统计并留给Poll报告
+        if (send_num != static_cast<int32_t>(end - begin)) {
+            uint32_t sent = send_num > 0 ? send_num : 0;
+            m_udp_send_stat._failed_num += end - begin - sent;
+            PLOG_ERROR_N_EVERY_SECOND(1, "sendmmsg %u datagrams to %lu, %d sent(%s)",
+                end - begin, m_udp_send_locals[begin], send_num, m_netio->GetLastError());
+            for (uint32_t i = begin + sent; i < end
+                && m_udp_send_failed.size() < NetIO::MAX_UDP_BATCH_NUM; ++i) {
+                m_udp_send_failed.push_back(m_udp_send_datagrams[i]._remote_addr);
+            }
+        }
+        begin = end;
+    }
+
+    m_udp_send_datagrams.clear();
+    m_udp_send_locals.clear();
+    m_udp_send_len = 0;
+}
+
+void NetMessage::GetUdpSendStat(UdpSendStat* stat) {
+    if (stat) {
+        *stat = m_udp_send_stat;
+    }
+    m_udp_send_stat = UdpSendStat();
+}
+
+void NetMessage::SetRewriteMsgFunc(const RewriteMsg& rewrite_msg_func) {
+    m_rewrite_msg_func = rewrite_msg_func;
+}
+
+int32_t NetMessage::SetUserData(uint64_t handle, uint32_t user_data) {
+    NetConnection* connection = GetConnection(handle);
+    if (connection == NULL) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    connection->_user_data = user_data;
+    return 0;
+}
+
+uint32_t NetMessage::GetUserData(uint64_t handle) {
+    NetConnection* connection = GetConnection(handle);
+    return connection ? connection->_user_data : 0;
+}
+
+int32_t NetMessage::WatchFd(int32_t fd, uint32_t events, const FdEventCallback& on_event) {
+    if (fd < 0 || !on_event) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+
+    uint64_t data = (static_cast<uint64_t>(fd) << 32) | EXTERNAL_FD_SLOT;
+    // fd被close后已自动从epoll移除，号码可能被复用，所以不依赖本地记录，先ADD失败再MOD
+    int32_t ret = m_epoll->AddFd(fd, events, data);
+    if (ret != 0 && EEXIST == errno) {
+        ret = m_epoll->ModFd(fd, events, data);
+    }
+    if (ret != 0) {
+        PLOG_ERROR("watch fd %d failed(%d)", fd, errno);
+        return kMESSAGE_UNSUPPORT;
+    }
+
+    m_fd_watchers[fd] = on_event;
+    return 0;
+}
+
+int32_t NetMessage::UnwatchFd(int32_t fd) {
+    if (m_fd_watchers.erase(fd) == 0) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+    m_epoll->DelFd(fd);
+    return 0;
+}
+
+int32_t NetMessage::GetPeerCred(uint64_t handle, int32_t* pid, uint32_t* uid, uint32_t* gid) {
+    if (m_netio->GetPeerCred(handle, pid, uid, gid) != 0) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+    return 0;
+}
+
+int32_t NetMessage::ExportListenFd(uint64_t handle) {
+    int32_t fd = m_netio->ExportListenFd(handle);
+    if (fd < 0) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    return fd;
+}
+
+int32_t NetMessage::StopListen(uint64_t handle) {
+    if (m_netio->StopListen(handle) != 0) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    return 0;
+}
+
+int32_t NetMessage::GetPollFd() {
+    return m_epoll ? m_epoll->GetFd() : -1;
+}
+
+bool NetMessage::HasPendingEvent() {
+    return !m_ready_handles.empty() || !m_udp_send_datagrams.empty() || !m_udp_send_failed.empty();
+}
+
 bool NetMessage::IsTcpTransport(uint64_t handle) {
     const SocketInfo* socket_info = m_netio->GetSocketInfo(handle);
     return socket_info->_state & TCP_PROTOCOL;
@@ -833,10 +1614,22 @@ void NetMessage::SetMaxSendListSize(uint32_t max_send_list_size) {
     m_max_send_list_size = max_send_list_size;
 }
 
+void NetMessage::SetAcceptBatch(uint32_t accept_batch_num) {
+    m_accepted.resize(accept_batch_num > 0 ? accept_batch_num : 1);
+}
+
+void NetMessage::SetEdgeTrigger(bool edge_trigger, uint32_t read_ahead_len) {
+    m_edge_trigger   = edge_trigger;
+    m_read_ahead_len = read_ahead_len;
+    if (m_netio) {
+        m_netio->SetEdgeTrigger(edge_trigger);
+    }
+}
+
 uint64_t NetMessage::GetLocalHandle(uint64_t netaddr) {
-    cxx::unordered_map<uint64_t, uint64_t>::iterator it = m_peer_handle_to_local.find(netaddr);
-    if (it != m_peer_handle_to_local.end()) {
-        return it->second;
+    uint64_t tag = (netaddr >> NetIO::UDP_REMOTE_TAG_SHIFT) & NetIO::MAX_UDP_REMOTE_TAG;
+    if (tag > 0 && tag <= m_udp_listens.size()) {
+        return m_udp_listens[tag - 1];
     }
     return netaddr;
 }
@@ -15,7 +15,9 @@
 #ifndef _PEBBLE_COMMON_NET_MESSAGE_H_
 #define _PEBBLE_COMMON_NET_MESSAGE_H_
 
+#include <deque>
 #include <list>
+#include <vector>
 #include "framework/message.h"
 
 
@@ -24,6 +26,7 @@ namespace pebble {
 class Epoll;
 class NetIO;
 class NetConnection;
+struct UdpDatagram;
 
 #define INVAILD_HANDLE UINT64_MAX
 
@@ -34,6 +37,15 @@ class NetConnection;
 /// @return uint32_t 消息数据部分的长度(不包括消息头长度)，<0解码出错，应该关闭连接
 typedef cxx::function<int32_t(const uint8_t* head, uint32_t head_len)> GetMsgDataLen;
 
+/// @brief 收到完整的TCP消息后回调，上层可在连接的接收缓冲区内原地改写消息(如解压缩)
+/// @param handle 连接句柄
+/// @param msg 完整消息(消息头+数据)，位于连接的接收缓冲区
+/// @param msg_len 消息长度
+/// @param buff_len 接收缓冲区大小，改写后的消息长度不能超过此值
+/// @return >=0 改写后的消息长度，<0 消息非法，应该关闭连接
+typedef cxx::function<int32_t(uint64_t handle, uint8_t* msg, uint32_t msg_len,
+    uint32_t buff_len)> RewriteMsg;
+
 
 /// @brief 封装tcp/udp收发消息功能，向上层用户提供基于消息的收发能力
 class NetMessage {
@@ -44,6 +56,15 @@ public:
     /// @brief 每个连接默认的收发缓冲区大小，默认为2M
     static const int32_t DEFAULT_MSG_BUFF_LEN = 1024 * 1024 * 2;
 
+    /// @brief udp listen每次唤醒最多批量收取的数据报数量
+    static const uint32_t UDP_BATCH_NUM = 32;
+
+    /// @brief tcp listen每次唤醒默认最多接受的连接数量
+    static const uint32_t DEFAULT_ACCEPT_BATCH_NUM = 64;
+
+    /// @brief 边缘触发模式下每个TCP连接默认的预读缓冲区大小
+    static const uint32_t DEFAULT_READ_AHEAD_LEN = 64 * 1024;
+
     /// @param msg_head_len 由上层用户指定TCP发送时消息头的长度
     /// @param get_msg_data_len_func 当接收完消息头部分后，回调此函数得到消息数据部分的长度
     /// @param msg_buff_len TCP接收缓冲区大小，默认为2M
@@ -60,6 +81,8 @@ public:
 
     /// @return 0 成功
     /// @return <0 失败
+    /// @note udp listen在处理本轮收到的数据报时的回包只是攒批缓存，返回0后在下次Poll时发出，
+    ///     发送失败时由Poll返回kMESSAGE_SEND_FAILED并带出对端handle
     int32_t Send(uint64_t handle, const uint8_t* msg, uint32_t msg_len);
 
     /// @return 0 成功
@@ -84,6 +107,7 @@ public:
     int32_t Close(uint64_t handle);
 
     /// @return 0 成功，有事件
+    /// @return kMESSAGE_SEND_FAILED 攒批的udp回包发送失败，handle为回包的对端handle，每次返回一个
     /// @return <0 失败，无事件或网络故障
     int32_t Poll(uint64_t* handle, int32_t* event, int32_t timeout_ms);
 
@@ -93,11 +117,108 @@ public:
     /// @brief 设置发送缓冲区列表最大长度
     void SetMaxSendListSize(uint32_t max_send_list_size);
 
+    /// @brief 设置tcp listen每次唤醒最多接受的连接数量，剩余的积压连接在下次Poll时继续接受
+    void SetAcceptBatch(uint32_t accept_batch_num);
+
+    /// @brief 预热，预先分配buff_num个连接接收缓冲区并写入每一页，此后关闭的连接的缓冲区也放回缓存复用
+    /// @param lock 是否mlock锁定缓冲区
+    /// @return 缓存中的缓冲区个数
+    int32_t Prewarm(uint32_t buff_num, bool lock);
+
+    /// @brief 获取连接接收缓冲区的占用情况
+    /// @param used_num 连接使用中的缓冲区个数
+    /// @param free_num 缓存中空闲的缓冲区个数
+    void GetBuffInfo(uint32_t* used_num, uint32_t* free_num);
+
+    /// @brief 设置TCP数据连接使用epoll边缘触发，需要在创建连接前设置
+    /// @param edge_trigger true 边缘触发，连接可读时一次recv读满预读缓冲区，再逐个切分消息；
+    ///     预读后仍有数据的连接放入就绪列表，与新事件的连接轮流处理，每轮每个连接取一个消息
+    /// @param read_ahead_len 每个连接的预读缓冲区大小，也是每轮单个连接最多读取的数据量
+    void SetEdgeTrigger(bool edge_trigger, uint32_t read_ahead_len = DEFAULT_READ_AHEAD_LEN);
+
+    /// @brief 设置TCP发送cork模式，发送的数据先缓存在连接上，调用Flush或累计超过flush_bytes时合并发送
+    /// @param flush_bytes 单个连接缓存数据的发送阈值，0表示关闭cork模式(关闭时会先发出已缓存的数据)
+    void SetSendCork(uint32_t flush_bytes);
+
+    /// @brief 发送cork模式下缓存的数据
+    /// @param handle 连接句柄，INVAILD_HANDLE表示所有连接
+    /// @return 0 成功
+    /// @return <0 失败
+    int32_t Flush(uint64_t handle);
+
+    /// @brief udp listen回包的攒批发送统计
+    struct UdpSendStat {
+        uint64_t _batch_num;    // 批量发送的次数
+        uint64_t _datagram_num; // 攒批发送的数据报数
+        uint64_t _failed_num;   // 发送失败丢弃的数据报数
+        UdpSendStat() : _batch_num(0), _datagram_num(0), _failed_num(0) {}
+    };
+
+    /// @brief 取出上次调用以来的udp攒批发送统计，取出后清零
+    void GetUdpSendStat(UdpSendStat* stat);
+
+    /// @brief 设置收到完整TCP消息后的改写回调，不设置时消息原样交给上层
+    void SetRewriteMsgFunc(const RewriteMsg& rewrite_msg_func);
+
+    /// @brief 设置连接上的上层自定义数据(如协商结果)，连接关闭或重连后清零
+    /// @return 0 成功
+    /// @return <0 失败
+    int32_t SetUserData(uint64_t handle, uint32_t user_data);
+
+    /// @brief 获取连接上的上层自定义数据，连接不存在时返回0
+    uint32_t GetUserData(uint64_t handle);
+
+    /// @brief 把外部fd加入epoll等待，fd就绪时Poll回调on_event后返回无消息 @see Message::WatchFd
+    /// @return 0 成功
+    /// @return <0 失败
+    int32_t WatchFd(int32_t fd, uint32_t events, const FdEventCallback& on_event);
+
+    /// @return 0 成功
+    /// @return <0 失败
+    int32_t UnwatchFd(int32_t fd);
+
+    /// @brief 获取unix域socket连接对端进程的身份 @see Message::GetPeerCred
+    /// @return 0 成功
+    /// @return <0 失败
+    int32_t GetPeerCred(uint64_t handle, int32_t* pid, uint32_t* uid, uint32_t* gid);
+
+    /// @brief 取监听句柄的socket用于热重启 @see Message::ExportListenFd
+    /// @return >=0 socket fd
+    /// @return <0 失败
+    int32_t ExportListenFd(uint64_t handle);
+
+    /// @brief 停止在监听句柄上接收新连接 @see Message::StopListen
+    int32_t StopListen(uint64_t handle);
+
+    /// @brief 获取内部的epoll fd，fd可读时说明有事件需要Poll处理，用于与其他事件循环合并等待
+    /// @return >=0 epoll fd
+    /// @return <0 未初始化
+    int32_t GetPollFd();
+
+    /// @brief 是否有不依赖epoll事件的待处理数据(边缘触发的就绪列表、攒批的udp回包及未报告的回包发送失败)，有时Poll不能阻塞等待
+    bool HasPendingEvent();
+
 private:
     int32_t PollConnectionBuffer(uint64_t* handle);
 
+    // 消息交给上层的连接加入缓存消息链表
+    void LinkBuffered(uint64_t netaddr);
+
+    void UnlinkBuffered(NetConnection* connection);
+
+    // 边缘触发模式的Poll，处理就绪列表中的连接
+    int32_t PollReadyConnection(uint64_t* handle, int32_t timeout_ms);
+
+    // 边缘触发模式下处理一个epoll事件，可读的连接加入就绪列表
+    void OnReadyEvent(uint64_t netaddr, uint32_t events);
+
+    int32_t RecvReadyConnection(uint64_t netaddr);
+
     NetConnection* CreateConnection(uint64_t netaddr);
 
+    // 释放连接，缓存未满时接收缓冲区放回缓存
+    void DeleteConnection(NetConnection* connection);
+
     NetConnection* GetConnection(uint64_t netaddr);
 
     void CloseConnection(uint64_t netaddr);
@@ -106,11 +227,24 @@ private:
 
     void SendCacheData(uint64_t netaddr, NetConnection* connection);
 
+    int32_t CorkSendData(uint64_t handle, NetConnection* connection,
+        uint32_t msg_frag_num, const uint8_t* msg_frag[], uint32_t msg_frag_len[]);
+
     int32_t RecvTcpData(uint64_t netaddr);
 
+    // 收取TCP数据，边缘触发模式下优先从预读缓冲区取
+    int32_t RecvStream(uint64_t netaddr, NetConnection* connection, uint8_t* buff, uint32_t len);
+
     int32_t RecvUdpData(uint64_t netaddr);
 
-    // 因message接口的限制，对于点对点通信方式先这样处理，后续优化
+    int32_t RecvUdpBatch(uint64_t netaddr, NetConnection* connection);
+
+    int32_t AppendUdpSendData(uint64_t local_handle, uint64_t peer_handle,
+        uint32_t msg_frag_num, const uint8_t* msg_frag[], uint32_t msg_frag_len[]);
+
+    void FlushUdpSendData();
+
+    // 仅用于udp listen收到的远端地址，由地址中的监听编号取本地监听句柄，本地句柄直接通过连接表判断
     uint64_t GetLocalHandle(uint64_t netaddr);
 
     void OnSocketError(uint64_t netaddr);
@@ -120,18 +254,54 @@ private:
     NetIO* m_netio;
 
     uint8_t* m_send_buff; // 对使用udp发送多片消息时使用buff组装完整包
+
+    // udp listen的回包先攒批，在Poll处理完缓存消息后通过sendmmsg一次发出
+    uint8_t* m_udp_send_buff;
+    uint32_t m_udp_send_len;
+    std::vector<UdpDatagram> m_udp_send_datagrams;
+    std::vector<uint64_t> m_udp_send_locals;
+    // 上层正在处理本轮收到的udp数据报，下次Poll前会发出攒批的回包，否则回包直接发送
+    bool m_udp_send_deferred;
+    UdpSendStat m_udp_send_stat;
+    // 攒批发送失败的回包的对端handle，由Poll逐个报告给上层，超过上限的只计入统计
+    std::vector<uint64_t> m_udp_send_failed;
     uint32_t m_msg_buff_len;
 
     uint32_t m_max_send_list_size;
 
+    // 批量accept的缓冲，大小即每次唤醒最多接受的连接数量
+    std::vector<uint64_t> m_accepted;
+
+    // 边缘触发模式，socket中或预读缓冲区中还有数据的连接在就绪列表中轮流处理
+    bool m_edge_trigger;
+    uint32_t m_read_ahead_len;
+    std::deque<uint64_t> m_ready_handles;
+    uint32_t m_ready_turns; // 本轮还未处理的就绪连接数，为0时重新查询epoll
+
+    // cork模式下的发送阈值，0表示不开启，有缓存数据的连接在Flush时发出
+    uint32_t m_cork_bytes;
+    std::vector<uint64_t> m_cork_handles;
+
     uint32_t m_msg_head_len;
     GetMsgDataLen m_get_msg_data_len_func;
+    RewriteMsg m_rewrite_msg_func;
+
+    // 连接数据，按NetAddr的槽位下标存放，与NetIO的socket表平行，通过generation校验句柄
+    std::vector<NetConnection*> m_connections;
+    uint32_t m_connection_num;
+
+    // 有消息交给过上层的连接，Poll时检查其中是否还有未取走的缓存消息
+    NetConnection* m_buffered_head;
+
+    // 空闲的连接接收缓冲区，新连接优先使用，上限由预热数量决定，默认不缓存
+    std::vector<uint8_t*> m_free_buffs;
+    uint32_t m_max_free_buff_num;
 
-    // 连接数据
-    cxx::unordered_map<uint64_t, NetConnection*> m_connections;
+    // udp listen句柄，下标+1为监听编号，标记在收到的远端地址中
+    std::vector<uint64_t> m_udp_listens;
 
-    // udp <peer handle, local listen handle> map
-    cxx::unordered_map<uint64_t, uint64_t> m_peer_handle_to_local;
+    // 外部fd的事件回调，epoll data的低32位为EXTERNAL_FD_SLOT以区别于NetAddr
+    cxx::unordered_map<int32_t, FdEventCallback> m_fd_watchers;
 };
 
 
@@ -27,9 +27,24 @@ Options::Options() {
     _app_instance_id        = DEFAULT_APP_INSTANCE_ID;
     _app_unit_id            = DEFAULT_APP_UNIT_ID;
     _app_program_id         = DEFAULT_APP_PROGRAM_ID;
+    _app_worker_num         = DEFAULT_APP_WORKER_NUM;
+    _app_use_io_uring       = DEFAULT_APP_USE_IO_URING;
+    _app_send_cork_bytes    = DEFAULT_APP_SEND_CORK_BYTES;
+    _app_compress_type      = DEFAULT_APP_COMPRESS_TYPE;
+    _app_compress_threshold = DEFAULT_APP_COMPRESS_THRESHOLD;
+    _app_accept_batch       = DEFAULT_APP_ACCEPT_BATCH;
+    _app_edge_trigger       = DEFAULT_APP_EDGE_TRIGGER;
+    _app_read_ahead_bytes   = DEFAULT_APP_READ_AHEAD_BYTES;
+    _app_use_shm            = DEFAULT_APP_USE_SHM;
+    _app_shm_spin_us        = DEFAULT_APP_SHM_SPIN_US;
+    _app_ipv6_only          = DEFAULT_APP_IPV6_ONLY;
+    _app_hot_restart_drain_ms = DEFAULT_APP_HOT_RESTART_DRAIN_MS;
+    _app_prewarm_connection_num = DEFAULT_APP_PREWARM_CONNECTION_NUM;
+    _app_prewarm_mlock      = DEFAULT_APP_PREWARM_MLOCK;
 
     // coroutine
     _co_stack_size_bytes    = DEFAULT_CO_STACK_SIZE;
+    _co_prewarm_num         = DEFAULT_CO_PREWARM_NUM;
 
     // log
     _log_device             = DEFAULT_LOG_DEVICE;
@@ -51,12 +66,17 @@ Options::Options() {
     _task_threshold         = DEFAULT_TASK_THRESHOLD;
     _message_expire_ms      = DEFAULT_MESSAGE_EXPIRE_MS;
     _idle_us                = DEFAULT_IDLE_US;
+    _idle_wait_ms           = DEFAULT_IDLE_WAIT_MS;
+    _busy_poll_us           = DEFAULT_BUSY_POLL_US;
 
     // broadcast
     _bc_zk_timeout_ms       = DEFAULT_BC_ZK_TIMEOUT_MS;
 
     // rpc
     _proc_req_timeout_ms    = DEFAULT_PROC_REQ_TIMEOUT_MS;
+    _rpc_batch_mode         = DEFAULT_RPC_BATCH_MODE;
+    _rpc_prewarm_session_num = DEFAULT_RPC_PREWARM_SESSION_NUM;
+    _rpc_prewarm_buff_bytes = DEFAULT_RPC_PREWARM_BUFF_BYTES;
 }
 
 std::string Options::ToString() {
@@ -69,8 +89,24 @@ std::string Options::ToString() {
             << kAppUnitId           << " = " << _app_unit_id          << "\n"
             << kAppProgramId        << " = " << _app_program_id       << "\n"
             << kAppCtrlCmdAddr      << " = " << _app_ctrl_cmd_addr    << "\n"
+            << kAppWorkerNum        << " = " << _app_worker_num       << "\n"
+            << kAppUseIoUring       << " = " << _app_use_io_uring     << "\n"
+            << kAppSendCorkBytes    << " = " << _app_send_cork_bytes  << "\n"
+            << kAppCompressType     << " = " << _app_compress_type    << "\n"
+            << kAppCompressThreshold << " = " << _app_compress_threshold << "\n"
+            << kAppAcceptBatch      << " = " << _app_accept_batch     << "\n"
+            << kAppEdgeTrigger      << " = " << _app_edge_trigger     << "\n"
+            << kAppReadAheadBytes   << " = " << _app_read_ahead_bytes << "\n"
+            << kAppUseShm           << " = " << _app_use_shm          << "\n"
+            << kAppShmSpinUs        << " = " << _app_shm_spin_us      << "\n"
+            << kAppIpv6Only         << " = " << _app_ipv6_only        << "\n"
+            << kAppHotRestartAddress << " = " << _app_hot_restart_address << "\n"
+            << kAppHotRestartDrainMs << " = " << _app_hot_restart_drain_ms << "\n"
+            << kAppPrewarmConnectionNum << " = " << _app_prewarm_connection_num << "\n"
+            << kAppPrewarmMlock     << " = " << _app_prewarm_mlock    << "\n"
         << "[" << kSectionCoroutine << "]\n"
             << kCoStackSize         << " = " << _co_stack_size_bytes  << "\n"
+            << kCoPrewarmNum        << " = " << _co_prewarm_num       << "\n"
         << "[" << kSectionLog << "]\n"
             << kLogDevice           << " = " << _log_device           << "\n"
             << kLogPriority         << " = " << _log_priority         << "\n"
@@ -89,12 +125,17 @@ std::string Options::ToString() {
             << kTaskThreshold       << " = " << _task_threshold       << "\n"
             << kMessageExpireMs     << " = " << _message_expire_ms    << "\n"
             << kIdleUs              << " = " << _idle_us              << "\n"
+            << kIdleWaitMs          << " = " << _idle_wait_ms         << "\n"
+            << kBusyPollUs          << " = " << _busy_poll_us         << "\n"
         << "[" << kSectionBroadcast << "]\n"
             << kBcRelayAddress      << " = " << _bc_relay_address     << "\n"
             << kBcZkHost            << " = " << _bc_zk_host           << "\n"
             << kBcZkTimeoutMs       << " = " << _bc_zk_timeout_ms     << "\n"
         << "[" << kSectionRpc << "]\n"
             << kProcReqTimeoutMs    << " = " << _proc_req_timeout_ms  << "\n"
+            << kRpcBatchMode        << " = " << _rpc_batch_mode       << "\n"
+            << kRpcPrewarmSessionNum << " = " << _rpc_prewarm_session_num << "\n"
+            << kRpcPrewarmBuffBytes << " = " << _rpc_prewarm_buff_bytes << "\n"
         ;
 
     return oss.str();
@@ -118,9 +159,25 @@ const char* kAppInstanceId      = "instance_id";
 const char* kAppUnitId          = "unit_id";
 const char* kAppProgramId       = "program_id";
 const char* kAppCtrlCmdAddr     = "ctrl_cmd_address";
+const char* kAppWorkerNum       = "worker_num";
+const char* kAppUseIoUring      = "use_io_uring";
+const char* kAppSendCorkBytes   = "send_cork_bytes";
+const char* kAppCompressType    = "compress_type";
+const char* kAppCompressThreshold = "compress_threshold";
+const char* kAppAcceptBatch     = "accept_batch";
+const char* kAppEdgeTrigger     = "edge_trigger";
+const char* kAppReadAheadBytes  = "read_ahead_bytes";
+const char* kAppUseShm          = "use_shm";
+const char* kAppShmSpinUs       = "shm_spin_us";
+const char* kAppIpv6Only        = "ipv6_only";
+const char* kAppHotRestartAddress = "hot_restart_address";
+const char* kAppHotRestartDrainMs = "hot_restart_drain_ms";
+const char* kAppPrewarmConnectionNum = "prewarm_connection_num";
+const char* kAppPrewarmMlock    = "prewarm_mlock";
 
 // [coroutine]
 const char* kCoStackSize        = "stack_size";
+const char* kCoPrewarmNum       = "prewarm_num";
 
 // [log]
 const char* kLogDevice          = "device";
@@ -142,6 +199,8 @@ const char* kMaxMsgNumPerLoop   = "msg_num_per_loop";
 const char* kTaskThreshold      = "task_threshold";
 const char* kMessageExpireMs    = "message_expire_ms";
 const char* kIdleUs             = "idle_us";
+const char* kIdleWaitMs         = "idle_wait_ms";
+const char* kBusyPollUs         = "busy_poll_us";
 
 // [broadcast]
 const char* kBcRelayAddress     = "relay_address";
@@ -150,6 +209,9 @@ const char* kBcZkTimeoutMs      = "zk_connect_timeout_ms";
 
 // [rpc]
 const char* kProcReqTimeoutMs   = "proc_request_timeout_ms";
+const char* kRpcBatchMode       = "batch_mode";
+const char* kRpcPrewarmSessionNum = "prewarm_session_num";
+const char* kRpcPrewarmBuffBytes = "prewarm_buff_bytes";
 
 }  // namespace pebble
 
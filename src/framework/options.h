@@ -33,9 +33,25 @@ struct Options {
     int32_t     _app_unit_id;       // 兼容OMS，UNIT ID，默认为0
     int32_t     _app_program_id;    // 兼容OMS, PROGRAM(SERVER) ID，默认为0
     std::string _app_ctrl_cmd_addr; // 控制命令监听地址
+    uint32_t    _app_worker_num;    // worker线程数，>1时为多worker模式(各worker通过SO_REUSEPORT监听同一地址)，默认为1，非reload生效
+    bool        _app_use_io_uring;  // 是否使用io_uring网络驱动，内核不支持时自动回退到epoll，默认为0，非reload生效
+    uint32_t    _app_send_cork_bytes; // TCP发送合并阈值(字节)，>0时一个Update周期内的发送先缓存在连接上，周期结束或超过阈值时合并发送，默认为0(关闭)，非reload生效
+    int32_t     _app_compress_type; // TCP消息压缩算法 { 0:不压缩, 1:lz4, 2:zstd }，需编译时开启对应的库，与对端逐连接协商后生效，默认为0，非reload生效
+    uint32_t    _app_compress_threshold; // 消息数据超过此长度(字节)才压缩，默认为16K，非reload生效
+    uint32_t    _app_accept_batch;  // TCP监听每次唤醒最多接受的连接数，连接风暴时一次取出积压的连接，默认为64，非reload生效
+    bool        _app_edge_trigger;  // TCP连接是否使用epoll边缘触发，可读时一次读取多个消息的数据，减少系统调用，默认为0，非reload生效
+    uint32_t    _app_read_ahead_bytes; // 边缘触发时每个TCP连接的预读缓冲区大小(字节)，也是每轮单个连接最多读取的数据量，默认为64K，非reload生效
+    bool        _app_use_shm;       // 是否启用共享内存驱动，启用后"shm://name"地址走同机共享内存，其他地址不受影响，默认为0，非reload生效
+    uint32_t    _app_shm_spin_us;   // 共享内存驱动无消息时阻塞前的忙等时间(us)，0为不忙等，默认为50，非reload生效
+    bool        _app_ipv6_only;     // ipv6监听地址是否只接受ipv6连接，为0时监听"[::]"同时接受ipv4连接，默认为0，非reload生效
+    std::string _app_hot_restart_address; // 热重启地址(unix域socket路径，'@'开头为抽象命名空间)，新进程从旧进程接管监听socket，多worker时自动加".worker序号"，默认为空(关闭)，非reload生效
+    uint32_t    _app_hot_restart_drain_ms; // 热重启交出监听后等待在途请求处理完的最长时间(ms)，超时后旧进程直接退出，默认为10000，非reload生效
+    uint32_t    _app_prewarm_connection_num; // 启动时预先分配并写入内存的连接接收缓冲区个数，关闭的连接的缓冲区也缓存复用，默认为0(不预热)，非reload生效
+    bool        _app_prewarm_mlock; // 是否mlock锁定预热的内存(协程栈、连接缓冲区、rpc编码缓冲区)，受RLIMIT_MEMLOCK限制，默认为0，非reload生效
 
     // coroutine
     uint32_t _co_stack_size_bytes;  // 协程栈大小（单位字节），默认为256K，非reload生效
+    uint32_t _co_prewarm_num;       // 启动时预先创建并写入协程栈的协程数，默认为0(不预热)，非reload生效
 
     // log
     std::string _log_device;        // 打印输出方式 { FILE、STDOUT }，默认为FILE
@@ -56,7 +72,9 @@ struct Options {
     uint32_t _max_msg_num_per_loop; // 每个tick最大消息处理数量，默认为100
     uint32_t _task_threshold;       // 系统并发任务门限，默认为1w
     uint32_t _message_expire_ms;    // 消息过期时间（单位ms），默认为10*1000(10s)
-    uint32_t _idle_us;              // idle time by us
+    uint32_t _idle_us;              // idle time by us，_idle_wait_ms为0时生效
+    uint32_t _idle_wait_ms;         // idle时阻塞等待网络事件的最长时间(ms)，会按最近的定时器超时时间截断，0表示改用sleep _idle_us，默认为10
+    uint32_t _busy_poll_us;         // 处理过消息后继续忙轮询而不idle的时间(us)，用于低时延场景，默认为0(关闭)
 
     // broadcast
     std::string _bc_relay_address;  // 接收其他server转发的广播消息的监听地址，非reload生效
@@ -65,6 +83,9 @@ struct Options {
 
     // rpc
     uint32_t _proc_req_timeout_ms; // 请求处理超时时间，超时未回响应就释放session
+    bool _rpc_batch_mode;          // 同一handle在一个Update周期内的rpc消息合并为一个批量消息发送，需对端支持，默认为false
+    uint32_t _rpc_prewarm_session_num; // 启动时按此并发会话数预留rpc会话表，避免运行中rehash，默认为0，非reload生效
+    uint32_t _rpc_prewarm_buff_bytes;  // 启动时预先分配并写入的rpc编码缓冲区大小(字节)，默认为0，非reload生效
 
     Options();
     std::string ToString();
@@ -89,10 +110,26 @@ extern const char* kAppInstanceId;
 extern const char* kAppUnitId;
 extern const char* kAppProgramId;
 extern const char* kAppCtrlCmdAddr;
+extern const char* kAppWorkerNum;
+extern const char* kAppUseIoUring;
+extern const char* kAppSendCorkBytes;
+extern const char* kAppCompressType;
+extern const char* kAppCompressThreshold;
+extern const char* kAppAcceptBatch;
+extern const char* kAppEdgeTrigger;
+extern const char* kAppReadAheadBytes;
+extern const char* kAppUseShm;
+extern const char* kAppShmSpinUs;
+extern const char* kAppIpv6Only;
+extern const char* kAppHotRestartAddress;
+extern const char* kAppHotRestartDrainMs;
+extern const char* kAppPrewarmConnectionNum;
+extern const char* kAppPrewarmMlock;
 
 
 // [coroutine]
 extern const char* kCoStackSize;
+extern const char* kCoPrewarmNum;
 
 // [log]
 extern const char* kLogDevice;
@@ -114,6 +151,8 @@ extern const char* kMaxMsgNumPerLoop;
 extern const char* kTaskThreshold;
 extern const char* kMessageExpireMs;
 extern const char* kIdleUs;
+extern const char* kIdleWaitMs;
+extern const char* kBusyPollUs;
 
 // [broadcast]
 extern const char* kBcRelayAddress;
@@ -122,6 +161,9 @@ extern const char* kBcZkTimeoutMs;
 
 // [rpc]
 extern const char* kProcReqTimeoutMs;
+extern const char* kRpcBatchMode;
+extern const char* kRpcPrewarmSessionNum;
+extern const char* kRpcPrewarmBuffBytes;
 
 // default values
 // [app]
@@ -131,10 +173,25 @@ extern const char* kProcReqTimeoutMs;
 
 #define DEFAULT_APP_UNIT_ID     0
 #define DEFAULT_APP_PROGRAM_ID  0
+#define DEFAULT_APP_WORKER_NUM  1
+#define DEFAULT_APP_USE_IO_URING false
+#define DEFAULT_APP_SEND_CORK_BYTES 0
+#define DEFAULT_APP_COMPRESS_TYPE 0
+#define DEFAULT_APP_COMPRESS_THRESHOLD (16 * 1024)
+#define DEFAULT_APP_ACCEPT_BATCH 64
+#define DEFAULT_APP_EDGE_TRIGGER false
+#define DEFAULT_APP_READ_AHEAD_BYTES (64 * 1024)
+#define DEFAULT_APP_USE_SHM false
+#define DEFAULT_APP_SHM_SPIN_US 50
+#define DEFAULT_APP_IPV6_ONLY false
+#define DEFAULT_APP_HOT_RESTART_DRAIN_MS 10000
+#define DEFAULT_APP_PREWARM_CONNECTION_NUM 0
+#define DEFAULT_APP_PREWARM_MLOCK false
 
 
 // [coroutine]
 #define DEFAULT_CO_STACK_SIZE   (256 * 1024)
+#define DEFAULT_CO_PREWARM_NUM  0
 
 // [log]
 #define DEFAULT_LOG_DEVICE      "FILE"
@@ -156,12 +213,17 @@ extern const char* kProcReqTimeoutMs;
 #define DEFAULT_TASK_THRESHOLD      (10000)
 #define DEFAULT_MESSAGE_EXPIRE_MS   (10 * 1000)
 #define DEFAULT_IDLE_US         (1000)
+#define DEFAULT_IDLE_WAIT_MS    (10)
+#define DEFAULT_BUSY_POLL_US    (0)
 
 // [broadcast]
 #define DEFAULT_BC_ZK_TIMEOUT_MS    20000
 
 // [rpc]
 #define DEFAULT_PROC_REQ_TIMEOUT_MS 20000
+#define DEFAULT_RPC_BATCH_MODE      false
+#define DEFAULT_RPC_PREWARM_SESSION_NUM 0
+#define DEFAULT_RPC_PREWARM_BUFF_BYTES  0
 
 }  // namespace pebble
 #endif   //  _PEBBLE_EXTENSION_OPTIONS_H_
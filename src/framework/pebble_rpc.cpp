@@ -11,12 +11,18 @@
  *
  */
 
+#include <algorithm>
+#include <errno.h>
+#include <sstream>
+#include <string.h>
 #include "common/log.h"
+#include "common/memory.h"
 #include "framework/pebble_rpc.h"
 #include "framework/rpc_plugin.inh"
 #include "framework/rpc_util.inh"
 #include "framework/dr/common/dr_define.h"
 #include "framework/dr/protocol/binary_protocol.h"
+#include "framework/dr/protocol/compact_protocol.h"
 #include "framework/dr/protocol/json_protocol.h"
 #include "framework/dr/transport/buffer_transport.h"
 #include "src/framework/exception.h"
@@ -24,6 +30,63 @@
 
 namespace pebble {
 
+RpcHedge::RpcHedge(const cxx::function<int64_t(int64_t exclude_handle)>& backup_route,
+    uint32_t percentile, uint32_t max_extra_percent) {
+    m_backup_route      = backup_route;
+    m_percentile        = std::max(1u, std::min(percentile, 99u));
+    m_max_extra_percent = std::max(1u, std::min(max_extra_percent, 100u));
+    m_budget            = 0;
+    m_delay_ms          = -1;
+    m_sample_pos        = 0;
+    m_new_sample_num    = 0;
+    m_samples.reserve(SAMPLE_NUM);
+}
+
+void RpcHedge::OnRequest() {
+    m_budget = std::min(m_budget + m_max_extra_percent, MAX_BURST * 100);
+}
+
+bool RpcHedge::Acquire() {
+    if (m_budget < 100) {
+        return false;
+    }
+    m_budget -= 100;
+    return true;
+}
+
+void RpcHedge::AddLatency(int64_t cost_ms) {
+    int32_t sample = static_cast<int32_t>(std::max(cost_ms, static_cast<int64_t>(0)));
+    if (m_samples.size() < SAMPLE_NUM) {
+        m_samples.push_back(sample);
+    } else {
+        m_samples[m_sample_pos] = sample;
+        m_sample_pos = (m_sample_pos + 1) % SAMPLE_NUM;
+    }
+
+    // 分位数每积累一批新样本重算一次
+    if (++m_new_sample_num >= MIN_SAMPLE_NUM) {
+        m_new_sample_num = 0;
+        UpdateDelay();
+    }
+}
+
+void RpcHedge::UpdateDelay() {
+    std::vector<int32_t> samples(m_samples);
+    std::vector<int32_t>::iterator nth = samples.begin() + samples.size() * m_percentile / 100;
+    std::nth_element(samples.begin(), nth, samples.end());
+    // 至少1ms，避免对冲延时为0时每个请求都对冲
+    m_delay_ms = std::max(*nth, 1);
+}
+
+int64_t RpcHedge::GetBackupHandle(int64_t handle) {
+    if (!m_backup_route) {
+        return -1;
+    }
+    // 路由负责排除原连接，取模/哈希等不支持对冲的路由返回<0
+    int64_t backup = m_backup_route(handle);
+    return (backup >= 0 && backup != handle) ? backup : -1;
+}
+
 PebbleRpc::PebbleRpc(CodeType code_type, CoroutineSchedule* coroutine_schedule) {
     m_rpc_util = new RpcUtil(this, coroutine_schedule);
     m_rpc_plugin = NULL;
@@ -31,7 +94,8 @@ PebbleRpc::PebbleRpc(CodeType code_type, CoroutineSchedule* coroutine_schedule)
     switch (m_code_type) {
         case kCODE_BINARY:
         case kCODE_JSON:
-            m_rpc_plugin = new ThriftRpcPlugin(this);
+        case kCODE_COMPACT:
+            m_rpc_plugin = new ThriftRpcPlugin(this, m_code_type);
             break;
         case kCODE_PB:
             m_rpc_plugin = new ProtoBufRpcPlugin(this);
@@ -70,6 +134,8 @@ dr::protocol::TProtocol* PebbleRpc::GetCodec(MemoryPolicy mem_policy) {
         (static_cast<dr::transport::TMemoryBuffer*>(codec->getTransport().get()))->resetBuffer();
         if (kCODE_JSON == m_code_type) {
             (static_cast<dr::protocol::TJSONProtocol*>(codec))->clearContext();
+        } else if (kCODE_COMPACT == m_code_type) {
+            (static_cast<dr::protocol::TCompactProtocol*>(codec))->clearState();
         }
         return codec;
     }
@@ -97,6 +163,10 @@ dr::protocol::TProtocol* PebbleRpc::GetCodec(MemoryPolicy mem_policy) {
             codec = new dr::protocol::TBinaryProtocol(trans);
             break;
 
+        case kCODE_COMPACT:
+            codec = new dr::protocol::TCompactProtocol(trans);
+            break;
+
         default:
             PLOG_ERROR("unsupport code type : %d", m_code_type);
             return NULL;
@@ -106,6 +176,19 @@ dr::protocol::TProtocol* PebbleRpc::GetCodec(MemoryPolicy mem_policy) {
     return codec;
 }
 
+void PebbleRpc::Prewarm(uint32_t session_num, uint32_t buff_bytes, bool lock) {
+    IRpc::Prewarm(session_num, buff_bytes, lock);
+
+    for (int32_t i = 0; i < kPOLICY_BUTT; i++) {
+        GetCodec(static_cast<MemoryPolicy>(i));
+    }
+
+    if (buff_bytes > 0 && GetBuffer(static_cast<int32_t>(buff_bytes)) != NULL
+        && PrefaultMemory(m_buff, m_buff_size, lock) != 0) {
+        PLOG_ERROR("mlock rpc buffer failed(%d:%s)", errno, strerror(errno));
+    }
+}
+
 uint8_t* PebbleRpc::GetBuffer(int32_t size) {
     static const int32_t max_buff_size = 1024 * 1024 * 8;
     if (m_buff != NULL && size <= m_buff_size) {
@@ -132,8 +215,31 @@ int32_t PebbleRpc::SendRequestSync(int64_t handle,
                     const uint8_t* buff,
                     uint32_t buff_len,
                     const OnRpcResponse& on_rsp,
-                    int32_t timeout_ms) {
-    return m_rpc_util->SendRequestSync(handle, rpc_head, buff, buff_len, on_rsp, timeout_ms);
+                    int32_t timeout_ms,
+                    RpcHedge* hedge) {
+    return m_rpc_util->SendRequestSync(handle, rpc_head, buff, buff_len, on_rsp, timeout_ms, hedge);
+}
+
+void PebbleRpc::GetResourceUsed(cxx::unordered_map<std::string, int64_t>* resource_info) {
+    if (!resource_info) {
+        return;
+    }
+    IRpc::GetResourceUsed(resource_info);
+
+    uint64_t hedge_num = 0;
+    uint64_t hedge_win_num = 0;
+    m_rpc_util->GetHedgeStat(&hedge_num, &hedge_win_num);
+    if (0 == hedge_num) {
+        return;
+    }
+
+    std::ostringstream hedge;
+    hedge << "Rpc(" << this << "):hedge";
+    (*resource_info)[hedge.str()] = hedge_num;
+
+    std::ostringstream hedge_win;
+    hedge_win << "Rpc(" << this << "):hedge_win";
+    (*resource_info)[hedge_win.str()] = hedge_win_num;
 }
 
 void PebbleRpc::SendRequestParallel(int64_t handle,
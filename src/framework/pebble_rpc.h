@@ -14,6 +14,7 @@
 #ifndef _PEBBLE_FRAMEWORK_PEBBLE_RPC_H_
 #define _PEBBLE_FRAMEWORK_PEBBLE_RPC_H_
 
+#include <vector>
 #include "framework/rpc.h"
 
 namespace pebble {
@@ -57,6 +58,7 @@ typedef enum {
     kCODE_BINARY  = 0,  // thrift binary protocol
     kCODE_JSON,         // thrift json protocol
     kCODE_PB,           // protobuff protocol
+    kCODE_COMPACT,      // thrift compact protocol
     kCODE_BUTT
 } CodeType;
 
@@ -71,6 +73,55 @@ class TProtocol;
 }
 }
 
+/// @brief 对冲请求(backup request)策略，用于通过路由访问多个后端的只读请求，由stub同步调用使用
+/// @note 请求发出后超过最近响应耗时的percentile分位仍未响应时，再经路由选择另一个连接发出相同的请求，
+///     先到的响应生效，另一个请求的会话被取消、不回调；对冲请求数不超过普通请求数的max_extra_percent%
+class RpcHedge {
+public:
+    // 参与分位数计算的最近耗时样本数
+    static const uint32_t SAMPLE_NUM = 256;
+    // 样本数不足时不对冲
+    static const uint32_t MIN_SAMPLE_NUM = 32;
+    // 额外请求预算最多累积的对冲次数
+    static const uint32_t MAX_BURST = 10;
+
+    /// @param backup_route 对冲路由函数，参数为原请求的连接句柄，返回另一个连接句柄，<0表示不对冲
+    /// @param percentile 对冲延时取最近响应耗时的此分位数，取值1~99
+    /// @param max_extra_percent 对冲请求数占普通请求数的比例上限，取值1~100
+    RpcHedge(const cxx::function<int64_t(int64_t exclude_handle)>& backup_route,
+        uint32_t percentile, uint32_t max_extra_percent);
+
+    /// @brief 返回发出对冲请求的延时(ms)，样本不足时返回-1表示不对冲
+    int32_t GetDelayMS() const { return m_delay_ms; }
+
+    /// @brief 记录一次普通请求，按比例补充对冲预算
+    void OnRequest();
+
+    /// @brief 消耗一次对冲预算
+    /// @return true 预算足够，可以发出对冲请求
+    bool Acquire();
+
+    /// @brief 记录一次响应耗时
+    void AddLatency(int64_t cost_ms);
+
+    /// @brief 经对冲路由选择一个与handle不同的连接，只调用一次路由
+    /// @return >=0 连接句柄，<0 没有其他可用连接或路由策略不支持对冲
+    int64_t GetBackupHandle(int64_t handle);
+
+private:
+    void UpdateDelay();
+
+private:
+    cxx::function<int64_t(int64_t)> m_backup_route;
+    uint32_t m_percentile;
+    uint32_t m_max_extra_percent;
+    uint32_t m_budget;      // 对冲预算，单位为1%个请求
+    int32_t  m_delay_ms;
+    uint32_t m_sample_pos;
+    uint32_t m_new_sample_num;
+    std::vector<int32_t> m_samples;
+};
+
 /// @brief PebbleRpc封装同步、并行处理，服务注册等基本能力，和IDL无关
 /// 框架内部通用能力如异常处理等编解码使用dr完成
 class PebbleRpc : public IRpc {
@@ -102,14 +153,21 @@ public:
     /// @note 内部使用，用户无需关注
     uint8_t* GetBuffer(int32_t size);
 
-    /// @brief stub同步发送接口
+    /// @brief stub同步发送接口，hedge非空时按其策略发出对冲请求
     /// @note 内部使用，用户无需关注
     int32_t SendRequestSync(int64_t handle,
                     const RpcHead& rpc_head,
                     const uint8_t* buff,
                     uint32_t buff_len,
                     const OnRpcResponse& on_rsp,
-                    int32_t timeout_ms);
+                    int32_t timeout_ms,
+                    RpcHedge* hedge = NULL);
+
+    /// @brief 返回动态资源使用情况，在IRpc的基础上增加对冲请求统计
+    virtual void GetResourceUsed(cxx::unordered_map<std::string, int64_t>* resource_info);
+
+    /// @brief 在IRpc的基础上预先创建编解码器，分配编码缓冲区并写入每一页
+    virtual void Prewarm(uint32_t session_num, uint32_t buff_bytes, bool lock);
 
     /// @brief stub并行发送接口
     /// @note 内部使用，用户无需关注
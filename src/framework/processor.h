@@ -16,6 +16,7 @@
 #define _PEBBLE_COMMON_PROCESSOR_H_
 
 #include "common/error.h"
+#include "common/function.h"
 #include "common/platform.h"
 #include "framework/message.h"
 
@@ -43,21 +44,21 @@ public:
 
 /// @brief send函数定义
 /// @param flag message接口可选参数，默认为0
-typedef cxx::function< // NOLINT
+typedef Function< // NOLINT
     int32_t(int64_t handle, const uint8_t* buff, uint32_t buff_len, int32_t flag)> SendFunction;
 
 /// @brief sendv函数定义
 /// @param flag message接口可选参数，默认为0
-typedef cxx::function< // NOLINT
+typedef Function< // NOLINT
     int32_t(int64_t handle, uint32_t msg_frag_num,
     const uint8_t* msg_frag[], uint32_t msg_frag_len[], int32_t flag)> SendVFunction;
 
 /// @brief broadcast函数定义
-typedef cxx::function< // NOLINT
+typedef Function< // NOLINT
     int32_t(const std::string& channel_name, const uint8_t* buff, uint32_t buff_len)> BroadcastFunction;
 
 /// @brief broadcastv函数定义
-typedef cxx::function< // NOLINT
+typedef Function< // NOLINT
     int32_t(const std::string& channel_name, uint32_t msg_frag_num,
     const uint8_t* msg_frag[], uint32_t msg_frag_len[])> BroadcastVFunction;
 
@@ -140,6 +141,11 @@ public:
     /// @return 处理的事件数，0表示无事件
     virtual int32_t Update() = 0;
 
+    /// @brief 返回距离下一个需要Update处理的定时事件的时间，框架据此决定idle时的最长等待时间
+    /// @return <0 无定时事件
+    /// @return >=0 等待时间，单位ms
+    virtual int64_t GetNextTimeoutMS() { return -1; }
+
     /// @brief Processor发送消息接口，实际使用SetSendFunction设置的send函数，用户可扩展在send前做些特殊处理
     /// @return 0 成功，<0 失败
     virtual int32_t Send(int64_t handle, const uint8_t* msg, uint32_t msg_len, int32_t flag);
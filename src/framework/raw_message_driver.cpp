@@ -17,6 +17,7 @@
 
 #include "common/log.h"
 #include "common/string_utility.h"
+#include "common/time_utility.h"
 #include "framework/net_message.h"
 #include "framework/raw_message_driver.h"
 
@@ -33,8 +34,19 @@ int32_t UrlToNetAddress(const std::string& url, std::string* ip, uint16_t* port)
         return -1;
     }
 
+    // unix域socket没有端口，路径中可能含有':'
+    size_t unix_pos = url.find("unix://");
+    if (0 == unix_pos || (3 == unix_pos && StringUtility::StartsWith(url, "raw"))) {
+        ip->assign(url);
+        *port = 0;
+        return 0;
+    }
+
+    // ipv6地址需写在"[]"中，如"tcp://[::1]:8080"
     size_t pos = url.find_last_of(':');
-    if (std::string::npos == pos || url.size() == pos) {
+    size_t bracket_pos = url.find_last_of(']');
+    if (std::string::npos == pos || url.size() == pos
+        || (std::string::npos != bracket_pos && pos < bracket_pos)) {
         return -1;
     }
 
@@ -44,12 +56,44 @@ int32_t UrlToNetAddress(const std::string& url, std::string* ip, uint16_t* port)
 }
 
 
+// 按需扩大临时缓冲区
+static uint8_t* ReserveBuff(uint8_t** buff, uint32_t* buff_len, uint32_t need_len) {
+    if (*buff != NULL && *buff_len >= need_len) {
+        return *buff;
+    }
+    uint8_t* new_buff = static_cast<uint8_t*>(realloc(*buff, need_len));
+    if (NULL == new_buff) {
+        return NULL;
+    }
+    *buff = new_buff;
+    *buff_len = need_len;
+    return new_buff;
+}
+
+__thread RawMessageDriver* RawMessageDriver::m_instance = NULL;
+
+void RawMessageDriver::ReleaseInstance() {
+    delete m_instance;
+    m_instance = NULL;
+}
+
 RawMessageDriver::RawMessageDriver() {
     m_net_message = NULL;
+    m_compress_type = kCOMPRESS_NONE;
+    m_compress_threshold = 0;
+    m_compress_src = NULL;
+    m_compress_src_len = 0;
+    m_compress_buff = NULL;
+    m_compress_buff_len = 0;
+    m_decompress_buff = NULL;
+    m_decompress_buff_len = 0;
 }
 
 RawMessageDriver::~RawMessageDriver() {
     delete m_net_message;
+    free(m_compress_src);
+    free(m_compress_buff);
+    free(m_decompress_buff);
 }
 
 int32_t RawMessageDriver::Init(uint32_t msg_buff_len) {
@@ -58,9 +102,16 @@ int32_t RawMessageDriver::Init(uint32_t msg_buff_len) {
     }
 
     m_net_message = new NetMessage();
-    return m_net_message->Init(sizeof(TcpMsgHead),
+    int32_t ret = m_net_message->Init(sizeof(TcpMsgHead),
         cxx::bind(&RawMessageDriver::ParseHead, this, cxx::placeholders::_1, cxx::placeholders::_2),
         msg_buff_len);
+    if (ret != 0) {
+        return ret;
+    }
+
+    m_net_message->SetRewriteMsgFunc(cxx::bind(&RawMessageDriver::DecompressMsg, this,
+        cxx::placeholders::_1, cxx::placeholders::_2, cxx::placeholders::_3, cxx::placeholders::_4));
+    return 0;
 }
 
 int64_t RawMessageDriver::Bind(const std::string& url) {
@@ -97,13 +148,7 @@ int64_t RawMessageDriver::Connect(const std::string& url) {
 
 int32_t RawMessageDriver::Send(int64_t handle, const uint8_t* msg, uint32_t msg_len, int32_t flag) {
     if (m_net_message->IsTcpTransport(handle)) {
-        TcpMsgHead head;
-        head._magic    = htonl(head._magic);
-        head._version  = htonl(head._version);
-        head._data_len = htonl(msg_len);
-        const uint8_t* frags[2] = { (uint8_t*)(&head),  msg     };
-        uint32_t fragslen[2]    = { sizeof(TcpMsgHead), msg_len };
-        return m_net_message->SendV(handle, 2, frags, fragslen);
+        return SendTcpMsg(handle, 1, &msg, &msg_len);
     } else {
         return m_net_message->Send(handle, msg, msg_len);
     }
@@ -112,37 +157,57 @@ int32_t RawMessageDriver::Send(int64_t handle, const uint8_t* msg, uint32_t msg_
 int32_t RawMessageDriver::SendV(int64_t handle, uint32_t msg_frag_num,
                           const uint8_t* msg_frag[], uint32_t msg_frag_len[], int32_t flag) {
     if (m_net_message->IsTcpTransport(handle)) {
+        return SendTcpMsg(handle, msg_frag_num, msg_frag, msg_frag_len);
+    } else {
+        return m_net_message->SendV(handle, msg_frag_num, msg_frag, msg_frag_len);
+    }
+}
 
-#define MAX_FRAG 32
+int32_t RawMessageDriver::SendTcpMsg(int64_t handle, uint32_t msg_frag_num,
+    const uint8_t* msg_frag[], uint32_t msg_frag_len[]) {
 
-        if (msg_frag_num + 1 > MAX_FRAG) {
-            PLOG_ERROR_N_EVERY_SECOND(1, "msg_frag_num %d > MAX_FRAG %d", msg_frag_num, MAX_FRAG);
-            return kMESSAGE_INVAILD_PARAM;
-        }
+#define MAX_FRAG 32
 
-        const uint8_t* tmp_frags[MAX_FRAG] = {0};
-        uint32_t tmp_frag_len[MAX_FRAG] = {0};
+    if (msg_frag_num + 1 > MAX_FRAG) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "msg_frag_num %d > MAX_FRAG %d", msg_frag_num, MAX_FRAG);
+        return kMESSAGE_INVAILD_PARAM;
+    }
 
-        int32_t msg_len = 0;
-        for (uint32_t i = 0; i < msg_frag_num; i++) {
-            msg_len += msg_frag_len[i];
+    uint32_t msg_len = 0;
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        msg_len += msg_frag_len[i];
+    }
 
-            tmp_frags[ i + 1 ]    = msg_frag[i];
-            tmp_frag_len[ i + 1 ] = msg_frag_len[i];
+    TcpMsgHead head;
+    head._magic = htonl(head._magic);
+
+    // 对端声明可以解压时，超过阈值的消息压缩后发送
+    if (m_compress_type != kCOMPRESS_NONE && msg_len > m_compress_threshold
+        && (m_net_message->GetUserData(handle) & (1u << m_compress_type)) != 0) {
+        int32_t compress_len = CompressMsg(msg_frag_num, msg_frag, msg_frag_len, msg_len);
+        if (compress_len > 0) {
+            head._version  = htonl(HeadVersion(m_compress_type));
+            head._data_len = htonl(compress_len);
+            const uint8_t* frags[2] = { (uint8_t*)(&head),  m_compress_buff };
+            uint32_t fragslen[2]    = { sizeof(TcpMsgHead), (uint32_t)compress_len };
+            return m_net_message->SendV(handle, 2, frags, fragslen);
         }
+    }
 
-        TcpMsgHead head;
-        head._magic    = htonl(head._magic);
-        head._version  = htonl(head._version);
-        head._data_len = htonl(msg_len);
+    const uint8_t* tmp_frags[MAX_FRAG] = {0};
+    uint32_t tmp_frag_len[MAX_FRAG] = {0};
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        tmp_frags[ i + 1 ]    = msg_frag[i];
+        tmp_frag_len[ i + 1 ] = msg_frag_len[i];
+    }
 
-        tmp_frags[0]    = (uint8_t*)(&head);
-        tmp_frag_len[0] = sizeof(TcpMsgHead);
+    head._version  = htonl(HeadVersion(kCOMPRESS_NONE));
+    head._data_len = htonl(msg_len);
 
-        return m_net_message->SendV(handle, msg_frag_num + 1, tmp_frags, tmp_frag_len);
-    } else {
-        return m_net_message->SendV(handle, msg_frag_num, msg_frag, msg_frag_len);
-    }
+    tmp_frags[0]    = (uint8_t*)(&head);
+    tmp_frag_len[0] = sizeof(TcpMsgHead);
+
+    return m_net_message->SendV(handle, msg_frag_num + 1, tmp_frags, tmp_frag_len);
 }
 
 int32_t RawMessageDriver::Recv(int64_t handle, uint8_t* msg_buff, uint32_t* buff_len,
@@ -225,6 +290,217 @@ const char* RawMessageDriver::GetLastError() {
     return NULL;
 }
 
+int32_t RawMessageDriver::Flush(int64_t handle) {
+    if (NULL == m_net_message) {
+        return 0;
+    }
+    return m_net_message->Flush(handle < 0 ? INVAILD_HANDLE : _CAST_TO_NETADDR(handle));
+}
+
+int32_t RawMessageDriver::WatchFd(int32_t fd, uint32_t events, const FdEventCallback& on_event) {
+    if (NULL == m_net_message) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    return m_net_message->WatchFd(fd, events, on_event);
+}
+
+int32_t RawMessageDriver::UnwatchFd(int32_t fd) {
+    if (NULL == m_net_message) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    return m_net_message->UnwatchFd(fd);
+}
+
+int32_t RawMessageDriver::GetPeerCred(int64_t handle, int32_t* pid, uint32_t* uid, uint32_t* gid) {
+    if (NULL == m_net_message) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    return m_net_message->GetPeerCred(_CAST_TO_NETADDR(handle), pid, uid, gid);
+}
+
+int32_t RawMessageDriver::ExportListenFd(int64_t handle) {
+    if (NULL == m_net_message) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    return m_net_message->ExportListenFd(_CAST_TO_NETADDR(handle));
+}
+
+int32_t RawMessageDriver::StopListen(int64_t handle) {
+    if (NULL == m_net_message) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    return m_net_message->StopListen(_CAST_TO_NETADDR(handle));
+}
+
+int32_t RawMessageDriver::GetPollFd() {
+    return m_net_message ? m_net_message->GetPollFd() : -1;
+}
+
+bool RawMessageDriver::HasPendingEvent() {
+    return m_net_message ? m_net_message->HasPendingEvent() : false;
+}
+
+int32_t RawMessageDriver::Prewarm(uint32_t conn_num, bool lock) {
+    if (NULL == m_net_message) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    return m_net_message->Prewarm(conn_num, lock);
+}
+
+int32_t RawMessageDriver::GetConnectionPoolInfo(uint32_t* used_num, uint32_t* free_num) {
+    if (NULL == m_net_message) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    m_net_message->GetBuffInfo(used_num, free_num);
+    return 0;
+}
+
+void RawMessageDriver::SetSendCork(uint32_t flush_bytes) {
+    if (m_net_message) {
+        m_net_message->SetSendCork(flush_bytes);
+    }
+}
+
+void RawMessageDriver::SetAcceptBatch(uint32_t accept_batch_num) {
+    if (m_net_message) {
+        m_net_message->SetAcceptBatch(accept_batch_num);
+    }
+}
+
+void RawMessageDriver::SetEdgeTrigger(bool edge_trigger, uint32_t read_ahead_len) {
+    if (m_net_message) {
+        m_net_message->SetEdgeTrigger(edge_trigger, read_ahead_len);
+    }
+}
+
+int32_t RawMessageDriver::SetCompress(CompressType type, uint32_t threshold) {
+    if (type != kCOMPRESS_NONE && !Compressor::IsSupport(type)) {
+        PLOG_ERROR("compress type %d unsupport, build with PEBBLE_USE_LZ4/PEBBLE_USE_ZSTD", type);
+        return kMESSAGE_UNSUPPORT;
+    }
+    m_compress_type = type;
+    m_compress_threshold = threshold;
+    return 0;
+}
+
+void RawMessageDriver::GetCompressStat(CompressStat* stat) {
+    if (stat) {
+        *stat = m_compress_stat;
+    }
+    m_compress_stat = CompressStat();
+}
+
+void RawMessageDriver::GetUdpSendStat(uint64_t* batch_num, uint64_t* datagram_num,
+    uint64_t* failed_num) {
+    NetMessage::UdpSendStat stat;
+    if (m_net_message) {
+        m_net_message->GetUdpSendStat(&stat);
+    }
+    *batch_num    = stat._batch_num;
+    *datagram_num = stat._datagram_num;
+    *failed_num   = stat._failed_num;
+}
+
+uint32_t RawMessageDriver::HeadVersion(CompressType type) {
+    // 未开启压缩时保持v1，与老版本完全一致
+    if (kCOMPRESS_NONE == m_compress_type) {
+        return TCP_HEAD_VERSION_1;
+    }
+    return TCP_HEAD_VERSION_2 | (static_cast<uint32_t>(type) << 8) | (Compressor::SupportMask() << 16);
+}
+
+int32_t RawMessageDriver::CompressMsg(uint32_t msg_frag_num, const uint8_t* msg_frag[],
+    uint32_t msg_frag_len[], uint32_t msg_len) {
+    // 多片消息先拼接为连续数据
+    const uint8_t* src = msg_frag[0];
+    if (msg_frag_num > 1) {
+        if (NULL == ReserveBuff(&m_compress_src, &m_compress_src_len, msg_len)) {
+            return -1;
+        }
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < msg_frag_num; i++) {
+            memcpy(m_compress_src + offset, msg_frag[i], msg_frag_len[i]);
+            offset += msg_frag_len[i];
+        }
+        src = m_compress_src;
+    }
+
+    uint32_t bound = sizeof(uint32_t) + Compressor::CompressBound(m_compress_type, msg_len);
+    if (NULL == ReserveBuff(&m_compress_buff, &m_compress_buff_len, bound)) {
+        return -1;
+    }
+
+    int64_t begin = TimeUtility::GetMonotonicUS();
+    int32_t len = Compressor::Compress(m_compress_type, src, msg_len,
+        m_compress_buff + sizeof(uint32_t), bound - sizeof(uint32_t));
+    m_compress_stat._compress_us += TimeUtility::GetMonotonicUS() - begin;
+    if (len <= 0 || len + sizeof(uint32_t) >= msg_len) {
+        // 压缩失败或无收益
+        return -1;
+    }
+
+    uint32_t raw_len = htonl(msg_len);
+    memcpy(m_compress_buff, &raw_len, sizeof(raw_len));
+
+    m_compress_stat._compress_num++;
+    m_compress_stat._raw_bytes += msg_len;
+    m_compress_stat._compressed_bytes += len + sizeof(uint32_t);
+    return len + sizeof(uint32_t);
+}
+
+int32_t RawMessageDriver::DecompressMsg(uint64_t handle, uint8_t* msg, uint32_t msg_len,
+    uint32_t buff_len) {
+    TcpMsgHead* head = reinterpret_cast<TcpMsgHead*>(msg);
+    uint32_t version = ntohl(head->_version);
+    if ((version & 0xff) < TCP_HEAD_VERSION_2) {
+        return msg_len;
+    }
+
+    // 记录对端可以解压的算法，连接关闭或重连后清零
+    uint32_t peer_mask = (version >> 16) & 0xff;
+    if (m_net_message->GetUserData(handle) != peer_mask) {
+        m_net_message->SetUserData(handle, peer_mask);
+    }
+
+    CompressType type = static_cast<CompressType>((version >> 8) & 0xff);
+    if (kCOMPRESS_NONE == type) {
+        return msg_len;
+    }
+
+    uint32_t head_len = sizeof(TcpMsgHead);
+    if (msg_len < head_len + sizeof(uint32_t) || !Compressor::IsSupport(type)) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "invalid compressed msg, type = %d, len = %u", type, msg_len);
+        return -1;
+    }
+
+    uint32_t raw_len = 0;
+    memcpy(&raw_len, msg + head_len, sizeof(raw_len));
+    raw_len = ntohl(raw_len);
+    if (raw_len > buff_len - head_len) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "raw len %u > buff len %u", raw_len, buff_len - head_len);
+        return -1;
+    }
+    if (NULL == ReserveBuff(&m_decompress_buff, &m_decompress_buff_len, raw_len)) {
+        return -1;
+    }
+
+    int64_t begin = TimeUtility::GetMonotonicUS();
+    int32_t ret = Compressor::Decompress(type, msg + head_len + sizeof(uint32_t),
+        msg_len - head_len - sizeof(uint32_t), m_decompress_buff, raw_len);
+    m_compress_stat._decompress_us += TimeUtility::GetMonotonicUS() - begin;
+    if (ret != 0) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "decompress failed(%d), type = %d", ret, type);
+        return -1;
+    }
+    m_compress_stat._decompress_num++;
+
+    // 解压后的消息写回连接的接收缓冲区，上层Peek到的仍是一个连续的完整消息
+    memcpy(msg + head_len, m_decompress_buff, raw_len);
+    head->_version  = htonl(version & ~0xff00u);
+    head->_data_len = htonl(raw_len);
+    return head_len + raw_len;
+}
+
 int32_t RawMessageDriver::ParseHead(const uint8_t* head, uint32_t head_len) {
     if (head == NULL || head_len < sizeof(TcpMsgHead)) {
         return -1;
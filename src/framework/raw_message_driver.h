@@ -16,6 +16,8 @@
 #define _PEBBLE_COMMON_RAW_MESSAGE_DRIVER_H_
 
 #include <list>
+#include <string.h>
+#include "common/compress.h"
 #include "framework/message.h"
 
 
@@ -24,16 +26,24 @@ namespace pebble {
 class NetMessage;
 
 #define TCP_HEAD_MAGIC 0xA5A5A5A5
+#define TCP_HEAD_VERSION_1 1
+/// v2在_version的高位携带压缩信息: bit0~7 版本号，bit8~15 本消息数据的压缩算法(CompressType)，
+///     bit16~23 发送端可以解压的算法掩码，逐连接协商，对端声明支持后才会向其发送压缩消息
+/// 压缩消息的数据部分为: 原始数据长度(uint32_t，网络序) + 压缩数据
+#define TCP_HEAD_VERSION_2 2
 #pragma pack(1)
 /// @brief 对tcp传输数据增加消息头
 struct TcpMsgHead {
-    TcpMsgHead() : _magic(TCP_HEAD_MAGIC), _version(1), _data_len(0) {}
+    TcpMsgHead() : _magic(TCP_HEAD_MAGIC), _version(TCP_HEAD_VERSION_1), _data_len(0) {}
     uint32_t _magic;
     uint32_t _version;
     uint32_t _data_len;
 };
 #pragma pack()
 
+/// @brief 解析"ip:port"形式的url，unix域socket的url("unix:///path")整体作为ip，port为0
+int32_t UrlToNetAddress(const std::string& url, std::string* ip, uint16_t* port);
+
 
 /// @brief RAW TCP/UDP网络驱动接口
 /// @note 这里不考虑性能，仅供开发、测试使用，生产环境使用tbuspp
@@ -46,11 +56,17 @@ public:
     static const int32_t DEFAULT_MSG_BUFF_LEN = 1024 * 1024 * 2;
     virtual ~RawMessageDriver();
 
+    /// @brief 每个线程一个实例，多worker模式下各worker独立收发
     static RawMessageDriver* Instance() {
-        static RawMessageDriver s_raw_message;
-        return &s_raw_message;
+        if (NULL == m_instance) {
+            m_instance = new RawMessageDriver();
+        }
+        return m_instance;
     }
 
+    /// @brief 释放当前线程的实例，关闭其上的所有连接，worker线程退出前调用
+    static void ReleaseInstance();
+
     int32_t Init(uint32_t msg_buff_len = DEFAULT_MSG_BUFF_LEN);
 
     virtual int64_t Bind(const std::string& url);
@@ -81,11 +97,98 @@ public:
 
     virtual const char* GetLastError();
 
+    virtual int32_t Flush(int64_t handle);
+
+    virtual int32_t WatchFd(int32_t fd, uint32_t events, const FdEventCallback& on_event);
+
+    virtual int32_t UnwatchFd(int32_t fd);
+
+    virtual int32_t GetPeerCred(int64_t handle, int32_t* pid, uint32_t* uid, uint32_t* gid);
+
+    virtual int32_t ExportListenFd(int64_t handle);
+
+    virtual int32_t StopListen(int64_t handle);
+
+    virtual int32_t Prewarm(uint32_t conn_num, bool lock);
+
+    virtual int32_t GetConnectionPoolInfo(uint32_t* used_num, uint32_t* free_num);
+
+    /// @brief 获取内部的epoll fd，用于与其他事件循环合并等待 @see NetMessage::GetPollFd
+    /// @return >=0 epoll fd
+    /// @return <0 未初始化
+    int32_t GetPollFd();
+
+    /// @brief 是否有不依赖epoll事件的待处理数据 @see NetMessage::HasPendingEvent
+    bool HasPendingEvent();
+
+    /// @brief 设置TCP发送cork模式 @see NetMessage::SetSendCork
+    void SetSendCork(uint32_t flush_bytes);
+
+    /// @brief 设置tcp listen每次唤醒最多接受的连接数量 @see NetMessage::SetAcceptBatch
+    void SetAcceptBatch(uint32_t accept_batch_num);
+
+    /// @brief 设置TCP数据连接使用epoll边缘触发 @see NetMessage::SetEdgeTrigger
+    void SetEdgeTrigger(bool edge_trigger, uint32_t read_ahead_len);
+
+    /// @brief 设置TCP消息压缩，开启后消息头升级为v2并声明本端可解压的算法，
+    ///     只对同样声明支持type的对端发送压缩消息，对端为老版本时不受影响
+    /// @param type 压缩算法，kCOMPRESS_NONE为关闭
+    /// @param threshold 消息数据超过此长度才压缩
+    /// @return 0 成功
+    /// @return kMESSAGE_UNSUPPORT 编译时未开启该算法
+    int32_t SetCompress(CompressType type, uint32_t threshold);
+
+    /// @brief 消息压缩统计
+    struct CompressStat {
+        uint64_t _compress_num;     // 压缩发送的消息数
+        uint64_t _raw_bytes;        // 压缩前的数据长度
+        uint64_t _compressed_bytes; // 压缩后的数据长度
+        int64_t  _compress_us;      // 压缩耗时(包括压缩无收益而放弃的)
+        uint64_t _decompress_num;   // 解压的消息数
+        int64_t  _decompress_us;    // 解压耗时
+        CompressStat() { memset(this, 0, sizeof(CompressStat)); }
+    };
+
+    /// @brief 取出上次调用以来的压缩统计，取出后清零
+    void GetCompressStat(CompressStat* stat);
+
+    /// @brief 取出上次调用以来的udp回包攒批发送统计，取出后清零 @see NetMessage::GetUdpSendStat
+    /// @param batch_num 批量发送的次数
+    /// @param datagram_num 攒批发送的数据报数
+    /// @param failed_num 发送失败丢弃的数据报数
+    void GetUdpSendStat(uint64_t* batch_num, uint64_t* datagram_num, uint64_t* failed_num);
+
 private:
     int32_t ParseHead(const uint8_t* head, uint32_t head_len);
 
+    int32_t SendTcpMsg(int64_t handle, uint32_t msg_frag_num,
+        const uint8_t* msg_frag[], uint32_t msg_frag_len[]);
+
+    /// @brief 压缩待发送的消息，结果为 原始长度 + 压缩数据，存放在m_compress_buff中
+    /// @return >0 压缩后的长度，<=0 压缩失败或无收益，按原始数据发送
+    int32_t CompressMsg(uint32_t msg_frag_num, const uint8_t* msg_frag[],
+        uint32_t msg_frag_len[], uint32_t msg_len);
+
+    /// @brief NetMessage收到完整TCP消息后的回调，记录对端的解压能力，并在接收缓冲区内解压
+    int32_t DecompressMsg(uint64_t handle, uint8_t* msg, uint32_t msg_len, uint32_t buff_len);
+
+    uint32_t HeadVersion(CompressType type);
+
 private:
     NetMessage* m_net_message;
+
+    CompressType m_compress_type;
+    uint32_t m_compress_threshold;
+    // 多片消息拼接、压缩输出、解压输出的临时缓冲区，按需增长
+    uint8_t* m_compress_src;
+    uint32_t m_compress_src_len;
+    uint8_t* m_compress_buff;
+    uint32_t m_compress_buff_len;
+    uint8_t* m_decompress_buff;
+    uint32_t m_decompress_buff_len;
+    CompressStat m_compress_stat;
+
+    static __thread RawMessageDriver* m_instance;
 };
 
 
@@ -86,6 +86,14 @@ int64_t Router::GetRoute(uint64_t key)
     return kROUTER_NOT_SUPPORTTED;
 }
 
+int64_t Router::GetBackupRoute(uint64_t key, int64_t exclude_handle)
+{
+    if (NULL != m_route_policy) {
+        return m_route_policy->GetBackupRoute(key, exclude_handle, m_route_handles);
+    }
+    return kROUTER_NOT_SUPPORTTED;
+}
+
 void Router::NameWatch(const std::vector<std::string>& urls)
 {
     // TODO: 后续优化，目前实现有点粗暴
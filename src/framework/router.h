@@ -52,6 +52,12 @@ class IRoutePolicy
 public:
     virtual ~IRoutePolicy() {}
     virtual int64_t GetRoute(uint64_t key, const std::vector<int64_t>& handles) = 0;
+
+    /// @brief 为对冲请求选择一个不同于exclude_handle的连接，默认不支持(如取模/哈希路由要求同一key落在同一连接)
+    virtual int64_t GetBackupRoute(uint64_t key, int64_t exclude_handle, const std::vector<int64_t>& handles)
+    {
+        return kROUTER_NOT_SUPPORTTED;
+    }
 };
 
 class RoundRoutePolicy      :   public IRoutePolicy
@@ -65,6 +71,17 @@ public:
         }
         return handles[(m_round++) % handles.size()];
     }
+
+    int64_t GetBackupRoute(uint64_t key, int64_t exclude_handle, const std::vector<int64_t>& handles)
+    {
+        for (uint32_t i = 0; i < handles.size(); ++i) {
+            int64_t handle = handles[(m_round++) % handles.size()];
+            if (handle != exclude_handle) {
+                return handle;
+            }
+        }
+        return kROUTER_NONE_VALID_HANDLE;
+    }
 private:
     uint32_t    m_round;
 };
@@ -111,6 +128,12 @@ public:
     /// @return 非负数 - 成功，其它失败@see RouterErrorCode
     virtual int64_t GetRoute(uint64_t key = 0);
 
+    /// @brief 为对冲请求获取一个不同于exclude_handle的路由，只有轮询路由(或实现了GetBackupRoute的自定义路由)支持
+    /// @param key 传入的key
+    /// @param exclude_handle 需要排除的句柄，一般为原请求的句柄
+    /// @return 非负数 - 成功，其它失败@see RouterErrorCode
+    virtual int64_t GetBackupRoute(uint64_t key, int64_t exclude_handle);
+
     /// @brief 设置router监测到地址列表发生变化时的回调函数
     /// @param on_address_changed 当地址列表发生变化时，调用此函数
     virtual void SetOnAddressChanged(const OnAddressChanged& on_address_changed);
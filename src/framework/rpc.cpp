@@ -11,6 +11,7 @@
  *
  */
 
+#include <arpa/inet.h>
 #include <sstream>
 #include <string.h>
 
@@ -30,6 +31,7 @@ private:
         m_timerid     = rhs.m_timerid;
         m_start_time  = rhs.m_start_time;
         m_server_side = rhs.m_server_side;
+        m_cancelled   = rhs.m_cancelled;
     }
 public:
     RpcSession() {
@@ -38,6 +40,7 @@ public:
         m_timerid     = -1;
         m_start_time  = 0;
         m_server_side = false;
+        m_cancelled   = false;
     }
 
     uint64_t m_session_id;
@@ -46,14 +49,40 @@ public:
     int64_t  m_start_time;
     RpcHead  m_rpc_head;
     bool     m_server_side;
+    bool     m_cancelled;     // 已取消，保留到原超时时间，期间到达的响应静默丢弃
     OnRpcResponse m_rsp;
 };
 
+/// @brief 同一handle上待合并发送的rpc消息
+struct RpcBatch {
+    RpcBatch() {
+        m_dst       = NULL;
+        m_num       = 0;
+        m_active_ms = 0;
+    }
+
+    IProcessor* m_dst;
+    uint32_t    m_num;
+    int64_t     m_active_ms;          // 最近一次加入消息的时间，空闲过久时释放
+    std::string m_data;               // 多个(4字节网络序长度 + rpc头 + rpc数据)，发送后清空复用
+    std::vector<uint64_t> m_sessions; // 批量中等待响应的请求会话，发送失败时通知
+};
+
+// 单个批量消息的数据上限，超过时先发出，需小于网络层的消息缓冲区(默认2M)
+static const uint32_t MAX_RPC_BATCH_LEN = 512 * 1024;
+
+// handle的批量缓存空闲超过此时间后释放
+static const int64_t BATCH_IDLE_RELEASE_MS = 10 * 1000;
+
 // TODO: timer改为外部传入
 IRpc::IRpc() {
     m_session_id        = 0;
     m_timer             = new SequenceTimer();
     m_proc_req_timeout_ms = REQ_PROC_TIMEOUT_MS;
+    m_batch_mode        = false;
+    m_batch_reply_handle = -1;
+    m_batch_pending_num = 0;
+    m_batch_sweep_ms    = 0;
 }
 
 IRpc::~IRpc() {
@@ -69,9 +98,21 @@ int32_t IRpc::Update() {
         num += m_timer->Update();
     }
 
+    num += FlushBatch();
+
+    num += NotifySendFailed();
+
     return num;
 }
 
+int64_t IRpc::GetNextTimeoutMS() {
+    // 有待发送的批量消息或待通知的发送失败时不阻塞，尽快进入下一轮Update处理
+    if (m_batch_pending_num > 0 || !m_send_failed_sessions.empty()) {
+        return 0;
+    }
+    return m_timer ? m_timer->GetNextTimeoutMS() : -1;
+}
+
 int32_t IRpc::OnMessage(int64_t handle, const uint8_t* msg,
     uint32_t msg_len, const MsgExternInfo* msg_info, uint32_t is_overload) {
 
@@ -100,13 +141,27 @@ int32_t IRpc::OnMessage(int64_t handle, const uint8_t* msg,
     const uint8_t* data = msg + head_len;
     uint32_t data_len   = msg_len - head_len;
 
+    // 请求方已放弃等待的请求直接丢弃，不再解码处理，响应也不会被接收
+    // 预算是请求方发出时剩余的时间，上游已耗费的时间已扣除，但网络传输的时间无法得知(两端时钟不同步)，
+    // 这里只用本地从到达起的等待时间比较，是偏宽松的判断，最多会多处理单程网络时延内过期的请求
+    if ((kRPC_CALL == head.m_message_type || kRPC_ONEWAY == head.m_message_type)
+        && head.m_timeout_ms > 0 && head.m_arrived_ms > 0) {
+        int64_t wait_ms = TimeUtility::GetCachedMS() - head.m_arrived_ms;
+        if (wait_ms >= head.m_timeout_ms) {
+            PLOG_ERROR_N_EVERY_SECOND(1, "%s expired, wait %ld ms >= timeout %d ms",
+                head.m_function_name.c_str(), wait_ms, head.m_timeout_ms);
+            RequestProcComplete(head.m_function_name, kRPC_MESSAGE_EXPIRED, wait_ms);
+            return kRPC_MESSAGE_EXPIRED;
+        }
+    }
+
     int32_t ret = kRPC_UNKNOWN_TYPE;
     switch (head.m_message_type) {
         case kRPC_CALL:
             if (is_overload != 0) {
                 ret = ResponseException(handle, kRPC_SYSTEM_OVERLOAD_BASE - is_overload, head);
                 RequestProcComplete(head.m_function_name, kRPC_SYSTEM_OVERLOAD_BASE - is_overload,
-                    head.m_arrived_ms > 0 ? TimeUtility::GetCurrentMS() - head.m_arrived_ms : 0);
+                    head.m_arrived_ms > 0 ? TimeUtility::GetCachedMS() - head.m_arrived_ms : 0);
                 break;
             }
         case kRPC_ONEWAY:
@@ -118,6 +173,15 @@ int32_t IRpc::OnMessage(int64_t handle, const uint8_t* msg,
             ret = ProcessResponse(head, data, data_len);
             break;
 
+        case kRPC_BATCH:
+            // 批量消息不支持嵌套
+            if (handle == m_batch_reply_handle) {
+                PLOG_ERROR_N_EVERY_SECOND(1, "nested rpc batch message from %ld", handle);
+                break;
+            }
+            ret = ProcessBatch(handle, data, data_len, msg_info, is_overload);
+            break;
+
         default:
             PLOG_ERROR_N_EVERY_SECOND(1, "rpc msg type error(%d)", head.m_message_type);
             break;
@@ -165,6 +229,21 @@ void IRpc::GetResourceUsed(cxx::unordered_map<std::string, int64_t>* resource_in
     return;
 }
 
+void IRpc::Prewarm(uint32_t session_num, uint32_t buff_bytes, bool lock) {
+    if (session_num > 0) {
+        m_session_map.rehash(static_cast<size_t>(session_num / m_session_map.max_load_factor()) + 1);
+    }
+}
+
+void IRpc::GetSessionInfo(uint32_t* session_num, uint32_t* bucket_num) const {
+    if (session_num) {
+        *session_num = m_session_map.size();
+    }
+    if (bucket_num) {
+        *bucket_num = m_session_map.bucket_count();
+    }
+}
+
 int32_t IRpc::SendRequest(int64_t handle,
                     const RpcHead& rpc_head,
                     const uint8_t* buff,
@@ -177,33 +256,39 @@ int32_t IRpc::SendRequest(int64_t handle,
         return kRPC_INVALID_PARAM;
     }
 
-    // 发送请求
-    int32_t ret = SendMessage(handle, rpc_head, buff, buff_len);
-    if (ret != kRPC_SUCCESS) {
-        ResponseProcComplete(rpc_head.m_function_name, kRPC_SEND_FAILED, 0);
-        return ret;
+    if (timeout_ms <= 0) {
+        timeout_ms = DEFAULT_REQ_TIMEOUT_MS;
     }
 
     // ONEWAY请求
     if (!on_rsp) {
-        ResponseProcComplete(rpc_head.m_function_name, kRPC_SUCCESS, 0);
-        return kRPC_SUCCESS;
+        int32_t ret = SendMessage(handle, rpc_head, buff, buff_len);
+        ResponseProcComplete(rpc_head.m_function_name,
+            ret != kRPC_SUCCESS ? kRPC_SEND_FAILED : kRPC_SUCCESS, 0);
+        return ret;
     }
 
-    // 保持会话
+    // 会话保存请求头的副本，超时预算写在副本中随请求带给服务方，
+    // 服务方据此丢弃过期请求、限制嵌套调用的超时，调用方传入的rpc_head不被修改
     cxx::shared_ptr<RpcSession> session(new RpcSession());
+    session->m_rpc_head = rpc_head;
+    session->m_rpc_head.m_timeout_ms = timeout_ms;
+
+    // 发送请求
+    int32_t ret = SendMessage(handle, session->m_rpc_head, buff, buff_len);
+    if (ret != kRPC_SUCCESS) {
+        ResponseProcComplete(rpc_head.m_function_name, kRPC_SEND_FAILED, 0);
+        return ret;
+    }
+
+    // 保持会话
     session->m_session_id  = rpc_head.m_session_id;
     session->m_handle      = handle;
     session->m_rsp         = on_rsp;
-    session->m_rpc_head    = rpc_head;
     session->m_server_side = false;
     TimeoutCallback cb     = cxx::bind(&IRpc::OnTimeout, this, session->m_session_id);
-
-    if (timeout_ms <= 0) {
-        timeout_ms = 10 * 1000;
-    }
     session->m_timerid     = m_timer->StartTimer(timeout_ms, cb);
-    session->m_start_time  = TimeUtility::GetCurrentMS();
+    session->m_start_time  = TimeUtility::GetCachedMS();
 
     m_session_map[session->m_session_id] = session;
 
@@ -260,7 +345,7 @@ int32_t IRpc::SendResponse(uint64_t session_id, int32_t ret,
         error_code = ret;
     }
     RequestProcComplete(it->second->m_rpc_head.m_function_name,
-        error_code, TimeUtility::GetCurrentMS() - it->second->m_start_time);
+        error_code, TimeUtility::GetCachedMS() - it->second->m_start_time);
 
     m_session_map.erase(it);
 
@@ -269,6 +354,11 @@ int32_t IRpc::SendResponse(uint64_t session_id, int32_t ret,
 
 int32_t IRpc::SendMessage(int64_t handle, const RpcHead& rpc_head,
     const uint8_t* buff, uint32_t buff_len) {
+    // 批量模式或正在处理批量请求时先缓存，在Update或批量请求处理完后合并发送
+    if (m_batch_mode || handle == m_batch_reply_handle) {
+        return AppendBatch(handle, rpc_head, buff, buff_len);
+    }
+
     int32_t head_len = HeadEncode(rpc_head, m_rpc_head_buff, sizeof(m_rpc_head_buff));
     if (head_len < 0) {
         PLOG_ERROR_N_EVERY_SECOND(1, "encode head failed(%d)", head_len);
@@ -293,6 +383,208 @@ int32_t IRpc::SendMessage(int64_t handle, const RpcHead& rpc_head,
     return send_ret;
 }
 
+int32_t IRpc::AppendBatch(int64_t handle, const RpcHead& rpc_head,
+    const uint8_t* buff, uint32_t buff_len) {
+    int32_t head_len = HeadEncode(rpc_head, m_rpc_head_buff, sizeof(m_rpc_head_buff));
+    if (head_len < 0) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "encode head failed(%d)", head_len);
+        return kRPC_ENCODE_FAILED;
+    }
+
+    // handle的批量缓存常驻复用，发送后只清空数据，不再每个周期重新分配
+    cxx::shared_ptr<RpcBatch>& batch = m_batch_map[handle];
+    if (!batch) {
+        batch.reset(new RpcBatch());
+    }
+
+    // 消息来源不同或加入后超限时，先把已缓存的消息发出
+    uint32_t msg_len = head_len + buff_len;
+    if (batch->m_num > 0
+        && (batch->m_dst != rpc_head.m_dst
+            || batch->m_data.size() + sizeof(msg_len) + msg_len > MAX_RPC_BATCH_LEN)) {
+        SendBatch(handle, batch.get());
+    }
+
+    if (0 == batch->m_num) {
+        ++m_batch_pending_num;
+    }
+
+    msg_len = htonl(msg_len);
+    batch->m_data.append((const char*)&msg_len, sizeof(msg_len));
+    batch->m_data.append((const char*)m_rpc_head_buff, head_len);
+    batch->m_data.append((const char*)buff, buff_len);
+    batch->m_dst = rpc_head.m_dst;
+    batch->m_active_ms = TimeUtility::GetCachedMS();
+    ++(batch->m_num);
+    if (kRPC_CALL == rpc_head.m_message_type) {
+        batch->m_sessions.push_back(rpc_head.m_session_id);
+    }
+
+    return kRPC_SUCCESS;
+}
+
+int32_t IRpc::FlushBatch() {
+    // 没有待发送的消息时，只定期检查释放空闲handle的缓存
+    int64_t now = TimeUtility::GetCachedMS();
+    bool sweep = (now - m_batch_sweep_ms >= BATCH_IDLE_RELEASE_MS);
+    if (0 == m_batch_pending_num && !sweep) {
+        return 0;
+    }
+    if (sweep) {
+        m_batch_sweep_ms = now;
+    }
+
+    int32_t num = 0;
+    cxx::unordered_map< int64_t, cxx::shared_ptr<RpcBatch> >::iterator it = m_batch_map.begin();
+    while (it != m_batch_map.end()) {
+        if (it->second->m_num > 0) {
+            SendBatch(it->first, it->second.get());
+            ++num;
+        } else if (sweep && now - it->second->m_active_ms >= BATCH_IDLE_RELEASE_MS) {
+            m_batch_map.erase(it++);
+            continue;
+        }
+        ++it;
+    }
+    return num;
+}
+
+int32_t IRpc::FlushBatch(int64_t handle) {
+    cxx::unordered_map< int64_t, cxx::shared_ptr<RpcBatch> >::iterator it = m_batch_map.find(handle);
+    if (m_batch_map.end() == it) {
+        return kRPC_SUCCESS;
+    }
+
+    return SendBatch(handle, it->second.get());
+}
+
+int32_t IRpc::SendBatch(int64_t handle, RpcBatch* batch) {
+    if (0 == batch->m_num) {
+        return kRPC_SUCCESS;
+    }
+
+    const uint8_t* data = (const uint8_t*)batch->m_data.data();
+    uint32_t data_len   = batch->m_data.size();
+
+    // 批量头单独编码，m_rpc_head_buff中可能是正在加入的消息的头
+    uint8_t batch_head_buff[256];
+    const uint8_t* msg_frag[] = { batch_head_buff, data     };
+    uint32_t msg_frag_len[]   = { 0,               data_len };
+    int32_t send_ret = 0;
+    if (1 == batch->m_num) {
+        // 只有一个消息时按普通消息发送
+        msg_frag[0]     = data + sizeof(uint32_t);
+        msg_frag_len[0] = data_len - sizeof(uint32_t);
+        msg_frag_len[1] = 0;
+    } else {
+        RpcHead head;
+        head.m_message_type = kRPC_BATCH;
+        int32_t head_len = HeadEncode(head, batch_head_buff, sizeof(batch_head_buff));
+        if (head_len < 0) {
+            PLOG_ERROR_N_EVERY_SECOND(1, "encode batch head failed(%d)", head_len);
+            send_ret = kRPC_ENCODE_FAILED;
+        }
+        msg_frag_len[0] = head_len;
+    }
+
+    if (0 == send_ret) {
+        uint32_t frag_num = msg_frag_len[1] > 0 ? 2 : 1;
+        if (batch->m_dst) {
+            send_ret = batch->m_dst->SendV(handle, frag_num, msg_frag, msg_frag_len, 0);
+        } else {
+            send_ret = SendV(handle, frag_num, msg_frag, msg_frag_len, 0);
+        }
+    }
+
+    if (send_ret != 0) {
+        // 请求方调用时已返回成功，发送失败的请求在Update中回调kRPC_SEND_FAILED，不必等到超时
+        PLOG_ERROR_N_EVERY_SECOND(1, "send batch(%u msgs) failed %d", batch->m_num, send_ret);
+        m_send_failed_sessions.insert(m_send_failed_sessions.end(),
+            batch->m_sessions.begin(), batch->m_sessions.end());
+    }
+
+    batch->m_data.clear();
+    batch->m_sessions.clear();
+    batch->m_num = 0;
+    --m_batch_pending_num;
+
+    return send_ret;
+}
+
+int32_t IRpc::NotifySendFailed() {
+    if (m_send_failed_sessions.empty()) {
+        return 0;
+    }
+
+    // 回调中可能再发请求并产生新的发送失败，先换出
+    std::vector<uint64_t> failed_sessions;
+    failed_sessions.swap(m_send_failed_sessions);
+
+    int32_t num = 0;
+    std::vector<uint64_t>::iterator it = failed_sessions.begin();
+    for (; it != failed_sessions.end(); ++it) {
+        cxx::unordered_map< uint64_t, cxx::shared_ptr<RpcSession> >::iterator session_it =
+            m_session_map.find(*it);
+        if (m_session_map.end() == session_it) {
+            continue;
+        }
+
+        cxx::shared_ptr<RpcSession> session = session_it->second;
+        m_timer->StopTimer(session->m_timerid);
+        m_session_map.erase(session_it);
+        if (session->m_cancelled) {
+            continue;
+        }
+
+        if (session->m_rsp) {
+            session->m_rsp(kRPC_SEND_FAILED, NULL, 0);
+            ReportTransportQuality(session->m_handle, kRPC_SEND_FAILED, 0);
+        }
+        ResponseProcComplete(session->m_rpc_head.m_function_name,
+            kRPC_SEND_FAILED, TimeUtility::GetCachedMS() - session->m_start_time);
+        ++num;
+    }
+    return num;
+}
+
+int32_t IRpc::ProcessBatch(int64_t handle, const uint8_t* buff, uint32_t buff_len,
+    const MsgExternInfo* msg_info, uint32_t is_overload) {
+    // 处理期间同步产生的响应合并，处理完后一起原路返回
+    int64_t old_reply_handle = m_batch_reply_handle;
+    m_batch_reply_handle = handle;
+
+    int32_t ret = kRPC_SUCCESS;
+    uint32_t pos = 0;
+    while (pos < buff_len) {
+        uint32_t msg_len = 0;
+        if (buff_len - pos < sizeof(msg_len)) {
+            PLOG_ERROR_N_EVERY_SECOND(1, "batch msg truncated, pos = %u, buff_len = %u", pos, buff_len);
+            ret = kRPC_DECODE_FAILED;
+            break;
+        }
+        memcpy(&msg_len, buff + pos, sizeof(msg_len));
+        msg_len = ntohl(msg_len);
+        pos += sizeof(msg_len);
+
+        if (msg_len > buff_len - pos) {
+            PLOG_ERROR_N_EVERY_SECOND(1, "batch msg len(%u) > remain len(%u)", msg_len, buff_len - pos);
+            ret = kRPC_DECODE_FAILED;
+            break;
+        }
+
+        int32_t result = OnMessage(handle, buff + pos, msg_len, msg_info, is_overload);
+        if (result != kRPC_SUCCESS) {
+            ret = result;
+        }
+        pos += msg_len;
+    }
+
+    m_batch_reply_handle = old_reply_handle;
+    FlushBatch(handle);
+
+    return ret;
+}
+
 int32_t IRpc::OnTimeout(uint64_t session_id) {
     cxx::unordered_map< uint64_t, cxx::shared_ptr<RpcSession> >::iterator it =
         m_session_map.find(session_id);
@@ -303,6 +595,12 @@ int32_t IRpc::OnTimeout(uint64_t session_id) {
 
     cxx::shared_ptr<RpcSession> session = it->second;
 
+    // 已取消的会话到期清理，不回调也不上报
+    if (session->m_cancelled) {
+        m_session_map.erase(it);
+        return kTIMER_BE_REMOVED;
+    }
+
     // request timeout
     if (session->m_rsp) {
         session->m_rsp(kRPC_REQUEST_TIMEOUT, NULL, 0);
@@ -311,10 +609,10 @@ int32_t IRpc::OnTimeout(uint64_t session_id) {
 
     if (session->m_server_side) {
         RequestProcComplete(session->m_rpc_head.m_function_name,
-            kRPC_PROCESS_TIMEOUT, TimeUtility::GetCurrentMS() - session->m_start_time);
+            kRPC_PROCESS_TIMEOUT, TimeUtility::GetCachedMS() - session->m_start_time);
     } else {
         ResponseProcComplete(session->m_rpc_head.m_function_name,
-            kRPC_REQUEST_TIMEOUT, TimeUtility::GetCurrentMS() - session->m_start_time);
+            kRPC_REQUEST_TIMEOUT, TimeUtility::GetCachedMS() - session->m_start_time);
     }
 
     m_session_map.erase(session_id);
@@ -322,6 +620,19 @@ int32_t IRpc::OnTimeout(uint64_t session_id) {
     return kTIMER_BE_REMOVED;
 }
 
+int32_t IRpc::CancelSession(uint64_t session_id) {
+    cxx::unordered_map< uint64_t, cxx::shared_ptr<RpcSession> >::iterator it =
+        m_session_map.find(session_id);
+    if (m_session_map.end() == it || it->second->m_cancelled) {
+        return kRPC_SESSION_NOT_FOUND;
+    }
+
+    // 会话和超时定时器保留到原超时时间，期间到达的响应静默丢弃，无需另外记录
+    it->second->m_cancelled = true;
+    it->second->m_rsp = OnRpcResponse();
+    return kRPC_SUCCESS;
+}
+
 int32_t IRpc::ProcessRequest(int64_t handle, const RpcHead& rpc_head,
     const uint8_t* buff, uint32_t buff_len) {
     return ProcessRequestImp(handle, rpc_head, buff, buff_len);
@@ -336,15 +647,15 @@ int32_t IRpc::ProcessRequestImp(int64_t handle, const RpcHead& rpc_head,
         PLOG_ERROR_N_EVERY_SECOND(1, "%s's request proc func not found", rpc_head.m_function_name.c_str());
         ResponseException(handle, kRPC_UNSUPPORT_FUNCTION_NAME, rpc_head);
         RequestProcComplete(rpc_head.m_function_name, kRPC_UNSUPPORT_FUNCTION_NAME,
-            rpc_head.m_arrived_ms > 0 ? TimeUtility::GetCurrentMS() - rpc_head.m_arrived_ms : 0);
+            rpc_head.m_arrived_ms > 0 ? TimeUtility::GetCachedMS() - rpc_head.m_arrived_ms : 0);
         return kRPC_UNSUPPORT_FUNCTION_NAME;
     }
 
     if (kRPC_ONEWAY == rpc_head.m_message_type) {
-        cxx::function<int32_t(int32_t, const uint8_t*, uint32_t)> rsp; // NOLINT
+        OnRpcResponse rsp;
         int32_t ret = (it->second)(buff, buff_len, rsp);
         RequestProcComplete(rpc_head.m_function_name, ret,
-            rpc_head.m_arrived_ms > 0 ? TimeUtility::GetCurrentMS() - rpc_head.m_arrived_ms : 0);
+            rpc_head.m_arrived_ms > 0 ? TimeUtility::GetCachedMS() - rpc_head.m_arrived_ms : 0);
         return ret;
     }
 
@@ -355,19 +666,37 @@ int32_t IRpc::ProcessRequestImp(int64_t handle, const RpcHead& rpc_head,
     session->m_rpc_head    = rpc_head;
     session->m_server_side = true;
 
+    // 处理超时不超过请求方剩余的超时预算，超时后的响应请求方已不再接收
+    uint32_t proc_timeout_ms = m_proc_req_timeout_ms;
+    int64_t deadline_ms = GetDeadlineMS(rpc_head);
+    if (deadline_ms > 0) {
+        int64_t remain_ms = deadline_ms - TimeUtility::GetCachedMS();
+        if (remain_ms < proc_timeout_ms) {
+            proc_timeout_ms = remain_ms > 0 ? remain_ms : 1;
+        }
+    }
+
     TimeoutCallback cb     = cxx::bind(&IRpc::OnTimeout, this, session->m_session_id);
-    session->m_timerid     = m_timer->StartTimer(m_proc_req_timeout_ms, cb);
-    session->m_start_time  = rpc_head.m_arrived_ms > 0 ? rpc_head.m_arrived_ms : TimeUtility::GetCurrentMS();
+    session->m_timerid     = m_timer->StartTimer(proc_timeout_ms, cb);
+    session->m_start_time  = rpc_head.m_arrived_ms > 0 ? rpc_head.m_arrived_ms : TimeUtility::GetCachedMS();
 
     m_session_map[session->m_session_id] = session;
 
-    cxx::function<int32_t(int32_t, const uint8_t*, uint32_t)> rsp = cxx::bind( // NOLINT
+    OnRpcResponse rsp = cxx::bind(
         &IRpc::SendResponse, this, session->m_session_id,
         cxx::placeholders::_1, cxx::placeholders::_2, cxx::placeholders::_3);
 
     return (it->second)(buff, buff_len, rsp);
 }
 
+int64_t IRpc::GetDeadlineMS(const RpcHead& rpc_head) {
+    if (rpc_head.m_timeout_ms <= 0) {
+        return 0;
+    }
+    int64_t start_ms = rpc_head.m_arrived_ms > 0 ? rpc_head.m_arrived_ms : TimeUtility::GetCachedMS();
+    return start_ms + rpc_head.m_timeout_ms;
+}
+
 int32_t IRpc::ProcessResponse(const RpcHead& rpc_head,
     const uint8_t* buff, uint32_t buff_len) {
 
@@ -383,6 +712,11 @@ int32_t IRpc::ProcessResponse(const RpcHead& rpc_head,
 
     m_timer->StopTimer(session->m_timerid);
 
+    if (session->m_cancelled) {
+        m_session_map.erase(it);
+        return kRPC_SUCCESS;
+    }
+
     int ret = kRPC_SUCCESS;
     const uint8_t* real_buff = buff;
     uint32_t real_buff_len = buff_len;
@@ -406,7 +740,7 @@ int32_t IRpc::ProcessResponse(const RpcHead& rpc_head,
         ret = session->m_rsp(ret, real_buff, real_buff_len);
     }
 
-    int64_t time_cost = TimeUtility::GetCurrentMS() - session->m_start_time;
+    int64_t time_cost = TimeUtility::GetCachedMS() - session->m_start_time;
     ReportTransportQuality(session->m_handle, ret, time_cost);
     ResponseProcComplete(session->m_rpc_head.m_function_name, ret, time_cost);
 
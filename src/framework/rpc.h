@@ -15,6 +15,8 @@
 #ifndef _PEBBLE_COMMON_RPC_H_
 #define _PEBBLE_COMMON_RPC_H_
 
+#include <vector>
+
 #include "framework/processor.h"
 
 
@@ -74,12 +76,14 @@ typedef enum {
     kRPC_REPLY     = 2,
     kRPC_EXCEPTION = 3,
     kRPC_ONEWAY    = 4,
+    kRPC_BATCH     = 5,     // 批量消息，数据部分为多个(4字节网络序长度 + 完整rpc消息)
 } RpcMessageType;
 
 
 // 前置声明
 class SequenceTimer;
 struct RpcSession;
+struct RpcBatch;
 
 /// @brief RPC协议版本号
 typedef enum {
@@ -92,6 +96,7 @@ struct RpcHead {
         m_version       = kVERSION_0;
         m_message_type  = kRPC_EXCEPTION;
         m_session_id    = 0;
+        m_timeout_ms    = 0;
         m_arrived_ms    = -1;
         m_dst           = NULL;
     }
@@ -100,6 +105,7 @@ struct RpcHead {
         m_message_type  = rhs.m_message_type;
         m_session_id    = rhs.m_session_id;
         m_function_name = rhs.m_function_name;
+        m_timeout_ms    = rhs.m_timeout_ms;
         m_arrived_ms    = rhs.m_arrived_ms;
         m_dst           = rhs.m_dst;
     }
@@ -108,6 +114,7 @@ struct RpcHead {
     int32_t     m_message_type;
     uint64_t    m_session_id;
     std::string m_function_name;
+    int32_t     m_timeout_ms; // 请求方发出时剩余的超时预算(ms)，<=0为未携带，不含网络传输时间
 
     int64_t     m_arrived_ms; // 消息到达时间
     IProcessor* m_dst;        // 非消息相关，标示消息来源模块，响应原路返回
@@ -123,6 +130,16 @@ struct RpcException {
     std::string m_message;
 };
 
+/// @brief RPC响应消息处理函数原型，由用户实现，RPC负责回调
+/// @param ret RPC调用结果，成功为0，其他非0 @see RpcErrorCode
+/// @param buff 响应消息码流
+/// @param buff_len 响应消息长度
+typedef Function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)> OnRpcResponse;
+
+/// @brief 服务接口应答回调(Function<void(int32_t ret_code, ...), RPC_RESPONSE_INLINE_SIZE>)的内联存储大小
+/// @note skeleton把OnRpcResponse绑定到应答函数上交给服务实现，此大小可以直接放下这个绑定，每个请求不再分配内存
+static const uint32_t RPC_RESPONSE_INLINE_SIZE = 112;
+
 /// @brief RPC请求消息处理函数原型，由用户实现，RPC触发调用
 /// @param buff 收到的消息码流
 /// @param buff_len 消息长度
@@ -130,14 +147,7 @@ struct RpcException {
 ///         rsp为空时，表示为ONEWAY请求，不需要回响应
 /// @return 0 处理成功
 /// @return 非0 处理失败
-typedef cxx::function<int32_t(const uint8_t* buff, uint32_t buff_len, // NOLINT
-            cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)>& rsp)> OnRpcRequest; // NOLINT
-
-/// @brief RPC响应消息处理函数原型，由用户实现，RPC负责回调
-/// @param ret RPC调用结果，成功为0，其他非0 @see RpcErrorCode
-/// @param buff 响应消息码流
-/// @param buff_len 响应消息长度
-typedef cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)> OnRpcResponse;
+typedef Function<int32_t(const uint8_t* buff, uint32_t buff_len, OnRpcResponse& rsp)> OnRpcRequest;
 
 class IRpc : public IProcessor {
 public:
@@ -148,6 +158,9 @@ public:
     /// @return 处理的事件数，0表示无事件
     virtual int32_t Update();
 
+    /// @brief 实现Processor接口，返回最近一个RPC会话超时的剩余时间
+    virtual int64_t GetNextTimeoutMS();
+
     /// @brief 实现Processor接口，消息处理入口
     /// @return 0 成功
     /// @return 非0 失败 @see RpcErrorCode
@@ -157,6 +170,15 @@ public:
     /// @brief 实现Processor接口，返回动态资源使用情况
     virtual void GetResourceUsed(cxx::unordered_map<std::string, int64_t>* resource_info);
 
+    /// @brief 预热，按预计的并发会话数预留会话表的桶，避免流量上涨时rehash
+    /// @param session_num 预计的并发会话数
+    /// @param buff_bytes 预先分配的编码缓冲区大小，由子类实现
+    /// @param lock 是否mlock锁定预热的内存，由子类实现
+    virtual void Prewarm(uint32_t session_num, uint32_t buff_bytes, bool lock);
+
+    /// @brief 返回会话表当前的会话数和桶数
+    void GetSessionInfo(uint32_t* session_num, uint32_t* bucket_num) const;
+
     /// @brief 添加RPC请求处理函数(RPC服务)
     /// @param name RPC请求服务的名字
     /// @param on_request 请求处理函数
@@ -179,6 +201,9 @@ public:
     /// @param timeout_ms 等待响应超时时间，单位为ms，<=0时使用默认值(10s)
     /// @return 0 成功
     /// @return 非0 失败 @see RpcErrorCode
+    /// @note timeout_ms会作为超时预算随请求发出(rpc_head本身不被修改)，pb、thrift binary和compact
+    ///     编码的请求头携带，json编码不携带；服务方丢弃到达后等待超过预算的请求，处理中发起的同步调用
+    ///     继承剩余的预算；预算不扣除网络传输时间，服务方的过期判断会比请求方的超时稍晚
     int32_t SendRequest(int64_t handle,
                     const RpcHead& rpc_head,
                     const uint8_t* buff,
@@ -200,11 +225,16 @@ public:
 
 public:
     static const uint32_t REQ_PROC_TIMEOUT_MS = 20 * 1000; // 20s
+    static const int32_t DEFAULT_REQ_TIMEOUT_MS = 10 * 1000; // 10s
 
     /// @note 内部使用，用户无需关注
     int32_t ProcessRequestImp(int64_t handle, const RpcHead& rpc_head,
         const uint8_t* buff, uint32_t buff_len);
 
+    /// @brief 计算请求的处理截止时间，请求方未携带超时预算时返回0
+    /// @note 内部使用，用户无需关注
+    static int64_t GetDeadlineMS(const RpcHead& rpc_head);
+
     /// @note 内部使用，用户无需关注
     uint64_t GenSessionId() {
         return m_session_id++;
@@ -215,6 +245,24 @@ public:
         m_proc_req_timeout_ms = proc_req_timeout_ms;
     }
 
+    /// @brief 取消等待响应的请求会话，之后到达的响应被丢弃，不回调也不上报统计
+    /// @note 会话保留到原超时时间后清理，期间计入会话数
+    /// @note 内部使用，用户无需关注
+    int32_t CancelSession(uint64_t session_id);
+
+    /// @brief 设置批量发送模式，打开后同一handle在一个Update周期内发出的rpc消息
+    ///     合并为一个kRPC_BATCH消息，在Update时发送
+    /// @note 需要对端支持kRPC_BATCH消息，只有一个消息时仍按普通消息发送；
+    ///     收到批量请求时，同步产生的响应总是合并后原路返回，与本开关无关；
+    ///     批量模式下SendRequest缓存后即返回成功，之后发送失败时等待响应的请求在Update中以kRPC_SEND_FAILED回调
+    void SetBatchMode(bool batch_mode) {
+        m_batch_mode = batch_mode;
+    }
+
+    /// @brief 发送所有缓存的批量消息
+    /// @return 发送的批量消息数
+    int32_t FlushBatch();
+
 protected:
     /// @brief RPC头的编码接口
     /// @param rpc_head RPC头部信息
@@ -264,6 +312,22 @@ private:
     // 超时处理，暂时支持请求的超时，可扩展支持服务处理超时
     int32_t OnTimeout(uint64_t session_id);
 
+    // 消息加入handle的批量缓存
+    int32_t AppendBatch(int64_t handle, const RpcHead& rpc_head, const uint8_t* buff, uint32_t buff_len);
+
+    // 发送handle上缓存的批量消息
+    int32_t FlushBatch(int64_t handle);
+
+    // 发送并清空批量缓存，失败时记录其中等待响应的会话
+    int32_t SendBatch(int64_t handle, RpcBatch* batch);
+
+    // 回调批量发送失败的请求会话
+    int32_t NotifySendFailed();
+
+    // 拆开批量消息，按顺序逐个处理
+    int32_t ProcessBatch(int64_t handle, const uint8_t* buff, uint32_t buff_len,
+        const MsgExternInfo* msg_info, uint32_t is_overload);
+
 private:
     int32_t ProcessResponse(const RpcHead& rpc_head,
                     const uint8_t* buff,
@@ -291,6 +355,13 @@ private:
     uint64_t m_session_id;
     cxx::unordered_map< uint64_t, cxx::shared_ptr<RpcSession> > m_session_map;
     uint32_t m_proc_req_timeout_ms;
+
+    bool m_batch_mode;
+    int64_t m_batch_reply_handle; // 正在处理的批量请求的来源handle，其响应也合并发送
+    cxx::unordered_map< int64_t, cxx::shared_ptr<RpcBatch> > m_batch_map;
+    uint32_t m_batch_pending_num; // 有待发送消息的批量缓存数
+    int64_t m_batch_sweep_ms;     // 最近一次检查释放空闲批量缓存的时间
+    std::vector<uint64_t> m_send_failed_sessions; // 批量发送失败、待回调的请求会话
 };
 
 } // namespace pebble
@@ -22,6 +22,14 @@
 
 namespace pebble {
 
+// thrift请求头后携带超时预算的保留字段id，IDL中的字段id均为正数，不会冲突
+static const int16_t BUDGET_FIELD_ID = 0;
+
+// 超时预算只在请求中携带
+static inline bool HasBudget(const RpcHead& rpc_head) {
+    return rpc_head.m_timeout_ms > 0
+        && (kRPC_CALL == rpc_head.m_message_type || kRPC_ONEWAY == rpc_head.m_message_type);
+}
 
 int32_t ProtoBufRpcPlugin::HeadEncode(const RpcHead& rpc_head, uint8_t* buff, uint32_t buff_len) {
     if (NULL == buff || 0 == buff_len) {
@@ -45,6 +53,9 @@ int32_t ProtoBufRpcPlugin::HeadEncode(const RpcHead& rpc_head, uint8_t* buff, ui
         pb_head.msg_type        = rpc_head.m_message_type;
         pb_head.session_id      = rpc_head.m_session_id;
         pb_head.function_name   = rpc_head.m_function_name;
+        if (HasBudget(rpc_head)) {
+            pb_head.__set_timeout_ms(rpc_head.m_timeout_ms);
+        }
 
         // 2. 序列化ProtoBufRpcHead，考虑到性能不使用write(buff, bufflen)接口
         len = pb_head.write(encoder);
@@ -84,13 +95,16 @@ int32_t ProtoBufRpcPlugin::HeadDecode(const uint8_t* buff, uint32_t buff_len, Rp
         rpc_head->m_message_type  = pb_head.msg_type;
         rpc_head->m_session_id    = pb_head.session_id;
         rpc_head->m_function_name = pb_head.function_name;
+        if (pb_head.__isset.timeout_ms) {
+            rpc_head->m_timeout_ms = pb_head.timeout_ms;
+        }
     } catch (TException e) {
         PLOG_ERROR_N_EVERY_SECOND(1, "catch exception : %s", e.what());
         return kPEBBLE_RPC_DECODE_HEAD_FAILED;
     }
 
     if (rpc_head->m_message_type < kRPC_CALL
-        || rpc_head->m_message_type > kRPC_ONEWAY) {
+        || rpc_head->m_message_type > kRPC_BATCH) {
         PLOG_ERROR_N_EVERY_SECOND(1, "message type error %d", rpc_head->m_message_type);
         return kRPC_UNKNOWN_TYPE;
     }
@@ -117,6 +131,14 @@ int32_t ThriftRpcPlugin::HeadEncode(const RpcHead& rpc_head, uint8_t* buff, uint
         len = encoder->writeMessageBegin(rpc_head.m_function_name,
             static_cast<pebble::dr::protocol::TMessageType>(rpc_head.m_message_type),
             rpc_head.m_session_id);
+        // 超时预算按参数结构体中的字段编码，老版本解码参数时作为未知字段跳过
+        if (HasBudget(rpc_head) && m_code_type != kCODE_JSON) {
+            len += encoder->writeStructBegin("");
+            len += encoder->writeFieldBegin("", dr::protocol::T_I32, BUDGET_FIELD_ID);
+            len += encoder->writeI32(rpc_head.m_timeout_ms);
+            len += encoder->writeFieldEnd();
+            len += encoder->writeStructEnd();
+        }
     } catch (TException e) {
         PLOG_ERROR_N_EVERY_SECOND(1, "catch exception : %s", e.what());
         return kPEBBLE_RPC_ENCODE_HEAD_FAILED;
@@ -147,13 +169,27 @@ int32_t ThriftRpcPlugin::HeadDecode(const uint8_t* buff, uint32_t buff_len, RpcH
         head_len = decoder->readMessageBegin(rpc_head->m_function_name, msg_type, seqid);
         rpc_head->m_message_type = static_cast<int32_t>(msg_type);
         rpc_head->m_session_id   = static_cast<uint64_t>(seqid);
+
+        if ((dr::protocol::T_CALL == msg_type || dr::protocol::T_ONEWAY == msg_type)
+            && HasBudgetField(buff + head_len, buff_len - head_len)) {
+            std::string name;
+            dr::protocol::TType field_type = dr::protocol::T_STOP;
+            int16_t field_id = -1;
+            int32_t timeout_ms = 0;
+            head_len += decoder->readStructBegin(name);
+            head_len += decoder->readFieldBegin(name, field_type, field_id);
+            head_len += decoder->readI32(timeout_ms);
+            head_len += decoder->readFieldEnd();
+            head_len += decoder->readStructEnd();
+            rpc_head->m_timeout_ms = timeout_ms;
+        }
     } catch (TException e) {
         PLOG_ERROR_N_EVERY_SECOND(1, "catch exception : %s", e.what());
         return kPEBBLE_RPC_DECODE_HEAD_FAILED;
     }
 
     if (rpc_head->m_message_type < dr::protocol::T_CALL
-        || rpc_head->m_message_type > dr::protocol::T_ONEWAY) {
+        || rpc_head->m_message_type > kRPC_BATCH) {
         PLOG_ERROR_N_EVERY_SECOND(1, "message type error %d", rpc_head->m_message_type);
         return kPEBBLE_RPC_MSG_TYPE_ERROR;
     }
@@ -161,6 +197,21 @@ int32_t ThriftRpcPlugin::HeadDecode(const uint8_t* buff, uint32_t buff_len, RpcH
     return head_len;
 }
 
+bool ThriftRpcPlugin::HasBudgetField(const uint8_t* buff, uint32_t buff_len) const {
+    // binary: 类型T_I32(1字节) + 字段id(2字节) + 值(4字节)
+    // compact: 类型CT_I32且id增量为0(1字节) + zigzag varint编码的字段id 0(1字节) + 值(1~5字节)
+    switch (m_code_type) {
+        case kCODE_BINARY:
+            return buff_len >= 7 && dr::protocol::T_I32 == buff[0]
+                && 0 == buff[1] && BUDGET_FIELD_ID == buff[2];
+        case kCODE_COMPACT:
+            return buff_len >= 3 && 0x05 == buff[0] && BUDGET_FIELD_ID == buff[1];
+        default:
+            break;
+    }
+    return false;
+}
+
 
 } // namespace pebble
 
@@ -13,6 +13,8 @@
 
 #include "common/coroutine.h"
 #include "common/log.h"
+#include "common/time_utility.h"
+#include "framework/pebble_rpc.h"
 #include "framework/rpc_util.inh"
 
 
@@ -21,6 +23,8 @@ namespace pebble {
 RpcUtil::RpcUtil(IRpc* rpc, CoroutineSchedule* coroutine_schedule) {
     m_rpc = rpc;
     m_coroutine_schedule = coroutine_schedule;
+    m_hedge_num = 0;
+    m_hedge_win_num = 0;
 }
 
 RpcUtil::~RpcUtil() {
@@ -33,7 +37,8 @@ int32_t RpcUtil::SendRequestSync(int64_t handle,
                     const uint8_t* buff,
                     uint32_t buff_len,
                     const OnRpcResponse& on_rsp,
-                    int32_t timeout_ms) {
+                    int32_t timeout_ms,
+                    RpcHedge* hedge) {
     if (!m_coroutine_schedule) {
         PLOG_ERROR("coroutine schedule not set");
         return kRPC_UTIL_CO_SCHEDULE_IS_NULL;
@@ -44,13 +49,92 @@ int32_t RpcUtil::SendRequestSync(int64_t handle,
         return kRPC_UTIL_NOT_IN_COROUTINE;
     }
 
+    timeout_ms = GetInheritedTimeout(timeout_ms);
+    if (timeout_ms <= 0) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "%s not sent, the request in process has expired",
+            rpc_head.m_function_name.c_str());
+        return kRPC_REQUEST_TIMEOUT;
+    }
+
     int32_t ret = kRPC_SUCCESS;
 
+    if (hedge != NULL) {
+        SendRequestHedged(handle, rpc_head, buff, buff_len, on_rsp, timeout_ms, hedge, &ret);
+        return ret;
+    }
+
     SendRequestInCoroutine(handle, rpc_head, buff, buff_len, on_rsp, timeout_ms, &ret);
 
     return ret;
 }
 
+void RpcUtil::SendRequestHedged(int64_t handle,
+                    const RpcHead& rpc_head,
+                    const uint8_t* buff,
+                    uint32_t buff_len,
+                    const OnRpcResponse& on_rsp,
+                    int32_t timeout_ms,
+                    RpcHedge* hedge,
+                    int32_t* ret) {
+    hedge->OnRequest();
+    int32_t delay_ms = hedge->GetDelayMS();
+    if (delay_ms >= timeout_ms) {
+        delay_ms = -1;
+    }
+
+    // 等待期间编码缓冲区可能被其他协程复用，需要对冲时先保留一份请求数据
+    std::string request;
+    if (delay_ms > 0) {
+        request.assign(reinterpret_cast<const char*>(buff), buff_len);
+    }
+
+    HedgeCall call;
+    call._co_id   = m_coroutine_schedule->CurrentTaskId();
+    call._pending = 0;
+    call._winner  = -1;
+
+    RpcHead head(rpc_head);
+    OnRpcResponse rsp = cxx::bind(&RpcUtil::OnHedgeResponse, this,
+        cxx::placeholders::_1, cxx::placeholders::_2, cxx::placeholders::_3, &call, 0);
+    *ret = m_rpc->SendRequest(handle, head, buff, buff_len, rsp, timeout_ms);
+    if (*ret != kRPC_SUCCESS) {
+        return;
+    }
+    call._session_id[0] = head.m_session_id;
+    call._pending = 1;
+
+    int64_t start_ms = TimeUtility::GetCachedMS();
+    int64_t backup_start_ms = start_ms;
+    if (m_coroutine_schedule->Yield(delay_ms) == kCO_TIMEOUT) {
+        // 超过对冲延时仍未响应，经路由换一个连接再发一次
+        int64_t backup = hedge->GetBackupHandle(handle);
+        if (backup >= 0 && hedge->Acquire()) {
+            backup_start_ms = TimeUtility::GetCachedMS();
+            int32_t remain_ms = timeout_ms - static_cast<int32_t>(backup_start_ms - start_ms);
+            RpcHead backup_head(rpc_head);
+            backup_head.m_session_id = m_rpc->GenSessionId();
+            OnRpcResponse backup_rsp = cxx::bind(&RpcUtil::OnHedgeResponse, this,
+                cxx::placeholders::_1, cxx::placeholders::_2, cxx::placeholders::_3, &call, 1);
+            if (m_rpc->SendRequest(backup, backup_head, reinterpret_cast<const uint8_t*>(request.data()),
+                request.size(), backup_rsp, remain_ms > 0 ? remain_ms : 1) == kRPC_SUCCESS) {
+                call._session_id[1] = backup_head.m_session_id;
+                ++call._pending;
+                ++m_hedge_num;
+            }
+        }
+        m_coroutine_schedule->Yield();
+    }
+
+    if (m_result._ret != kRPC_REQUEST_TIMEOUT) {
+        hedge->AddLatency(TimeUtility::GetCachedMS() - (call._winner == 1 ? backup_start_ms : start_ms));
+    }
+    if (1 == call._winner) {
+        ++m_hedge_win_num;
+    }
+
+    *ret = on_rsp(m_result._ret, m_result._buff, m_result._buff_len);
+}
+
 void RpcUtil::SendRequestInCoroutine(int64_t handle,
                     const RpcHead& rpc_head,
                     const uint8_t* buff,
@@ -101,6 +185,21 @@ void RpcUtil::SendRequestParallel(int64_t handle,
         return;
     }
 
+    // 已过期时不再发送，但仍需完成并行计数，最后一个调用负责等待已发出的请求
+    timeout_ms = GetInheritedTimeout(timeout_ms);
+    if (timeout_ms <= 0) {
+        *ret_code = kRPC_REQUEST_TIMEOUT;
+        --(*num_parallel);
+        if (--(*num_called) == 0) {
+            uint32_t num_yield = 0;
+            while (++num_yield <= *num_parallel) {
+                m_coroutine_schedule->Yield();
+                *(m_result._ret_code) = m_result._on_rsp(m_result._ret, m_result._buff, m_result._buff_len);
+            }
+        }
+        return;
+    }
+
     SendRequestParallelInCoroutine(handle,
                                    rpc_head,
                                    buff,
@@ -162,6 +261,28 @@ int32_t RpcUtil::OnResponse(int32_t ret,
     return kRPC_SUCCESS;
 }
 
+int32_t RpcUtil::OnHedgeResponse(int32_t ret,
+                                 const uint8_t* buff,
+                                 uint32_t buff_len,
+                                 HedgeCall* call,
+                                 int32_t index) {
+    --(call->_pending);
+
+    // 超时不算响应，另一个请求还在等待时继续等
+    if (kRPC_REQUEST_TIMEOUT == ret && call->_pending > 0) {
+        return kRPC_SUCCESS;
+    }
+
+    // 先到的响应生效，取消另一个请求
+    call->_winner = index;
+    if (call->_pending > 0) {
+        m_rpc->CancelSession(call->_session_id[1 - index]);
+        call->_pending = 0;
+    }
+
+    return OnResponse(ret, buff, buff_len, call->_co_id);
+}
+
 int32_t RpcUtil::OnResponseParallel(int32_t ret,
                                     const uint8_t* buff,
                                     uint32_t buff_len,
@@ -189,9 +310,8 @@ int32_t RpcUtil::ProcessRequest(int64_t handle, const RpcHead& rpc_head,
     }
 
     CommonCoroutineTask* task = m_coroutine_schedule->NewTask<CommonCoroutineTask>();
-    cxx::function<void(void)> run = cxx::bind(&RpcUtil::ProcessRequestInCoroutine, this,
-        handle, rpc_head, buff, buff_len);
-    task->Init(run);
+    task->Init(cxx::bind(&RpcUtil::ProcessRequestInCoroutine, this,
+        handle, rpc_head, buff, buff_len));
     task->Start();
 
     return kRPC_SUCCESS;
@@ -199,7 +319,37 @@ int32_t RpcUtil::ProcessRequest(int64_t handle, const RpcHead& rpc_head,
 
 int32_t RpcUtil::ProcessRequestInCoroutine(int64_t handle, const RpcHead& rpc_head,
     const uint8_t* buff, uint32_t buff_len) {
-    return m_rpc->ProcessRequestImp(handle, rpc_head, buff, buff_len);
+    int64_t deadline_ms = IRpc::GetDeadlineMS(rpc_head);
+    if (deadline_ms <= 0) {
+        return m_rpc->ProcessRequestImp(handle, rpc_head, buff, buff_len);
+    }
+
+    int64_t co_id = m_coroutine_schedule->CurrentTaskId();
+    m_deadlines[co_id] = deadline_ms;
+    int32_t ret = m_rpc->ProcessRequestImp(handle, rpc_head, buff, buff_len);
+    m_deadlines.erase(co_id);
+    return ret;
+}
+
+int32_t RpcUtil::GetInheritedTimeout(int32_t timeout_ms) {
+    if (m_deadlines.empty()) {
+        return timeout_ms > 0 ? timeout_ms : IRpc::DEFAULT_REQ_TIMEOUT_MS;
+    }
+
+    cxx::unordered_map<int64_t, int64_t>::iterator it =
+        m_deadlines.find(m_coroutine_schedule->CurrentTaskId());
+    if (m_deadlines.end() == it) {
+        return timeout_ms > 0 ? timeout_ms : IRpc::DEFAULT_REQ_TIMEOUT_MS;
+    }
+
+    int64_t remain_ms = it->second - TimeUtility::GetCachedMS();
+    if (remain_ms <= 0) {
+        return 0;
+    }
+    if (timeout_ms <= 0 || remain_ms < timeout_ms) {
+        return static_cast<int32_t>(remain_ms);
+    }
+    return timeout_ms;
 }
 
 
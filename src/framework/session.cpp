@@ -84,6 +84,10 @@ int32_t SessionMgr::CheckTimeout() {
     return m_timer->Update();
 }
 
+int64_t SessionMgr::GetNextTimeoutMS() {
+    return m_timer->GetNextTimeoutMS();
+}
+
 int32_t SessionMgr::RestartTimer(int64_t session_id, uint32_t new_timeout_ms) {
     cxx::unordered_map<int64_t, SessionInfo>::iterator it = m_sessions.find(session_id);
     if (m_sessions.end() == it) {
@@ -114,6 +114,10 @@ public:
         return m_sessions.size();
     }
 
+    /// @brief 返回距离最近一个session超时的时间，单位ms
+    /// @return <0 无session
+    int64_t GetNextTimeoutMS();
+
 private:
     int32_t OnTimeout(int64_t session_id, Session* session);
 
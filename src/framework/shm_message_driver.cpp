@@ -0,0 +1,1071 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "common/log.h"
+#include "common/net_util.h"
+#include "common/string_utility.h"
+#include "common/time_utility.h"
+#include "framework/shm_message_driver.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+
+namespace pebble {
+
+// handle格式: | flag(1bit, bit49) | generation(16bit) | slot(32bit) |
+// 与NetIO的NetAddr(最大40bit)和io_uring驱动的handle(bit48)不重叠
+static const int64_t SHM_HANDLE_FLAG = 1LL << 49;
+// 本驱动epoll的data中标记eventfd的事件，其余为连接handle
+static const uint64_t SHM_EFD_EVENT = 1ULL << 62;
+
+static const uint32_t SHM_MAGIC = 0x314d5350;   // "PSM1"
+static const uint32_t SHM_VERSION = 1;
+static const uint32_t SHM_MIN_RING_SIZE = 64 * 1024;
+static const uint32_t SHM_MAX_RING_SIZE = 1024 * 1024 * 1024;
+// 队列中每个消息前有8字节的头(消息长度)，消息按8字节对齐
+static const uint32_t SHM_RECORD_HEAD_LEN = 8;
+// 队列尾部放不下整个消息时写入此标记，消息从队列头部开始写
+static const uint32_t SHM_WRAP_LEN = 0xFFFFFFFFU;
+static const int32_t SHM_MAX_EVENTS = 64;
+static const char* SHM_URL_PREFIX = "shm://";
+static const char* SHM_SOCKET_PREFIX = "pebble.shm.";
+static const size_t SHM_MAX_NAME_LEN = 80;
+// 最近多久内有消息才在阻塞前忙等
+static const int64_t SHM_SPIN_ACTIVE_US = 1000000;
+
+enum {
+    SHM_LISTEN_CONN  = 1,
+    SHM_ACCEPT_CONN  = 2,
+    SHM_CONNECT_CONN = 3,
+};
+
+/// @brief 共享内存中单个方向队列的控制信息，生产者和消费者写的字段分别独占cache line
+struct ShmRingCtrl {
+    uint64_t    _tail;              // 生产者写入位置，只增不减
+    char        _pad0[56];
+    uint64_t    _head;              // 消费者读取位置，只增不减
+    uint32_t    _need_wakeup;       // 消费者阻塞前置1，生产者写入后看到1则清0并写eventfd
+    char        _pad1[52];
+};
+
+/// @brief 共享内存头，其后依次为两个方向队列的数据区
+struct ShmSegmentHead {
+    uint32_t    _magic;
+    uint32_t    _version;
+    uint32_t    _ring_size;
+    uint32_t    _reserved;
+    char        _pad[48];
+    ShmRingCtrl _rings[2];          // [0] 客户端->服务端，[1] 服务端->客户端
+};
+
+/// @brief 本进程中队列的视图
+struct ShmRing {
+    ShmRing() : _ctrl(NULL), _data(NULL), _size(0), _peer_pos(0) {}
+
+    ShmRingCtrl* _ctrl;
+    uint8_t*    _data;
+    uint32_t    _size;
+    uint64_t    _peer_pos;          // 缓存的对端位置(发送队列为head，接收队列为tail)，减少访问对端的cache line
+};
+
+/// @brief 一个shm连接(含监听socket)
+struct ShmConnection {
+    ShmConnection() : _handle(-1), _generation(0), _type(0), _closed(true), _established(false),
+        _sock_fd(-1), _rx_efd(-1), _tx_efd(-1), _listen_handle(-1), _shm(NULL), _shm_size(0) {}
+
+    int64_t     _handle;
+    uint16_t    _generation;
+    uint8_t     _type;
+    bool        _closed;
+    bool        _established;      // 已映射共享内存，可以收发
+    int32_t     _sock_fd;           // 监听socket或建连socket，建连后用于感知对端退出
+    int32_t     _rx_efd;            // 本端等待时被对端唤醒的eventfd
+    int32_t     _tx_efd;            // 唤醒对端的eventfd
+    int64_t     _listen_handle;     // accept的连接对应的监听handle
+    std::string _name;
+    void*       _shm;
+    size_t      _shm_size;
+    ShmRing     _tx;
+    ShmRing     _rx;
+};
+
+
+static inline uint32_t RecordLen(uint32_t msg_len) {
+    return SHM_RECORD_HEAD_LEN + ((msg_len + 7) & ~7U);
+}
+
+static bool IsShmUrl(const std::string& url) {
+    return StringUtility::StartsWith(url, SHM_URL_PREFIX);
+}
+
+static int32_t ShmSockAddr(const std::string& name, struct sockaddr_un* addr, socklen_t* addr_len) {
+    std::string path(SHM_SOCKET_PREFIX);
+    path.append(name);
+    if (name.empty() || name.size() > SHM_MAX_NAME_LEN) {
+        return -1;
+    }
+    // 抽象命名空间，进程退出后自动释放
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path + 1, path.data(), path.size());
+    *addr_len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + 1 + path.size());
+    return 0;
+}
+
+static int32_t CreateShmFd(const std::string& name) {
+    std::string shm_name(SHM_SOCKET_PREFIX);
+    shm_name.append(name);
+#ifdef __NR_memfd_create
+    int32_t fd = static_cast<int32_t>(syscall(__NR_memfd_create, shm_name.c_str(), MFD_CLOEXEC));
+    if (fd >= 0 || errno != ENOSYS) {
+        return fd;
+    }
+#endif
+    // 内核3.17以下没有memfd，在/dev/shm下创建后立即删除
+    char path[] = "/dev/shm/pebble.shm.XXXXXX";
+    int32_t tmp_fd = mkstemp(path);
+    if (tmp_fd >= 0) {
+        unlink(path);
+        fcntl(tmp_fd, F_SETFD, FD_CLOEXEC);
+    }
+    return tmp_fd;
+}
+
+static void InitRing(ShmSegmentHead* head, uint32_t idx, ShmRing* ring) {
+    ring->_ctrl = &head->_rings[idx];
+    ring->_data = reinterpret_cast<uint8_t*>(head) + sizeof(ShmSegmentHead) + idx * head->_ring_size;
+    ring->_size = head->_ring_size;
+    ring->_peer_pos = 0;
+}
+
+/// @brief 写入一个消息，队列满时返回kMESSAGE_SEND_BUFF_NOT_ENOUGH
+static int32_t RingWrite(ShmRing* ring, uint32_t frag_num, const uint8_t* frag[],
+    const uint32_t frag_len[], uint32_t total_len) {
+    uint32_t need = RecordLen(total_len);
+    uint64_t tail = ring->_ctrl->_tail;
+    uint32_t offset = static_cast<uint32_t>(tail & (ring->_size - 1));
+    uint32_t wrap = (ring->_size - offset < need) ? (ring->_size - offset) : 0;
+    if (tail + wrap + need - ring->_peer_pos > ring->_size) {
+        ring->_peer_pos = __atomic_load_n(&ring->_ctrl->_head, __ATOMIC_ACQUIRE);
+        if (tail + wrap + need - ring->_peer_pos > ring->_size) {
+            return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
+        }
+    }
+
+    if (wrap > 0) {
+        *reinterpret_cast<uint32_t*>(ring->_data + offset) = SHM_WRAP_LEN;
+        tail += wrap;
+        offset = 0;
+    }
+
+    uint8_t* pos = ring->_data + offset;
+    *reinterpret_cast<uint32_t*>(pos) = total_len;
+    pos += SHM_RECORD_HEAD_LEN;
+    for (uint32_t i = 0; i < frag_num; ++i) {
+        memcpy(pos, frag[i], frag_len[i]);
+        pos += frag_len[i];
+    }
+    __atomic_store_n(&ring->_ctrl->_tail, tail + need, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/// @return 1 有消息，0 队列空，-1 数据非法
+static int32_t RingPeek(ShmRing* ring, const uint8_t** msg, uint32_t* msg_len) {
+    uint64_t head = ring->_ctrl->_head;
+    while (true) {
+        if (head == ring->_peer_pos) {
+            ring->_peer_pos = __atomic_load_n(&ring->_ctrl->_tail, __ATOMIC_ACQUIRE);
+            if (head == ring->_peer_pos) {
+                return 0;
+            }
+        }
+
+        uint32_t offset = static_cast<uint32_t>(head & (ring->_size - 1));
+        uint32_t len = *reinterpret_cast<const uint32_t*>(ring->_data + offset);
+        if (SHM_WRAP_LEN == len) {
+            head += ring->_size - offset;
+            __atomic_store_n(&ring->_ctrl->_head, head, __ATOMIC_RELEASE);
+            continue;
+        }
+        if (len > ring->_size || RecordLen(len) > ring->_size - offset
+            || head + RecordLen(len) > ring->_peer_pos) {
+            return -1;
+        }
+        *msg = ring->_data + offset + SHM_RECORD_HEAD_LEN;
+        *msg_len = len;
+        return 1;
+    }
+}
+
+static void RingPop(ShmRing* ring, uint32_t msg_len) {
+    __atomic_store_n(&ring->_ctrl->_head, ring->_ctrl->_head + RecordLen(msg_len), __ATOMIC_RELEASE);
+}
+
+static bool RingEmpty(ShmRing* ring) {
+    uint64_t head = ring->_ctrl->_head;
+    if (head != ring->_peer_pos) {
+        return false;
+    }
+    ring->_peer_pos = __atomic_load_n(&ring->_ctrl->_tail, __ATOMIC_ACQUIRE);
+    return head == ring->_peer_pos;
+}
+
+/// @brief 写入后对端在等待时才写eventfd唤醒
+static void WakeupPeer(ShmConnection* connection) {
+    // 与消费者阻塞前"置标记-检查队列"配对，保证不会丢失唤醒
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&connection->_tx._ctrl->_need_wakeup, __ATOMIC_RELAXED)
+        && __atomic_exchange_n(&connection->_tx._ctrl->_need_wakeup, 0, __ATOMIC_ACQ_REL)) {
+        uint64_t value = 1;
+        if (write(connection->_tx_efd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+            PLOG_ERROR_N_EVERY_SECOND(1, "write eventfd failed(%d)", errno);
+        }
+    }
+}
+
+
+__thread ShmMessageDriver* ShmMessageDriver::m_instance = NULL;
+
+void ShmMessageDriver::ReleaseInstance() {
+    delete m_instance;
+    m_instance = NULL;
+}
+
+ShmMessageDriver::ShmMessageDriver() {
+    m_next_driver = NULL;
+    m_ring_size = DEFAULT_RING_SIZE;
+    m_spin_us = DEFAULT_SPIN_US;
+    m_multi_cpu = (sysconf(_SC_NPROCESSORS_ONLN) > 1);
+    m_epoll_fd = -1;
+    m_watched = false;
+    m_epoll_ready = false;
+    m_last_active_us = 0;
+    m_next_poll = 0;
+}
+
+ShmMessageDriver::~ShmMessageDriver() {
+    for (std::vector<ShmConnection*>::iterator it = m_connections.begin();
+        it != m_connections.end(); ++it) {
+        if (!(*it)->_closed) {
+            CloseConnection(*it);
+        }
+        delete *it;
+    }
+    m_connections.clear();
+
+    if (m_epoll_fd >= 0) {
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+    }
+}
+
+int32_t ShmMessageDriver::Init(MessageDriver* next_driver, uint32_t ring_size) {
+    if (NULL == next_driver || next_driver == this
+        || ring_size < SHM_MIN_RING_SIZE || ring_size > SHM_MAX_RING_SIZE
+        || (ring_size & (ring_size - 1)) != 0) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+
+    m_ring_size = ring_size;
+    if (m_next_driver) {
+        return 0;
+    }
+
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd < 0) {
+        PLOG_ERROR("epoll_create failed(%d)", errno);
+        return kMESSAGE_EPOLL_INIT_FAILED;
+    }
+
+    // 本驱动的fd都注册在自己的epoll上，下层驱动只需等待这一个fd
+    m_next_driver = next_driver;
+    m_watched = (0 == m_next_driver->WatchFd(m_epoll_fd, EPOLLIN,
+        cxx::bind(&ShmMessageDriver::OnEpollEvent, this,
+            cxx::placeholders::_1, cxx::placeholders::_2)));
+    PLOG_IF_ERROR(!m_watched, "next driver not support WatchFd, shm wait at most 1ms");
+    return 0;
+}
+
+int64_t ShmMessageDriver::Bind(const std::string& url) {
+    if (NULL == m_next_driver) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    if (!IsShmUrl(url)) {
+        return m_next_driver->Bind(url);
+    }
+
+    struct sockaddr_un addr;
+    socklen_t addr_len = 0;
+    std::string name(url, strlen(SHM_URL_PREFIX));
+    if (ShmSockAddr(name, &addr, &addr_len) != 0) {
+        PLOG_ERROR("invalid shm url %s", url.c_str());
+        return kMESSAGE_INVAILD_PARAM;
+    }
+
+    // 热重启时直接使用旧进程的监听socket
+    int32_t fd = NetIO::TakeInheritedFd(reinterpret_cast<struct sockaddr*>(&addr), addr_len, SOCK_STREAM);
+    bool inherited = (fd >= 0);
+    if (inherited) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    } else {
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    }
+    if (fd < 0) {
+        PLOG_ERROR("socket failed(%d)", errno);
+        return kMESSAGE_BIND_ADDR_FAILED;
+    }
+    if (!inherited && (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len) != 0
+        || listen(fd, SOMAXCONN) != 0)) {
+        PLOG_ERROR("bind %s failed(%d)", url.c_str(), errno);
+        close(fd);
+        return kMESSAGE_BIND_ADDR_FAILED;
+    }
+
+    ShmConnection* connection = CreateConnection(SHM_LISTEN_CONN);
+    connection->_sock_fd = fd;
+    connection->_name = name;
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = connection->_handle;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    return connection->_handle;
+}
+
+int64_t ShmMessageDriver::Connect(const std::string& url) {
+    if (NULL == m_next_driver) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    if (!IsShmUrl(url)) {
+        return m_next_driver->Connect(url);
+    }
+
+    std::string name(url, strlen(SHM_URL_PREFIX));
+    if (name.empty() || name.size() > SHM_MAX_NAME_LEN) {
+        PLOG_ERROR("invalid shm url %s", url.c_str());
+        return kMESSAGE_INVAILD_PARAM;
+    }
+
+    ShmConnection* connection = CreateConnection(SHM_CONNECT_CONN);
+    connection->_name = name;
+    int32_t ret = Handshake(connection);
+    if (ret != 0) {
+        CloseConnection(connection);
+        return ret;
+    }
+    return connection->_handle;
+}
+
+int32_t ShmMessageDriver::Send(int64_t handle, const uint8_t* msg, uint32_t msg_len, int32_t flag) {
+    const uint8_t* frags[1] = { msg     };
+    uint32_t fragslen[1]    = { msg_len };
+    return SendV(handle, 1, frags, fragslen, flag);
+}
+
+int32_t ShmMessageDriver::SendV(int64_t handle, uint32_t msg_frag_num,
+    const uint8_t* msg_frag[], uint32_t msg_frag_len[], int32_t flag) {
+    if (!IsShmHandle(handle)) {
+        return m_next_driver ? m_next_driver->SendV(handle, msg_frag_num, msg_frag, msg_frag_len, flag)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    ShmConnection* connection = GetConnection(handle);
+    if (NULL == connection || SHM_LISTEN_CONN == connection->_type) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    // 客户端连接在对端关闭后重新建连
+    if (!connection->_established) {
+        if (SHM_ACCEPT_CONN == connection->_type || Handshake(connection) != 0) {
+            return kMESSAGE_ON_DISCONNECTED;
+        }
+    }
+
+    uint64_t total_len = 0;
+    for (uint32_t i = 0; i < msg_frag_num; ++i) {
+        total_len += msg_frag_len[i];
+    }
+    if (total_len > connection->_tx._size / 4) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "msg len %lu > shm ring size %u / 4", total_len, connection->_tx._size);
+        return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
+    }
+
+    int32_t ret = RingWrite(&connection->_tx, msg_frag_num, msg_frag, msg_frag_len,
+        static_cast<uint32_t>(total_len));
+    if (ret != 0) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "shm ring of %s full", connection->_name.c_str());
+        return ret;
+    }
+    WakeupPeer(connection);
+    return 0;
+}
+
+int32_t ShmMessageDriver::Recv(int64_t handle, uint8_t* msg_buff, uint32_t* buff_len,
+    MsgExternInfo* msg_info) {
+    if (!IsShmHandle(handle)) {
+        return m_next_driver ? m_next_driver->Recv(handle, msg_buff, buff_len, msg_info)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    const uint8_t* msg = NULL;
+    uint32_t msg_len = 0;
+    int32_t ret = Peek(handle, &msg, &msg_len, msg_info);
+    if (ret != 0) {
+        return ret;
+    }
+    if (msg_len > *buff_len) {
+        return kMESSAGE_RECV_BUFF_NOT_ENOUGH;
+    }
+    memcpy(msg_buff, msg, msg_len);
+    *buff_len = msg_len;
+    return Pop(handle);
+}
+
+int32_t ShmMessageDriver::Peek(int64_t handle, const uint8_t** msg, uint32_t* msg_len,
+    MsgExternInfo* msg_info) {
+    if (!IsShmHandle(handle)) {
+        return m_next_driver ? m_next_driver->Peek(handle, msg, msg_len, msg_info)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    ShmConnection* connection = GetConnection(handle);
+    if (NULL == connection || !connection->_established) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+
+    int32_t ret = RingPeek(&connection->_rx, msg, msg_len);
+    if (ret < 0) {
+        PLOG_ERROR("invalid data in shm ring of %s, close it", connection->_name.c_str());
+        CloseConnection(connection);
+        return kMESSAGE_RECV_INVALID_DATA;
+    }
+    if (0 == ret) {
+        return kMESSAGE_RECV_EMPTY;
+    }
+
+    SetMsgInfo(connection, msg_info);
+    return 0;
+}
+
+int32_t ShmMessageDriver::Pop(int64_t handle) {
+    if (!IsShmHandle(handle)) {
+        return m_next_driver ? m_next_driver->Pop(handle) : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    ShmConnection* connection = GetConnection(handle);
+    if (NULL == connection || !connection->_established) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+
+    const uint8_t* msg = NULL;
+    uint32_t msg_len = 0;
+    if (RingPeek(&connection->_rx, &msg, &msg_len) <= 0) {
+        return kMESSAGE_RECV_EMPTY;
+    }
+    RingPop(&connection->_rx, msg_len);
+    return 0;
+}
+
+int32_t ShmMessageDriver::Close(int64_t handle) {
+    if (!IsShmHandle(handle)) {
+        return m_next_driver ? m_next_driver->Close(handle) : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    ShmConnection* connection = GetConnection(handle);
+    if (NULL == connection) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    CloseConnection(connection);
+    return 0;
+}
+
+int32_t ShmMessageDriver::Poll(int64_t* handle, int32_t* event, int32_t timeout_ms) {
+    if (NULL == m_next_driver) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    // 没有shm地址时直接由下层驱动等待
+    if (m_connections.size() == m_free_slots.size()) {
+        return m_next_driver->Poll(handle, event, timeout_ms);
+    }
+
+    if (m_epoll_ready || !m_watched) {
+        ProcessEvents();
+    }
+    if (PollShm(handle)) {
+        return 0;
+    }
+
+    int32_t ret = 0;
+    if (0 == timeout_ms) {
+        ret = m_next_driver->Poll(handle, event, 0);
+        if (m_epoll_ready) {
+            ProcessEvents();
+        }
+        return (0 == ret || PollShm(handle)) ? 0 : -1;
+    }
+
+    // 最近有消息时先忙等，对端此时发送不需要唤醒；单核时忙等只会占用对端的时间片
+    if (m_spin_us > 0 && m_multi_cpu && !m_established.empty()) {
+        int64_t now = TimeUtility::GetMonotonicUS();
+        if (now - m_last_active_us < SHM_SPIN_ACTIVE_US) {
+            int64_t spin_us = m_spin_us;
+            if (timeout_ms > 0 && spin_us > timeout_ms * 1000LL) {
+                spin_us = timeout_ms * 1000LL;
+            }
+            int64_t spin_end = now + spin_us;
+            do {
+                if (PollShm(handle)) {
+                    return 0;
+                }
+            } while (TimeUtility::GetMonotonicUS() < spin_end);
+        }
+    }
+
+    if (ArmWakeup()) {
+        DisarmWakeup();
+        return PollShm(handle) ? 0 : -1;
+    }
+    if (!m_watched && (timeout_ms < 0 || timeout_ms > 1)) {
+        timeout_ms = 1;
+    }
+    ret = m_next_driver->Poll(handle, event, timeout_ms);
+    DisarmWakeup();
+    if (m_epoll_ready || !m_watched) {
+        ProcessEvents();
+    }
+    if (0 == ret || PollShm(handle)) {
+        return 0;
+    }
+    return -1;
+}
+
+int32_t ShmMessageDriver::ReportHandleResult(int64_t handle, int32_t result, int64_t time_cost) {
+    if (!IsShmHandle(handle)) {
+        return m_next_driver ? m_next_driver->ReportHandleResult(handle, result, time_cost)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+    return kMESSAGE_UNSUPPORT;
+}
+
+int32_t ShmMessageDriver::GetUsedSize(int64_t handle, uint32_t* remain_size, uint32_t* max_size) {
+    if (!IsShmHandle(handle)) {
+        return m_next_driver ? m_next_driver->GetUsedSize(handle, remain_size, max_size)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    ShmConnection* connection = GetConnection(handle);
+    if (NULL == connection || !connection->_established) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    ShmRing* ring = &connection->_tx;
+    uint64_t used = ring->_ctrl->_tail - __atomic_load_n(&ring->_ctrl->_head, __ATOMIC_ACQUIRE);
+    if (remain_size) {
+        *remain_size = ring->_size - static_cast<uint32_t>(used);
+    }
+    if (max_size) {
+        *max_size = ring->_size;
+    }
+    return 0;
+}
+
+const char* ShmMessageDriver::GetLastError() {
+    return m_next_driver ? m_next_driver->GetLastError() : NULL;
+}
+
+int32_t ShmMessageDriver::Flush(int64_t handle) {
+    // shm发送即写入共享内存，没有缓存
+    if (m_next_driver && !IsShmHandle(handle)) {
+        return m_next_driver->Flush(handle);
+    }
+    return 0;
+}
+
+int32_t ShmMessageDriver::WatchFd(int32_t fd, uint32_t events, const FdEventCallback& on_event) {
+    return m_next_driver ? m_next_driver->WatchFd(fd, events, on_event) : kMESSAGE_UNINSTALL_DRIVER;
+}
+
+int32_t ShmMessageDriver::UnwatchFd(int32_t fd) {
+    return m_next_driver ? m_next_driver->UnwatchFd(fd) : kMESSAGE_UNINSTALL_DRIVER;
+}
+
+int32_t ShmMessageDriver::ExportListenFd(int64_t handle) {
+    if (!IsShmHandle(handle)) {
+        return m_next_driver ? m_next_driver->ExportListenFd(handle) : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    ShmConnection* connection = GetConnection(handle);
+    if (NULL == connection || SHM_LISTEN_CONN != connection->_type || connection->_sock_fd < 0) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    return connection->_sock_fd;
+}
+
+int32_t ShmMessageDriver::StopListen(int64_t handle) {
+    if (!IsShmHandle(handle)) {
+        return m_next_driver ? m_next_driver->StopListen(handle) : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    ShmConnection* connection = GetConnection(handle);
+    if (NULL == connection || SHM_LISTEN_CONN != connection->_type) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    // 已建连的连接只记录监听句柄的值，直接关闭监听连接不影响它们
+    CloseConnection(connection);
+    return 0;
+}
+
+int32_t ShmMessageDriver::Prewarm(uint32_t conn_num, bool lock) {
+    return m_next_driver ? m_next_driver->Prewarm(conn_num, lock) : kMESSAGE_UNINSTALL_DRIVER;
+}
+
+int32_t ShmMessageDriver::GetConnectionPoolInfo(uint32_t* used_num, uint32_t* free_num) {
+    return m_next_driver ? m_next_driver->GetConnectionPoolInfo(used_num, free_num)
+        : kMESSAGE_UNINSTALL_DRIVER;
+}
+
+int32_t ShmMessageDriver::GetPeerCred(int64_t handle, int32_t* pid, uint32_t* uid, uint32_t* gid) {
+    if (!IsShmHandle(handle)) {
+        return m_next_driver ? m_next_driver->GetPeerCred(handle, pid, uid, gid)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    ShmConnection* connection = GetConnection(handle);
+    if (NULL == connection || SHM_LISTEN_CONN == connection->_type || connection->_sock_fd < 0) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(connection->_sock_fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+    if (pid) *pid = cred.pid;
+    if (uid) *uid = cred.uid;
+    if (gid) *gid = cred.gid;
+    return 0;
+}
+
+bool ShmMessageDriver::IsShmHandle(int64_t handle) const {
+    return handle >= 0 && (handle & SHM_HANDLE_FLAG) != 0;
+}
+
+ShmConnection* ShmMessageDriver::CreateConnection(uint8_t type) {
+    uint32_t slot = 0;
+    if (!m_free_slots.empty()) {
+        slot = m_free_slots.back();
+        m_free_slots.pop_back();
+    } else {
+        slot = m_connections.size();
+        m_connections.push_back(new ShmConnection());
+    }
+
+    ShmConnection* connection = m_connections[slot];
+    connection->_handle = SHM_HANDLE_FLAG
+        | (static_cast<int64_t>(connection->_generation) << 32) | slot;
+    connection->_type   = type;
+    connection->_closed = false;
+    connection->_established = false;
+    connection->_listen_handle = -1;
+    return connection;
+}
+
+ShmConnection* ShmMessageDriver::GetConnection(int64_t handle) {
+    if (!IsShmHandle(handle)) {
+        return NULL;
+    }
+    uint32_t slot = static_cast<uint32_t>(handle);
+    if (slot >= m_connections.size()) {
+        return NULL;
+    }
+    ShmConnection* connection = m_connections[slot];
+    if (connection->_closed || connection->_handle != handle) {
+        return NULL;
+    }
+    return connection;
+}
+
+void ShmMessageDriver::CloseConnection(ShmConnection* connection) {
+    ReleaseShm(connection);
+    if (connection->_sock_fd >= 0) {
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, connection->_sock_fd, NULL);
+        close(connection->_sock_fd);
+        connection->_sock_fd = -1;
+    }
+    connection->_closed = true;
+    connection->_name.clear();
+    ++connection->_generation;
+    m_free_slots.push_back(static_cast<uint32_t>(connection->_handle));
+}
+
+void ShmMessageDriver::ReleaseShm(ShmConnection* connection) {
+    if (connection->_established) {
+        uint32_t slot = static_cast<uint32_t>(connection->_handle);
+        for (size_t i = 0; i < m_established.size(); ++i) {
+            if (m_established[i] == slot) {
+                m_established[i] = m_established.back();
+                m_established.pop_back();
+                break;
+            }
+        }
+        connection->_established = false;
+    }
+    if (connection->_shm) {
+        munmap(connection->_shm, connection->_shm_size);
+        connection->_shm = NULL;
+        connection->_shm_size = 0;
+        connection->_tx = ShmRing();
+        connection->_rx = ShmRing();
+    }
+    if (connection->_rx_efd >= 0) {
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, connection->_rx_efd, NULL);
+        close(connection->_rx_efd);
+        connection->_rx_efd = -1;
+    }
+    if (connection->_tx_efd >= 0) {
+        close(connection->_tx_efd);
+        connection->_tx_efd = -1;
+    }
+}
+
+int32_t ShmMessageDriver::Handshake(ShmConnection* connection) {
+    ReleaseShm(connection);
+    if (connection->_sock_fd >= 0) {
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, connection->_sock_fd, NULL);
+        close(connection->_sock_fd);
+        connection->_sock_fd = -1;
+    }
+
+    struct sockaddr_un addr;
+    socklen_t addr_len = 0;
+    ShmSockAddr(connection->_name, &addr, &addr_len);
+    int32_t sock_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock_fd < 0) {
+        PLOG_ERROR("socket failed(%d)", errno);
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+    if (connect(sock_fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len) != 0) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "connect shm://%s failed(%d)", connection->_name.c_str(), errno);
+        close(sock_fd);
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+
+    int32_t shm_fd = -1;
+    int32_t efds[2] = { -1, -1 };
+    size_t shm_size = sizeof(ShmSegmentHead) + 2 * static_cast<size_t>(m_ring_size);
+    void* shm = MAP_FAILED;
+    do {
+        shm_fd = CreateShmFd(connection->_name);
+        if (shm_fd < 0 || ftruncate(shm_fd, shm_size) != 0) {
+            PLOG_ERROR("create shm failed(%d)", errno);
+            break;
+        }
+        shm = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+        if (MAP_FAILED == shm) {
+            PLOG_ERROR("mmap shm failed(%d)", errno);
+            break;
+        }
+        efds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        efds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (efds[0] < 0 || efds[1] < 0) {
+            PLOG_ERROR("eventfd failed(%d)", errno);
+            break;
+        }
+
+        ShmSegmentHead* head = static_cast<ShmSegmentHead*>(shm);
+        head->_magic = SHM_MAGIC;
+        head->_version = SHM_VERSION;
+        head->_ring_size = m_ring_size;
+
+        // 共享内存和两个eventfd一次传给服务端：[0] 唤醒服务端，[1] 唤醒客户端
+        int32_t fds[3] = { shm_fd, efds[0], efds[1] };
+        char cmsg_buf[CMSG_SPACE(sizeof(fds))];
+        memset(cmsg_buf, 0, sizeof(cmsg_buf));
+        uint8_t data = static_cast<uint8_t>(SHM_VERSION);
+        struct iovec iov = { &data, sizeof(data) };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cmsg_buf;
+        msg.msg_controllen = sizeof(cmsg_buf);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+        if (sendmsg(sock_fd, &msg, MSG_NOSIGNAL) != sizeof(data)) {
+            PLOG_ERROR("send shm fd to %s failed(%d)", connection->_name.c_str(), errno);
+            break;
+        }
+        close(shm_fd);
+
+        fcntl(sock_fd, F_SETFL, fcntl(sock_fd, F_GETFL) | O_NONBLOCK);
+        connection->_sock_fd = sock_fd;
+        connection->_shm = shm;
+        connection->_shm_size = shm_size;
+        connection->_tx_efd = efds[0];
+        connection->_rx_efd = efds[1];
+        InitRing(head, 0, &connection->_tx);
+        InitRing(head, 1, &connection->_rx);
+        connection->_established = true;
+        m_established.push_back(static_cast<uint32_t>(connection->_handle));
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = connection->_handle;
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, sock_fd, &event);
+        event.events = EPOLLIN | EPOLLET;
+        event.data.u64 = connection->_handle | SHM_EFD_EVENT;
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, connection->_rx_efd, &event);
+        return 0;
+    } while (false);
+
+    if (shm != MAP_FAILED) {
+        munmap(shm, shm_size);
+    }
+    for (int32_t i = 0; i < 2; ++i) {
+        if (efds[i] >= 0) {
+            close(efds[i]);
+        }
+    }
+    if (shm_fd >= 0) {
+        close(shm_fd);
+    }
+    close(sock_fd);
+    return kMESSAGE_CONNECT_ADDR_FAILED;
+}
+
+void ShmMessageDriver::OnHandshake(ShmConnection* connection) {
+    int32_t fds[3] = { -1, -1, -1 };
+    char cmsg_buf[CMSG_SPACE(sizeof(fds))];
+    uint8_t data = 0;
+    struct iovec iov = { &data, sizeof(data) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsg_buf;
+    msg.msg_controllen = sizeof(cmsg_buf);
+    ssize_t ret = recvmsg(connection->_sock_fd, &msg, MSG_CMSG_CLOEXEC);
+    if (ret < 0 && (EAGAIN == errno || EINTR == errno)) {
+        return;
+    }
+
+    int32_t fd_num = 0;
+    struct cmsghdr* cmsg = (ret > 0) ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cmsg && SOL_SOCKET == cmsg->cmsg_level && SCM_RIGHTS == cmsg->cmsg_type) {
+        fd_num = static_cast<int32_t>((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int32_t));
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    }
+
+    void* shm = MAP_FAILED;
+    size_t shm_size = 0;
+    do {
+        if (fd_num != 3 || data != SHM_VERSION) {
+            PLOG_ERROR("invalid shm handshake from %s(ret=%ld fd_num=%d)",
+                connection->_name.c_str(), ret, fd_num);
+            break;
+        }
+        struct stat st;
+        if (fstat(fds[0], &st) != 0 || st.st_size < static_cast<off_t>(sizeof(ShmSegmentHead))) {
+            break;
+        }
+        shm_size = st.st_size;
+        shm = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+        if (MAP_FAILED == shm) {
+            PLOG_ERROR("mmap shm failed(%d)", errno);
+            break;
+        }
+        ShmSegmentHead* head = static_cast<ShmSegmentHead*>(shm);
+        uint32_t ring_size = head->_ring_size;
+        if (head->_magic != SHM_MAGIC || head->_version != SHM_VERSION
+            || ring_size < SHM_MIN_RING_SIZE || ring_size > SHM_MAX_RING_SIZE
+            || (ring_size & (ring_size - 1)) != 0
+            || shm_size < sizeof(ShmSegmentHead) + 2 * static_cast<size_t>(ring_size)) {
+            PLOG_ERROR("invalid shm head from %s", connection->_name.c_str());
+            break;
+        }
+
+        close(fds[0]);
+        connection->_shm = shm;
+        connection->_shm_size = shm_size;
+        connection->_rx_efd = fds[1];
+        connection->_tx_efd = fds[2];
+        InitRing(head, 0, &connection->_rx);
+        InitRing(head, 1, &connection->_tx);
+        connection->_established = true;
+        m_established.push_back(static_cast<uint32_t>(connection->_handle));
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLET;
+        event.data.u64 = connection->_handle | SHM_EFD_EVENT;
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, connection->_rx_efd, &event);
+        return;
+    } while (false);
+
+    if (shm != MAP_FAILED) {
+        munmap(shm, shm_size);
+    }
+    for (int32_t i = 0; i < 3; ++i) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    CloseConnection(connection);
+}
+
+void ShmMessageDriver::OnAccept(ShmConnection* listen_conn) {
+    while (true) {
+        int32_t fd = accept4(listen_conn->_sock_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (EINTR == errno || ECONNABORTED == errno) {
+                continue;
+            }
+            PLOG_IF_ERROR(errno != EAGAIN, "accept shm://%s failed(%d)", listen_conn->_name.c_str(), errno);
+            return;
+        }
+
+        ShmConnection* connection = CreateConnection(SHM_ACCEPT_CONN);
+        connection->_sock_fd = fd;
+        connection->_listen_handle = listen_conn->_handle;
+        connection->_name = listen_conn->_name;
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = connection->_handle;
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        // 客户端connect后立即发送，一般已经可读
+        OnHandshake(connection);
+    }
+}
+
+void ShmMessageDriver::OnSocketEvent(ShmConnection* connection) {
+    if (!connection->_established) {
+        if (SHM_ACCEPT_CONN == connection->_type) {
+            OnHandshake(connection);
+        }
+        return;
+    }
+
+    // 建连后对端不会再写socket，可读即对端关闭或出错
+    char buff[64];
+    ssize_t ret = recv(connection->_sock_fd, buff, sizeof(buff), MSG_DONTWAIT);
+    if (ret > 0 || (ret < 0 && (EAGAIN == errno || EINTR == errno))) {
+        return;
+    }
+
+    PLOG_INFO("shm peer of %s closed", connection->_name.c_str());
+    if (SHM_ACCEPT_CONN == connection->_type) {
+        CloseConnection(connection);
+        return;
+    }
+    // 客户端保留handle，下次发送时重新建连
+    ReleaseShm(connection);
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, connection->_sock_fd, NULL);
+    close(connection->_sock_fd);
+    connection->_sock_fd = -1;
+}
+
+void ShmMessageDriver::OnEpollEvent(int32_t fd, uint32_t events) {
+    m_epoll_ready = true;
+}
+
+void ShmMessageDriver::ProcessEvents() {
+    m_epoll_ready = false;
+    struct epoll_event events[SHM_MAX_EVENTS];
+    int32_t num = epoll_wait(m_epoll_fd, events, SHM_MAX_EVENTS, 0);
+    for (int32_t i = 0; i < num; ++i) {
+        uint64_t data = events[i].data.u64;
+        ShmConnection* connection = GetConnection(static_cast<int64_t>(data & ~SHM_EFD_EVENT));
+        if (NULL == connection) {
+            continue;
+        }
+        // eventfd以边缘触发注册，只用于唤醒，不需要读出计数
+        if (data & SHM_EFD_EVENT) {
+            continue;
+        } else if (SHM_LISTEN_CONN == connection->_type) {
+            OnAccept(connection);
+        } else {
+            OnSocketEvent(connection);
+        }
+    }
+    // 一次没取完，下次Poll继续
+    if (SHM_MAX_EVENTS == num) {
+        m_epoll_ready = true;
+    }
+}
+
+bool ShmMessageDriver::PollShm(int64_t* handle) {
+    uint32_t num = m_established.size();
+    for (uint32_t i = 0; i < num; ++i) {
+        if (m_next_poll >= num) {
+            m_next_poll = 0;
+        }
+        ShmConnection* connection = m_connections[m_established[m_next_poll++]];
+        if (!RingEmpty(&connection->_rx)) {
+            *handle = connection->_handle;
+            m_last_active_us = TimeUtility::GetCachedUS();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ShmMessageDriver::ArmWakeup() {
+    for (std::vector<uint32_t>::iterator it = m_established.begin(); it != m_established.end(); ++it) {
+        __atomic_store_n(&m_connections[*it]->_rx._ctrl->_need_wakeup, 1, __ATOMIC_RELAXED);
+    }
+    // 与生产者"写入-检查标记"配对
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (std::vector<uint32_t>::iterator it = m_established.begin(); it != m_established.end(); ++it) {
+        if (!RingEmpty(&m_connections[*it]->_rx)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ShmMessageDriver::DisarmWakeup() {
+    // 忙于处理消息期间对端发送不需要唤醒
+    for (std::vector<uint32_t>::iterator it = m_established.begin(); it != m_established.end(); ++it) {
+        __atomic_store_n(&m_connections[*it]->_rx._ctrl->_need_wakeup, 0, __ATOMIC_RELAXED);
+    }
+}
+
+void ShmMessageDriver::SetMsgInfo(ShmConnection* connection, MsgExternInfo* msg_info) {
+    msg_info->_msg_arrived_ms = TimeUtility::GetCachedMS();
+    msg_info->_remote_handle  = connection->_handle;
+    msg_info->_self_handle    = connection->_handle;
+    if (SHM_ACCEPT_CONN == connection->_type) {
+        msg_info->_self_handle = connection->_listen_handle;
+    }
+}
+
+} // namespace pebble
@@ -0,0 +1,176 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#ifndef _PEBBLE_COMMON_SHM_MESSAGE_DRIVER_H_
+#define _PEBBLE_COMMON_SHM_MESSAGE_DRIVER_H_
+
+#include <vector>
+#include "framework/message.h"
+
+
+namespace pebble {
+
+struct ShmConnection;
+
+/// @brief 基于共享内存的同机网络驱动，地址为"shm://name"
+/// @note 每个连接一块共享内存(memfd)，内含两个方向的单生产者单消费者环形队列，
+///     收发消息不经过内核，Peek直接返回共享内存中的消息(在Pop前有效)
+/// @note 建连时客户端通过unix域socket(抽象命名空间"pebble.shm.name")把共享内存和两个eventfd
+///     传给服务端，此后该socket只用于感知对端进程退出；对端等待时才写eventfd唤醒，
+///     对端在Poll中忙等时不产生系统调用
+/// @note 非shm地址和句柄交给下层驱动(raw或io_uring)处理，shm的事件也通过下层驱动的WatchFd等待
+/// @note 客户端连接在对端关闭后，下次发送时自动重新建连；服务端未启动时Connect直接失败
+class ShmMessageDriver : public MessageDriver {
+protected:
+    ShmMessageDriver();
+    ShmMessageDriver(const ShmMessageDriver& rhs) {}
+public:
+    // 每个方向环形队列的默认大小，单个消息不能超过其1/4
+    static const uint32_t DEFAULT_RING_SIZE = 4 * 1024 * 1024;
+    // 无消息时阻塞前的默认忙等时间
+    static const uint32_t DEFAULT_SPIN_US = 50;
+
+    virtual ~ShmMessageDriver();
+
+    /// @brief 每个线程一个实例，多worker模式下各worker独立收发
+    static ShmMessageDriver* Instance() {
+        if (NULL == m_instance) {
+            m_instance = new ShmMessageDriver();
+        }
+        return m_instance;
+    }
+
+    /// @brief 释放当前线程的实例，关闭其上的所有连接，worker线程退出前调用
+    static void ReleaseInstance();
+
+    /// @param next_driver 处理非shm地址的下层驱动，不能为NULL
+    /// @param ring_size 本端发起连接时每个方向环形队列的大小，需为2的幂，服务端以客户端为准
+    /// @return 0 成功
+    /// @return <0 失败，错误码@see MessageErrorCode
+    int32_t Init(MessageDriver* next_driver, uint32_t ring_size = DEFAULT_RING_SIZE);
+
+    /// @brief 设置无消息时阻塞前的忙等时间，最近1s内收到过shm消息才忙等，0表示不忙等
+    /// @note 忙等期间对端发送不需要唤醒，同机往返时延最低，代价是空闲时每次Poll多占用spin_us的CPU，
+    ///     且下层驱动的消息最多延后spin_us处理；只有一个CPU时不忙等
+    void SetSpinUs(uint32_t spin_us) { m_spin_us = spin_us; }
+
+    virtual int64_t Bind(const std::string& url);
+
+    virtual int64_t Connect(const std::string& url);
+
+    virtual int32_t Send(int64_t handle, const uint8_t* msg, uint32_t msg_len, int32_t flag);
+
+    virtual int32_t SendV(int64_t handle, uint32_t msg_frag_num,
+                          const uint8_t* msg_frag[], uint32_t msg_frag_len[], int32_t flag);
+
+    virtual int32_t Recv(int64_t handle, uint8_t* msg_buff, uint32_t* buff_len,
+                         MsgExternInfo* msg_info);
+
+    virtual int32_t Peek(int64_t handle, const uint8_t** msg, uint32_t* msg_len,
+                         MsgExternInfo* msg_info);
+
+    virtual int32_t Pop(int64_t handle);
+
+    virtual int32_t Close(int64_t handle);
+
+    virtual int32_t Poll(int64_t* handle, int32_t* event, int32_t timeout_ms);
+
+    virtual int32_t ReportHandleResult(int64_t handle, int32_t result, int64_t time_cost);
+
+    /// @brief shm句柄返回发送队列的剩余空间和总大小
+    virtual int32_t GetUsedSize(int64_t handle, uint32_t* remain_size, uint32_t* max_size);
+
+    virtual const char* GetLastError();
+
+    virtual int32_t Flush(int64_t handle);
+
+    virtual int32_t WatchFd(int32_t fd, uint32_t events, const FdEventCallback& on_event);
+
+    virtual int32_t UnwatchFd(int32_t fd);
+
+    /// @brief shm句柄返回建连socket对端进程的身份
+    virtual int32_t GetPeerCred(int64_t handle, int32_t* pid, uint32_t* uid, uint32_t* gid);
+
+    virtual int32_t ExportListenFd(int64_t handle);
+
+    virtual int32_t StopListen(int64_t handle);
+
+    /// @brief 交给下层驱动，shm连接的共享内存由客户端创建，不预热
+    virtual int32_t Prewarm(uint32_t conn_num, bool lock);
+
+    virtual int32_t GetConnectionPoolInfo(uint32_t* used_num, uint32_t* free_num);
+
+private:
+    bool IsShmHandle(int64_t handle) const;
+
+    ShmConnection* CreateConnection(uint8_t type);
+
+    ShmConnection* GetConnection(int64_t handle);
+
+    void CloseConnection(ShmConnection* connection);
+
+    /// @brief 释放共享内存和eventfd，客户端连接保留socket以外的状态等待重连
+    void ReleaseShm(ShmConnection* connection);
+
+    /// @brief 客户端建连：连接服务端socket，创建共享内存并传给服务端
+    int32_t Handshake(ShmConnection* connection);
+
+    /// @brief 服务端收取客户端传来的共享内存和eventfd
+    void OnHandshake(ShmConnection* connection);
+
+    void OnAccept(ShmConnection* listen_conn);
+
+    void OnSocketEvent(ShmConnection* connection);
+
+    /// @brief 记录下层驱动通知的本驱动epoll可读事件
+    void OnEpollEvent(int32_t fd, uint32_t events);
+
+    /// @brief 处理本驱动epoll上的事件(accept、握手、对端关闭、eventfd唤醒)
+    void ProcessEvents();
+
+    /// @brief 在已建连的连接上轮流查找有消息的连接
+    bool PollShm(int64_t* handle);
+
+    /// @brief 阻塞前设置各接收队列的唤醒标记
+    /// @return true 设置后发现已有消息，不能阻塞
+    bool ArmWakeup();
+
+    void DisarmWakeup();
+
+    void SetMsgInfo(ShmConnection* connection, MsgExternInfo* msg_info);
+
+private:
+    MessageDriver* m_next_driver;
+    uint32_t m_ring_size;
+    uint32_t m_spin_us;
+    bool m_multi_cpu;
+    int32_t m_epoll_fd;
+    // 下层驱动不支持WatchFd时，本驱动的事件只能在每次Poll时检查
+    bool m_watched;
+    bool m_epoll_ready;
+    int64_t m_last_active_us;
+
+    // 连接表，slot复用，handle中带generation防止误用已关闭连接
+    std::vector<ShmConnection*> m_connections;
+    std::vector<uint32_t> m_free_slots;
+    // 已建连的连接，Poll时轮流检查
+    std::vector<uint32_t> m_established;
+    uint32_t m_next_poll;
+
+    static __thread ShmMessageDriver* m_instance;
+};
+
+} // namespace pebble
+
+#endif // _PEBBLE_COMMON_SHM_MESSAGE_DRIVER_H_
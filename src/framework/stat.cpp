@@ -80,6 +80,53 @@ int32_t Stat::AddMessageItem(const std::string& name) {
     return 0;
 }
 
+void Stat::Merge(const Stat& other) {
+    m_message_counts += other.m_message_counts;
+    m_failure_message_counts += other.m_failure_message_counts;
+
+    ResourceStatTemp::const_iterator rit = other.m_resource_stat_temp.begin();
+    for (; rit != other.m_resource_stat_temp.end(); ++rit) {
+        const ResourceStatTempData& other_temp = rit->second;
+        ResourceStatItem& item = m_resource_stat_result[rit->first];
+        ResourceStatTempData& temp = m_resource_stat_temp[rit->first];
+        temp._result = &item;
+        temp._count += other_temp._count;
+        temp._total_value += other_temp._total_value;
+        if (other_temp._result) {
+            if (other_temp._result->_max_value > item._max_value) {
+                item._max_value = other_temp._result->_max_value;
+            }
+            if (other_temp._result->_min_value < item._min_value) {
+                item._min_value = other_temp._result->_min_value;
+            }
+        }
+    }
+
+    MessageStatTemp::const_iterator mit = other.m_message_stat_temp.begin();
+    cxx::unordered_map<int32_t, uint32_t>::const_iterator result_it;
+    for (; mit != other.m_message_stat_temp.end(); ++mit) {
+        const MessageStatTempData& other_temp = mit->second;
+        MessageStatItem& item = m_message_stat_result[mit->first];
+        MessageStatTempData& temp = m_message_stat_temp[mit->first];
+        temp._result = &item;
+        temp._total_count += other_temp._total_count;
+        temp._total_cost_ms += other_temp._total_cost_ms;
+        temp._failure_count += other_temp._failure_count;
+        if (other_temp._result) {
+            if (other_temp._result->_max_cost_ms > item._max_cost_ms) {
+                item._max_cost_ms = other_temp._result->_max_cost_ms;
+            }
+            if (other_temp._result->_min_cost_ms < item._min_cost_ms) {
+                item._min_cost_ms = other_temp._result->_min_cost_ms;
+            }
+            for (result_it = other_temp._result->_result.begin();
+                result_it != other_temp._result->_result.end(); ++result_it) {
+                item._result[result_it->first] += result_it->second;
+            }
+        }
+    }
+}
+
 const ResourceStatItem* Stat::GetResourceResultByName(const std::string& name) {
     cxx::unordered_map<std::string, ResourceStatTempData>::iterator it;
     it = m_resource_stat_temp.find(name);
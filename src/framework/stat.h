@@ -103,6 +103,10 @@ public:
     /// @brief 获取所有消息型统计结果
     const MessageStatResult* GetAllMessageResults();
 
+    /// @brief 把其他Stat实例记录的数据合并到本实例，一般用于多worker的统计汇总
+    /// @param other 被合并的Stat实例，合并后other的数据不变
+    void Merge(const Stat& other);
+
     /// @brief 获取所有消息数
     uint32_t GetAllMessageCounts() {
         return m_message_counts;
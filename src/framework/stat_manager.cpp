@@ -36,14 +36,21 @@ StatManager::StatManager() {
     m_gdata_id          = DEFAULT_GDATA_ID;
     m_gdata_log_id      = DEFAULT_GDATA_LOG_ID;
     m_start_time_s      = 0;
+    m_master            = NULL;
 }
 
 StatManager::~StatManager() {
-    WriteLog();
+    if (m_master) {
+        m_master->Merge(*m_stat);
+    } else {
+        WriteLog();
+    }
     delete m_report_timer;
     delete m_gdata_monitor;
     delete m_stat;
-    oss::CLogDataAPI::FiniDataLog();
+    if (!m_master) {
+        oss::CLogDataAPI::FiniDataLog();
+    }
 }
 
 int32_t StatManager::SetReportCycle(uint32_t report_cycle_s) {
@@ -79,6 +86,11 @@ int32_t StatManager::Init(int64_t app_id, int32_t unit_id, int32_t program_id, i
         return -1;
     }
 
+    // Gdata上报由master统一负责
+    if (m_master) {
+        return 0;
+    }
+
     return InitGdataApi(app_id, unit_id, program_id, instance_id, gdata_log_path);
 }
 
@@ -115,13 +127,29 @@ int32_t StatManager::Update() {
     return m_report_timer->Update();
 }
 
+int64_t StatManager::GetNextTimeoutMS() {
+    return m_report_timer->GetNextTimeoutMS();
+}
+
 int32_t StatManager::OnTimeout() {
+    if (m_master) {
+        m_master->Merge(*m_stat);
+        m_stat->Clear();
+        return m_report_cycle_s * 1000;
+    }
+
+    AutoLocker lock(&m_merge_mutex);
     WriteLog();
     ReportGdataByCycle();
     m_stat->Clear();
     return m_report_cycle_s * 1000;
 }
 
+void StatManager::Merge(const Stat& stat) {
+    AutoLocker lock(&m_merge_mutex);
+    m_stat->Merge(stat);
+}
+
 void StatManager::WriteLog() {
     static const int32_t BUFF_LEN = 4000;
     static const int32_t BUFF_WATER_LINE = 3600;
@@ -222,7 +250,7 @@ void StatManager::ReportGdataByCycle() {
 void StatManager::Report2Gdata(const std::string& name,
     int32_t result, int64_t time_cost) {
 
-    if (m_report_gdata_type != kREPORT_BY_MESSAGE) {
+    if (m_report_gdata_type != kREPORT_BY_MESSAGE || NULL == m_gdata_monitor) {
         return;
     }
 
@@ -16,6 +16,7 @@
 
 #include <set>
 
+#include "common/mutex.h"
 #include "common/platform.h"
 
 namespace pebble {
@@ -82,6 +83,9 @@ public:
     /// @return 处理事件数，未处理返回0
     int32_t Update();
 
+    /// @brief 返回距离下一次统计输出的时间，单位ms
+    int64_t GetNextTimeoutMS();
+
     /// @brief 返回Stat实例
     /// @return 非空
     Stat* GetStat() {
@@ -93,6 +97,17 @@ public:
     /// @brief 获取程序的运行时间，单位为s
     uint64_t GetRuntimeInSecond();
 
+    /// @brief 多worker模式下设置汇总统计的StatManager，每个统计周期结束时本实例的数据合并到master，
+    ///     由master统一输出到log和Gdata
+    /// @param master 汇总统计的StatManager，为NULL时本实例独立输出
+    /// @note 需要在Init前调用，设置master后本实例不再初始化Gdata上报
+    void SetMaster(StatManager* master) {
+        m_master = master;
+    }
+
+    /// @brief 合并其他实例的统计数据，线程安全
+    void Merge(const Stat& stat);
+
 private:
     int32_t InitGdataApi(int64_t app_id,
         int32_t unit_id,
@@ -119,6 +134,8 @@ private:
     int32_t m_gdata_log_id;
     uint64_t m_start_time_s;
     std::set<std::string> m_report_names;
+    StatManager* m_master;
+    Mutex m_merge_mutex;
 };
 
 } // namespace pebble
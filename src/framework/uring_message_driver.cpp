@@ -0,0 +1,1336 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#include "common/log.h"
+#include "common/memory.h"
+#include "common/net_util.h"
+#include "common/string_utility.h"
+#include "common/time_utility.h"
+#include "framework/raw_message_driver.h"
+#include "framework/uring_message_driver.h"
+
+// 编译环境的内核头文件需要有multishot recv和EXT_ARG的定义
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ENTER_EXT_ARG) && defined(__NR_io_uring_setup)
+#define PEBBLE_HAVE_IO_URING 1
+#endif
+
+
+namespace pebble {
+
+// handle格式: | flag(1bit, bit48) | generation(16bit) | slot(32bit) |
+// 与NetIO的NetAddr(最大40bit)不重叠，raw driver的handle不会带此标记
+static const int64_t URING_HANDLE_FLAG = 1LL << 48;
+static const uint64_t URING_HANDLE_MASK = (1ULL << 48) - 1;
+
+// sqe的user_data格式: | op(8bit) | 0 | generation(16bit) | slot(32bit) |
+enum {
+    URING_OP_ACCEPT = 1,
+    URING_OP_RECV,
+    URING_OP_SEND,
+    URING_OP_CONNECT,
+    URING_OP_CANCEL,
+    URING_OP_POLL,      // 等待raw driver的epoll fd可读，不属于任何连接
+};
+
+enum {
+    URING_LISTEN_CONN  = 1,
+    URING_ACCEPT_CONN  = 2,
+    URING_CONNECT_CONN = 3,
+};
+
+/// @brief io_uring上的一个TCP连接(含监听socket)
+struct UringConnection {
+    UringConnection() : _handle(-1), _generation(0), _fd(-1), _type(0), _closed(true),
+        _connected(false), _connecting(false), _reconnecting(false), _ready(false),
+        _sending(false), _send_queued(false), _exported(false), _reconnect_num(0), _pending_ops(0),
+        _listen_handle(-1), _msg_arrived_ms(0), _peer_addr_len(0), _read_pos(0), _sent_len(0) {
+        memset(&_peer_addr, 0, sizeof(_peer_addr));
+    }
+
+    int64_t     _handle;
+    uint16_t    _generation;
+    int32_t     _fd;
+    uint8_t     _type;
+    bool        _closed;
+    bool        _connected;
+    bool        _connecting;
+    bool        _reconnecting;      // 等待在途请求完成后重连
+    bool        _ready;             // 有完整消息，已加入ready队列
+    bool        _sending;           // 有在途的send请求
+    bool        _send_queued;       // 已加入待发送队列
+    bool        _exported;          // 监听socket已交给热重启的新进程
+    uint8_t     _reconnect_num;
+    uint32_t    _pending_ops;       // 在途请求数，为0时才能释放或重连
+    int64_t     _listen_handle;     // accept的连接对应的监听handle
+    int64_t     _msg_arrived_ms;
+    struct sockaddr_in6 _peer_addr; // connect的地址(ipv4时按sockaddr_in存放)，需在connect请求完成前保持有效
+    socklen_t   _peer_addr_len;
+
+    std::string _recv_buff;         // 接收数据，[_read_pos, size)为未处理数据
+    uint32_t    _read_pos;
+    std::string _send_buff;         // 待发送数据
+    std::string _sending_buff;      // 在途发送数据，请求完成前不能修改
+    uint32_t    _sent_len;
+};
+
+
+#ifdef PEBBLE_HAVE_IO_URING
+
+struct UringRing {
+    UringRing() {
+        memset(this, 0, sizeof(*this));
+        _fd = -1;
+    }
+
+    int32_t     _fd;
+    void*       _ring_ptr;
+    size_t      _ring_size;
+    struct io_uring_sqe* _sqes;
+    size_t      _sqes_size;
+
+    uint32_t*   _sq_head;
+    uint32_t*   _sq_tail;
+    uint32_t*   _sq_array;
+    uint32_t    _sq_mask;
+    uint32_t    _sq_entries;
+
+    uint32_t*   _cq_head;
+    uint32_t*   _cq_tail;
+    uint32_t    _cq_mask;
+    struct io_uring_cqe* _cqes;
+
+    struct io_uring_buf_ring* _buf_ring;
+    size_t      _buf_ring_size;
+    uint32_t    _buf_num;
+    uint32_t    _buf_size;
+    uint8_t*    _bufs;
+    uint16_t    _buf_tail;
+};
+
+static bool KernelSupportUring() {
+    // multishot recv需要6.0以上内核
+    struct utsname name;
+    if (uname(&name) != 0) {
+        return false;
+    }
+    int major = 0;
+    int minor = 0;
+    if (sscanf(name.release, "%d.%d", &major, &minor) != 2) {
+        return false;
+    }
+    return major >= 6;
+}
+
+static void RingExit(UringRing* ring) {
+    if (ring->_bufs) {
+        free(ring->_bufs);
+    }
+    if (ring->_buf_ring) {
+        munmap(ring->_buf_ring, ring->_buf_ring_size);
+    }
+    if (ring->_sqes) {
+        munmap(ring->_sqes, ring->_sqes_size);
+    }
+    if (ring->_ring_ptr) {
+        munmap(ring->_ring_ptr, ring->_ring_size);
+    }
+    if (ring->_fd >= 0) {
+        close(ring->_fd);
+    }
+    *ring = UringRing();
+}
+
+static void RingProvideBuffer(UringRing* ring, uint16_t bid) {
+    // C++下bufs柔性数组的偏移不一定为0，直接按ring首地址取，tail与bufs[0]的resv重叠
+    struct io_uring_buf* bufs = reinterpret_cast<struct io_uring_buf*>(ring->_buf_ring);
+    struct io_uring_buf* buf  = &bufs[ring->_buf_tail & (ring->_buf_num - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(ring->_bufs + bid * ring->_buf_size);
+    buf->len  = ring->_buf_size;
+    buf->bid  = bid;
+    ring->_buf_tail++;
+    __atomic_store_n(&ring->_buf_ring->tail, ring->_buf_tail, __ATOMIC_RELEASE);
+}
+
+static int32_t RingSetup(UringRing* ring, uint32_t entries, uint32_t buf_num, uint32_t buf_size) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+        PLOG_ERROR("io_uring_setup failed(%d:%s)", errno, strerror(errno));
+        return -1;
+    }
+    ring->_fd = fd;
+
+    uint32_t required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required) {
+        PLOG_ERROR("io_uring features 0x%x not support 0x%x", params.features, required);
+        RingExit(ring);
+        return -1;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->_ring_size = sq_size > cq_size ? sq_size : cq_size;
+    void* ptr = mmap(NULL, ring->_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == ptr) {
+        PLOG_ERROR("mmap sq/cq ring failed(%d:%s)", errno, strerror(errno));
+        RingExit(ring);
+        return -1;
+    }
+    ring->_ring_ptr = ptr;
+
+    ring->_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ptr = mmap(NULL, ring->_sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (MAP_FAILED == ptr) {
+        PLOG_ERROR("mmap sqes failed(%d:%s)", errno, strerror(errno));
+        RingExit(ring);
+        return -1;
+    }
+    ring->_sqes = static_cast<struct io_uring_sqe*>(ptr);
+
+    uint8_t* base = static_cast<uint8_t*>(ring->_ring_ptr);
+    ring->_sq_head    = reinterpret_cast<uint32_t*>(base + params.sq_off.head);
+    ring->_sq_tail    = reinterpret_cast<uint32_t*>(base + params.sq_off.tail);
+    ring->_sq_array   = reinterpret_cast<uint32_t*>(base + params.sq_off.array);
+    ring->_sq_mask    = *reinterpret_cast<uint32_t*>(base + params.sq_off.ring_mask);
+    ring->_sq_entries = params.sq_entries;
+    ring->_cq_head    = reinterpret_cast<uint32_t*>(base + params.cq_off.head);
+    ring->_cq_tail    = reinterpret_cast<uint32_t*>(base + params.cq_off.tail);
+    ring->_cq_mask    = *reinterpret_cast<uint32_t*>(base + params.cq_off.ring_mask);
+    ring->_cqes       = reinterpret_cast<struct io_uring_cqe*>(base + params.cq_off.cqes);
+
+    // provided buffer ring，multishot recv从这里取buffer
+    ring->_buf_num  = buf_num;
+    ring->_buf_size = buf_size;
+    ring->_buf_ring_size = buf_num * sizeof(struct io_uring_buf);
+    ptr = mmap(NULL, ring->_buf_ring_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == ptr) {
+        PLOG_ERROR("mmap buffer ring failed(%d:%s)", errno, strerror(errno));
+        ring->_buf_ring = NULL;
+        RingExit(ring);
+        return -1;
+    }
+    ring->_buf_ring = static_cast<struct io_uring_buf_ring*>(ptr);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = reinterpret_cast<uint64_t>(ring->_buf_ring);
+    reg.ring_entries = buf_num;
+    reg.bgid         = 0;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        PLOG_ERROR("register buffer ring failed(%d:%s)", errno, strerror(errno));
+        RingExit(ring);
+        return -1;
+    }
+
+    ring->_bufs = static_cast<uint8_t*>(malloc(buf_num * buf_size));
+    if (NULL == ring->_bufs) {
+        RingExit(ring);
+        return -1;
+    }
+    for (uint32_t i = 0; i < buf_num; i++) {
+        RingProvideBuffer(ring, static_cast<uint16_t>(i));
+    }
+
+    return 0;
+}
+
+static uint32_t RingToSubmit(UringRing* ring) {
+    return *ring->_sq_tail - __atomic_load_n(ring->_sq_head, __ATOMIC_ACQUIRE);
+}
+
+static int32_t RingEnter(UringRing* ring, int32_t timeout_ms) {
+    uint32_t to_submit = RingToSubmit(ring);
+    bool has_cqe = *ring->_cq_head != __atomic_load_n(ring->_cq_tail, __ATOMIC_ACQUIRE);
+    if (0 == to_submit && (0 == timeout_ms || has_cqe)) {
+        return 0;
+    }
+
+    uint32_t wait_nr = (0 == timeout_ms || has_cqe) ? 0 : 1;
+    uint32_t flags   = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    void* argp = NULL;
+    size_t argsz = 0;
+    if (wait_nr > 0 && timeout_ms > 0) {
+        ts.tv_sec  = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        argp   = &arg;
+        argsz  = sizeof(arg);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    int ret = syscall(__NR_io_uring_enter, ring->_fd, to_submit, wait_nr, flags, argp, argsz);
+    if (ret < 0 && errno != ETIME && errno != EINTR) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "io_uring_enter failed(%d:%s)", errno, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static struct io_uring_sqe* RingGetSqe(UringRing* ring) {
+    uint32_t tail = *ring->_sq_tail;
+    if (tail - __atomic_load_n(ring->_sq_head, __ATOMIC_ACQUIRE) >= ring->_sq_entries) {
+        // SQ满先提交一次
+        RingEnter(ring, 0);
+        if (tail - __atomic_load_n(ring->_sq_head, __ATOMIC_ACQUIRE) >= ring->_sq_entries) {
+            return NULL;
+        }
+    }
+
+    uint32_t index = tail & ring->_sq_mask;
+    struct io_uring_sqe* sqe = &ring->_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->_sq_array[index] = index;
+    return sqe;
+}
+
+static void RingCommitSqe(UringRing* ring) {
+    __atomic_store_n(ring->_sq_tail, *ring->_sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+static bool RingPrep(UringRing* ring, uint8_t op, int32_t fd,
+    const void* buf, uint32_t len, uint64_t user_data) {
+    struct io_uring_sqe* sqe = RingGetSqe(ring);
+    if (NULL == sqe) {
+        return false;
+    }
+
+    sqe->fd        = fd;
+    sqe->user_data = user_data;
+    switch (op) {
+        case URING_OP_ACCEPT:
+            sqe->opcode       = IORING_OP_ACCEPT;
+            sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_CLOEXEC;
+            break;
+        case URING_OP_RECV:
+            sqe->opcode    = IORING_OP_RECV;
+            sqe->ioprio    = IORING_RECV_MULTISHOT;
+            sqe->flags     = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = 0;
+            break;
+        case URING_OP_SEND:
+            sqe->opcode    = IORING_OP_SEND;
+            sqe->addr      = reinterpret_cast<uint64_t>(buf);
+            sqe->len       = len;
+            sqe->msg_flags = MSG_NOSIGNAL;
+            break;
+        case URING_OP_CONNECT:
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->addr   = reinterpret_cast<uint64_t>(buf);
+            sqe->off    = len;
+            break;
+        case URING_OP_CANCEL:
+            sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            break;
+        case URING_OP_POLL:
+            sqe->opcode        = IORING_OP_POLL_ADD;
+            sqe->poll32_events = POLLIN;
+            break;
+        default:
+            break;
+    }
+
+    RingCommitSqe(ring);
+    return true;
+}
+
+/// @return true 取到一个完成事件，处理完后需调用RingAdvance
+static bool RingPeek(UringRing* ring, uint64_t* user_data, int32_t* res, bool* more, int32_t* bid) {
+    uint32_t head = *ring->_cq_head;
+    if (head == __atomic_load_n(ring->_cq_tail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    struct io_uring_cqe* cqe = &ring->_cqes[head & ring->_cq_mask];
+    *user_data = cqe->user_data;
+    *res       = cqe->res;
+    *more      = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    *bid       = (cqe->flags & IORING_CQE_F_BUFFER) ? (cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+    return true;
+}
+
+static void RingAdvance(UringRing* ring) {
+    __atomic_store_n(ring->_cq_head, *ring->_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+static const uint8_t* RingBuffer(UringRing* ring, int32_t bid) {
+    return ring->_bufs + bid * ring->_buf_size;
+}
+
+#else // PEBBLE_HAVE_IO_URING
+
+struct UringRing {
+    UringRing() : _fd(-1) {}
+    int32_t _fd;
+};
+
+static bool KernelSupportUring() { return false; }
+static void RingExit(UringRing* ring) {}
+static void RingProvideBuffer(UringRing* ring, uint16_t bid) {}
+static int32_t RingSetup(UringRing* ring, uint32_t entries, uint32_t buf_num, uint32_t buf_size) {
+    return -1;
+}
+static int32_t RingEnter(UringRing* ring, int32_t timeout_ms) { return -1; }
+static bool RingPrep(UringRing* ring, uint8_t op, int32_t fd,
+    const void* buf, uint32_t len, uint64_t user_data) { return false; }
+static bool RingPeek(UringRing* ring, uint64_t* user_data, int32_t* res, bool* more, int32_t* bid) {
+    return false;
+}
+static void RingAdvance(UringRing* ring) {}
+static const uint8_t* RingBuffer(UringRing* ring, int32_t bid) { return NULL; }
+
+#endif // PEBBLE_HAVE_IO_URING
+
+
+static inline uint64_t MakeUserData(uint8_t op, int64_t handle) {
+    return (static_cast<uint64_t>(op) << 56) | (static_cast<uint64_t>(handle) & URING_HANDLE_MASK);
+}
+
+static int32_t SetSocketOpt(int32_t fd, uint8_t type) {
+    int flags = 1;
+    int ret = 0;
+    if (URING_LISTEN_CONN == type) {
+        ret = (ret < 0 || !NetIO::ADDR_REUSE)
+            ? ret : setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flags, sizeof(flags));
+        ret = (ret < 0 || !NetIO::REUSE_PORT)
+            ? ret : setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &flags, sizeof(flags));
+        return ret;
+    }
+
+    ret = (ret < 0 || !NetIO::KEEP_ALIVE)
+        ? ret : setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &flags, sizeof(flags));
+    ret = (ret < 0 || NetIO::USE_NAGLE)
+        ? ret : setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags));
+    return ret;
+}
+
+static int32_t ParseTcpUrl(const std::string& url, struct sockaddr_in6* addr, socklen_t* addr_len) {
+    std::string ip;
+    uint16_t port = 0;
+    if (UrlToNetAddress(url, &ip, &port) != 0) {
+        return -1;
+    }
+
+    if (StringUtility::StartsWith(ip, "raw")) {
+        ip.erase(0, strlen("raw"));
+    }
+    if (StringUtility::StartsWith(ip, "tcp://")) {
+        ip.erase(0, strlen("tcp://"));
+    }
+
+    if (IpToSockAddr(ip, port, addr) != 0) {
+        PLOG_ERROR("unknown ip[%s] address, it should be ipv4 xx.xx.xx.xx or ipv6 [xx::xx]", ip.c_str());
+        return -1;
+    }
+    *addr_len = (AF_INET6 == addr->sin6_family) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+    return 0;
+}
+
+// udp和unix域socket地址交给raw driver处理
+static bool IsRawUrl(const std::string& url) {
+    std::string tmp(url);
+    if (StringUtility::StartsWith(tmp, "raw")) {
+        tmp.erase(0, strlen("raw"));
+    }
+    return StringUtility::StartsWith(tmp, "udp://") || StringUtility::StartsWith(tmp, "unix://");
+}
+
+
+__thread UringMessageDriver* UringMessageDriver::m_instance = NULL;
+
+void UringMessageDriver::ReleaseInstance() {
+    delete m_instance;
+    m_instance = NULL;
+}
+
+UringMessageDriver::UringMessageDriver() {
+    m_ring = NULL;
+    m_msg_buff_len = DEFAULT_MSG_BUFF_LEN;
+    m_raw_driver = NULL;
+    m_raw_poll_armed = false;
+}
+
+UringMessageDriver::~UringMessageDriver() {
+    for (std::vector<UringConnection*>::iterator it = m_connections.begin();
+        it != m_connections.end(); ++it) {
+        if ((*it)->_fd >= 0) {
+            close((*it)->_fd);
+        }
+        delete *it;
+    }
+    m_connections.clear();
+
+    if (m_ring) {
+        RingExit(m_ring);
+        delete m_ring;
+        m_ring = NULL;
+    }
+}
+
+int32_t UringMessageDriver::Init(uint32_t msg_buff_len) {
+    if (m_ring) {
+        return 0;
+    }
+
+    if (!KernelSupportUring()) {
+        PLOG_INFO("io_uring multishot recv not support in this kernel");
+        return kMESSAGE_UNSUPPORT;
+    }
+
+    m_ring = new UringRing();
+    if (RingSetup(m_ring, RING_ENTRIES, RECV_BUFF_NUM, RECV_BUFF_SIZE) != 0) {
+        delete m_ring;
+        m_ring = NULL;
+        return kMESSAGE_UNSUPPORT;
+    }
+
+    m_msg_buff_len = msg_buff_len;
+    return 0;
+}
+
+int64_t UringMessageDriver::Bind(const std::string& url) {
+    if (IsRawUrl(url)) {
+        RawMessageDriver* raw = GetRawDriver();
+        if (NULL == raw) {
+            return kMESSAGE_BIND_ADDR_FAILED;
+        }
+        return raw->Bind(url);
+    }
+
+    struct sockaddr_in6 addr;
+    socklen_t addr_len = 0;
+    if (ParseTcpUrl(url, &addr, &addr_len) != 0) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+
+    // 热重启时直接使用旧进程的监听socket
+    int32_t fd = NetIO::TakeInheritedFd(reinterpret_cast<struct sockaddr*>(&addr), addr_len, SOCK_STREAM);
+    if (fd >= 0) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        PLOG_INFO("bind %s use inherited listen socket %d", url.c_str(), fd);
+        UringConnection* connection = CreateConnection(fd, URING_LISTEN_CONN);
+        SubmitAccept(connection);
+        return connection->_handle;
+    }
+
+    fd = socket(addr.sin6_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        PLOG_ERROR("socket failed(%d:%s)", errno, strerror(errno));
+        return kMESSAGE_BIND_ADDR_FAILED;
+    }
+
+    int32_t v6_only = NetIO::IPV6_ONLY ? 1 : 0;
+    if (SetSocketOpt(fd, URING_LISTEN_CONN) != 0
+        || (AF_INET6 == addr.sin6_family
+            && setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6_only, sizeof(v6_only)) != 0)
+        || bind(fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len) != 0
+        || listen(fd, NetIO::LISTEN_BACKLOG) != 0) {
+        PLOG_ERROR("bind %s failed(%d:%s)", url.c_str(), errno, strerror(errno));
+        close(fd);
+        return kMESSAGE_BIND_ADDR_FAILED;
+    }
+
+    UringConnection* connection = CreateConnection(fd, URING_LISTEN_CONN);
+    SubmitAccept(connection);
+    return connection->_handle;
+}
+
+int64_t UringMessageDriver::Connect(const std::string& url) {
+    if (IsRawUrl(url)) {
+        RawMessageDriver* raw = GetRawDriver();
+        if (NULL == raw) {
+            return kMESSAGE_CONNECT_ADDR_FAILED;
+        }
+        return raw->Connect(url);
+    }
+
+    struct sockaddr_in6 addr;
+    socklen_t addr_len = 0;
+    if (ParseTcpUrl(url, &addr, &addr_len) != 0) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+
+    int32_t fd = socket(addr.sin6_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        PLOG_ERROR("socket failed(%d:%s)", errno, strerror(errno));
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+    SetSocketOpt(fd, URING_CONNECT_CONN);
+
+    UringConnection* connection = CreateConnection(fd, URING_CONNECT_CONN);
+    connection->_peer_addr = addr;
+    connection->_peer_addr_len = addr_len;
+    SubmitConnect(connection);
+    return connection->_handle;
+}
+
+int32_t UringMessageDriver::Send(int64_t handle, const uint8_t* msg, uint32_t msg_len, int32_t flag) {
+    const uint8_t* frags[1] = { msg     };
+    uint32_t fragslen[1]    = { msg_len };
+    return SendV(handle, 1, frags, fragslen, flag);
+}
+
+int32_t UringMessageDriver::SendV(int64_t handle, uint32_t msg_frag_num,
+    const uint8_t* msg_frag[], uint32_t msg_frag_len[], int32_t flag) {
+    if (!IsUringHandle(handle)) {
+        return m_raw_driver ? m_raw_driver->SendV(handle, msg_frag_num, msg_frag, msg_frag_len, flag)
+            : kMESSAGE_UNKNOWN_CONNECTION;
+    }
+
+    UringConnection* connection = GetConnection(handle);
+    if (NULL == connection || URING_LISTEN_CONN == connection->_type) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+
+    return AppendSendData(connection, msg_frag_num, msg_frag, msg_frag_len);
+}
+
+int32_t UringMessageDriver::Recv(int64_t handle, uint8_t* msg_buff, uint32_t* buff_len,
+    MsgExternInfo* msg_info) {
+    if (!IsUringHandle(handle)) {
+        return m_raw_driver ? m_raw_driver->Recv(handle, msg_buff, buff_len, msg_info)
+            : kMESSAGE_UNKNOWN_CONNECTION;
+    }
+
+    const uint8_t* msg = NULL;
+    uint32_t msg_len = 0;
+    int32_t ret = Peek(handle, &msg, &msg_len, msg_info);
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (*buff_len < msg_len) {
+        return kMESSAGE_RECV_BUFF_NOT_ENOUGH;
+    }
+
+    memcpy(msg_buff, msg, msg_len);
+    *buff_len = msg_len;
+
+    return Pop(handle);
+}
+
+int32_t UringMessageDriver::Peek(int64_t handle, const uint8_t** msg, uint32_t* msg_len,
+    MsgExternInfo* msg_info) {
+    if (!IsUringHandle(handle)) {
+        return m_raw_driver ? m_raw_driver->Peek(handle, msg, msg_len, msg_info)
+            : kMESSAGE_UNKNOWN_CONNECTION;
+    }
+
+    UringConnection* connection = GetConnection(handle);
+    if (NULL == connection) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    if (!connection->_ready) {
+        return kMESSAGE_RECV_EMPTY;
+    }
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(connection->_recv_buff.data())
+        + connection->_read_pos;
+    const TcpMsgHead* head = reinterpret_cast<const TcpMsgHead*>(data);
+    *msg     = data + sizeof(TcpMsgHead);
+    *msg_len = ntohl(head->_data_len);
+
+    if (msg_info) {
+        msg_info->_self_handle = URING_ACCEPT_CONN == connection->_type
+            ? connection->_listen_handle : handle;
+        msg_info->_remote_handle  = handle;
+        msg_info->_msg_arrived_ms = connection->_msg_arrived_ms;
+    }
+
+    return 0;
+}
+
+int32_t UringMessageDriver::Pop(int64_t handle) {
+    if (!IsUringHandle(handle)) {
+        return m_raw_driver ? m_raw_driver->Pop(handle) : kMESSAGE_UNKNOWN_CONNECTION;
+    }
+
+    UringConnection* connection = GetConnection(handle);
+    if (NULL == connection) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    if (!connection->_ready) {
+        return kMESSAGE_RECV_EMPTY;
+    }
+
+    const TcpMsgHead* head = reinterpret_cast<const TcpMsgHead*>(
+        connection->_recv_buff.data() + connection->_read_pos);
+    connection->_read_pos += sizeof(TcpMsgHead) + ntohl(head->_data_len);
+    if (connection->_read_pos == connection->_recv_buff.size()) {
+        connection->_recv_buff.clear();
+        connection->_read_pos = 0;
+    }
+
+    if (!m_ready_handles.empty() && m_ready_handles.front() == handle) {
+        m_ready_handles.pop_front();
+    }
+    connection->_ready = false;
+
+    // 同一连接上还有完整消息时排到队尾，避免一个连接独占
+    int32_t ret = CheckRecvMsg(connection);
+    if (ret > 0) {
+        connection->_ready = true;
+        m_ready_handles.push_back(handle);
+    } else if (ret < 0) {
+        OnConnectionError(connection);
+    }
+
+    return 0;
+}
+
+int32_t UringMessageDriver::Close(int64_t handle) {
+    if (!IsUringHandle(handle)) {
+        return m_raw_driver ? m_raw_driver->Close(handle) : kMESSAGE_UNKNOWN_CONNECTION;
+    }
+
+    UringConnection* connection = GetConnection(handle);
+    if (NULL == connection) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+
+    CloseConnection(connection);
+    return 0;
+}
+
+int32_t UringMessageDriver::Poll(int64_t* handle, int32_t* event, int32_t timeout_ms) {
+    // 有UDP等raw地址时raw driver的epoll fd也放到ring中等待，一次等待同时覆盖两边
+    // poll请求在途说明上次raw侧已无消息且epoll fd还未就绪，不需要再检查raw侧
+    if (m_raw_driver && !m_raw_poll_armed) {
+        if (m_raw_driver->Poll(handle, event, 0) == 0) {
+            return 0;
+        }
+        if (m_raw_driver->HasPendingEvent()) {
+            timeout_ms = 0;
+        } else if (RingPrep(m_ring, URING_OP_POLL, m_raw_driver->GetPollFd(), NULL, 0,
+            MakeUserData(URING_OP_POLL, 0))) {
+            m_raw_poll_armed = true;
+        } else if (timeout_ms < 0 || timeout_ms > 1) {
+            // SQ满无法投递poll请求时退化为短超时轮询
+            timeout_ms = 1;
+        }
+    }
+
+    // 已有缓存消息时不阻塞，但仍需提交发送并收割完成事件
+    if (!m_ready_handles.empty()) {
+        timeout_ms = 0;
+    }
+
+    FlushSendData();
+    SubmitAndWait(timeout_ms);
+    ProcessCompletions();
+
+    while (!m_ready_handles.empty()) {
+        int64_t ready_handle = m_ready_handles.front();
+        UringConnection* connection = GetConnection(ready_handle);
+        if (connection && connection->_ready) {
+            *handle = ready_handle;
+            return 0;
+        }
+        m_ready_handles.pop_front();
+    }
+
+    // raw driver的epoll fd已就绪
+    if (m_raw_driver && !m_raw_poll_armed) {
+        return m_raw_driver->Poll(handle, event, 0);
+    }
+
+    return -1;
+}
+
+int32_t UringMessageDriver::GetUsedSize(int64_t handle, uint32_t* remain_size, uint32_t* max_size) {
+    return kMESSAGE_UNSUPPORT;
+}
+
+const char* UringMessageDriver::GetLastError() {
+    // 所有错误都输出到log
+    return NULL;
+}
+
+int32_t UringMessageDriver::Flush(int64_t handle) {
+    if (m_raw_driver) {
+        m_raw_driver->Flush(handle);
+    }
+
+    // 发送本来就在Poll时批量提交，这里提前提交所有连接的待发送数据
+    if (m_ring) {
+        FlushSendData();
+        SubmitAndWait(0);
+    }
+    return 0;
+}
+
+bool UringMessageDriver::IsUringHandle(int64_t handle) const {
+    return handle >= 0 && (handle & URING_HANDLE_FLAG) != 0;
+}
+
+int32_t UringMessageDriver::GetPeerCred(int64_t handle, int32_t* pid, uint32_t* uid, uint32_t* gid) {
+    if (IsUringHandle(handle)) {
+        return kMESSAGE_UNSUPPORT;
+    }
+    return m_raw_driver ? m_raw_driver->GetPeerCred(handle, pid, uid, gid)
+        : kMESSAGE_UNKNOWN_CONNECTION;
+}
+
+int32_t UringMessageDriver::ExportListenFd(int64_t handle) {
+    if (!IsUringHandle(handle)) {
+        return m_raw_driver ? m_raw_driver->ExportListenFd(handle) : kMESSAGE_UNKNOWN_CONNECTION;
+    }
+
+    UringConnection* connection = GetConnection(handle);
+    if (NULL == connection || URING_LISTEN_CONN != connection->_type || connection->_fd < 0) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    connection->_exported = true;
+    return connection->_fd;
+}
+
+int32_t UringMessageDriver::StopListen(int64_t handle) {
+    if (!IsUringHandle(handle)) {
+        return m_raw_driver ? m_raw_driver->StopListen(handle) : kMESSAGE_UNKNOWN_CONNECTION;
+    }
+
+    UringConnection* connection = GetConnection(handle);
+    if (NULL == connection || URING_LISTEN_CONN != connection->_type) {
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    // 已accept的连接只记录监听句柄的值，直接关闭监听连接不影响它们
+    CloseConnection(connection);
+    return 0;
+}
+
+int32_t UringMessageDriver::Prewarm(uint32_t conn_num, bool lock) {
+    // 连接对象按slot缓存复用，预先创建；接收使用共享的缓冲区环，写入其内存
+    while (m_free_slots.size() < conn_num) {
+        m_free_slots.push_back(m_connections.size());
+        m_connections.push_back(new UringConnection());
+    }
+
+#ifdef PEBBLE_HAVE_IO_URING
+    if (m_ring != NULL && m_ring->_bufs != NULL
+        && PrefaultMemory(m_ring->_bufs, m_ring->_buf_num * m_ring->_buf_size, lock) != 0) {
+        PLOG_ERROR("mlock buffer ring failed(%d:%s)", errno, strerror(errno));
+    }
+#endif
+
+    // 非tcp地址由raw driver处理
+    if (m_raw_driver != NULL) {
+        m_raw_driver->Prewarm(conn_num, lock);
+    }
+
+    return m_free_slots.size();
+}
+
+int32_t UringMessageDriver::GetConnectionPoolInfo(uint32_t* used_num, uint32_t* free_num) {
+    uint32_t raw_used = 0;
+    uint32_t raw_free = 0;
+    if (m_raw_driver != NULL) {
+        m_raw_driver->GetConnectionPoolInfo(&raw_used, &raw_free);
+    }
+    if (used_num) {
+        *used_num = m_connections.size() - m_free_slots.size() + raw_used;
+    }
+    if (free_num) {
+        *free_num = m_free_slots.size() + raw_free;
+    }
+    return 0;
+}
+
+RawMessageDriver* UringMessageDriver::GetRawDriver() {
+    if (NULL == m_raw_driver) {
+        RawMessageDriver* raw = RawMessageDriver::Instance();
+        if (raw->Init(m_msg_buff_len) != 0) {
+            PLOG_ERROR("raw message driver init failed");
+            return NULL;
+        }
+        m_raw_driver = raw;
+    }
+    return m_raw_driver;
+}
+
+UringConnection* UringMessageDriver::CreateConnection(int32_t fd, uint8_t type) {
+    uint32_t slot = 0;
+    if (!m_free_slots.empty()) {
+        slot = m_free_slots.back();
+        m_free_slots.pop_back();
+    } else {
+        slot = m_connections.size();
+        m_connections.push_back(new UringConnection());
+    }
+
+    UringConnection* connection = m_connections[slot];
+    connection->_handle = URING_HANDLE_FLAG
+        | (static_cast<int64_t>(connection->_generation) << 32) | slot;
+    connection->_fd     = fd;
+    connection->_type   = type;
+    connection->_closed = false;
+    connection->_connected = (URING_ACCEPT_CONN == type);
+    return connection;
+}
+
+UringConnection* UringMessageDriver::GetConnection(int64_t handle) {
+    uint32_t slot = static_cast<uint32_t>(handle & 0xFFFFFFFF);
+    if (slot >= m_connections.size()) {
+        return NULL;
+    }
+
+    UringConnection* connection = m_connections[slot];
+    if (connection->_closed || connection->_handle != handle) {
+        return NULL;
+    }
+    return connection;
+}
+
+void UringMessageDriver::CloseConnection(UringConnection* connection) {
+    if (connection->_closed) {
+        return;
+    }
+
+    connection->_closed = true;
+    connection->_ready  = false;
+
+    // 唤醒并取消该fd上所有在途请求，全部完成后才释放连接
+    // 已交给新进程的监听socket不能shutdown，否则新进程的监听也一起失效
+    if (connection->_fd >= 0) {
+        if (!connection->_exported) {
+            shutdown(connection->_fd, SHUT_RDWR);
+        }
+        if (connection->_pending_ops > 0
+            && RingPrep(m_ring, URING_OP_CANCEL, connection->_fd, NULL, 0,
+                MakeUserData(URING_OP_CANCEL, connection->_handle))) {
+            connection->_pending_ops++;
+        }
+    }
+
+    if (0 == connection->_pending_ops) {
+        ReleaseConnection(connection);
+    }
+}
+
+void UringMessageDriver::ReleaseConnection(UringConnection* connection) {
+    if (connection->_fd >= 0) {
+        close(connection->_fd);
+    }
+
+    uint32_t slot = static_cast<uint32_t>(connection->_handle & 0xFFFFFFFF);
+    uint16_t generation = connection->_generation + 1;
+
+    // 保留对象，复用slot，释放缓存
+    std::string().swap(connection->_recv_buff);
+    std::string().swap(connection->_send_buff);
+    std::string().swap(connection->_sending_buff);
+    *connection = UringConnection();
+    connection->_generation = generation;
+
+    m_free_slots.push_back(slot);
+}
+
+int32_t UringMessageDriver::Reconnect(UringConnection* connection) {
+    connection->_reconnecting = false;
+    if (connection->_fd >= 0) {
+        close(connection->_fd);
+        connection->_fd = -1;
+    }
+
+    // 在途数据中已完整发出的消息丢弃，发出一部分的消息从头开始，与未发出的数据一起在连接成功后重新发送
+    if (!connection->_sending_buff.empty()) {
+        uint32_t msg_begin = 0;
+        while (msg_begin + sizeof(TcpMsgHead) <= connection->_sent_len) {
+            const TcpMsgHead* head = reinterpret_cast<const TcpMsgHead*>(
+                connection->_sending_buff.data() + msg_begin);
+            uint32_t msg_end = msg_begin + sizeof(TcpMsgHead) + ntohl(head->_data_len);
+            if (msg_end > connection->_sent_len) {
+                break;
+            }
+            msg_begin = msg_end;
+        }
+        connection->_sending_buff.erase(0, msg_begin);
+        connection->_sending_buff.append(connection->_send_buff);
+        connection->_send_buff.swap(connection->_sending_buff);
+        connection->_sending_buff.clear();
+    }
+    connection->_sent_len = 0;
+
+    int32_t fd = socket(connection->_peer_addr.sin6_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        PLOG_ERROR("socket failed(%d:%s)", errno, strerror(errno));
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+    SetSocketOpt(fd, URING_CONNECT_CONN);
+
+    connection->_fd = fd;
+    connection->_reconnect_num++;
+    SubmitConnect(connection);
+    return 0;
+}
+
+int32_t UringMessageDriver::AppendSendData(UringConnection* connection, uint32_t msg_frag_num,
+    const uint8_t* msg_frag[], uint32_t msg_frag_len[]) {
+    uint32_t msg_len = 0;
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        msg_len += msg_frag_len[i];
+    }
+
+    if (connection->_send_buff.size() + sizeof(TcpMsgHead) + msg_len > MAX_SEND_BUFF_LEN) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "send buff full %lu, handle %ld",
+            connection->_send_buff.size(), connection->_handle);
+        return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
+    }
+
+    // 主动连接断开且不在重连中，发送时重新发起连接
+    if (URING_CONNECT_CONN == connection->_type && !connection->_connected
+        && !connection->_connecting && !connection->_reconnecting) {
+        connection->_reconnect_num = 0;
+        Reconnect(connection);
+    }
+
+    TcpMsgHead head;
+    head._magic    = htonl(head._magic);
+    head._version  = htonl(head._version);
+    head._data_len = htonl(msg_len);
+    connection->_send_buff.append(reinterpret_cast<const char*>(&head), sizeof(head));
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        connection->_send_buff.append(reinterpret_cast<const char*>(msg_frag[i]), msg_frag_len[i]);
+    }
+
+    if (!connection->_send_queued) {
+        connection->_send_queued = true;
+        m_send_handles.push_back(connection->_handle);
+    }
+
+    return 0;
+}
+
+void UringMessageDriver::SubmitAccept(UringConnection* connection) {
+    if (RingPrep(m_ring, URING_OP_ACCEPT, connection->_fd, NULL, 0,
+        MakeUserData(URING_OP_ACCEPT, connection->_handle))) {
+        connection->_pending_ops++;
+    } else {
+        PLOG_ERROR("submit accept failed, handle %ld", connection->_handle);
+    }
+}
+
+void UringMessageDriver::SubmitRecv(UringConnection* connection) {
+    if (RingPrep(m_ring, URING_OP_RECV, connection->_fd, NULL, 0,
+        MakeUserData(URING_OP_RECV, connection->_handle))) {
+        connection->_pending_ops++;
+    } else {
+        PLOG_ERROR("submit recv failed, handle %ld", connection->_handle);
+    }
+}
+
+void UringMessageDriver::SubmitSend(UringConnection* connection) {
+    if (connection->_sending || !connection->_connected) {
+        return;
+    }
+
+    if (connection->_sending_buff.empty()) {
+        connection->_sending_buff.swap(connection->_send_buff);
+        connection->_sent_len = 0;
+    }
+    if (connection->_sending_buff.empty()) {
+        return;
+    }
+
+    if (RingPrep(m_ring, URING_OP_SEND, connection->_fd,
+        connection->_sending_buff.data() + connection->_sent_len,
+        connection->_sending_buff.size() - connection->_sent_len,
+        MakeUserData(URING_OP_SEND, connection->_handle))) {
+        connection->_sending = true;
+        connection->_pending_ops++;
+    } else {
+        PLOG_ERROR_N_EVERY_SECOND(1, "submit send failed, handle %ld", connection->_handle);
+    }
+}
+
+void UringMessageDriver::SubmitConnect(UringConnection* connection) {
+    if (RingPrep(m_ring, URING_OP_CONNECT, connection->_fd, &connection->_peer_addr,
+        connection->_peer_addr_len, MakeUserData(URING_OP_CONNECT, connection->_handle))) {
+        connection->_connecting = true;
+        connection->_pending_ops++;
+    } else {
+        PLOG_ERROR("submit connect failed, handle %ld", connection->_handle);
+    }
+}
+
+void UringMessageDriver::FlushSendData() {
+    for (std::vector<int64_t>::iterator it = m_send_handles.begin(); it != m_send_handles.end(); ++it) {
+        UringConnection* connection = GetConnection(*it);
+        if (connection) {
+            connection->_send_queued = false;
+            SubmitSend(connection);
+        }
+    }
+    m_send_handles.clear();
+}
+
+int32_t UringMessageDriver::SubmitAndWait(int32_t timeout_ms) {
+    return RingEnter(m_ring, timeout_ms);
+}
+
+void UringMessageDriver::ProcessCompletions() {
+    uint64_t user_data = 0;
+    int32_t res  = 0;
+    bool more    = false;
+    int32_t bid  = -1;
+
+    while (RingPeek(m_ring, &user_data, &res, &more, &bid)) {
+        RingAdvance(m_ring);
+
+        uint8_t op = static_cast<uint8_t>(user_data >> 56);
+        if (URING_OP_POLL == op) {
+            m_raw_poll_armed = false;
+            if (res < 0) {
+                PLOG_ERROR_N_EVERY_SECOND(1, "poll raw driver failed(%d:%s)", -res, strerror(-res));
+            }
+            continue;
+        }
+
+        int64_t handle = URING_HANDLE_FLAG | static_cast<int64_t>(user_data & URING_HANDLE_MASK);
+        uint32_t slot = static_cast<uint32_t>(handle & 0xFFFFFFFF);
+        UringConnection* connection = slot < m_connections.size() ? m_connections[slot] : NULL;
+        if (NULL == connection || connection->_handle != handle) {
+            // 连接释放前会等所有请求完成，不应出现
+            PLOG_ERROR_N_EVERY_SECOND(1, "unknown completion op %d handle %ld", op, handle);
+            if (bid >= 0) {
+                RingProvideBuffer(m_ring, static_cast<uint16_t>(bid));
+            }
+            continue;
+        }
+
+        if (!more) {
+            connection->_pending_ops--;
+        }
+
+        switch (op) {
+            case URING_OP_ACCEPT:
+                OnAccept(connection, res, more);
+                break;
+            case URING_OP_RECV:
+                if (bid >= 0) {
+                    if (!connection->_closed && !connection->_reconnecting && res > 0) {
+                        OnDataArrived(connection, RingBuffer(m_ring, bid), res);
+                    }
+                    RingProvideBuffer(m_ring, static_cast<uint16_t>(bid));
+                }
+                OnRecv(connection, res, more);
+                break;
+            case URING_OP_SEND:
+                OnSend(connection, res);
+                break;
+            case URING_OP_CONNECT:
+                OnConnect(connection, res);
+                break;
+            default:
+                break;
+        }
+
+        // 连接可能已在回调中释放
+        if (connection->_handle == handle && 0 == connection->_pending_ops) {
+            if (connection->_closed) {
+                ReleaseConnection(connection);
+            } else if (connection->_reconnecting) {
+                Reconnect(connection);
+            }
+        }
+    }
+}
+
+void UringMessageDriver::OnAccept(UringConnection* connection, int32_t res, bool more) {
+    if (res >= 0) {
+        if (connection->_closed) {
+            close(res);
+        } else {
+            SetSocketOpt(res, URING_ACCEPT_CONN);
+            UringConnection* peer = CreateConnection(res, URING_ACCEPT_CONN);
+            peer->_listen_handle = connection->_handle;
+            SubmitRecv(peer);
+        }
+    } else if (!connection->_closed) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "accept failed(%d:%s), handle %ld",
+            -res, strerror(-res), connection->_handle);
+    }
+
+    // multishot accept结束后重新投递
+    if (!more && !connection->_closed) {
+        SubmitAccept(connection);
+    }
+}
+
+void UringMessageDriver::OnRecv(UringConnection* connection, int32_t res, bool more) {
+    if (connection->_closed || connection->_reconnecting) {
+        return;
+    }
+
+    if (0 == res || (res < 0 && res != -ENOBUFS)) {
+        // 对端关闭或出错
+        OnConnectionError(connection);
+        return;
+    }
+
+    // buffer不足(-ENOBUFS)或multishot被内核终止时重新投递
+    if (!more) {
+        SubmitRecv(connection);
+    }
+}
+
+void UringMessageDriver::OnSend(UringConnection* connection, int32_t res) {
+    connection->_sending = false;
+    if (connection->_closed || connection->_reconnecting) {
+        return;
+    }
+
+    if (res < 0) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "send failed(%d:%s), handle %ld",
+            -res, strerror(-res), connection->_handle);
+        OnConnectionError(connection);
+        return;
+    }
+
+    connection->_sent_len += res;
+    if (connection->_sent_len >= connection->_sending_buff.size()) {
+        connection->_sending_buff.clear();
+        connection->_sent_len = 0;
+    }
+
+    SubmitSend(connection);
+}
+
+void UringMessageDriver::OnConnect(UringConnection* connection, int32_t res) {
+    connection->_connecting = false;
+    if (connection->_closed) {
+        return;
+    }
+
+    if (0 == res) {
+        connection->_connected = true;
+        connection->_reconnect_num = 0;
+        SubmitRecv(connection);
+        SubmitSend(connection);
+        return;
+    }
+
+    PLOG_ERROR_N_EVERY_SECOND(1, "connect failed(%d:%s), handle %ld",
+        -res, strerror(-res), connection->_handle);
+    if (connection->_reconnect_num < NetIO::AUTO_RECONNECT) {
+        connection->_reconnecting = true;
+    }
+}
+
+void UringMessageDriver::OnDataArrived(UringConnection* connection, const uint8_t* data, uint32_t len) {
+    // 已处理的数据前移，Peek出的消息指针在下一次Poll前有效
+    if (connection->_read_pos > 0) {
+        connection->_recv_buff.erase(0, connection->_read_pos);
+        connection->_read_pos = 0;
+    }
+    connection->_recv_buff.append(reinterpret_cast<const char*>(data), len);
+
+    if (connection->_ready) {
+        return;
+    }
+
+    int32_t ret = CheckRecvMsg(connection);
+    if (ret > 0) {
+        MarkReady(connection);
+    } else if (ret < 0) {
+        OnConnectionError(connection);
+    }
+}
+
+void UringMessageDriver::OnConnectionError(UringConnection* connection) {
+    // 被动连接直接关闭，由对端重连
+    if (URING_CONNECT_CONN != connection->_type) {
+        CloseConnection(connection);
+        return;
+    }
+
+    // 主动连接等在途请求完成后自动重连，未发完的消息保留，重连成功后重新发送
+    connection->_connected    = false;
+    connection->_reconnecting = true;
+    connection->_ready        = false;
+    connection->_reconnect_num = 0;
+    connection->_recv_buff.clear();
+    connection->_read_pos = 0;
+
+    if (connection->_fd >= 0) {
+        shutdown(connection->_fd, SHUT_RDWR);
+        if (connection->_pending_ops > 0
+            && RingPrep(m_ring, URING_OP_CANCEL, connection->_fd, NULL, 0,
+                MakeUserData(URING_OP_CANCEL, connection->_handle))) {
+            connection->_pending_ops++;
+        }
+    }
+
+    if (0 == connection->_pending_ops) {
+        Reconnect(connection);
+    }
+}
+
+void UringMessageDriver::MarkReady(UringConnection* connection) {
+    connection->_ready = true;
+    connection->_msg_arrived_ms = TimeUtility::GetCachedMS();
+    m_ready_handles.push_back(connection->_handle);
+}
+
+int32_t UringMessageDriver::CheckRecvMsg(UringConnection* connection) {
+    uint32_t remain = connection->_recv_buff.size() - connection->_read_pos;
+    if (remain < sizeof(TcpMsgHead)) {
+        return 0;
+    }
+
+    const TcpMsgHead* head = reinterpret_cast<const TcpMsgHead*>(
+        connection->_recv_buff.data() + connection->_read_pos);
+    uint32_t data_len = ntohl(head->_data_len);
+    if (ntohl(head->_magic) != TCP_HEAD_MAGIC || data_len + sizeof(TcpMsgHead) > m_msg_buff_len) {
+        PLOG_ERROR_N_EVERY_SECOND(1, "recv invalid msg head, magic 0x%x len %u, handle %ld",
+            ntohl(head->_magic), data_len, connection->_handle);
+        return -1;
+    }
+
+    return remain >= sizeof(TcpMsgHead) + data_len ? 1 : 0;
+}
+
+
+} // namespace pebble
+
@@ -0,0 +1,180 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#ifndef _PEBBLE_COMMON_URING_MESSAGE_DRIVER_H_
+#define _PEBBLE_COMMON_URING_MESSAGE_DRIVER_H_
+
+#include <deque>
+#include <vector>
+#include "framework/message.h"
+
+
+namespace pebble {
+
+class RawMessageDriver;
+struct UringRing;
+struct UringConnection;
+
+/// @brief 基于io_uring的TCP网络驱动，消息格式与RawMessageDriver相同(TcpMsgHead + data)
+/// @note 依赖内核multishot accept/recv及provided buffer ring(linux 6.0+)，
+///     Init失败时由上层回退到RawMessageDriver；UDP和unix域socket地址直接交给内部的RawMessageDriver处理
+/// @note 发送数据先缓存在连接上，在下一次Poll时批量提交，一次io_uring_enter完成提交和收割
+class UringMessageDriver : public MessageDriver {
+protected:
+    UringMessageDriver();
+    UringMessageDriver(const UringMessageDriver& rhs) {}
+public:
+    // 默认接收缓冲区为2M，单个消息不能超过此长度
+    static const int32_t DEFAULT_MSG_BUFF_LEN = 1024 * 1024 * 2;
+    // SQ/CQ队列长度
+    static const uint32_t RING_ENTRIES = 1024;
+    // provided buffer ring的buffer个数和单个buffer大小
+    static const uint32_t RECV_BUFF_NUM  = 512;
+    static const uint32_t RECV_BUFF_SIZE = 8 * 1024;
+    // 单个连接待发送数据上限
+    static const uint32_t MAX_SEND_BUFF_LEN = 64 * 1024 * 1024;
+
+    virtual ~UringMessageDriver();
+
+    /// @brief 每个线程一个实例，多worker模式下各worker独立收发
+    static UringMessageDriver* Instance() {
+        if (NULL == m_instance) {
+            m_instance = new UringMessageDriver();
+        }
+        return m_instance;
+    }
+
+    /// @brief 释放当前线程的实例，关闭其上的所有连接，worker线程退出前调用
+    static void ReleaseInstance();
+
+    /// @brief 检查内核能力并初始化io_uring
+    /// @return 0 成功
+    /// @return kMESSAGE_UNSUPPORT 当前内核或编译环境不支持
+    int32_t Init(uint32_t msg_buff_len = DEFAULT_MSG_BUFF_LEN);
+
+    virtual int64_t Bind(const std::string& url);
+
+    virtual int64_t Connect(const std::string& url);
+
+    virtual int32_t Send(int64_t handle, const uint8_t* msg, uint32_t msg_len, int32_t flag);
+
+    virtual int32_t SendV(int64_t handle, uint32_t msg_frag_num,
+                          const uint8_t* msg_frag[], uint32_t msg_frag_len[], int32_t flag);
+
+    virtual int32_t Recv(int64_t handle, uint8_t* msg_buff, uint32_t* buff_len,
+                         MsgExternInfo* msg_info);
+
+    virtual int32_t Peek(int64_t handle, const uint8_t** msg, uint32_t* msg_len,
+                         MsgExternInfo* msg_info);
+
+    virtual int32_t Pop(int64_t handle);
+
+    virtual int32_t Close(int64_t handle);
+
+    virtual int32_t Poll(int64_t* handle, int32_t* event, int32_t timeout_ms);
+
+    virtual int32_t ReportHandleResult(int64_t handle, int32_t result, int64_t time_cost)
+    { return kMESSAGE_UNINSTALL_DRIVER; }
+
+    virtual int32_t GetUsedSize(int64_t handle, uint32_t* remain_size, uint32_t* max_size);
+
+    virtual const char* GetLastError();
+
+    virtual int32_t Flush(int64_t handle);
+
+    virtual int32_t GetPeerCred(int64_t handle, int32_t* pid, uint32_t* uid, uint32_t* gid);
+
+    virtual int32_t ExportListenFd(int64_t handle);
+
+    virtual int32_t StopListen(int64_t handle);
+
+    virtual int32_t Prewarm(uint32_t conn_num, bool lock);
+
+    virtual int32_t GetConnectionPoolInfo(uint32_t* used_num, uint32_t* free_num);
+
+private:
+    bool IsUringHandle(int64_t handle) const;
+
+    RawMessageDriver* GetRawDriver();
+
+    UringConnection* CreateConnection(int32_t fd, uint8_t type);
+
+    UringConnection* GetConnection(int64_t handle);
+
+    void CloseConnection(UringConnection* connection);
+
+    void ReleaseConnection(UringConnection* connection);
+
+    int32_t Reconnect(UringConnection* connection);
+
+    int32_t AppendSendData(UringConnection* connection, uint32_t msg_frag_num,
+                           const uint8_t* msg_frag[], uint32_t msg_frag_len[]);
+
+    void SubmitAccept(UringConnection* connection);
+
+    void SubmitRecv(UringConnection* connection);
+
+    void SubmitSend(UringConnection* connection);
+
+    void SubmitConnect(UringConnection* connection);
+
+    void FlushSendData();
+
+    int32_t SubmitAndWait(int32_t timeout_ms);
+
+    void ProcessCompletions();
+
+    void OnAccept(UringConnection* connection, int32_t res, bool more);
+
+    void OnRecv(UringConnection* connection, int32_t res, bool more);
+
+    void OnSend(UringConnection* connection, int32_t res);
+
+    void OnConnect(UringConnection* connection, int32_t res);
+
+    void OnDataArrived(UringConnection* connection, const uint8_t* data, uint32_t len);
+
+    void OnConnectionError(UringConnection* connection);
+
+    void MarkReady(UringConnection* connection);
+
+    /// @return 1 有完整消息，0 消息不完整，<0 消息头非法
+    int32_t CheckRecvMsg(UringConnection* connection);
+
+private:
+    UringRing* m_ring;
+    uint32_t m_msg_buff_len;
+
+    // 连接表，slot复用，handle中带generation防止误用已关闭连接
+    std::vector<UringConnection*> m_connections;
+    std::vector<uint32_t> m_free_slots;
+
+    // 有完整消息待处理的连接
+    std::deque<int64_t> m_ready_handles;
+    // 有待发送数据的连接
+    std::vector<int64_t> m_send_handles;
+
+    // UDP、unix域socket等非TCP地址使用raw driver
+    RawMessageDriver* m_raw_driver;
+    // 已向ring投递等待raw driver的epoll fd可读的poll请求，尚未完成
+    bool m_raw_poll_armed;
+
+    static __thread UringMessageDriver* m_instance;
+};
+
+
+} // namespace pebble
+
+#endif // _PEBBLE_COMMON_URING_MESSAGE_DRIVER_H_
+
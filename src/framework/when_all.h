@@ -17,11 +17,12 @@
 
 #include <vector>
 #include "common/platform.h"
+#include "common/function.h"
 #include "common/log.h"
 
 namespace pebble {
 
-typedef cxx::function<int32_t(uint32_t*, uint32_t*)> Call;
+typedef Function<int32_t(uint32_t*, uint32_t*)> Call;
 
 template <typename ServiceMethod,
           typename Stub,
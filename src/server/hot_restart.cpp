@@ -0,0 +1,377 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "common/log.h"
+#include "common/net_util.h"
+#include "common/time_utility.h"
+#include "framework/message.h"
+#include "server/hot_restart.h"
+
+
+namespace pebble {
+
+static const uint32_t HOT_RESTART_MAGIC = 0x50424852;   // "PBHR"
+static const char HOT_RESTART_READY = 'R';
+// 内核限制一次最多传253个fd(SCM_MAX_FD)
+static const uint32_t HOT_RESTART_MAX_FD_NUM = 250;
+// 旧进程在主循环中响应，等待超过这个时间按失败处理
+static const int32_t HOT_RESTART_TIMEOUT_S = 5;
+// 驱动不支持WatchFd时的检查间隔
+static const int64_t HOT_RESTART_CHECK_INTERVAL_MS = 100;
+
+/// @brief 旧进程发给新进程的消息头，fd通过SCM_RIGHTS随消息传递：[0]为热重启地址的监听socket，其余为Bind的监听socket
+struct HotRestartHead {
+    uint32_t _magic;
+    uint32_t _fd_num;
+    int32_t  _pid;
+};
+
+static int32_t MakeSockAddr(const std::string& address, struct sockaddr_un* addr, socklen_t* addr_len) {
+    bool abstract = !address.empty() && '@' == address[0];
+    if (address.size() < 2 || address.size() >= sizeof(addr->sun_path)) {
+        return -1;
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, address.data(), address.size());
+    if (abstract) {
+        addr->sun_path[0] = '\0';
+        *addr_len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + address.size());
+    } else {
+        *addr_len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + address.size() + 1);
+    }
+    return 0;
+}
+
+static bool IsFilePath(const std::string& address) {
+    return !address.empty() && address[0] != '@';
+}
+
+HotRestart::HotRestart()
+    : m_stale(false), m_listen_fd(-1), m_peer_fd(-1), m_listen_ready(false), m_peer_ready(false),
+      m_watched(false), m_last_check_ms(0), m_handed_off(false), m_hand_off_ms(0) {
+}
+
+HotRestart::~HotRestart() {
+    ClosePeer();
+    if (m_listen_fd >= 0) {
+        if (m_watched) {
+            Message::UnwatchFd(m_listen_fd);
+        }
+        close(m_listen_fd);
+        // 已交给新进程时m_listen_fd为-1，路径归新进程使用
+        if (IsFilePath(m_address)) {
+            unlink(m_address.c_str());
+        }
+    }
+}
+
+int32_t HotRestart::Takeover(const std::string& address) {
+    m_address = address;
+
+    struct sockaddr_un addr;
+    socklen_t addr_len = 0;
+    if (MakeSockAddr(address, &addr, &addr_len) != 0) {
+        PLOG_ERROR("invalid hot restart address %s", address.c_str());
+        m_address.clear();
+        return -1;
+    }
+
+    int32_t fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        PLOG_ERROR("create socket failed(%d)", errno);
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len) != 0) {
+        int32_t err = errno;
+        close(fd);
+        // 没有旧进程，首次启动
+        if (ENOENT == err || ECONNREFUSED == err) {
+            m_stale = (ECONNREFUSED == err);
+            return 0;
+        }
+        PLOG_ERROR("connect hot restart address %s failed(%d)", address.c_str(), err);
+        return -1;
+    }
+
+    struct timeval timeout = { HOT_RESTART_TIMEOUT_S, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    HotRestartHead head;
+    memset(&head, 0, sizeof(head));
+    int32_t fds[HOT_RESTART_MAX_FD_NUM];
+    char cmsg_buf[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { &head, sizeof(head) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsg_buf;
+    msg.msg_controllen = sizeof(cmsg_buf);
+    ssize_t ret = 0;
+    do {
+        ret = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (ret < 0 && EINTR == errno);
+
+    uint32_t fd_num = 0;
+    struct cmsghdr* cmsg = (ret > 0) ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cmsg && SOL_SOCKET == cmsg->cmsg_level && SCM_RIGHTS == cmsg->cmsg_type) {
+        fd_num = static_cast<uint32_t>((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int32_t));
+        memcpy(fds, CMSG_DATA(cmsg), fd_num * sizeof(int32_t));
+    }
+
+    if (ret != sizeof(head) || head._magic != HOT_RESTART_MAGIC
+        || head._fd_num != fd_num || 0 == fd_num) {
+        PLOG_ERROR("receive listen sockets from %s failed(ret=%ld errno=%d fd_num=%u)",
+            address.c_str(), ret, errno, fd_num);
+        for (uint32_t i = 0; i < fd_num; ++i) {
+            close(fds[i]);
+        }
+        close(fd);
+        return -1;
+    }
+
+    m_listen_fd = fds[0];
+    for (uint32_t i = 1; i < fd_num; ++i) {
+        NetIO::AddInheritedFd(fds[i]);
+    }
+    m_peer_fd = fd;
+
+    PLOG_INFO("take over %u listen sockets from process %d", fd_num - 1, head._pid);
+    return static_cast<int32_t>(fd_num - 1);
+}
+
+void HotRestart::AddListenHandle(int64_t handle) {
+    m_listen_handles.push_back(handle);
+}
+
+void HotRestart::RemoveListenHandle(int64_t handle) {
+    for (std::vector<int64_t>::iterator it = m_listen_handles.begin();
+        it != m_listen_handles.end(); ++it) {
+        if (*it == handle) {
+            m_listen_handles.erase(it);
+            return;
+        }
+    }
+}
+
+int32_t HotRestart::Ready() {
+    if (m_address.empty()) {
+        return -1;
+    }
+
+    uint32_t unused = NetIO::CloseInheritedFds();
+    PLOG_IF_ERROR(unused > 0, "%u inherited listen sockets not bound again, closed", unused);
+
+    // 通知旧进程停止接收，通知失败时旧进程会继续接收，和本进程一起服务
+    if (m_peer_fd >= 0) {
+        char ready = HOT_RESTART_READY;
+        PLOG_IF_ERROR(send(m_peer_fd, &ready, sizeof(ready), MSG_NOSIGNAL) != sizeof(ready),
+            "notify old process failed(%d)", errno);
+        ClosePeer();
+    }
+
+    if (m_listen_fd < 0) {
+        if (Listen() != 0) {
+            return -1;
+        }
+    } else {
+        fcntl(m_listen_fd, F_SETFL, fcntl(m_listen_fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    m_watched = (0 == Message::WatchFd(m_listen_fd, EPOLLIN,
+        cxx::bind(&HotRestart::OnFdEvent, this, cxx::placeholders::_1, cxx::placeholders::_2)));
+    m_last_check_ms = TimeUtility::GetCachedMS();
+    return 0;
+}
+
+int32_t HotRestart::Update() {
+    if (m_listen_fd < 0 && m_peer_fd < 0) {
+        return 0;
+    }
+
+    if (!m_watched) {
+        int64_t now = TimeUtility::GetCachedMS();
+        if (now - m_last_check_ms < HOT_RESTART_CHECK_INTERVAL_MS) {
+            return 0;
+        }
+        m_last_check_ms = now;
+        m_listen_ready = true;
+        m_peer_ready   = true;
+    }
+
+    int32_t num = 0;
+    if (m_peer_ready) {
+        m_peer_ready = false;
+        num += OnPeerEvent();
+    }
+    if (m_listen_ready) {
+        m_listen_ready = false;
+        num += OnAccept();
+    }
+    return num;
+}
+
+int32_t HotRestart::Listen() {
+    struct sockaddr_un addr;
+    socklen_t addr_len = 0;
+    MakeSockAddr(m_address, &addr, &addr_len);
+
+    int32_t fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        PLOG_ERROR("create socket failed(%d)", errno);
+        return -1;
+    }
+
+    int32_t ret = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len);
+    // 上次异常退出遗留的路径，Takeover时已确认没有进程在监听
+    if (ret != 0 && EADDRINUSE == errno && m_stale) {
+        unlink(m_address.c_str());
+        ret = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len);
+    }
+    if (ret != 0 || listen(fd, 8) != 0) {
+        PLOG_ERROR("listen hot restart address %s failed(%d)", m_address.c_str(), errno);
+        close(fd);
+        return -1;
+    }
+
+    m_listen_fd = fd;
+    return 0;
+}
+
+int32_t HotRestart::OnAccept() {
+    if (m_listen_fd < 0) {
+        return 0;
+    }
+    int32_t fd = accept4(m_listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    // 同时只处理一个新进程
+    if (m_peer_fd >= 0 || m_handed_off) {
+        PLOG_ERROR("hot restart is in progress, reject the new one");
+        close(fd);
+        return 1;
+    }
+
+    std::vector<int32_t> fds;
+    fds.push_back(m_listen_fd);
+    for (std::vector<int64_t>::iterator it = m_listen_handles.begin();
+        it != m_listen_handles.end() && fds.size() < HOT_RESTART_MAX_FD_NUM; ++it) {
+        int32_t listen_fd = Message::ExportListenFd(*it);
+        if (listen_fd < 0) {
+            PLOG_ERROR("export listen handle %ld failed(%d)", *it, listen_fd);
+            continue;
+        }
+        fds.push_back(listen_fd);
+    }
+    PLOG_IF_ERROR(fds.size() - 1 < m_listen_handles.size(),
+        "only %lu of %lu listen sockets can be handed over", fds.size() - 1, m_listen_handles.size());
+
+    HotRestartHead head;
+    head._magic  = HOT_RESTART_MAGIC;
+    head._fd_num = static_cast<uint32_t>(fds.size());
+    head._pid    = getpid();
+
+    std::vector<char> cmsg_buf(CMSG_SPACE(sizeof(int32_t) * fds.size()), 0);
+    struct iovec iov = { &head, sizeof(head) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &cmsg_buf[0];
+    msg.msg_controllen = cmsg_buf.size();
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int32_t) * fds.size());
+    memcpy(CMSG_DATA(cmsg), &fds[0], sizeof(int32_t) * fds.size());
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(head)) {
+        PLOG_ERROR("send listen sockets failed(%d)", errno);
+        close(fd);
+        return 1;
+    }
+
+    m_peer_fd = fd;
+    if (m_watched) {
+        Message::WatchFd(m_peer_fd, EPOLLIN,
+            cxx::bind(&HotRestart::OnFdEvent, this, cxx::placeholders::_1, cxx::placeholders::_2));
+    }
+
+    PLOG_INFO("hand %lu listen sockets over to new process", fds.size() - 1);
+    return 1;
+}
+
+int32_t HotRestart::OnPeerEvent() {
+    if (m_peer_fd < 0) {
+        return 0;
+    }
+    char ready = 0;
+    ssize_t ret = recv(m_peer_fd, &ready, sizeof(ready), 0);
+    if (ret < 0 && (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno)) {
+        return 0;
+    }
+
+    if (sizeof(ready) == ret && HOT_RESTART_READY == ready) {
+        // 新进程已开始服务，本进程不再接收新连接，已有连接继续处理
+        for (std::vector<int64_t>::iterator it = m_listen_handles.begin();
+            it != m_listen_handles.end(); ++it) {
+            int32_t stop_ret = Message::StopListen(*it);
+            PLOG_IF_ERROR(stop_ret != 0, "stop listen handle %ld failed(%d)", *it, stop_ret);
+        }
+        if (m_watched) {
+            Message::UnwatchFd(m_listen_fd);
+        }
+        close(m_listen_fd);
+        m_listen_fd   = -1;
+        m_handed_off  = true;
+        m_hand_off_ms = TimeUtility::GetCachedMS();
+        PLOG_INFO("new process is ready, stop accepting");
+    } else {
+        PLOG_ERROR("new process quit before ready(ret=%ld errno=%d), keep serving", ret, errno);
+    }
+
+    ClosePeer();
+    return 1;
+}
+
+void HotRestart::OnFdEvent(int32_t fd, uint32_t events) {
+    if (fd == m_listen_fd) {
+        m_listen_ready = true;
+    } else if (fd == m_peer_fd) {
+        m_peer_ready = true;
+    }
+}
+
+void HotRestart::ClosePeer() {
+    if (m_peer_fd < 0) {
+        return;
+    }
+    if (m_watched) {
+        Message::UnwatchFd(m_peer_fd);
+    }
+    close(m_peer_fd);
+    m_peer_fd = -1;
+}
+
+} // namespace pebble
@@ -0,0 +1,99 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#ifndef _PEBBLE_SERVER_HOT_RESTART_H_
+#define _PEBBLE_SERVER_HOT_RESTART_H_
+
+#include <string>
+#include <vector>
+#include "common/platform.h"
+
+
+namespace pebble {
+
+/// @brief 热重启：新进程通过unix域socket从旧进程接收监听socket(SCM_RIGHTS)，重启期间监听不中断
+/// @note 流程：
+///     1. 新进程Init时Takeover，连上旧进程的热重启地址，收到旧进程所有Bind的监听socket，
+///        登记到NetIO，之后Bind相同地址时直接使用，不再新建socket
+///     2. 新进程Serve前Ready，通知旧进程，并接管热重启地址等待下一次重启
+///     3. 旧进程收到通知后在自己的监听句柄上停止接收(Message::StopListen，不影响新进程)，
+///        已建立的连接继续处理，在途请求处理完后退出
+/// @note 已建立的连接不迁移，由旧进程处理完后关闭，客户端重连到新进程
+/// @note 地址为unix域socket路径，以'@'开头为抽象命名空间
+/// @note 新进程在Ready前退出时，旧进程继续服务
+class HotRestart {
+public:
+    HotRestart();
+    ~HotRestart();
+
+    /// @brief 新进程初始化时调用，需在任何Bind之前
+    /// @param address 热重启地址，多worker时各worker使用不同的地址
+    /// @return >=0 从旧进程接收的监听socket个数，没有旧进程时为0
+    /// @return <0 失败，此时按首次启动处理
+    int32_t Takeover(const std::string& address);
+
+    /// @brief 记录Bind成功的句柄，热重启时交给新进程
+    void AddListenHandle(int64_t handle);
+
+    void RemoveListenHandle(int64_t handle);
+
+    /// @brief 初始化完成，开始服务前调用：通知旧进程交接完成，关闭未使用的继承socket，并开始在热重启地址上监听
+    /// @return 0 成功
+    /// @return <0 失败，不影响服务，只是不能再热重启
+    int32_t Ready();
+
+    /// @brief 在主循环中调用，处理新进程的接管请求
+    /// @return 处理的事件数
+    int32_t Update();
+
+    /// @brief 是否已把监听socket交给新进程，此后应在处理完在途请求后退出
+    bool IsHandedOff() const { return m_handed_off; }
+
+    /// @brief 交出监听socket的时间(ms)
+    int64_t GetHandOffTimeMs() const { return m_hand_off_ms; }
+
+private:
+    /// @brief 接受新进程的连接，发送监听socket
+    /// @return 处理的连接数
+    int32_t OnAccept();
+
+    /// @brief 读取新进程的通知，完成交接或在新进程失败时恢复
+    /// @return 处理的事件数
+    int32_t OnPeerEvent();
+
+    /// @brief WatchFd的回调，只记录事件，在Update中处理
+    void OnFdEvent(int32_t fd, uint32_t events);
+
+    /// @brief 在热重启地址上新建监听
+    int32_t Listen();
+
+    void ClosePeer();
+
+private:
+    std::string m_address;
+    bool    m_stale;                // 地址是上次异常退出遗留的路径，可以删除
+    int32_t m_listen_fd;
+    int32_t m_peer_fd;              // 旧进程中为接管中的新进程连接，新进程中为到旧进程的连接
+    bool    m_listen_ready;
+    bool    m_peer_ready;
+    bool    m_watched;
+    int64_t m_last_check_ms;
+    bool    m_handed_off;
+    int64_t m_hand_off_ms;
+    std::vector<int64_t> m_listen_handles;
+};
+
+} // namespace pebble
+
+#endif // _PEBBLE_SERVER_HOT_RESTART_H_
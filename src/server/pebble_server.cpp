@@ -12,18 +12,23 @@
  */
 
 #include <algorithm>
+#include <errno.h>
 #include <iostream>
+#include <poll.h>
 #include <sstream>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include "common/coroutine.h"
 #include "common/cpu.h"
 #include "common/ini_reader.h"
 #include "common/log.h"
 #include "common/memory.h"
+#include "common/net_util.h"
 #include "common/string_utility.h"
+#include "common/thread.h"
 #include "common/time_utility.h"
 #include "common/timer.h"
 #include "framework/broadcast_mgr.h"
@@ -33,11 +38,15 @@
 #include "framework/message.h"
 #include "framework/monitor.h"
 #include "framework/pebble_rpc.h"
+#include "framework/raw_message_driver.h"
 #include "framework/register_error.h"
 #include "framework/session.h"
+#include "framework/shm_message_driver.h"
 #include "framework/stat.h"
 #include "framework/stat_manager.h"
+#include "framework/uring_message_driver.h"
 #include "pebble_version.inh"
+#include "server/hot_restart.h"
 #include "server/pebble_server.h"
 #include "src/server/control__PebbleControl.h"
 #include "version.inh"
@@ -56,17 +65,32 @@ const char* GetVersion() {
 }
 
 
-static struct {
-    int32_t _stop;
-    int32_t _reload;
-} g_app_events = { 0, 0 };
+struct AppEvents {
+    volatile int32_t _stop;
+    volatile int32_t _reload;
+};
+
+static AppEvents g_app_events = { 0, 0 };
+
+// 多worker模式下唤醒主线程的eventfd，主线程阻塞等待信号和worker退出
+static int32_t g_group_wakeup_fd = -1;
+
+static void pebble_wakeup_group() {
+    if (g_group_wakeup_fd >= 0) {
+        uint64_t value = 1;
+        ssize_t ret = write(g_group_wakeup_fd, &value, sizeof(value));
+        (void)ret;
+    }
+}
 
 void pebble_on_stop(int32_t signal) {
     g_app_events._stop = signal;
+    pebble_wakeup_group();
 }
 
 void pebble_on_reload(int32_t signal) {
     g_app_events._reload = 1;
+    pebble_wakeup_group();
 }
 
 // 独立的控制命令RPC服务处理类，只是纯通道，不关心具体的命令，所有的命令处理都有外部注册
@@ -79,7 +103,8 @@ public:
     int32_t RegisterCommand(const OnControlCommand& on_cmd, const std::string& cmd,
         const std::string& desc, bool internal = false);
     virtual void RunCommand(const ControlRequest& req,
-        cxx::function<void(int32_t ret_code, const ControlResponse& response)>& rsp);
+        Function<void(int32_t ret_code, const ControlResponse& response),
+            RPC_RESPONSE_INLINE_SIZE>& rsp);
 
 private:
     void OnControlHelp(const std::vector<std::string>& options, int32_t* ret_code, std::string* data);
@@ -169,7 +194,8 @@ int32_t PebbleControlHandler::Init() {
 }
 
 void PebbleControlHandler::RunCommand(const ControlRequest& req,
-    cxx::function<void(int32_t ret_code, const ControlResponse& response)>& rsp) {
+    Function<void(int32_t ret_code, const ControlResponse& response),
+        RPC_RESPONSE_INLINE_SIZE>& rsp) {
 
     ControlResponse response;
 
@@ -310,6 +336,11 @@ PebbleServer::PebbleServer() {
     m_is_overload             = kNO_OVERLOAD;
     m_broadcast_event_handler = NULL;
     m_control_handler         = NULL;
+    m_hot_restart             = NULL;
+    m_last_active_us          = 0;
+    m_worker_index            = -1;
+    m_app_events              = &g_app_events;
+    m_stat_master             = NULL;
 
     for (int32_t i = 0; i < kNAMING_BUTT; ++i) {
         m_naming_array[i] = NULL;
@@ -322,6 +353,8 @@ PebbleServer::PebbleServer() {
 
 PebbleServer::~PebbleServer() {
     // delete的原则: 如果出现重复delete说明逻辑实现有问题，通过crash暴露出来，赋NULL可能掩盖问题
+    delete m_hot_restart;
+
     for (cxx::unordered_map<std::string, Router*>::iterator it = m_router_map.begin();
         it != m_router_map.end(); ++it) {
         delete it->second;
@@ -360,9 +393,11 @@ int32_t PebbleServer::Init(AppEventHandler* event_handler) {
 
     m_event_handler = event_handler;
 
-    RegisterErrorString();
-
-    InitLog();
+    // 多worker模式下错误描述和log由主线程在启动worker前统一设置
+    if (m_worker_index < 0) {
+        RegisterErrorString();
+        InitLog();
+    }
 
     PLOG_INFO("%s", m_options.ToString().c_str());
 
@@ -375,7 +410,11 @@ int32_t PebbleServer::Init(AppEventHandler* event_handler) {
     ret = InitStat();
     CHECK_RETURN(ret);
 
-    ret = Message::Init();
+    ret = InitMessageDriver();
+    CHECK_RETURN(ret);
+
+    // 需在用户Bind之前接管旧进程的监听socket
+    ret = InitHotRestart();
     CHECK_RETURN(ret);
 
     InitMonitor();
@@ -399,6 +438,9 @@ int32_t PebbleServer::Init(AppEventHandler* event_handler) {
 int64_t PebbleServer::Bind(const std::string &url) {
     int64_t handle = Message::Bind(url);
     PLOG_IF_ERROR(handle < 0, "bind %s failed(%ld:%s)", url.c_str(), handle, Message::GetLastError());
+    if (handle >= 0 && m_hot_restart) {
+        m_hot_restart->AddListenHandle(handle);
+    }
     // tbuspp升级后bind时默认就注册名字了
     return handle;
 }
@@ -412,24 +454,43 @@ int64_t PebbleServer::Connect(const std::string &url) {
 int32_t PebbleServer::Close(int64_t handle) {
     int32_t ret = Message::Close(handle);
     PLOG_IF_ERROR(ret != 0, "close %ld failed(%s)", handle, Message::GetLastError());
+    if (m_hot_restart) {
+        m_hot_restart->RemoveListenHandle(handle);
+    }
     return ret;
 }
 
 void PebbleServer::Serve() {
-    // 运行在服务模式时，接管USR1/USR2信号
-    signal(SIGUSR1, pebble_on_stop);
-    signal(SIGUSR2, pebble_on_reload);
+    // 运行在服务模式时，接管USR1/USR2信号，多worker模式下信号由主线程接管
+    if (m_worker_index < 0) {
+        signal(SIGUSR1, pebble_on_stop);
+        signal(SIGUSR2, pebble_on_reload);
+    }
+
+    Prewarm();
+
+    // 初始化完成，通知旧进程停止接收
+    if (m_hot_restart) {
+        m_hot_restart->Ready();
+    }
 
     do {
-        if (g_app_events._stop) {
+        // 监听已交给新进程，在途请求处理完后按收到停止信号处理
+        if (m_hot_restart && m_hot_restart->IsHandedOff()
+            && !m_app_events->_stop && IsHotRestartDrained()) {
+            PLOG_INFO("hot restart drained, stop");
+            m_app_events->_stop = SIGUSR1;
+        }
+
+        if (m_app_events->_stop) {
             if (Stop() == 0) {
-                g_app_events._stop = 0;
+                m_app_events->_stop = 0;
                 break;
             }
         }
 
-        if (g_app_events._reload) {
-            g_app_events._reload = 0;
+        if (m_app_events->_reload) {
+            m_app_events->_reload = 0;
             Reload();
         }
 
@@ -464,7 +525,7 @@ int32_t PebbleServer::Attach(Router* router, IProcessor* processor) {
 }
 
 PebbleRpc* PebbleServer::GetPebbleRpc(ProtocolType protocol_type) {
-    if (protocol_type < kPEBBLE_RPC_BINARY || protocol_type > kPEBBLE_RPC_PROTOBUF) {
+    if (protocol_type < kPEBBLE_RPC_BINARY || protocol_type > kPEBBLE_RPC_COMPACT) {
         PLOG_ERROR("param protocol_type invalid(%d)", protocol_type);
         return NULL;
     }
@@ -492,6 +553,10 @@ PebbleRpc* PebbleServer::GetPebbleRpc(ProtocolType protocol_type) {
             rpc_code_type = kCODE_PB;
             break;
 
+        case kPEBBLE_RPC_COMPACT:
+            rpc_code_type = kCODE_COMPACT;
+            break;
+
         default:
             PLOG_FATAL("unsupport protocol type %d", protocol_type);
             return NULL;
@@ -501,6 +566,7 @@ PebbleRpc* PebbleServer::GetPebbleRpc(ProtocolType protocol_type) {
     rpc_instance->SetSendFunction(Message::Send, Message::SendV);
     rpc_instance->SetEventHandler(m_rpc_event_handler);
     rpc_instance->SetProcRequestTimeoutMS(m_options._proc_req_timeout_ms);
+    rpc_instance->SetBatchMode(m_options._rpc_batch_mode);
     m_processor_array[protocol_type] = rpc_instance;
 
     return rpc_instance;
@@ -538,6 +604,11 @@ Naming* PebbleServer::GetNaming(NamingType naming_type) {
     m_naming_array[naming_type] = factory->GetNaming(
         m_options._bc_zk_host, m_options._bc_zk_timeout_ms);
 
+    // 接入主循环: 协程内的同步名字操作让出协程，名字服务连接fd加入epoll，避免阻塞所有请求
+    if (m_naming_array[naming_type] != NULL) {
+        m_naming_array[naming_type]->AttachEventLoop(m_coroutine_schedule, Message::WatchFd);
+    }
+
     return m_naming_array[naming_type];
 }
 
@@ -580,7 +651,9 @@ int32_t PebbleServer::Stop() {
 int32_t PebbleServer::Update() {
     int32_t num = 0;
 
-    int64_t old = TimeUtility::GetCurrentUS();
+    // 每轮刷新一次缓存时钟，本轮内的消息处理、超时检查都使用这个时间
+    TimeUtility::UpdateCachedTime();
+    int64_t old = TimeUtility::GetCachedUS();
 
     Log::Instance().SetCurrentTime(old);
 
@@ -614,21 +687,32 @@ int32_t PebbleServer::Update() {
     int64_t user_begin = 0;
     int64_t user_end = 0;
     if (m_event_handler) {
-        user_begin = TimeUtility::GetCurrentUS();
+        user_begin = TimeUtility::GetMonotonicUS();
         num += m_event_handler->OnUpdate();
-        user_end = TimeUtility::GetCurrentUS();
+        user_end = TimeUtility::GetMonotonicUS();
     }
 
     if (m_broadcast_mgr) {
         num += m_broadcast_mgr->Update(m_is_overload);
     }
 
+    if (m_hot_restart) {
+        num += m_hot_restart->Update();
+    }
+
+    // 本周期内cork缓存的发送数据统一发出
+    Message::Flush();
+
     if (m_stat_manager) {
         num += m_stat_manager->Update();
-        m_stat_manager->GetStat()->AddResourceItem("_loop", (TimeUtility::GetCurrentUS() - old) / 1000);
+        m_stat_manager->GetStat()->AddResourceItem("_loop", (TimeUtility::GetMonotonicUS() - old) / 1000);
         m_stat_manager->GetStat()->AddResourceItem("_user_loop", (user_end - user_begin) / 1000);
     }
 
+    if (num > 0) {
+        m_last_active_us = old;
+    }
+
     return num;
 }
 
@@ -650,7 +734,9 @@ int32_t PebbleServer::Reload() {
     PLOG_INFO("%s", m_options.ToString().c_str());
 
     // log
-    InitLog();
+    if (m_worker_index < 0) {
+        InitLog();
+    }
 
     // stat
     m_stat_manager->SetReportCycle(m_options._stat_report_cycle_s);
@@ -662,10 +748,12 @@ int32_t PebbleServer::Reload() {
     m_message_expire_monitor->SetExpireThreshold(m_options._message_expire_ms);
 
     // rpc
-    for (int i = kPEBBLE_RPC_BINARY; i <= kPEBBLE_RPC_PROTOBUF; i++) {
+    for (int i = kPEBBLE_RPC_BINARY; i <= kPEBBLE_RPC_COMPACT; i++) {
         if (m_processor_array[i]) {
             (dynamic_cast<PebbleRpc*>(m_processor_array[i]))
                 ->SetProcRequestTimeoutMS(m_options._proc_req_timeout_ms);
+            (dynamic_cast<PebbleRpc*>(m_processor_array[i]))
+                ->SetBatchMode(m_options._rpc_batch_mode);
         }
     }
 
@@ -681,16 +769,62 @@ void PebbleServer::Idle() {
         return;
     }
 
+    // 低时延场景，处理过消息后的一段时间内继续忙轮询
+    if (m_options._busy_poll_us > 0
+        && TimeUtility::GetMonotonicUS() - m_last_active_us < m_options._busy_poll_us) {
+        return;
+    }
+
     Log::Instance().Flush();
     oss::CLogDataAPI::Flush();
 
-    usleep(m_options._idle_us);
+    if (0 == m_options._idle_wait_ms) {
+        usleep(m_options._idle_us);
+        return;
+    }
+
+    // 阻塞在网络事件上，有消息到达或最近的定时器超时即返回
+    // 收到的消息缓存在连接上，在下一轮Update中处理
+    int64_t handle = -1;
+    int32_t event  = 0;
+    Message::Poll(&handle, &event, GetIdleWaitMS());
+}
+
+int32_t PebbleServer::GetIdleWaitMS() {
+    int64_t wait_ms = m_options._idle_wait_ms;
+    int64_t next_timeout[] = {
+        m_timer ? m_timer->GetNextTimeoutMS() : -1,
+        m_session_mgr ? m_session_mgr->GetNextTimeoutMS() : -1,
+        m_stat_manager ? m_stat_manager->GetNextTimeoutMS() : -1,
+    };
+
+    for (uint32_t i = 0; i < sizeof(next_timeout) / sizeof(next_timeout[0]); ++i) {
+        if (next_timeout[i] >= 0 && next_timeout[i] < wait_ms) {
+            wait_ms = next_timeout[i];
+        }
+    }
+
+    for (int32_t i = 0; i < kPROTOCOL_TYPE_BUTT; ++i) {
+        if (m_processor_array[i]) {
+            int64_t timeout = m_processor_array[i]->GetNextTimeoutMS();
+            if (timeout >= 0 && timeout < wait_ms) {
+                wait_ms = timeout;
+            }
+        }
+    }
+
+    return static_cast<int32_t>(wait_ms);
 }
 
 int32_t PebbleServer::ProcessMessage() {
     int64_t handle = -1;
     int32_t event  = 0;
     int32_t ret = Message::Poll(&handle, &event, 0);
+    if (kMESSAGE_SEND_FAILED == ret) {
+        // udp攒批的回包发送失败，Send时已返回成功，这里报告后继续处理后续事件
+        PLOG_ERROR_N_EVERY_SECOND(1, "deferred udp reply to handle(%ld) send failed", handle);
+        return 1;
+    }
     if (ret != 0) {
         return 0;
     }
@@ -758,6 +892,7 @@ int32_t PebbleServer::InitCoSchedule() {
 int32_t PebbleServer::InitStat() {
     if (!m_stat_manager) {
         m_stat_manager = new StatManager();
+        m_stat_manager->SetMaster(m_stat_master);
     }
 
     m_stat_manager->SetReportCycle(m_options._stat_report_cycle_s);
@@ -768,6 +903,87 @@ int32_t PebbleServer::InitStat() {
         m_options._app_program_id, m_options._app_instance_id, m_options._gdata_log_path);
 }
 
+int32_t PebbleServer::InitMessageDriver() {
+    // 需在监听前设置，raw和io_uring驱动都生效
+    NetIO::IPV6_ONLY = m_options._app_ipv6_only;
+
+    if (m_options._app_use_io_uring) {
+        UringMessageDriver* driver = UringMessageDriver::Instance();
+        if (driver->Init() == 0) {
+            Message::SetMessageDriver(driver);
+            PLOG_INFO("use io_uring message driver");
+        } else {
+            PLOG_INFO("io_uring not support, fall back to raw message driver");
+        }
+    }
+
+    int32_t ret = Message::Init();
+    if (ret != 0) {
+        return ret;
+    }
+
+    // io_uring驱动本身在Poll时合并提交发送，cork只对raw驱动生效
+    if (m_options._app_send_cork_bytes > 0) {
+        RawMessageDriver::Instance()->SetSendCork(m_options._app_send_cork_bytes);
+    }
+    RawMessageDriver::Instance()->SetAcceptBatch(m_options._app_accept_batch);
+    if (m_options._app_edge_trigger) {
+        RawMessageDriver::Instance()->SetEdgeTrigger(true, m_options._app_read_ahead_bytes);
+    }
+
+    // 压缩同样只对raw驱动的TCP连接生效，不支持时仅告警，按不压缩运行
+    if (m_options._app_compress_type != kCOMPRESS_NONE) {
+        ret = RawMessageDriver::Instance()->SetCompress(
+            static_cast<CompressType>(m_options._app_compress_type), m_options._app_compress_threshold);
+        PLOG_IF_ERROR(ret != 0, "set compress type %d failed(%d)", m_options._app_compress_type, ret);
+    }
+
+    // 共享内存驱动叠加在已选的驱动之上，只接管"shm://"地址
+    if (m_options._app_use_shm) {
+        ShmMessageDriver* shm_driver = ShmMessageDriver::Instance();
+        ret = shm_driver->Init(Message::GetMessageDriver());
+        if (ret != 0) {
+            PLOG_ERROR("shm message driver init failed(%d)", ret);
+            return ret;
+        }
+        shm_driver->SetSpinUs(m_options._app_shm_spin_us);
+        Message::SetMessageDriver(shm_driver);
+    }
+    return 0;
+}
+
+int32_t PebbleServer::InitHotRestart() {
+    if (m_options._app_hot_restart_address.empty()) {
+        return 0;
+    }
+
+    // 多worker时各worker各自接管自己的监听socket
+    std::string address(m_options._app_hot_restart_address);
+    if (m_worker_index >= 0) {
+        std::ostringstream oss;
+        oss << address << "." << m_worker_index;
+        address = oss.str();
+    }
+
+    m_hot_restart = new HotRestart();
+    int32_t ret = m_hot_restart->Takeover(address);
+    // 接管失败按首次启动处理，旧进程仍在监听时Bind会失败
+    PLOG_IF_ERROR(ret < 0, "take over from %s failed(%d)", address.c_str(), ret);
+    return 0;
+}
+
+bool PebbleServer::IsHotRestartDrained() {
+    // 交出监听后一段时间内没有新消息才认为处理完，长连接上持续有请求时等到超时
+    static const int64_t kHOT_RESTART_QUIET_US = 100 * 1000;
+
+    int64_t now_ms = TimeUtility::GetCachedMS();
+    if (now_ms - m_hot_restart->GetHandOffTimeMs() >= m_options._app_hot_restart_drain_ms) {
+        return true;
+    }
+    return m_coroutine_schedule->Size() == 0
+        && TimeUtility::GetCachedUS() - m_last_active_us >= kHOT_RESTART_QUIET_US;
+}
+
 void PebbleServer::InitMonitor() {
     if (!m_task_monitor) {
         m_task_monitor = new TaskMonitor();
@@ -802,6 +1018,39 @@ int32_t PebbleServer::InitTimer() {
     return 0;
 }
 
+void PebbleServer::Prewarm() {
+    bool lock = m_options._app_prewarm_mlock;
+    int64_t begin_ms = TimeUtility::GetMonotonicMS();
+
+    int32_t co_num = 0;
+    if (m_coroutine_schedule && m_options._co_prewarm_num > 0) {
+        co_num = m_coroutine_schedule->Prewarm(m_options._co_prewarm_num, lock);
+    }
+
+    int32_t conn_num = 0;
+    if (m_options._app_prewarm_connection_num > 0) {
+        conn_num = Message::Prewarm(m_options._app_prewarm_connection_num, lock);
+        PLOG_IF_ERROR(conn_num < 0, "prewarm connection failed(%d:%s)", conn_num, Message::GetLastError());
+    }
+
+    // 只预热已创建(用户已使用)的rpc实例
+    if (m_options._rpc_prewarm_session_num > 0 || m_options._rpc_prewarm_buff_bytes > 0) {
+        for (int32_t i = kPEBBLE_RPC_BINARY; i <= kPEBBLE_RPC_COMPACT; i++) {
+            IRpc* rpc = dynamic_cast<IRpc*>(m_processor_array[i]);
+            if (rpc != NULL) {
+                rpc->Prewarm(m_options._rpc_prewarm_session_num, m_options._rpc_prewarm_buff_bytes, lock);
+            }
+        }
+    }
+
+    if (co_num > 0 || conn_num > 0
+        || m_options._rpc_prewarm_session_num > 0 || m_options._rpc_prewarm_buff_bytes > 0) {
+        PLOG_INFO("prewarm coroutine %d, connection %d, rpc session %u buff %u, lock %d, cost %ld ms",
+            co_num, conn_num, m_options._rpc_prewarm_session_num, m_options._rpc_prewarm_buff_bytes,
+            lock, TimeUtility::GetMonotonicMS() - begin_ms);
+    }
+}
+
 INIReader* PebbleServer::GetINIReader() {
     if (!m_ini_reader) {
         m_ini_reader = new INIReader();
@@ -829,9 +1078,25 @@ int32_t PebbleServer::LoadOptionsFromIni(const std::string& file_name) {
     m_options._app_unit_id = ini_reader->GetInt32(kSectionApp, kAppUnitId, m_options._app_unit_id);
     m_options._app_program_id = ini_reader->GetInt32(kSectionApp, kAppProgramId, m_options._app_program_id);
     m_options._app_ctrl_cmd_addr = ini_reader->Get(kSectionApp, kAppCtrlCmdAddr, m_options._app_ctrl_cmd_addr);
+    m_options._app_worker_num = ini_reader->GetUInt32(kSectionApp, kAppWorkerNum, m_options._app_worker_num);
+    m_options._app_use_io_uring = ini_reader->GetBoolean(kSectionApp, kAppUseIoUring, m_options._app_use_io_uring);
+    m_options._app_send_cork_bytes = ini_reader->GetUInt32(kSectionApp, kAppSendCorkBytes, m_options._app_send_cork_bytes);
+    m_options._app_compress_type = ini_reader->GetInt32(kSectionApp, kAppCompressType, m_options._app_compress_type);
+    m_options._app_compress_threshold = ini_reader->GetUInt32(kSectionApp, kAppCompressThreshold, m_options._app_compress_threshold);
+    m_options._app_accept_batch = ini_reader->GetUInt32(kSectionApp, kAppAcceptBatch, m_options._app_accept_batch);
+    m_options._app_edge_trigger = ini_reader->GetBoolean(kSectionApp, kAppEdgeTrigger, m_options._app_edge_trigger);
+    m_options._app_read_ahead_bytes = ini_reader->GetUInt32(kSectionApp, kAppReadAheadBytes, m_options._app_read_ahead_bytes);
+    m_options._app_use_shm = ini_reader->GetBoolean(kSectionApp, kAppUseShm, m_options._app_use_shm);
+    m_options._app_shm_spin_us = ini_reader->GetUInt32(kSectionApp, kAppShmSpinUs, m_options._app_shm_spin_us);
+    m_options._app_ipv6_only = ini_reader->GetBoolean(kSectionApp, kAppIpv6Only, m_options._app_ipv6_only);
+    m_options._app_hot_restart_address = ini_reader->Get(kSectionApp, kAppHotRestartAddress, m_options._app_hot_restart_address);
+    m_options._app_hot_restart_drain_ms = ini_reader->GetUInt32(kSectionApp, kAppHotRestartDrainMs, m_options._app_hot_restart_drain_ms);
+    m_options._app_prewarm_connection_num = ini_reader->GetUInt32(kSectionApp, kAppPrewarmConnectionNum, m_options._app_prewarm_connection_num);
+    m_options._app_prewarm_mlock = ini_reader->GetBoolean(kSectionApp, kAppPrewarmMlock, m_options._app_prewarm_mlock);
 
     // coroutine
     m_options._co_stack_size_bytes = ini_reader->GetUInt32(kSectionCoroutine, kCoStackSize, m_options._co_stack_size_bytes);
+    m_options._co_prewarm_num = ini_reader->GetUInt32(kSectionCoroutine, kCoPrewarmNum, m_options._co_prewarm_num);
 
     // log
     m_options._log_device = ini_reader->Get(kSectionLog, kLogDevice, m_options._log_device);
@@ -853,6 +1118,8 @@ int32_t PebbleServer::LoadOptionsFromIni(const std::string& file_name) {
     m_options._task_threshold = ini_reader->GetUInt32(kSectionFlowControl, kTaskThreshold, m_options._task_threshold);
     m_options._message_expire_ms = ini_reader->GetUInt32(kSectionFlowControl, kMessageExpireMs, m_options._message_expire_ms);
     m_options._idle_us = ini_reader->GetUInt32(kSectionFlowControl, kIdleUs, m_options._idle_us);
+    m_options._idle_wait_ms = ini_reader->GetUInt32(kSectionFlowControl, kIdleWaitMs, m_options._idle_wait_ms);
+    m_options._busy_poll_us = ini_reader->GetUInt32(kSectionFlowControl, kBusyPollUs, m_options._busy_poll_us);
 
     // broadcast
     m_options._bc_relay_address = ini_reader->Get(kSectionBroadcast, kBcRelayAddress, m_options._bc_relay_address);
@@ -861,6 +1128,9 @@ int32_t PebbleServer::LoadOptionsFromIni(const std::string& file_name) {
 
     // rpc
     m_options._proc_req_timeout_ms = ini_reader->GetUInt32(kSectionRpc, kProcReqTimeoutMs, m_options._proc_req_timeout_ms);
+    m_options._rpc_batch_mode = ini_reader->GetBoolean(kSectionRpc, kRpcBatchMode, m_options._rpc_batch_mode);
+    m_options._rpc_prewarm_session_num = ini_reader->GetUInt32(kSectionRpc, kRpcPrewarmSessionNum, m_options._rpc_prewarm_session_num);
+    m_options._rpc_prewarm_buff_bytes = ini_reader->GetUInt32(kSectionRpc, kRpcPrewarmBuffBytes, m_options._rpc_prewarm_buff_bytes);
 
     return 0;
 }
@@ -871,6 +1141,8 @@ int32_t PebbleServer::OnStatTimeout() {
     StatMemory(stat);
     StatCoroutine(stat);
     StatProcessorResource(stat);
+    StatCompress(stat);
+    StatUdpSend(stat);
 
     return m_stat_timer_ms;
 }
@@ -945,6 +1217,35 @@ void PebbleServer::StatProcessorResource(Stat* stat) {
     }
 }
 
+void PebbleServer::StatCompress(Stat* stat) {
+    if (m_options._app_compress_type == kCOMPRESS_NONE) {
+        return;
+    }
+
+    RawMessageDriver::CompressStat compress_stat;
+    RawMessageDriver::Instance()->GetCompressStat(&compress_stat);
+    if (compress_stat._raw_bytes > 0) {
+        stat->AddResourceItem("_compress_ratio(%)",
+            compress_stat._compressed_bytes * 100.0 / compress_stat._raw_bytes);
+    }
+    stat->AddResourceItem("_compress_cpu(us)", compress_stat._compress_us);
+    stat->AddResourceItem("_decompress_cpu(us)", compress_stat._decompress_us);
+}
+
+void PebbleServer::StatUdpSend(Stat* stat) {
+    uint64_t batch_num    = 0;
+    uint64_t datagram_num = 0;
+    uint64_t failed_num   = 0;
+    RawMessageDriver::Instance()->GetUdpSendStat(&batch_num, &datagram_num, &failed_num);
+    // 没有udp listen回包时不输出
+    if (0 == datagram_num) {
+        return;
+    }
+    stat->AddResourceItem("_udp_send_batch", batch_num);
+    stat->AddResourceItem("_udp_send_datagram", datagram_num);
+    stat->AddResourceItem("_udp_send_failed", failed_num);
+}
+
 SessionMgr* PebbleServer::GetSessionMgr() {
     if (!m_session_mgr) {
         m_session_mgr = new SessionMgr();
@@ -1029,8 +1330,8 @@ int32_t PebbleServer::InitControlService() {
         return 0;
     }
 
-    // 未配置控制命令监听地址，不启动控制命令服务
-    if (m_options._app_ctrl_cmd_addr.empty()) {
+    // 未配置控制命令监听地址，不启动控制命令服务；多worker模式下只由0号worker提供
+    if (m_options._app_ctrl_cmd_addr.empty() || m_worker_index > 0) {
         return 0;
     }
 
@@ -1083,10 +1384,17 @@ int32_t PebbleServer::InitControlService() {
         true);
     RETURN_IF_ERROR(ret != 0, ret, "register log failed.");
 
+    ret = m_control_handler->RegisterCommand(
+        cxx::bind(&PebbleServer::OnControlPool, this, _1, _2, _3), "pool",
+        "pool               # print coroutine, connection buffer and rpc session pool occupancy\n"
+        "                   # of worker 0 in multi worker mode, no option",
+        true);
+    RETURN_IF_ERROR(ret != 0, ret, "register pool failed.");
+
     return 0;
 }
 
-int32_t PebbleServer::MakeCoroutine(const cxx::function<void()>& routine) {
+int32_t PebbleServer::MakeCoroutine(const Function<void()>& routine) {
     if (!m_coroutine_schedule) {
         PLOG_ERROR("coroutine schedule is null");
         return -1;
@@ -1126,6 +1434,14 @@ void PebbleServer::SetControlCommandAcl(bool auth, const std::vector<std::string
 void PebbleServer::OnControlReload(const std::vector<std::string>& options,
     int32_t* ret_code, std::string* data) {
 
+    // 多worker模式下由主线程统一转发给各worker
+    if (m_worker_index >= 0) {
+        g_app_events._reload = 1;
+        *ret_code = 0;
+        data->assign("reload triggered.");
+        return;
+    }
+
     if (Reload() != 0) {
         *ret_code = -1;
         data->assign("reload failed.");
@@ -1177,6 +1493,39 @@ void PebbleServer::OnControlLog(const std::vector<std::string>& options,
     return;
 }
 
+void PebbleServer::OnControlPool(const std::vector<std::string>& options,
+    int32_t* ret_code, std::string* data) {
+    std::ostringstream oss;
+    if (m_coroutine_schedule) {
+        oss << "coroutine : running " << m_coroutine_schedule->Size()
+            << ", idle " << m_coroutine_schedule->IdleSize()
+            << ", prewarm " << m_options._co_prewarm_num << std::endl;
+    }
+
+    uint32_t used_num = 0;
+    uint32_t free_num = 0;
+    if (Message::GetConnectionPoolInfo(&used_num, &free_num) == 0) {
+        oss << "connection : used " << used_num << ", free " << free_num
+            << ", prewarm " << m_options._app_prewarm_connection_num << std::endl;
+    }
+
+    static const char* rpc_names[] = { "binary", "json", "protobuf", "compact" };
+    for (int32_t i = kPEBBLE_RPC_BINARY; i <= kPEBBLE_RPC_COMPACT; i++) {
+        IRpc* rpc = dynamic_cast<IRpc*>(m_processor_array[i]);
+        if (NULL == rpc) {
+            continue;
+        }
+        uint32_t session_num = 0;
+        uint32_t bucket_num  = 0;
+        rpc->GetSessionInfo(&session_num, &bucket_num);
+        oss << "rpc(" << rpc_names[i] << ") session : used " << session_num
+            << ", buckets " << bucket_num << std::endl;
+    }
+
+    *ret_code = 0;
+    data->assign(oss.str());
+}
+
 MsgExternInfo* PebbleServer::GetLastMessageInfo() {
     return &m_last_msg_info;
 }
@@ -1186,6 +1535,216 @@ int32_t PebbleServer::Detach(int64_t handle) {
     return num == 1 ? 0 : -1;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class PebbleServerGroup::WorkerThread : public Thread {
+public:
+    WorkerThread(PebbleServerGroup* group, uint32_t index)
+        : m_group(group), m_index(index), m_server(NULL), m_exited(false) {
+        m_events._stop   = 0;
+        m_events._reload = 0;
+    }
+
+    virtual ~WorkerThread() {}
+
+    virtual void Run() {
+        // 消息驱动、协程调度等线程私有资源均在worker线程中创建
+        m_server = new PebbleServer();
+        m_server->m_options       = *(m_group->GetOptions());
+        m_server->m_ini_file_name = m_group->m_master->m_ini_file_name;
+        m_server->m_worker_index  = m_index;
+        m_server->m_app_events    = &m_events;
+        m_server->m_stat_master   = m_group->m_master->m_stat_manager;
+
+        AppEventHandler* event_handler = NULL;
+        if (m_group->m_factory) {
+            event_handler = m_group->m_factory(m_index);
+        }
+
+        if (m_server->Init(event_handler) != 0) {
+            PLOG_ERROR("worker %u init failed", m_index);
+            g_app_events._stop = SIGUSR1;
+        } else {
+            PLOG_INFO("worker %u start", m_index);
+            m_server->Serve();
+            PLOG_INFO("worker %u stop", m_index);
+        }
+
+        delete m_server;
+        m_server = NULL;
+        delete event_handler;
+
+        // 消息驱动为线程私有，worker退出时释放，关闭其上的socket
+        Message::SetMessageDriver(NULL);
+        ShmMessageDriver::ReleaseInstance();
+        UringMessageDriver::ReleaseInstance();
+        RawMessageDriver::ReleaseInstance();
+        m_exited = true;
+        pebble_wakeup_group();
+    }
+
+    AppEvents* GetEvents() {
+        return &m_events;
+    }
+
+    bool IsExited() const {
+        return m_exited;
+    }
+
+private:
+    PebbleServerGroup* m_group;
+    uint32_t      m_index;
+    PebbleServer* m_server;
+    AppEvents     m_events;
+    volatile bool m_exited;
+};
+
+PebbleServerGroup::PebbleServerGroup() {
+    m_master = new PebbleServer();
+}
+
+PebbleServerGroup::~PebbleServerGroup() {
+    for (std::vector<WorkerThread*>::iterator it = m_workers.begin(); it != m_workers.end(); ++it) {
+        delete *it;
+    }
+    delete m_master;
+}
+
+int32_t PebbleServerGroup::LoadOptionsFromIni(const std::string& file_name) {
+    return m_master->LoadOptionsFromIni(file_name);
+}
+
+Options* PebbleServerGroup::GetOptions() {
+    return m_master->GetOptions();
+}
+
+int32_t PebbleServerGroup::Init(const AppEventHandlerFactory& factory) {
+    if (!factory) {
+        PLOG_ERROR("param factory is null");
+        return -1;
+    }
+    m_factory = factory;
+
+    RegisterErrorString();
+    m_master->InitLog();
+
+    Options* options = GetOptions();
+    PLOG_INFO("%s", options->ToString().c_str());
+
+    if (options->_app_worker_num < 1) {
+        options->_app_worker_num = 1;
+    }
+
+    // 各worker的统计数据汇总到master的StatManager统一输出
+    if (m_master->InitStat() != 0) {
+        return -1;
+    }
+
+    // 多个worker监听同一地址
+    if (options->_app_worker_num > 1) {
+        NetIO::REUSE_PORT = true;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    return 0;
+}
+
+void PebbleServerGroup::Serve() {
+    // 主线程阻塞在eventfd上，信号和worker退出时唤醒，统计周期到时超时返回
+    g_group_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_group_wakeup_fd < 0) {
+        PLOG_ERROR("create eventfd failed(%d), wait by timeout", errno);
+    }
+
+    signal(SIGUSR1, pebble_on_stop);
+    signal(SIGUSR2, pebble_on_reload);
+
+    uint32_t worker_num = GetOptions()->_app_worker_num;
+    for (uint32_t i = 0; i < worker_num; ++i) {
+        WorkerThread* worker = new WorkerThread(this, i);
+        if (!worker->Start()) {
+            PLOG_ERROR("start worker %u failed", i);
+            delete worker;
+            g_app_events._stop = SIGUSR1;
+            break;
+        }
+        m_workers.push_back(worker);
+    }
+
+    while (true) {
+        Update();
+
+        bool all_exited = true;
+        for (std::vector<WorkerThread*>::iterator it = m_workers.begin();
+            it != m_workers.end(); ++it) {
+            all_exited = all_exited && (*it)->IsExited();
+        }
+        if (all_exited) {
+            break;
+        }
+
+        // 信号先置标记再写eventfd，Update之后到达的信号也会让poll立即返回
+        int32_t wait_ms = static_cast<int32_t>(m_master->m_stat_manager->GetNextTimeoutMS());
+        if (g_group_wakeup_fd < 0 && (wait_ms < 0 || wait_ms > 10)) {
+            wait_ms = 10;
+        }
+        struct pollfd wakeup;
+        wakeup.fd      = g_group_wakeup_fd;
+        wakeup.events  = POLLIN;
+        wakeup.revents = 0;
+        if (poll(&wakeup, 1, wait_ms) > 0) {
+            uint64_t value = 0;
+            ssize_t ret = read(g_group_wakeup_fd, &value, sizeof(value));
+            (void)ret;
+        }
+    }
+
+    for (std::vector<WorkerThread*>::iterator it = m_workers.begin(); it != m_workers.end(); ++it) {
+        (*it)->Join();
+    }
+
+    if (g_group_wakeup_fd >= 0) {
+        close(g_group_wakeup_fd);
+        g_group_wakeup_fd = -1;
+    }
+
+    PLOG_INFO("all workers stopped");
+    Log::Instance().Flush();
+}
+
+void PebbleServerGroup::Update() {
+    // 信号转发给各worker，stop由各worker自行判断是否允许
+    if (g_app_events._stop) {
+        int32_t stop = g_app_events._stop;
+        g_app_events._stop = 0;
+        for (std::vector<WorkerThread*>::iterator it = m_workers.begin();
+            it != m_workers.end(); ++it) {
+            (*it)->GetEvents()->_stop = stop;
+        }
+    }
+
+    if (g_app_events._reload) {
+        g_app_events._reload = 0;
+        if (!m_master->m_ini_file_name.empty()
+            && m_master->LoadOptionsFromIni(m_master->m_ini_file_name) == 0) {
+            m_master->InitLog();
+            m_master->m_stat_manager->SetReportCycle(GetOptions()->_stat_report_cycle_s);
+            m_master->m_stat_manager->SetGdataParameter(GetOptions()->_stat_report_to_gdata,
+                GetOptions()->_gdata_id, GetOptions()->_gdata_log_id);
+        }
+        for (std::vector<WorkerThread*>::iterator it = m_workers.begin();
+            it != m_workers.end(); ++it) {
+            (*it)->GetEvents()->_reload = 1;
+        }
+    }
+
+    Log::Instance().SetCurrentTime(TimeUtility::GetMonotonicUS());
+    m_master->m_stat_manager->Update();
+    Log::Instance().Flush();
+    oss::CLogDataAPI::Flush();
+}
+
 
 }  // namespace pebble
 
@@ -33,6 +33,7 @@ class _PebbleBroadcastClient;
 class BroadcastMgr;
 class BroadcastRelayHandler;
 class CoroutineSchedule;
+class HotRestart;
 class IEventHandler;
 class INIReader;
 class IProcessor;
@@ -42,6 +43,7 @@ class Naming;
 class NamingFactory;
 class PebbleControlHandler;
 class PebbleServer;
+class PebbleServerGroup;
 class PipeProcessor;
 class RouterFactory;
 class SessionMgr;
@@ -49,6 +51,7 @@ class Stat;
 class StatManager;
 class TaskMonitor;
 class Timer;
+struct AppEvents;
 
 
 //////////////////////////////////////////////////////////////////////////////////////
@@ -111,6 +114,7 @@ typedef enum {
     kPEBBLE_RPC_BINARY = 0, // thrift binary编码协议
     kPEBBLE_RPC_JSON,       // thrift json编码协议
     kPEBBLE_RPC_PROTOBUF,   // protobuf编码协议
+    kPEBBLE_RPC_COMPACT,    // thrift compact编码协议
     kPEBBLE_PIPE,           // pipe协议，pipe是接入gconnd的私有协议，上面承载其他rpc编码协议
     kPROTOCOL_TYPE_BUTT
 } ProtocolType;
@@ -129,6 +133,7 @@ typedef cxx::function<void(const std::vector<std::string>& options,
 
 /// @brief PebbleApp的一个实现，本身为一个通用的Pebble server程序，聚合了Pebble的各功能模块
 class PebbleServer {
+    friend class PebbleServerGroup;
 public:
     PebbleServer();
     ~PebbleServer();
@@ -155,6 +160,8 @@ public:
     ///     "http://127.0.0.1:8880[/service]"
     ///     "tcp://127.0.0.1:8880"
     ///     "udp://127.0.0.1:8880"
+    ///     "tcp://[::1]:8880"(ipv6地址写在"[]"中)
+    ///     "unix:///var/run/app.sock"(同机进程间，"unix://@app"为抽象命名空间)
     /// @return >=0 表示成功
     /// @return <0 表示失败，错误码@see MessageErrorCode
     /// @note 原生tcp/udp与tbuspp协议只能二选一
@@ -167,6 +174,8 @@ public:
     ///     "http://127.0.0.1:8880[/service]"
     ///     "tcp://127.0.0.1:8880"
     ///     "udp://127.0.0.1:8880"
+    ///     "tcp://[::1]:8880"(ipv6地址写在"[]"中)
+    ///     "unix:///var/run/app.sock"(同机进程间，"unix://@app"为抽象命名空间)
     /// @return >=0 表示成功
     /// @return <0 表示失败，错误码@see MessageErrorCode
     /// @note 原生tcp/udp与tbuspp协议只能二选一
@@ -285,7 +294,7 @@ public:
     /// @param routine 协程执行入口函数
     /// @return 0 成功
     /// @return <0 失败
-    int32_t MakeCoroutine(const cxx::function<void()>& routine);
+    int32_t MakeCoroutine(const Function<void()>& routine);
 
     /// @brief 注册控制命令
     /// @param on_cmd 命令处理回调
@@ -328,6 +337,9 @@ public:
 private:
     int32_t ProcessMessage();
 
+    // idle时最长等待时间，取配置的上限和各定时器最近超时时间的最小值
+    int32_t GetIdleWaitMS();
+
     void InitLog();
 
     int32_t InitCoSchedule();
@@ -338,8 +350,19 @@ private:
 
     int32_t InitTimer();
 
+    int32_t InitMessageDriver();
+
     int32_t InitControlService();
 
+    int32_t InitHotRestart();
+
+    // 监听已交给新进程后，在途请求是否已处理完(或超时)
+    bool IsHotRestartDrained();
+
+    // 按配置预先创建协程、连接缓冲区和rpc编码缓冲区并写入内存，预留rpc会话表，
+    // 在开始服务前(热重启时在通知旧进程停止接收前)执行，避免首批请求的缺页中断和rehash
+    void Prewarm();
+
     int32_t OnStatTimeout();
 
     void OnRouterAddressChanged(Router* router,
@@ -353,12 +376,18 @@ private:
 
     void StatProcessorResource(Stat* stat);
 
+    void StatCompress(Stat* stat);
+
+    void StatUdpSend(Stat* stat);
+
     void OnControlReload(const std::vector<std::string>& options, int32_t* ret_code, std::string* data);
 
     void OnControlPrint(const std::vector<std::string>& options, int32_t* ret_code, std::string* data);
 
     void OnControlLog(const std::vector<std::string>& options, int32_t* ret_code, std::string* data);
 
+    void OnControlPool(const std::vector<std::string>& options, int32_t* ret_code, std::string* data);
+
     int32_t Detach(int64_t handle);
 
 private:
@@ -383,12 +412,63 @@ private:
     BroadcastRelayHandler* m_broadcast_relay_handler;
     _PebbleBroadcastClient* m_broadcast_relay_client;
     PebbleControlHandler* m_control_handler;
+    HotRestart*        m_hot_restart;
     cxx::unordered_map<int64_t, IProcessor*> m_processor_map;
     cxx::unordered_map<std::string, Router*> m_router_map;
     cxx::unordered_map<Router*, std::vector<int64_t> > m_router_handle_map;
     std::string m_ini_file_name;
     uint32_t    m_is_overload;
     MsgExternInfo m_last_msg_info;
+    int64_t     m_last_active_us; // 最近一次有事件处理的时间，用于忙轮询
+
+    // 多worker模式相关，非worker模式时m_worker_index为-1
+    int32_t      m_worker_index;
+    AppEvents*   m_app_events;
+    StatManager* m_stat_master;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////
+
+/// @brief 创建worker的AppEventHandler，在worker线程中调用，返回的对象由PebbleServerGroup释放
+/// @param worker_index worker序号，从0开始
+typedef cxx::function<AppEventHandler*(uint32_t worker_index)> AppEventHandlerFactory;
+
+/// @brief 多worker(多reactor)运行模式，启动Options::_app_worker_num个线程，每个线程运行一个独立的
+///     PebbleServer实例(消息驱动、协程调度、定时器、rpc均为worker私有)，各worker通过SO_REUSEPORT
+///     监听同一地址，由内核将连接分散到各worker
+/// @note 统计数据汇总到主线程统一输出，控制命令只由0号worker处理，信号由主线程接收后转发给各worker
+class PebbleServerGroup {
+public:
+    PebbleServerGroup();
+    ~PebbleServerGroup();
+
+    /// @brief 自动解析ini文件，并设置到options，如果调用需要在Init前调用
+    /// @param file_name 配置文件 如 "../cfg/pebble.ini"
+    /// @return 0 成功
+    /// @return <0 失败
+    int32_t LoadOptionsFromIni(const std::string& file_name);
+
+    /// @brief 返回Pebble的配置参数，所有worker使用相同的配置
+    Options* GetOptions();
+
+    /// @brief 初始化接口
+    /// @param factory 为每个worker创建AppEventHandler，worker在OnInit中完成Bind、Attach等操作
+    /// @return 0 成功
+    /// @return <0 失败
+    int32_t Init(const AppEventHandlerFactory& factory);
+
+    /// @brief 启动所有worker，此调用会阻塞当前线程，直到所有worker退出
+    void Serve();
+
+private:
+    class WorkerThread;
+
+    void Update();
+
+private:
+    PebbleServer* m_master; // 只用于加载配置和汇总统计，不处理消息
+    AppEventHandlerFactory m_factory;
+    std::vector<WorkerThread*> m_workers;
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////
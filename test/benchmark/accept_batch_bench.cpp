@@ -0,0 +1,106 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+// 连接风暴: 子进程先把全部连接建立在监听的backlog中，再用Poll(timeout 0)取完，统计耗时和Poll次数
+// 用法: accept_batch_bench [accept_batch，默认64] [连接数，默认4000] [端口，默认19200]
+// 连接数不能超过net.core.somaxconn和NetIO::LISTEN_BACKLOG，打开的fd数需要放开ulimit -n
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "common/time_utility.h"
+#include "framework/net_message.h"
+
+using namespace pebble;
+
+static int32_t GetMsgLen(const uint8_t* head, uint32_t head_len) {
+    return 0;
+}
+
+// 建立conn_num个连接后通知父进程，保持连接直到被杀掉
+static void ConnectStorm(uint16_t port, int conn_num, int notify_fd) {
+    struct sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    for (int i = 0; i < conn_num; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            perror("connect");
+            break;
+        }
+    }
+    char c = 1;
+    if (write(notify_fd, &c, 1) != 1) {
+        _exit(1);
+    }
+    pause();
+    _exit(0);
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t accept_batch = argc > 1 ? atoi(argv[1]) : 64;
+    int conn_num = argc > 2 ? atoi(argv[2]) : 4000;
+    uint16_t port = argc > 3 ? atoi(argv[3]) : 19200;
+
+    NetMessage net_message;
+    net_message.Init(4, GetMsgLen, 4096);
+    net_message.SetAcceptBatch(accept_batch);
+    uint64_t listen_handle = net_message.Bind("127.0.0.1", port);
+    if (static_cast<int64_t>(listen_handle) < 0) {
+        printf("bind port %u failed\n", port);
+        return 1;
+    }
+    // 已有的连接(如udp监听)不计入
+    uint32_t listen_num = 0;
+    net_message.GetBuffInfo(&listen_num, NULL);
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return 1;
+    }
+    pid_t pid = fork();
+    if (0 == pid) {
+        ConnectStorm(port, conn_num, fds[1]);
+    }
+    // 等全部连接进入backlog
+    char c = 0;
+    if (read(fds[0], &c, 1) != 1) {
+        return 1;
+    }
+
+    int64_t begin = TimeUtility::GetCurrentUS();
+    int polls = 0;
+    uint32_t accepted = 0;
+    while (accepted < static_cast<uint32_t>(conn_num) && polls < 10 * conn_num) {
+        uint64_t handle = 0;
+        int32_t event = 0;
+        net_message.Poll(&handle, &event, 0);
+        polls++;
+        uint32_t used_num = 0;
+        net_message.GetBuffInfo(&used_num, NULL);
+        accepted = used_num - listen_num;
+    }
+    printf("accept_batch=%u: accepted %u/%d in %ld us, %d Poll calls\n",
+        accept_batch, accepted, conn_num, TimeUtility::GetCurrentUS() - begin, polls);
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+// binary与compact编码的码流大小和编解码耗时对比，结构体按生成代码的形式手写
+// 用法: compact_protocol_bench [循环次数，默认1000000]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/time_utility.h"
+#include "framework/dr/protocol/binary_protocol.h"
+#include "framework/dr/protocol/compact_protocol.h"
+#include "framework/dr/transport/buffer_transport.h"
+
+using namespace pebble;
+using namespace pebble::dr::protocol;
+using namespace pebble::dr::transport;
+
+// 与dr生成代码相同形式的结构体，覆盖常见的字段类型和一个较大的字段id
+struct Player {
+    int64_t uid;
+    int32_t level;
+    int32_t gold;
+    bool online;
+    std::string name;
+    std::vector<int64_t> friends;
+    std::map<int32_t, int64_t> items;
+    double score;
+    int16_t far_id;
+
+    uint32_t write(TProtocol* oprot) const {
+        uint32_t xfer = 0;
+        xfer += oprot->writeStructBegin("Player");
+        xfer += oprot->writeFieldBegin("uid", T_I64, 1);
+        xfer += oprot->writeI64(uid);
+        xfer += oprot->writeFieldEnd();
+        xfer += oprot->writeFieldBegin("level", T_I32, 2);
+        xfer += oprot->writeI32(level);
+        xfer += oprot->writeFieldEnd();
+        xfer += oprot->writeFieldBegin("gold", T_I32, 3);
+        xfer += oprot->writeI32(gold);
+        xfer += oprot->writeFieldEnd();
+        xfer += oprot->writeFieldBegin("online", T_BOOL, 4);
+        xfer += oprot->writeBool(online);
+        xfer += oprot->writeFieldEnd();
+        xfer += oprot->writeFieldBegin("name", T_STRING, 5);
+        xfer += oprot->writeString(name);
+        xfer += oprot->writeFieldEnd();
+        xfer += oprot->writeFieldBegin("friends", T_LIST, 6);
+        xfer += oprot->writeListBegin(T_I64, friends.size());
+        for (size_t i = 0; i < friends.size(); i++) {
+            xfer += oprot->writeI64(friends[i]);
+        }
+        xfer += oprot->writeListEnd();
+        xfer += oprot->writeFieldEnd();
+        xfer += oprot->writeFieldBegin("items", T_MAP, 7);
+        xfer += oprot->writeMapBegin(T_I32, T_I64, items.size());
+        for (std::map<int32_t, int64_t>::const_iterator it = items.begin(); it != items.end(); ++it) {
+            xfer += oprot->writeI32(it->first);
+            xfer += oprot->writeI64(it->second);
+        }
+        xfer += oprot->writeMapEnd();
+        xfer += oprot->writeFieldEnd();
+        xfer += oprot->writeFieldBegin("score", T_DOUBLE, 8);
+        xfer += oprot->writeDouble(score);
+        xfer += oprot->writeFieldEnd();
+        xfer += oprot->writeFieldBegin("far_id", T_I16, 100);
+        xfer += oprot->writeI16(far_id);
+        xfer += oprot->writeFieldEnd();
+        xfer += oprot->writeFieldStop();
+        xfer += oprot->writeStructEnd();
+        return xfer;
+    }
+
+    uint32_t read(TProtocol* iprot) {
+        uint32_t xfer = 0;
+        std::string fname;
+        TType ftype;
+        int16_t fid;
+        xfer += iprot->readStructBegin(fname);
+        while (true) {
+            xfer += iprot->readFieldBegin(fname, ftype, fid);
+            if (T_STOP == ftype) {
+                break;
+            }
+            switch (fid) {
+                case 1:
+                    xfer += iprot->readI64(uid);
+                    break;
+                case 2:
+                    xfer += iprot->readI32(level);
+                    break;
+                case 3:
+                    xfer += iprot->readI32(gold);
+                    break;
+                case 4:
+                    xfer += iprot->readBool(online);
+                    break;
+                case 5:
+                    xfer += iprot->readString(name);
+                    break;
+                case 6: {
+                    TType etype;
+                    uint32_t size = 0;
+                    xfer += iprot->readListBegin(etype, size);
+                    friends.resize(size);
+                    for (uint32_t i = 0; i < size; i++) {
+                        xfer += iprot->readI64(friends[i]);
+                    }
+                    xfer += iprot->readListEnd();
+                    break;
+                }
+                case 7: {
+                    TType ktype;
+                    TType vtype;
+                    uint32_t size = 0;
+                    items.clear();
+                    xfer += iprot->readMapBegin(ktype, vtype, size);
+                    for (uint32_t i = 0; i < size; i++) {
+                        int32_t key = 0;
+                        xfer += iprot->readI32(key);
+                        xfer += iprot->readI64(items[key]);
+                    }
+                    xfer += iprot->readMapEnd();
+                    break;
+                }
+                case 8:
+                    xfer += iprot->readDouble(score);
+                    break;
+                case 100:
+                    xfer += iprot->readI16(far_id);
+                    break;
+                default:
+                    xfer += iprot->skip(ftype);
+                    break;
+            }
+            xfer += iprot->readFieldEnd();
+        }
+        xfer += iprot->readStructEnd();
+        return xfer;
+    }
+
+    bool operator==(const Player& rhs) const {
+        return uid == rhs.uid && level == rhs.level && gold == rhs.gold && online == rhs.online
+            && name == rhs.name && friends == rhs.friends && items == rhs.items
+            && score == rhs.score && far_id == rhs.far_id;
+    }
+};
+
+template <typename Protocol>
+static void Bench(const char* name, const Player& player, int loop) {
+    cxx::shared_ptr<TMemoryBuffer> wbuff(new TMemoryBuffer());
+    Protocol encoder(wbuff);
+    uint32_t len = 0;
+    int64_t begin = TimeUtility::GetCurrentUS();
+    for (int i = 0; i < loop; i++) {
+        wbuff->resetBuffer();
+        len = player.write(&encoder);
+    }
+    int64_t encode_us = TimeUtility::GetCurrentUS() - begin;
+
+    uint8_t* data = NULL;
+    uint32_t size = 0;
+    wbuff->getBuffer(&data, &size);
+    std::string encoded(reinterpret_cast<char*>(data), size);
+
+    cxx::shared_ptr<TMemoryBuffer> rbuff(new TMemoryBuffer(NULL, 0));
+    Protocol decoder(rbuff);
+    Player out;
+    begin = TimeUtility::GetCurrentUS();
+    for (int i = 0; i < loop; i++) {
+        rbuff->resetBuffer(reinterpret_cast<uint8_t*>(const_cast<char*>(encoded.data())),
+            encoded.size(), TMemoryBuffer::OBSERVE);
+        out.read(&decoder);
+    }
+    int64_t decode_us = TimeUtility::GetCurrentUS() - begin;
+
+    printf("%-8s size=%4u B  encode=%6.0f ns/op  decode=%6.0f ns/op  %s\n", name, len,
+        encode_us * 1000.0 / loop, decode_us * 1000.0 / loop, out == player ? "ok" : "MISMATCH");
+}
+
+int main(int argc, char* argv[]) {
+    int loop = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    Player player;
+    player.uid = 10000123456LL;
+    player.level = 57;
+    player.gold = 123456;
+    player.online = true;
+    player.name = "player_0001";
+    for (int i = 0; i < 20; i++) {
+        player.friends.push_back(10000000000LL + i * 37);
+    }
+    for (int i = 0; i < 10; i++) {
+        player.items[1000 + i] = i * 3;
+    }
+    player.score = 3.25;
+    player.far_id = -7;
+
+    Bench<TBinaryProtocol>("binary", player, loop);
+    Bench<TCompactProtocol>("compact", player, loop);
+    return 0;
+}
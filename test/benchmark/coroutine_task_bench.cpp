@@ -0,0 +1,96 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+// 协程任务的创建和调度开销: NewTask + Start + Yield + Resume直到结束，统计每个协程的耗时和operator new次数
+// 用法: coroutine_task_bench [协程数，默认1000000] [bind|func，任务体为bind结果或普通函数，默认bind]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <string>
+
+#include "common/coroutine.h"
+#include "common/time_utility.h"
+
+using namespace pebble;
+
+static int64_t g_new_num = 0;
+
+void* operator new(size_t size) {
+    g_new_num++;
+    void* p = malloc(size);
+    if (NULL == p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) throw() {
+    free(p);
+}
+
+static CoroutineSchedule* g_schedule = NULL;
+static int64_t g_last_id = -1;
+static int64_t g_done = 0;
+
+static void PlainBody() {
+    g_last_id = g_schedule->CurrentTaskId();
+    g_schedule->Yield();
+    g_done++;
+}
+
+static void BindBody(int step) {
+    g_last_id = g_schedule->CurrentTaskId();
+    g_schedule->Yield();
+    g_done += step;
+}
+
+int main(int argc, char* argv[]) {
+    int64_t n = argc > 1 ? atol(argv[1]) : 1000000;
+    bool plain = argc > 2 && std::string("func") == argv[2];
+
+    CoroutineSchedule schedule;
+    g_schedule = &schedule;
+    schedule.Init(NULL, 64 * 1024);
+
+    // 预热协程栈和任务对象的缓存
+    for (int i = 0; i < 1000; i++) {
+        CommonCoroutineTask* task = schedule.NewTask<CommonCoroutineTask>();
+        task->Init(cxx::bind(BindBody, 1));
+        task->Start();
+        schedule.Resume(g_last_id);
+    }
+
+    Function<void()> body;
+    if (plain) {
+        body = PlainBody;
+    } else {
+        body = cxx::bind(BindBody, 1);
+    }
+
+    int64_t new_num = g_new_num;
+    int64_t begin = TimeUtility::GetMonotonicUS();
+    for (int64_t i = 0; i < n; i++) {
+        CommonCoroutineTask* task = schedule.NewTask<CommonCoroutineTask>();
+        task->Init(body);
+        task->Start();
+        schedule.Resume(g_last_id);
+    }
+    int64_t cost = TimeUtility::GetMonotonicUS() - begin;
+    new_num = g_new_num - new_num;
+
+    printf("%ld coroutines (%s body) in %.3fs: %.0f/s, %.1f ns each, operator new per coroutine %.2f\n",
+        n, plain ? "function" : "bind", cost / 1e6, n * 1e6 / cost, cost * 1e3 / n,
+        static_cast<double>(new_num) / n);
+    return g_done == n + 1000 ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+// NetMessage水平触发与边缘触发(带预读)的收包对比: 子进程的多个连接批量写入带长度头的消息，
+// 本进程收取并检查每个连接的消息顺序，统计每个消息的recv和epoll_wait次数(本程序中替换这两个函数计数)
+// 用法: edge_trigger_bench <0:LT|1:ET> <连接数> <每连接消息数> <消息体大小> <端口> [预读字节数]
+// 例: edge_trigger_bench 1 8 20000 100 19300
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "common/time_utility.h"
+#include "framework/net_message.h"
+
+using namespace pebble;
+
+static int64_t g_recv_calls = 0;
+static int64_t g_epoll_wait_calls = 0;
+
+// 可执行程序中定义的同名函数优先于libc，直接走系统调用并计数
+extern "C" ssize_t recv(int fd, void* buff, size_t len, int flags) {
+    ++g_recv_calls;
+    return syscall(SYS_recvfrom, fd, buff, len, flags, NULL, NULL);
+}
+
+extern "C" int epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout) {
+    ++g_epoll_wait_calls;
+    return syscall(SYS_epoll_pwait, epfd, events, maxevents, timeout, NULL, 0);
+}
+
+static int32_t GetMsgLen(const uint8_t* head, uint32_t head_len) {
+    uint32_t len = 0;
+    memcpy(&len, head, sizeof(len));
+    return ntohl(len);
+}
+
+// conn_num个连接，每个连接发送msg_num个消息，消息体前4字节为序号，攒够256KB写一次，发完关闭
+static void Client(uint16_t port, int conn_num, int msg_num, int body_len) {
+    struct sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    std::vector<int> fds;
+    for (int i = 0; i < conn_num; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            _exit(1);
+        }
+        fds.push_back(fd);
+    }
+
+    std::string chunk;
+    std::string body(body_len, 'x');
+    for (int m = 0; m < msg_num; m++) {
+        uint32_t len = htonl(body_len);
+        chunk.append(reinterpret_cast<char*>(&len), sizeof(len));
+        uint32_t seq = m;
+        memcpy(&body[0], &seq, sizeof(seq));
+        chunk += body;
+        if (chunk.size() < 256 * 1024 && m != msg_num - 1) {
+            continue;
+        }
+        for (int i = 0; i < conn_num; i++) {
+            size_t offset = 0;
+            while (offset < chunk.size()) {
+                ssize_t n = write(fds[i], chunk.data() + offset, chunk.size() - offset);
+                if (n <= 0) {
+                    _exit(1);
+                }
+                offset += n;
+            }
+        }
+        chunk.clear();
+    }
+    for (int i = 0; i < conn_num; i++) {
+        close(fds[i]);
+    }
+    _exit(0);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 6) {
+        printf("usage: %s <0:LT|1:ET> <conns> <msgs per conn> <body bytes> <port> [read ahead bytes]\n",
+            argv[0]);
+        return 1;
+    }
+    bool edge_trigger = atoi(argv[1]) != 0;
+    int conn_num = atoi(argv[2]);
+    int msg_num = atoi(argv[3]);
+    int body_len = atoi(argv[4]);
+    uint16_t port = atoi(argv[5]);
+    uint32_t read_ahead = argc > 6 ? atoi(argv[6]) : NetMessage::DEFAULT_READ_AHEAD_LEN;
+
+    NetMessage net_message;
+    net_message.Init(4, GetMsgLen, 1024 * 1024);
+    net_message.SetEdgeTrigger(edge_trigger, read_ahead);
+    uint64_t listen_handle = net_message.Bind("127.0.0.1", port);
+    if (static_cast<int64_t>(listen_handle) < 0) {
+        printf("bind port %u failed\n", port);
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if (0 == pid) {
+        Client(port, conn_num, msg_num, body_len);
+    }
+
+    int64_t total = static_cast<int64_t>(conn_num) * msg_num;
+    int64_t recv_num = 0;
+    int64_t bad = 0;
+    // 按连接槽位记录期望的下一个序号
+    std::vector<uint32_t> next_seq(1 << 16, 0);
+    int64_t recv_calls = g_recv_calls;
+    int64_t wait_calls = g_epoll_wait_calls;
+    int64_t begin = TimeUtility::GetCurrentUS();
+    int idle = 0;
+    while (recv_num < total && idle < 3000) {
+        uint64_t handle = 0;
+        int32_t event = 0;
+        if (net_message.Poll(&handle, &event, 1) != 0) {
+            idle++;
+            continue;
+        }
+        idle = 0;
+        const uint8_t* msg = NULL;
+        uint32_t len = 0;
+        MsgExternInfo info;
+        if (net_message.Peek(handle, &msg, &len, &info) != 0) {
+            continue;
+        }
+        uint32_t seq = 0;
+        memcpy(&seq, msg + 4, sizeof(seq));
+        uint32_t slot = static_cast<uint32_t>(handle) & 0xFFFF;
+        if (len != static_cast<uint32_t>(body_len) + 4 || seq != next_seq[slot]) {
+            bad++;
+        }
+        next_seq[slot] = seq + 1;
+        recv_num++;
+        net_message.Pop(handle);
+    }
+    int64_t cost = TimeUtility::GetCurrentUS() - begin;
+    recv_calls = g_recv_calls - recv_calls;
+    wait_calls = g_epoll_wait_calls - wait_calls;
+
+    // 等待对端关闭被发现，检查连接是否全部释放
+    for (int i = 0; i < 200; i++) {
+        uint64_t handle = 0;
+        int32_t event = 0;
+        net_message.Poll(&handle, &event, 1);
+    }
+    uint32_t alive = 0;
+    net_message.GetBuffInfo(&alive, NULL);
+
+    double per_msg = recv_num > 0 ? static_cast<double>(recv_num) : 1.0;
+    printf("%s conns=%d body=%dB: got %ld/%ld bad=%ld in %ld ms; recv %.3f/msg epoll_wait %.3f/msg; "
+        "connections left after peer close %u\n",
+        edge_trigger ? "ET" : "LT", conn_num, body_len, recv_num, total, bad, cost / 1000,
+        recv_calls / per_msg, wait_calls / per_msg, alive);
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+// RPC回调的内存分配: 两个IRpc在进程内直接对接，统计每次往返(客户端SendRequest -> 服务端处理 -> 应答 ->
+// 客户端回调)的operator new次数和耗时，分别按以下三种回调形式:
+//   bind callback        客户端回调为cxx::bind结果
+//   generated async stub 与生成的异步桩代码相同，用户回调绑定在RPC响应回调中
+//   generated skeleton   与生成的服务端骨架相同，OnRpcResponse绑定在交给服务实现的应答回调中
+// 用法: rpc_callback_bench [往返次数，默认200000]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "common/time_utility.h"
+#include "framework/rpc.h"
+
+using namespace pebble;
+using namespace cxx::placeholders;
+
+// 生成的异步桩代码中用户回调的类型
+typedef Function<void(int32_t ret_code, uint32_t len)> UserCallback;
+// 生成的服务端骨架交给服务实现的应答回调的类型
+typedef Function<void(int32_t ret_code, const std::string& response), RPC_RESPONSE_INLINE_SIZE> ServerResponse;
+
+static int64_t g_new_num = 0;
+
+void* operator new(size_t size) {
+    g_new_num++;
+    void* p = malloc(size);
+    if (NULL == p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) throw() {
+    free(p);
+}
+
+void* operator new[](size_t size) {
+    g_new_num++;
+    void* p = malloc(size);
+    if (NULL == p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete[](void* p) throw() {
+    free(p);
+}
+
+class LoopbackRpc;
+
+struct Packet {
+    LoopbackRpc* dst;
+    int64_t handle;
+    std::string data;
+};
+
+// 发出的消息先放在这里，由Drain投递给对端
+static std::vector<Packet> g_wire;
+
+// 最简单的消息头编码，发送直接拷贝到g_wire
+class LoopbackRpc : public IRpc {
+public:
+    LoopbackRpc() : m_peer(NULL) {
+        SetSendFunction(cxx::bind(&LoopbackRpc::Send, this, _1, _2, _3, _4),
+            cxx::bind(&LoopbackRpc::SendV, this, _1, _2, _3, _4, _5));
+    }
+
+    void SetPeer(LoopbackRpc* peer) { m_peer = peer; }
+
+    virtual int32_t HeadEncode(const RpcHead& rpc_head, uint8_t* buff, uint32_t buff_len) {
+        buff[0] = rpc_head.m_message_type;
+        memcpy(buff + 1, &rpc_head.m_session_id, sizeof(rpc_head.m_session_id));
+        buff[9] = rpc_head.m_function_name.size();
+        memcpy(buff + 10, rpc_head.m_function_name.data(), buff[9]);
+        return 10 + buff[9];
+    }
+
+    virtual int32_t HeadDecode(const uint8_t* buff, uint32_t buff_len, RpcHead* rpc_head) {
+        rpc_head->m_message_type = buff[0];
+        memcpy(&rpc_head->m_session_id, buff + 1, sizeof(rpc_head->m_session_id));
+        rpc_head->m_function_name.assign(reinterpret_cast<const char*>(buff) + 10, buff[9]);
+        return 10 + buff[9];
+    }
+
+    virtual int32_t ExceptionEncode(const RpcException& exception, uint8_t* buff, uint32_t buff_len) {
+        return 0;
+    }
+
+    virtual int32_t ExceptionDecode(const uint8_t* buff, uint32_t buff_len, RpcException* exception) {
+        return 0;
+    }
+
+private:
+    int32_t Send(int64_t handle, const uint8_t* msg, uint32_t msg_len, int32_t flag) {
+        return 0;
+    }
+
+    int32_t SendV(int64_t handle, uint32_t msg_frag_num,
+        const uint8_t* msg_frag[], uint32_t msg_frag_len[], int32_t flag) {
+        g_wire.resize(g_wire.size() + 1);
+        Packet& packet = g_wire.back();
+        packet.dst = m_peer;
+        packet.handle = handle;
+        packet.data.clear();
+        for (uint32_t i = 0; i < msg_frag_num; i++) {
+            packet.data.append(reinterpret_cast<const char*>(msg_frag[i]), msg_frag_len[i]);
+        }
+        return 0;
+    }
+
+    LoopbackRpc* m_peer;
+};
+
+static void Drain() {
+    for (size_t i = 0; i < g_wire.size(); i++) {
+        g_wire[i].dst->OnMessage(g_wire[i].handle,
+            reinterpret_cast<const uint8_t*>(g_wire[i].data.data()), g_wire[i].data.size(), NULL, 0);
+    }
+    g_wire.clear();
+}
+
+class App {
+public:
+    App() : m_done(0) {}
+
+    int32_t OnRequest(const uint8_t* buff, uint32_t buff_len, OnRpcResponse& rsp) {
+        return rsp(0, buff, buff_len);
+    }
+
+    // 生成的服务端骨架process_X: 把rsp绑定到return_X上交给服务实现
+    int32_t OnSkeletonRequest(const uint8_t* buff, uint32_t buff_len, OnRpcResponse& rsp) {
+        ServerResponse response = cxx::bind(&App::ReturnResponse, this, rsp, _1, _2);
+        Serve(response);
+        return 0;
+    }
+
+    void Serve(ServerResponse& rsp) {
+        rsp(0, m_response);
+    }
+
+    // 生成的服务端骨架return_X: 编码后调用rsp
+    void ReturnResponse(OnRpcResponse& rsp, int32_t ret_code, const std::string& response) {
+        rsp(ret_code, reinterpret_cast<const uint8_t*>(response.data()), response.size());
+    }
+
+    int32_t OnResponse(int32_t ret, const uint8_t* buff, uint32_t buff_len, int64_t context) {
+        m_done += (0 == ret);
+        return 0;
+    }
+
+    // 生成的异步桩代码recv_X: 解码后调用用户回调
+    int32_t OnStubResponse(int32_t ret, const uint8_t* buff, uint32_t buff_len, const UserCallback& cb) {
+        cb(ret, buff_len);
+        return 0;
+    }
+
+    void OnUserCallback(int32_t ret_code, uint32_t len) {
+        m_done += (0 == ret_code);
+    }
+
+    int64_t m_done;
+    std::string m_response;
+};
+
+int main(int argc, char* argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : 200000;
+
+    LoopbackRpc client;
+    LoopbackRpc server;
+    client.SetPeer(&server);
+    server.SetPeer(&client);
+
+    App app;
+    server.AddOnRequestFunction("echo", cxx::bind(&App::OnRequest, &app, _1, _2, _3));
+    server.AddOnRequestFunction("skel", cxx::bind(&App::OnSkeletonRequest, &app, _1, _2, _3));
+    g_wire.reserve(16);
+
+    const char* names[] = { "bind callback", "generated async stub", "generated skeleton" };
+    const char body[] = "0123456789abcdef";
+    for (int mode = 0; mode < 3; mode++) {
+        // 第一轮预热会话表等容器
+        for (int round = 0; round < 2; round++) {
+            int64_t new_num = g_new_num;
+            int64_t begin = TimeUtility::GetMonotonicUS();
+            for (int i = 0; i < n; i++) {
+                RpcHead head;
+                head.m_message_type = kRPC_CALL;
+                head.m_session_id = client.GenSessionId();
+                head.m_function_name = (2 == mode) ? "skel" : "echo";
+                if (1 == mode) {
+                    UserCallback cb = cxx::bind(&App::OnUserCallback, &app, _1, _2);
+                    client.SendRequest(1, head, (const uint8_t*)body, sizeof(body),
+                        cxx::bind(&App::OnStubResponse, &app, _1, _2, _3, cb), 1000);
+                } else {
+                    client.SendRequest(1, head, (const uint8_t*)body, sizeof(body),
+                        cxx::bind(&App::OnResponse, &app, _1, _2, _3, static_cast<int64_t>(i)), 1000);
+                }
+                Drain();
+            }
+            int64_t cost = TimeUtility::GetMonotonicUS() - begin;
+            if (round > 0) {
+                printf("%-20s: %.2f allocs/round trip, %.0f ns/round trip\n", names[mode],
+                    static_cast<double>(g_new_num - new_num) / n, cost * 1000.0 / n);
+            }
+        }
+    }
+    return app.m_done == 6L * n ? 0 : 1;
+}
@@ -0,0 +1,252 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+// 共享内存驱动与tcp、unix域socket的ping-pong往返时延对比，服务端为fork出的echo进程
+//   latency 各传输方式下单个消息在途的往返时延，以及每次往返的eventfd唤醒次数
+//   verify  连续发送大小不一的消息(含超过ring一半的大消息)，服务端检查内容和顺序
+// 用法: shm_driver_bench [latency|verify] [消息数，默认100000]
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "common/time_utility.h"
+#include "framework/raw_message_driver.h"
+#include "framework/shm_message_driver.h"
+
+using namespace pebble;
+
+static int64_t g_eventfd_writes = 0;
+
+// 可执行程序中定义的write优先于libc，8字节的写入只有eventfd唤醒，用来统计唤醒次数
+extern "C" ssize_t write(int fd, const void* buff, size_t len) {
+    if (8 == len) {
+        ++g_eventfd_writes;
+    }
+    return syscall(SYS_write, fd, buff, len);
+}
+
+// 驱动的构造函数不公开，shm驱动叠加在独立的raw驱动上
+class BenchRawDriver : public RawMessageDriver {
+public:
+    BenchRawDriver() {}
+};
+
+class BenchShmDriver : public ShmMessageDriver {
+public:
+    BenchShmDriver() {}
+};
+
+struct DriverStack {
+    BenchRawDriver raw;
+    BenchShmDriver shm;
+
+    explicit DriverStack(uint32_t spin_us) {
+        raw.Init();
+        shm.Init(&raw);
+        shm.SetSpinUs(spin_us);
+    }
+};
+
+// 客户端发送"STAT"时服务端回复已收消息数、错误数和eventfd写次数
+static void Server(const std::string& url, uint32_t spin_us, bool verify) {
+    // fork时继承了父进程的计数
+    g_eventfd_writes = 0;
+    DriverStack stack(spin_us);
+    int64_t listen_handle = stack.shm.Bind(url);
+    if (listen_handle < 0) {
+        printf("bind %s failed %ld\n", url.c_str(), listen_handle);
+        fflush(stdout);
+        _exit(1);
+    }
+    std::vector<uint32_t> next_seq(1024, 0);
+    int64_t recv_num = 0;
+    int64_t bad = 0;
+    while (true) {
+        int64_t handle = -1;
+        int32_t event = 0;
+        if (stack.shm.Poll(&handle, &event, 10) != 0) {
+            continue;
+        }
+        const uint8_t* msg = NULL;
+        uint32_t len = 0;
+        MsgExternInfo info;
+        if (stack.shm.Peek(handle, &msg, &len, &info) != 0) {
+            continue;
+        }
+        if (4 == len && 0 == memcmp(msg, "STAT", 4)) {
+            char stat[64];
+            int n = snprintf(stat, sizeof(stat), "%ld %ld %ld", recv_num, bad, g_eventfd_writes);
+            stack.shm.Pop(handle);
+            stack.shm.Send(info._remote_handle, reinterpret_cast<uint8_t*>(stat), n, 0);
+            continue;
+        }
+        if (!verify) {
+            stack.shm.Send(info._remote_handle, msg, len, 0);
+            stack.shm.Pop(handle);
+            continue;
+        }
+        uint32_t seq = 0;
+        memcpy(&seq, msg, sizeof(seq));
+        recv_num++;
+        for (uint32_t i = 4; i < len; i++) {
+            if (msg[i] != static_cast<uint8_t>(seq + i)) {
+                bad++;
+                break;
+            }
+        }
+        uint32_t slot = static_cast<uint32_t>(handle) & 1023;
+        if (seq != next_seq[slot]) {
+            bad++;
+        }
+        next_seq[slot] = seq + 1;
+        stack.shm.Pop(handle);
+    }
+}
+
+static pid_t StartServer(const std::string& url, uint32_t spin_us, bool verify) {
+    pid_t pid = fork();
+    if (0 == pid) {
+        Server(url, spin_us, verify);
+    }
+    usleep(100000);
+    return pid;
+}
+
+static void StopServer(pid_t pid) {
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+static bool WaitReply(DriverStack* stack, std::string* reply, int32_t timeout_ms) {
+    static uint8_t buff[1 << 16];
+    int64_t end = TimeUtility::GetCurrentMS() + timeout_ms;
+    while (TimeUtility::GetCurrentMS() < end) {
+        int64_t handle = -1;
+        int32_t event = 0;
+        if (stack->shm.Poll(&handle, &event, 10) != 0) {
+            continue;
+        }
+        uint32_t len = sizeof(buff);
+        MsgExternInfo info;
+        if (stack->shm.Recv(handle, buff, &len, &info) == 0) {
+            if (reply != NULL) {
+                reply->assign(reinterpret_cast<char*>(buff), len);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static void Latency(const std::string& url, uint32_t spin_us, int n, int size) {
+    pid_t pid = StartServer(url, spin_us, false);
+    {
+        DriverStack stack(spin_us);
+        int64_t handle = stack.shm.Connect(url);
+        if (handle < 0) {
+            printf("connect %s failed %ld\n", url.c_str(), handle);
+            StopServer(pid);
+            return;
+        }
+        std::string msg(size, 'x');
+        // 预热
+        for (int i = 0; i < 1000; i++) {
+            stack.shm.Send(handle, reinterpret_cast<const uint8_t*>(msg.data()), size, 0);
+            WaitReply(&stack, NULL, 2000);
+        }
+
+        std::vector<int64_t> rtts;
+        int64_t writes = g_eventfd_writes;
+        int64_t begin = TimeUtility::GetCurrentUS();
+        for (int i = 0; i < n; i++) {
+            int64_t send_time = TimeUtility::GetCurrentUS();
+            stack.shm.Send(handle, reinterpret_cast<const uint8_t*>(msg.data()), size, 0);
+            if (!WaitReply(&stack, NULL, 2000)) {
+                printf("%s: reply timeout\n", url.c_str());
+                break;
+            }
+            rtts.push_back(TimeUtility::GetCurrentUS() - send_time);
+        }
+        int64_t cost = TimeUtility::GetCurrentUS() - begin;
+        writes = g_eventfd_writes - writes;
+
+        std::string stat;
+        stack.shm.Send(handle, reinterpret_cast<const uint8_t*>("STAT"), 4, 0);
+        WaitReply(&stack, &stat, 2000);
+        if (!rtts.empty()) {
+            std::sort(rtts.begin(), rtts.end());
+            printf("%-22s spin=%-3u %5dB: avg %.2fus p50 %ldus p99 %ldus | "
+                "client eventfd writes/rtt %.3f, server recv/bad/eventfd writes %s\n",
+                url.c_str(), spin_us, size, cost / static_cast<double>(rtts.size()),
+                rtts[rtts.size() / 2], rtts[rtts.size() * 99 / 100],
+                writes / static_cast<double>(rtts.size()), stat.c_str());
+        }
+    }
+    StopServer(pid);
+}
+
+static void Verify(const std::string& url, int n) {
+    pid_t pid = StartServer(url, 50, true);
+    DriverStack stack(50);
+    int64_t handle = stack.shm.Connect(url);
+    std::vector<uint8_t> msg(70000);
+    int64_t full_retries = 0;
+    srand(1);
+    int64_t begin = TimeUtility::GetCurrentUS();
+    for (int i = 0; i < n; i++) {
+        // 每100个消息有一个大消息，使ring多次回绕
+        uint32_t len = 4 + rand() % (0 == i % 100 ? 60000 : 3000);
+        uint32_t seq = i;
+        memcpy(&msg[0], &seq, sizeof(seq));
+        for (uint32_t k = 4; k < len; k++) {
+            msg[k] = static_cast<uint8_t>(seq + k);
+        }
+        while (stack.shm.Send(handle, &msg[0], len, 0) == kMESSAGE_SEND_BUFF_NOT_ENOUGH) {
+            full_retries++;
+            usleep(10);
+        }
+    }
+    int64_t cost = TimeUtility::GetCurrentUS() - begin;
+    std::string stat;
+    stack.shm.Send(handle, reinterpret_cast<const uint8_t*>("STAT"), 4, 0);
+    WaitReply(&stack, &stat, 5000);
+    printf("verify %d msgs in %ldms, ring-full retries %ld, server recv/bad/eventfd writes: %s\n",
+        n, cost / 1000, full_retries, stat.c_str());
+    StopServer(pid);
+}
+
+int main(int argc, char* argv[]) {
+    signal(SIGPIPE, SIG_IGN);
+    std::string mode = argc > 1 ? argv[1] : "latency";
+    int n = argc > 2 ? atoi(argv[2]) : 100000;
+
+    if ("verify" == mode) {
+        Verify("shm://pebble_bench", n);
+        return 0;
+    }
+    Latency("tcp://127.0.0.1:18790", 50, n, 128);
+    Latency("unix://@pebble_bench_unix", 50, n, 128);
+    Latency("shm://pebble_bench", 50, n, 128);
+    Latency("shm://pebble_bench", 0, n, 128);
+    Latency("tcp://127.0.0.1:18791", 50, n, 4096);
+    Latency("shm://pebble_bench", 50, n, 4096);
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+// 最小客户端(raw驱动Init加若干个Connect)的启动耗时和常驻内存增量，用于观察NetIO socket表的初始化开销
+// 用法: socket_table_bench [连接数，默认1]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common/time_utility.h"
+#include "framework/raw_message_driver.h"
+
+using namespace pebble;
+
+// 当前进程的常驻内存，单位KB
+static int64_t GetRssKB() {
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (NULL == fp) {
+        return 0;
+    }
+    int64_t size = 0;
+    int64_t resident = 0;
+    if (fscanf(fp, "%ld %ld", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(fp);
+    return resident * 4;
+}
+
+int main(int argc, char* argv[]) {
+    int conn_num = argc > 1 ? atoi(argv[1]) : 1;
+
+    int64_t rss_begin = GetRssKB();
+    int64_t begin = TimeUtility::GetCurrentUS();
+
+    RawMessageDriver* driver = RawMessageDriver::Instance();
+    driver->Init();
+    // 连接一个没有监听的端口，只为分配socket表项
+    for (int i = 0; i < conn_num; i++) {
+        driver->Connect("tcp://127.0.0.1:1");
+    }
+
+    int64_t cost = TimeUtility::GetCurrentUS() - begin;
+    printf("init + %d connect: %ld us, rss +%ld KB\n", conn_num, cost, GetRssKB() - rss_begin);
+    return 0;
+}
@@ -0,0 +1,316 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+// io_uring驱动与epoll驱动的对比:
+//   bench     回环TCP echo吞吐，服务端用被测驱动，客户端固定用epoll驱动，在另一个进程中
+//   poll      有udp监听时空闲Poll是否按调用者的超时等待，udp数据报到达时是否立即唤醒
+//   reconnect 主动连接被对端断开后，重连时在途的未发完消息是否重新发送
+// 用法: uring_driver_bench [all|bench|poll|reconnect] [消息数，默认100000]
+
+#include <arpa/inet.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "common/time_utility.h"
+#include "framework/raw_message_driver.h"
+#include "framework/uring_message_driver.h"
+
+using namespace pebble;
+
+// 驱动的构造函数不公开，测试中每个用例需要独立的驱动实例
+class BenchRawDriver : public RawMessageDriver {
+public:
+    BenchRawDriver() {}
+};
+
+class BenchUringDriver : public UringMessageDriver {
+public:
+    BenchUringDriver() {}
+};
+
+static MessageDriver* MakeDriver(bool uring) {
+    if (uring) {
+        BenchUringDriver* driver = new BenchUringDriver();
+        if (driver->Init() != 0) {
+            printf("io_uring unsupported\n");
+            exit(3);
+        }
+        return driver;
+    }
+    BenchRawDriver* driver = new BenchRawDriver();
+    driver->Init();
+    return driver;
+}
+
+// 服务端echo，收到n个消息后退出
+static void EchoServer(bool uring, const char* url, int64_t n) {
+    MessageDriver* driver = MakeDriver(uring);
+    if (driver->Bind(url) < 0) {
+        printf("bind %s failed\n", url);
+        _exit(1);
+    }
+    static uint8_t buff[1 << 16];
+    int64_t recv_num = 0;
+    while (recv_num < n) {
+        int64_t handle = -1;
+        int32_t event = 0;
+        if (driver->Poll(&handle, &event, 10) != 0) {
+            continue;
+        }
+        uint32_t len = sizeof(buff);
+        MsgExternInfo info;
+        if (driver->Recv(handle, buff, &len, &info) != 0) {
+            continue;
+        }
+        driver->Send(info._remote_handle, buff, len, 0);
+        recv_num++;
+    }
+    driver->Flush(-1);
+    usleep(100000);
+    _exit(0);
+}
+
+// 客户端conn个连接，每个连接window个消息在途
+static void EchoClient(const char* url, const char* name, int64_t n, int conn, int window, int size) {
+    BenchRawDriver driver;
+    driver.Init();
+    std::vector<int64_t> handles;
+    for (int i = 0; i < conn; i++) {
+        handles.push_back(driver.Connect(url));
+    }
+
+    std::string msg(size, 'x');
+    static uint8_t buff[1 << 16];
+    int64_t sent = 0;
+    int64_t recv_num = 0;
+    std::vector<int64_t> rtts;
+    int64_t begin = TimeUtility::GetCurrentUS();
+    int64_t last_send = begin;
+    for (int i = 0; i < conn; i++) {
+        for (int w = 0; w < window && sent < n; w++, sent++) {
+            driver.Send(handles[i], (const uint8_t*)msg.data(), size, 0);
+        }
+    }
+    while (recv_num < n) {
+        int64_t handle = -1;
+        int32_t event = 0;
+        if (driver.Poll(&handle, &event, 10) != 0) {
+            continue;
+        }
+        uint32_t len = sizeof(buff);
+        MsgExternInfo info;
+        if (driver.Recv(handle, buff, &len, &info) != 0) {
+            continue;
+        }
+        recv_num++;
+        // 只有一个消息在途时才统计往返时延
+        if (1 == conn && 1 == window) {
+            int64_t now = TimeUtility::GetCurrentUS();
+            rtts.push_back(now - last_send);
+            last_send = now;
+        }
+        if (sent < n) {
+            driver.Send(handle, (const uint8_t*)msg.data(), size, 0);
+            sent++;
+        }
+    }
+
+    double sec = (TimeUtility::GetCurrentUS() - begin) / 1e6;
+    printf("%-6s conn=%3d window=%2d size=%5d: %8.0f msg/s %7.1f MB/s",
+        name, conn, window, size, n / sec, n * static_cast<double>(size) / sec / 1e6);
+    if (!rtts.empty()) {
+        std::sort(rtts.begin(), rtts.end());
+        printf("  rtt p50 %ldus p99 %ldus", rtts[rtts.size() / 2], rtts[rtts.size() * 99 / 100]);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static void Bench(bool uring, int port, int64_t n, int conn, int window, int size) {
+    char url[64];
+    snprintf(url, sizeof(url), "tcp://127.0.0.1:%d", port);
+    pid_t pid = fork();
+    if (0 == pid) {
+        EchoServer(uring, url, n);
+    }
+    usleep(100000);
+    EchoClient(url, uring ? "uring" : "epoll", n, conn, window, size);
+    waitpid(pid, NULL, 0);
+}
+
+static void PollTimeout() {
+    BenchUringDriver* driver = new BenchUringDriver();
+    if (driver->Init() != 0) {
+        printf("io_uring unsupported\n");
+        return;
+    }
+    driver->Bind("tcp://127.0.0.1:19100");
+    driver->Bind("udp://127.0.0.1:19101");
+
+    int64_t handle = -1;
+    int32_t event = 0;
+    int calls = 0;
+    int64_t begin = TimeUtility::GetCurrentUS();
+    while (TimeUtility::GetCurrentUS() - begin < 200000) {
+        driver->Poll(&handle, &event, 200);
+        calls++;
+    }
+    printf("idle Poll(200ms) with udp bound: %d calls in %ldms\n",
+        calls, (TimeUtility::GetCurrentUS() - begin) / 1000);
+
+    pid_t pid = fork();
+    if (0 == pid) {
+        usleep(50000);
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(19101);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        sendto(fd, "ping", 4, 0, (struct sockaddr*)&addr, sizeof(addr));
+        _exit(0);
+    }
+
+    begin = TimeUtility::GetCurrentUS();
+    calls = 0;
+    int ret = -1;
+    while (ret != 0 && TimeUtility::GetCurrentUS() - begin < 2000000) {
+        ret = driver->Poll(&handle, &event, 1000);
+        calls++;
+    }
+    uint8_t buff[64];
+    uint32_t len = sizeof(buff);
+    MsgExternInfo info;
+    int recv_ret = (0 == ret) ? driver->Recv(handle, buff, &len, &info) : -1;
+    printf("udp datagram sent after 50ms: woke after %ldms, %d calls, recv ret %d len %u\n",
+        (TimeUtility::GetCurrentUS() - begin) / 1000, calls, recv_ret, len);
+    waitpid(pid, NULL, 0);
+}
+
+static void ReconnectResend() {
+    const char* url = "tcp://127.0.0.1:19110";
+    const int kMsgNum = 4000;
+    const int kMsgSize = 16 * 1024;
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return;
+    }
+
+    pid_t pid = fork();
+    if (0 == pid) {
+        close(fds[0]);
+        BenchRawDriver driver;
+        driver.Init();
+        driver.Bind(url);
+        std::set<int> seqs;
+        bool closed = false;
+        int recv_num = 0;
+        int bad = 0;
+        static uint8_t buff[1 << 16];
+        int64_t begin = TimeUtility::GetCurrentUS();
+        while (static_cast<int>(seqs.size()) < kMsgNum
+            && TimeUtility::GetCurrentUS() - begin < 10000000) {
+            int64_t handle = -1;
+            int32_t event = 0;
+            if (driver.Poll(&handle, &event, 10) != 0) {
+                continue;
+            }
+            uint32_t len = sizeof(buff);
+            MsgExternInfo info;
+            if (driver.Recv(handle, buff, &len, &info) != 0) {
+                continue;
+            }
+            recv_num++;
+            int seq = -1;
+            memcpy(&seq, buff, sizeof(seq));
+            if (len != static_cast<uint32_t>(kMsgSize) || seq < 0 || seq >= kMsgNum) {
+                bad++;
+            } else {
+                seqs.insert(seq);
+            }
+            // 收到一部分后断开连接，此时客户端的在途发送缓冲区中还有数据
+            if (!closed && 500 == recv_num) {
+                driver.Close(info._remote_handle);
+                closed = true;
+            }
+        }
+        char out[256];
+        int len = snprintf(out, sizeof(out), "reconnect: server recv %d msgs, distinct %zu/%d, bad %d\n",
+            recv_num, seqs.size(), kMsgNum, bad);
+        if (write(fds[1], out, len) < 0) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    close(fds[1]);
+    usleep(100000);
+    BenchUringDriver* driver = new BenchUringDriver();
+    if (driver->Init() != 0) {
+        printf("io_uring unsupported\n");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return;
+    }
+    int64_t handle = driver->Connect(url);
+    std::string msg(kMsgSize, 'y');
+    for (int i = 0; i < kMsgNum; i++) {
+        memcpy(&msg[0], &i, sizeof(i));
+        driver->Send(handle, (const uint8_t*)msg.data(), kMsgSize, 0);
+    }
+    int64_t begin = TimeUtility::GetCurrentUS();
+    while (waitpid(pid, NULL, WNOHANG) != pid && TimeUtility::GetCurrentUS() - begin < 12000000) {
+        int64_t poll_handle = -1;
+        int32_t event = 0;
+        driver->Poll(&poll_handle, &event, 5);
+    }
+    char out[256];
+    int len = read(fds[0], out, sizeof(out) - 1);
+    if (len > 0) {
+        out[len] = 0;
+        printf("%s", out);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    signal(SIGPIPE, SIG_IGN);
+    std::string mode = argc > 1 ? argv[1] : "all";
+    int64_t n = argc > 2 ? atol(argv[2]) : 100000;
+
+    if ("all" == mode || "bench" == mode) {
+        // {连接数, 每连接在途消息数, 消息大小}
+        const int cases[][3] = { {1, 1, 128}, {1, 32, 128}, {64, 8, 128}, {64, 8, 4096} };
+        int port = 19000;
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            int64_t num = (1 == cases[i][0] && 1 == cases[i][1]) ? n / 4 : n;
+            Bench(false, port++, num, cases[i][0], cases[i][1], cases[i][2]);
+            Bench(true, port++, num, cases[i][0], cases[i][1], cases[i][2]);
+        }
+    }
+    if ("all" == mode || "poll" == mode) {
+        PollTimeout();
+    }
+    if ("all" == mode || "reconnect" == mode) {
+        ReconnectResend();
+    }
+    return 0;
+}
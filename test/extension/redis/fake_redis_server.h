@@ -0,0 +1,334 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#ifndef PEBBLE_TEST_EXTENSION_REDIS_FAKE_REDIS_SERVER_H
+#define PEBBLE_TEST_EXTENSION_REDIS_FAKE_REDIS_SERVER_H
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/// @brief 测试用的进程内redis服务，在独立线程中解析RESP协议，支持PING/SET/GET/DEL/MGET
+/// @note 可以断开所有连接、停止监听后在同一端口重新监听、暂停回包，用于模拟redis故障
+class FakeRedisServer {
+public:
+    FakeRedisServer() : m_listen_fd(-1), m_port(0), m_hang(false), m_exit(false) {
+        pthread_mutex_init(&m_mutex, NULL);
+    }
+
+    ~FakeRedisServer() {
+        pthread_mutex_lock(&m_mutex);
+        m_exit = true;
+        pthread_mutex_unlock(&m_mutex);
+        pthread_join(m_thread, NULL);
+        Stop();
+        pthread_mutex_destroy(&m_mutex);
+    }
+
+    /// @brief 开始监听并启动服务线程，port为0时使用系统分配的端口
+    /// @return 0成功，非0失败
+    int Start(int port = 0) {
+        if (Listen(port) != 0) {
+            return -1;
+        }
+        return pthread_create(&m_thread, NULL, ThreadFn, this);
+    }
+
+    /// @brief 停止监听后在原端口重新监听，模拟redis重启
+    int Restart() {
+        return Listen(m_port);
+    }
+
+    /// @brief 关闭监听和所有连接，模拟redis宕机
+    void Stop() {
+        pthread_mutex_lock(&m_mutex);
+        if (m_listen_fd >= 0) {
+            close(m_listen_fd);
+            m_listen_fd = -1;
+        }
+        CloseClients();
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    /// @brief 关闭所有连接，继续监听
+    void DropClients() {
+        pthread_mutex_lock(&m_mutex);
+        CloseClients();
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    /// @brief 暂停回包(命令照常接收和计数，回包暂存)，模拟redis卡顿，恢复后按序发出
+    void SetHang(bool hang) {
+        pthread_mutex_lock(&m_mutex);
+        m_hang = hang;
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    /// @brief 写入或删除一个key，不经过连接
+    void SetKey(const std::string& key, const std::string& value) {
+        pthread_mutex_lock(&m_mutex);
+        m_db[key] = value;
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    void DelKey(const std::string& key) {
+        pthread_mutex_lock(&m_mutex);
+        m_db.erase(key);
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    /// @brief 收到的某个命令(大写)的次数
+    int CommandCount(const std::string& cmd) {
+        pthread_mutex_lock(&m_mutex);
+        int count = m_cmd_count[cmd];
+        pthread_mutex_unlock(&m_mutex);
+        return count;
+    }
+
+    /// @brief 当前的连接数
+    int ClientNum() {
+        pthread_mutex_lock(&m_mutex);
+        int num = static_cast<int>(m_clients.size());
+        pthread_mutex_unlock(&m_mutex);
+        return num;
+    }
+
+    int Port() const { return m_port; }
+
+private:
+    struct Client {
+        int         _fd;
+        std::string _in;
+        std::string _out;
+    };
+
+    static void* ThreadFn(void* arg) {
+        static_cast<FakeRedisServer*>(arg)->Run();
+        return NULL;
+    }
+
+    int Listen(int port) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0
+            || getsockname(fd, (sockaddr*)&addr, &len) != 0) {
+            close(fd);
+            return -1;
+        }
+        pthread_mutex_lock(&m_mutex);
+        m_listen_fd = fd;
+        m_port      = ntohs(addr.sin_port);
+        pthread_mutex_unlock(&m_mutex);
+        return 0;
+    }
+
+    void CloseClients() {
+        for (std::map<int, Client>::iterator it = m_clients.begin(); it != m_clients.end(); ++it) {
+            close(it->first);
+        }
+        m_clients.clear();
+    }
+
+    // poll在锁外进行，控制接口在另一线程关闭的fd在处理前按m_clients重新确认
+    void Run() {
+        while (true) {
+            std::vector<pollfd> fds;
+            pthread_mutex_lock(&m_mutex);
+            if (m_exit) {
+                pthread_mutex_unlock(&m_mutex);
+                return;
+            }
+            if (m_listen_fd >= 0) {
+                pollfd pfd = { m_listen_fd, POLLIN, 0 };
+                fds.push_back(pfd);
+            }
+            for (std::map<int, Client>::iterator it = m_clients.begin(); it != m_clients.end(); ++it) {
+                pollfd pfd = { it->first, POLLIN, 0 };
+                fds.push_back(pfd);
+            }
+            pthread_mutex_unlock(&m_mutex);
+
+            if (fds.empty()) {
+                usleep(1000);
+                continue;
+            }
+            poll(&fds[0], fds.size(), 1);
+
+            pthread_mutex_lock(&m_mutex);
+            for (size_t i = 0; i < fds.size(); i++) {
+                if (fds[i].revents == 0) {
+                    continue;
+                }
+                if (fds[i].fd == m_listen_fd) {
+                    int fd = accept(m_listen_fd, NULL, NULL);
+                    if (fd >= 0) {
+                        m_clients[fd]._fd = fd;
+                    }
+                    continue;
+                }
+                std::map<int, Client>::iterator it = m_clients.find(fds[i].fd);
+                if (it != m_clients.end() && !OnReadable(&it->second)) {
+                    close(it->first);
+                    m_clients.erase(it);
+                }
+            }
+            // 暂停回包期间积压的回包在恢复后发出
+            for (std::map<int, Client>::iterator it = m_clients.begin(); it != m_clients.end();) {
+                if (Flush(&it->second)) {
+                    ++it;
+                    continue;
+                }
+                close(it->first);
+                m_clients.erase(it++);
+            }
+            pthread_mutex_unlock(&m_mutex);
+        }
+    }
+
+    bool OnReadable(Client* client) {
+        char buff[4096];
+        ssize_t n = recv(client->_fd, buff, sizeof(buff), 0);
+        if (n <= 0) {
+            return false;
+        }
+        client->_in.append(buff, n);
+
+        std::vector<std::string> args;
+        while (Parse(&client->_in, &args)) {
+            client->_out.append(Execute(args));
+        }
+        return true;
+    }
+
+    bool Flush(Client* client) {
+        if (m_hang || client->_out.empty()) {
+            return true;
+        }
+        ssize_t sent = send(client->_fd, client->_out.data(), client->_out.size(), MSG_NOSIGNAL);
+        if (sent < 0) {
+            return false;
+        }
+        client->_out.erase(0, sent);
+        return true;
+    }
+
+    // 解析一条完整的多批量请求，数据不完整时返回false
+    static bool Parse(std::string* in, std::vector<std::string>* args) {
+        args->clear();
+        if (in->empty() || (*in)[0] != '*') {
+            return false;
+        }
+        size_t pos = in->find("\r\n");
+        if (pos == std::string::npos) {
+            return false;
+        }
+        int num = atoi(in->c_str() + 1);
+        pos += 2;
+        for (int i = 0; i < num; i++) {
+            size_t end = in->find("\r\n", pos);
+            if (end == std::string::npos) {
+                return false;
+            }
+            size_t len = atoi(in->c_str() + pos + 1);
+            if (in->size() < end + 2 + len + 2) {
+                return false;
+            }
+            args->push_back(in->substr(end + 2, len));
+            pos = end + 2 + len + 2;
+        }
+        in->erase(0, pos);
+        return true;
+    }
+
+    static std::string Bulk(const std::map<std::string, std::string>::const_iterator& it,
+                            const std::map<std::string, std::string>& db) {
+        if (it == db.end()) {
+            return "$-1\r\n";
+        }
+        char head[32];
+        snprintf(head, sizeof(head), "$%zu\r\n", it->second.size());
+        return head + it->second + "\r\n";
+    }
+
+    std::string Execute(const std::vector<std::string>& args) {
+        if (args.empty()) {
+            return "-ERR empty command\r\n";
+        }
+        std::string cmd = args[0];
+        for (size_t i = 0; i < cmd.size(); i++) {
+            cmd[i] = toupper(cmd[i]);
+        }
+        ++m_cmd_count[cmd];
+
+        if (cmd == "PING") {
+            return "+PONG\r\n";
+        }
+        if (cmd == "SET" && args.size() == 3) {
+            m_db[args[1]] = args[2];
+            return "+OK\r\n";
+        }
+        if (cmd == "GET" && args.size() == 2) {
+            return Bulk(m_db.find(args[1]), m_db);
+        }
+        if (cmd == "DEL" && args.size() >= 2) {
+            char reply[32];
+            size_t num = 0;
+            for (size_t i = 1; i < args.size(); i++) {
+                num += m_db.erase(args[i]);
+            }
+            snprintf(reply, sizeof(reply), ":%zu\r\n", num);
+            return reply;
+        }
+        if (cmd == "MGET" && args.size() >= 2) {
+            char head[32];
+            snprintf(head, sizeof(head), "*%zu\r\n", args.size() - 1);
+            std::string reply(head);
+            for (size_t i = 1; i < args.size(); i++) {
+                reply.append(Bulk(m_db.find(args[i]), m_db));
+            }
+            return reply;
+        }
+        return "-ERR unknown command '" + args[0] + "'\r\n";
+    }
+
+private:
+    pthread_t m_thread;
+    pthread_mutex_t m_mutex;
+    int m_listen_fd;
+    int m_port;
+    bool m_hang;
+    bool m_exit;
+    std::map<int, Client> m_clients;
+    std::map<std::string, std::string> m_db;
+    std::map<std::string, int> m_cmd_count;
+};
+
+#endif // PEBBLE_TEST_EXTENSION_REDIS_FAKE_REDIS_SERVER_H
@@ -0,0 +1,331 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+// RedisCache测试
+//   过期和负缓存用计数的回源函数验证回源次数
+//   并发未命中的合并、回源失败和等待超时通过RedisPool::GET回源到进程内的FakeRedisServer，
+//   以redis实际收到的GET数验证同一key同一时刻只有一条命令
+// 用法: redis_cache_test，全部通过返回0
+
+#include <stdio.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+
+#include "common/coroutine.h"
+#include "common/time_utility.h"
+#include "common/timer.h"
+#include "extension/redis/redis_cache.h"
+#include "extension/redis/redis_pool.h"
+#include "fake_redis_server.h"
+
+using namespace pebble;
+
+static int g_failed = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++g_failed; \
+        } \
+    } while (0)
+
+static const int kTimeoutMs = 300;
+
+static SequenceTimer g_timer;
+static CoroutineSchedule g_sched;
+static RedisPool g_pool;
+static FakeRedisServer g_server;
+static RedisCache* g_cache = NULL;
+
+// 模拟服务主循环的一个tick
+static void Tick() {
+    TimeUtility::UpdateCachedTime();
+    g_pool.Update();
+    if (g_cache != NULL) {
+        g_cache->Update();
+    }
+    g_timer.Update();
+    usleep(1000);
+}
+
+static void Spawn(const cxx::function<void()>& fn) {
+    CommonCoroutineTask* task = g_sched.NewTask<CommonCoroutineTask>();
+    task->Init(fn);
+    task->Start();
+}
+
+// 在协程中执行fn，驱动主循环直到其返回
+static void Run(const cxx::function<void()>& fn) {
+    bool done = false;
+    Spawn([&]() { fn(); done = true; });
+    while (!done) {
+        Tick();
+    }
+}
+
+static bool TickUntil(const cxx::function<bool()>& cond, int64_t timeout_ms) {
+    int64_t deadline = TimeUtility::GetMonotonicMS() + timeout_ms;
+    while (!cond()) {
+        if (TimeUtility::GetMonotonicMS() > deadline) {
+            return false;
+        }
+        Tick();
+    }
+    return true;
+}
+
+static void TickFor(int64_t ms) {
+    int64_t deadline = TimeUtility::GetMonotonicMS() + ms;
+    while (TimeUtility::GetMonotonicMS() < deadline) {
+        Tick();
+    }
+}
+
+// 同步返回的回源函数，记录回源次数
+struct CountingLoader {
+    CountingLoader() : _loads(0), _fail(false) {}
+
+    int Load(const std::string& key, std::string* value, bool* exists) {
+        ++_loads;
+        if (_fail) {
+            return -1;
+        }
+        std::map<std::string, std::string>::iterator it = _db.find(key);
+        *exists = (it != _db.end());
+        if (*exists) {
+            *value = it->second;
+        }
+        return 0;
+    }
+
+    int _loads;
+    bool _fail;
+    std::map<std::string, std::string> _db;
+};
+
+static RedisCacheLoader MakeLoader(CountingLoader* loader) {
+    return cxx::bind(&CountingLoader::Load, loader,
+        cxx::placeholders::_1, cxx::placeholders::_2, cxx::placeholders::_3);
+}
+
+static void TestTtl() {
+    CountingLoader loader;
+    loader._db["k"] = "v1";
+    RedisCacheOptions options;
+    options._ttl_ms = 50;
+    RedisCache cache;
+    CHECK(cache.Init(&g_sched, MakeLoader(&loader), options) == 0);
+
+    std::string value;
+    // 不在协程中
+    CHECK(cache.Get("k", &value) == kREDIS_CACHE_NOT_IN_COROUTINE);
+
+    Run([&]() {
+        CHECK(cache.Get("k", &value) == 0 && value == "v1");
+        CHECK(cache.Get("k", &value) == 0 && value == "v1");
+    });
+    CHECK(loader._loads == 1);
+    CHECK(cache.GetStat()._hits == 1 && cache.GetStat()._misses == 1);
+
+    // 过期后重新回源，取到新值
+    loader._db["k"] = "v2";
+    TickFor(options._ttl_ms + 20);
+    Run([&]() { CHECK(cache.Get("k", &value) == 0 && value == "v2"); });
+    CHECK(loader._loads == 2);
+
+    // Set指定的过期时间覆盖默认值
+    TickFor(1);
+    Run([&]() {
+        cache.Set("s", "local", 10);
+        CHECK(cache.Get("s", &value) == 0 && value == "local");
+    });
+    CHECK(loader._loads == 2);
+    TickFor(20);
+    Run([&]() {
+        bool exists = true;
+        CHECK(cache.Get("s", &value, &exists) == 0 && !exists);
+    });
+    CHECK(loader._loads == 3);
+}
+
+static void TestNegativeTtl() {
+    CountingLoader loader;
+    RedisCacheOptions options;
+    options._negative_ttl_ms = 50;
+    RedisCache cache;
+    CHECK(cache.Init(&g_sched, MakeLoader(&loader), options) == 0);
+
+    Run([&]() {
+        std::string value = "dirty";
+        bool exists = true;
+        CHECK(cache.Get("none", &value, &exists) == 0 && !exists);
+        exists = true;
+        CHECK(cache.Get("none", &value, &exists) == 0 && !exists && value.empty());
+        // 不关心是否存在时返回空串
+        value = "dirty";
+        CHECK(cache.Get("none", &value) == 0 && value.empty());
+    });
+    CHECK(loader._loads == 1);
+    CHECK(cache.GetStat()._negative_hits == 2 && cache.GetStat()._hits == 2);
+
+    // 负缓存过期后key已被写入
+    loader._db["none"] = "now";
+    TickFor(options._negative_ttl_ms + 20);
+    Run([&]() {
+        std::string value;
+        bool exists = false;
+        CHECK(cache.Get("none", &value, &exists) == 0 && exists && value == "now");
+    });
+    CHECK(loader._loads == 2);
+
+    // 负缓存时间为0时不缓存不存在的key
+    CountingLoader loader0;
+    RedisCacheOptions options0;
+    options0._negative_ttl_ms = 0;
+    RedisCache cache0;
+    CHECK(cache0.Init(&g_sched, MakeLoader(&loader0), options0) == 0);
+    Run([&]() {
+        std::string value;
+        bool exists = true;
+        CHECK(cache0.Get("none", &value, &exists) == 0 && !exists);
+        CHECK(cache0.Get("none", &value, &exists) == 0 && !exists);
+    });
+    CHECK(loader0._loads == 2 && cache0.Size() == 0);
+
+    // 负的过期时间非法
+    RedisCacheOptions invalid;
+    invalid._negative_ttl_ms = -1;
+    RedisCache cache1;
+    CHECK(cache1.Init(&g_sched, MakeLoader(&loader0), invalid) != 0);
+}
+
+static void TestLoadFailed() {
+    CountingLoader loader;
+    loader._db["k"] = "v";
+    loader._fail = true;
+    RedisCache cache;
+    CHECK(cache.Init(&g_sched, MakeLoader(&loader)) == 0);
+
+    Run([&]() {
+        std::string value;
+        CHECK(cache.Get("k", &value) == kREDIS_CACHE_LOAD_FAILED);
+        // 失败的结果不缓存
+        loader._fail = false;
+        CHECK(cache.Get("k", &value) == 0 && value == "v");
+    });
+    CHECK(loader._loads == 2 && cache.GetStat()._load_failed == 1);
+}
+
+// 同一tick内N个协程读同一个未缓存的key
+static void GetConcurrently(RedisCache* cache, const std::string& key, int num,
+                            int* ok, int* failed, int* done, int* last_ret) {
+    for (int i = 0; i < num; i++) {
+        Spawn([=]() {
+            std::string value;
+            int ret = cache->Get(key, &value);
+            if (ret == 0 && value == "hot") {
+                ++*ok;
+            } else {
+                ++*failed;
+                *last_ret = ret;
+            }
+            ++*done;
+        });
+    }
+}
+
+static void TestCollapsedMisses() {
+    const int N = 50;
+    RedisCache cache;
+    CHECK(cache.Init(&g_sched, RedisCache::PoolLoader(&g_pool)) == 0);
+    g_cache = &cache;
+    g_server.SetKey("hot", "hot");
+
+    int ok = 0, failed = 0, done = 0, last_ret = 0;
+    int get_num = g_server.CommandCount("GET");
+    GetConcurrently(&cache, "hot", N, &ok, &failed, &done, &last_ret);
+    CHECK(TickUntil([&]() { return done == N; }, 1000));
+    CHECK(ok == N && failed == 0);
+    CHECK(g_server.CommandCount("GET") == get_num + 1);
+    CHECK(cache.GetStat()._misses == 1);
+    CHECK(cache.GetStat()._collapsed == static_cast<uint64_t>(N - 1));
+
+    // 之后全部命中，不再访问redis
+    ok = failed = done = 0;
+    GetConcurrently(&cache, "hot", N, &ok, &failed, &done, &last_ret);
+    CHECK(TickUntil([&]() { return done == N; }, 1000));
+    CHECK(ok == N && g_server.CommandCount("GET") == get_num + 1);
+
+    // 回源时连接断开，等待者都得到失败，结果不缓存
+    cache.Invalidate("hot");
+    g_server.SetHang(true);
+    ok = failed = done = 0;
+    GetConcurrently(&cache, "hot", N, &ok, &failed, &done, &last_ret);
+    CHECK(TickUntil([&]() { return g_server.CommandCount("GET") == get_num + 2; }, 1000));
+    g_server.DropClients();
+    g_server.SetHang(false);
+    CHECK(TickUntil([&]() { return done == N; }, 1000));
+    CHECK(failed == N && last_ret == kREDIS_CACHE_LOAD_FAILED);
+    CHECK(cache.GetStat()._load_failed == 1 && cache.Size() == 0);
+
+    CHECK(TickUntil([]() { return g_pool.GetConnectedNum() == 2; },
+                    RedisPool::RECONNECT_INTERVAL_MS + 1000));
+    g_cache = NULL;
+}
+
+static void TestWaitTimeout() {
+    // 等待时间短于回源，等待者先超时离开，回源者照常取到结果
+    RedisCacheOptions options;
+    options._wait_timeout_ms = 50;
+    RedisCache cache;
+    CHECK(cache.Init(&g_sched, RedisCache::PoolLoader(&g_pool), options) == 0);
+    g_cache = &cache;
+
+    int leader_ret = -100, waiter_ret = -100;
+    int done = 0;
+    g_server.SetHang(true);
+    Spawn([&]() { std::string value; leader_ret = cache.Get("hot", &value); ++done; });
+    Spawn([&]() { std::string value; waiter_ret = cache.Get("hot", &value); ++done; });
+    CHECK(TickUntil([&]() { return done == 1; }, 1000));
+    CHECK(waiter_ret == kREDIS_CACHE_WAIT_TIMEOUT);
+    g_server.SetHang(false);
+    CHECK(TickUntil([&]() { return done == 2; }, 1000));
+    CHECK(leader_ret == 0 && cache.Size() == 1);
+
+    // 已超时的等待者不会再被唤醒
+    TickFor(20);
+    g_cache = NULL;
+}
+
+int main(int argc, char** argv) {
+    if (g_server.Start() != 0) {
+        fprintf(stderr, "start fake redis failed\n");
+        return 1;
+    }
+    g_sched.Init(&g_timer);
+    CHECK(g_pool.Init(&g_sched, "127.0.0.1", g_server.Port(), 2, kTimeoutMs) == 0);
+    CHECK(TickUntil([]() { return g_pool.GetConnectedNum() == 2; }, 1000));
+
+    TestTtl();
+    TestNegativeTtl();
+    TestLoadFailed();
+    TestCollapsedMisses();
+    TestWaitTimeout();
+
+    CHECK(g_sched.Size() == 0);
+
+    printf("redis_cache_test %s\n", g_failed == 0 ? "passed" : "FAILED");
+    return g_failed == 0 ? 0 : 1;
+}
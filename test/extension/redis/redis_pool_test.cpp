@@ -0,0 +1,230 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+// RedisPool测试，redis由进程内的FakeRedisServer模拟，不依赖外部的redis-server
+//   基本命令、pipeline和MGET
+//   命令超时后迟到的回包不会唤醒协程，也不会错配给同连接上的下一条命令
+//   连接断开时在途命令失败返回，按重连间隔重连；redis宕机期间命令失败，恢复后自动重连
+// 用法: redis_pool_test，全部通过返回0
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "common/coroutine.h"
+#include "common/time_utility.h"
+#include "common/timer.h"
+#include "extension/redis/redis_pool.h"
+#include "fake_redis_server.h"
+
+using namespace pebble;
+
+static int g_failed = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++g_failed; \
+        } \
+    } while (0)
+
+static const int kTimeoutMs = 300;
+
+static SequenceTimer g_timer;
+static CoroutineSchedule g_sched;
+static RedisPool g_pool;
+static FakeRedisServer g_server;
+
+// 模拟服务主循环的一个tick
+static void Tick() {
+    TimeUtility::UpdateCachedTime();
+    g_pool.Update();
+    g_timer.Update();
+    usleep(1000);
+}
+
+static void Spawn(const cxx::function<void()>& fn) {
+    CommonCoroutineTask* task = g_sched.NewTask<CommonCoroutineTask>();
+    task->Init(fn);
+    task->Start();
+}
+
+// 在协程中执行fn，驱动主循环直到其返回
+static void Run(const cxx::function<void()>& fn) {
+    bool done = false;
+    Spawn([&]() { fn(); done = true; });
+    while (!done) {
+        Tick();
+    }
+}
+
+// 驱动主循环直到条件成立，超时返回false
+static bool TickUntil(const cxx::function<bool()>& cond, int64_t timeout_ms) {
+    int64_t deadline = TimeUtility::GetMonotonicMS() + timeout_ms;
+    while (!cond()) {
+        if (TimeUtility::GetMonotonicMS() > deadline) {
+            return false;
+        }
+        Tick();
+    }
+    return true;
+}
+
+static void TickFor(int64_t ms) {
+    int64_t deadline = TimeUtility::GetMonotonicMS() + ms;
+    while (TimeUtility::GetMonotonicMS() < deadline) {
+        Tick();
+    }
+}
+
+static std::string GetString(const char* key) {
+    redisReply* reply = g_pool.Command("GET %s", key);
+    if (reply == NULL || reply->type != REDIS_REPLY_STRING) {
+        return "<null>";
+    }
+    return std::string(reply->str, reply->len);
+}
+
+static bool AllConnected() {
+    return g_pool.GetConnectedNum() == 2;
+}
+
+static bool NoneConnected() {
+    return g_pool.GetConnectedNum() == 0;
+}
+
+static void TestCommand() {
+    // 不在协程中
+    CHECK(g_pool.Command("PING") == NULL);
+
+    Run([]() {
+        redisReply* reply = g_pool.Command("SET %s %s", "a", "1");
+        CHECK(reply != NULL && reply->type == REDIS_REPLY_STATUS);
+        CHECK(GetString("a") == "1");
+
+        reply = g_pool.Command("GET nokey");
+        CHECK(reply != NULL && reply->type == REDIS_REPLY_NIL);
+
+        RedisPipeline pipeline;
+        pipeline.AddCommand("SET b 2");
+        pipeline.AddCommand("GET b");
+        pipeline.AddCommand("BOGUS");
+        CHECK(g_pool.Exec(&pipeline) == 0);
+        CHECK(pipeline.GetReply(1) != NULL && std::string(pipeline.GetReply(1)->str) == "2");
+        CHECK(pipeline.GetReply(2) != NULL && pipeline.GetReply(2)->type == REDIS_REPLY_ERROR);
+
+        std::vector<std::string> keys;
+        keys.push_back("a");
+        keys.push_back("nokey");
+        keys.push_back("b");
+        std::vector<std::string> values;
+        std::vector<bool> exists;
+        CHECK(g_pool.MGet(keys, &values, &exists) == 0);
+        CHECK(values.size() == 3 && values[0] == "1" && values[1] == "" && values[2] == "2");
+        CHECK(exists.size() == 3 && exists[0] && !exists[1] && exists[2]);
+    });
+}
+
+static void TestTimeout() {
+    g_server.SetKey("x", "x");
+    g_server.SetKey("y", "y");
+
+    Run([]() {
+        g_server.SetHang(true);
+        int64_t begin = TimeUtility::GetMonotonicMS();
+        CHECK(g_pool.Command("GET x") == NULL);
+        int64_t cost = TimeUtility::GetMonotonicMS() - begin;
+        CHECK(cost >= kTimeoutMs - 10 && cost < kTimeoutMs + 200);
+        g_server.SetHang(false);
+
+        // 两个连接都发一次，确保覆盖超时命令所在的连接，迟到的"x"不能交给这些命令
+        for (int i = 0; i < 4; i++) {
+            CHECK(GetString("y") == "y");
+        }
+    });
+}
+
+static void TestReconnectAfterDisconnect() {
+    g_server.SetKey("k", "v");
+
+    // 在途命令在连接断开时失败返回，不等到超时
+    bool done = false;
+    redisReply* reply = reinterpret_cast<redisReply*>(1);
+    int64_t cost = 0;
+    g_server.SetHang(true);
+    int get_num = g_server.CommandCount("GET");
+    Spawn([&]() {
+        int64_t begin = TimeUtility::GetMonotonicMS();
+        reply = g_pool.Command("GET k");
+        cost = TimeUtility::GetMonotonicMS() - begin;
+        done = true;
+    });
+    CHECK(TickUntil([&]() { return g_server.CommandCount("GET") > get_num; }, 1000));
+    g_server.DropClients();
+    g_server.SetHang(false);
+    CHECK(TickUntil([&]() { return done; }, 1000));
+    CHECK(reply == NULL);
+    CHECK(cost < kTimeoutMs);
+    CHECK(TickUntil(NoneConnected, 1000));
+
+    // 重连间隔内没有可用连接，命令直接失败
+    Run([]() { CHECK(g_pool.Command("GET k") == NULL); });
+
+    int64_t begin = TimeUtility::GetMonotonicMS();
+    CHECK(TickUntil(AllConnected, RedisPool::RECONNECT_INTERVAL_MS + 1000));
+    CHECK(TimeUtility::GetMonotonicMS() - begin >= RedisPool::RECONNECT_INTERVAL_MS - 100);
+    Run([]() { CHECK(GetString("k") == "v"); });
+}
+
+static void TestReconnectAfterRestart() {
+    g_server.Stop();
+    CHECK(TickUntil(NoneConnected, 1000));
+
+    // 宕机期间的重连失败，命令失败而不是挂起
+    TickFor(RedisPool::RECONNECT_INTERVAL_MS * 2 + 200);
+    CHECK(NoneConnected());
+    Run([]() { CHECK(g_pool.Command("PING") == NULL); });
+
+    CHECK(g_server.Restart() == 0);
+    CHECK(TickUntil(AllConnected, RedisPool::RECONNECT_INTERVAL_MS + 1000));
+    Run([]() {
+        redisReply* reply = g_pool.Command("PING");
+        CHECK(reply != NULL && reply->type == REDIS_REPLY_STATUS);
+        CHECK(GetString("k") == "v");
+    });
+    CHECK(g_server.ClientNum() == 2);
+}
+
+int main(int argc, char** argv) {
+    if (g_server.Start() != 0) {
+        fprintf(stderr, "start fake redis failed\n");
+        return 1;
+    }
+    g_sched.Init(&g_timer);
+    CHECK(g_pool.Init(&g_sched, "127.0.0.1", g_server.Port(), 2, kTimeoutMs) == 0);
+    CHECK(TickUntil(AllConnected, 1000));
+
+    TestCommand();
+    TestTimeout();
+    TestReconnectAfterDisconnect();
+    TestReconnectAfterRestart();
+
+    // 所有协程都已结束，没有遗留在等待中的
+    TickFor(kTimeoutMs);
+    CHECK(g_sched.Size() == 0);
+
+    printf("redis_pool_test %s\n", g_failed == 0 ? "passed" : "FAILED");
+    return g_failed == 0 ? 0 : 1;
+}
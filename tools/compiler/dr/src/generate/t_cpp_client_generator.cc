@@ -2450,7 +2450,7 @@ void t_cpp_client_generator::generate_service_client(t_service* tservice, string
       std::string args = "int32_t ret, const uint8_t* buff, uint32_t buff_len";
       std::string ret_sync;
       std::string ret_parallel = ", int32_t* ret_code";
-      std::string ret_async(", cxx::function<void(int ret_code)>& cb");
+      std::string ret_async(", pebble::Function<void(int ret_code)>& cb");
       if (!(*f_iter)->get_returntype()->is_void()) {
         std::string type_ref;
         std::string type_const;
@@ -2460,7 +2460,7 @@ void t_cpp_client_generator::generate_service_client(t_service* tservice, string
         }
         ret_sync  = ", " + type_name((*f_iter)->get_returntype()) + "* response";
         ret_parallel = ", int32_t* ret_code, " + type_name((*f_iter)->get_returntype()) + "* response";
-        ret_async = ", cxx::function<void(int ret_code, " + type_const + type_name((*f_iter)->get_returntype())
+        ret_async = ", pebble::Function<void(int ret_code, " + type_const + type_name((*f_iter)->get_returntype())
             + type_ref + " response)>" + "& cb";
       }
 
@@ -2694,7 +2694,7 @@ void t_cpp_client_generator::generate_service_client(t_service* tservice, string
         out << endl;
 
       // 响应函数实现 recv_functionname
-      std::string ret_async = ", cxx::function<void(int ret_code)>& cb";
+      std::string ret_async = ", pebble::Function<void(int ret_code)>& cb";
       std::string ret_value;
       if (!(*f_iter)->get_returntype()->is_void()) {
         std::string type_const;
@@ -2703,7 +2703,7 @@ void t_cpp_client_generator::generate_service_client(t_service* tservice, string
             type_const = "const ";
             type_ref   = "&";
         }
-        ret_async = ", cxx::function<void(int ret_code, " + type_const + type_name((*f_iter)->get_returntype()) + type_ref + " response)>& cb";
+        ret_async = ", pebble::Function<void(int ret_code, " + type_const + type_name((*f_iter)->get_returntype()) + type_ref + " response)>& cb";
         ret_value = ", response";
       }
       out << indent() <<
@@ -2934,7 +2934,7 @@ void ProcessorGenerator4Client::generate_class_definition() {
     indent(out) <<
       "int32_t process_" << (*f_iter)->get_name() <<
       "(const uint8_t* buff, uint32_t buff_len, " << endl << indent(1) <<
-      "cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)>& rsp);" << endl;
+      "pebble::OnRpcResponse& rsp);" << endl;
 
     if (!(*f_iter)->is_oneway()) {
       string ret_arg = ", int32_t ret_code";
@@ -2948,7 +2948,7 @@ void ProcessorGenerator4Client::generate_class_definition() {
         ret_arg += type_const + type_name((*f_iter)->get_returntype()) + type_ref + " response";
       }
       indent(out) << "void return_" << (*f_iter)->get_name() <<
-        "(cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)>& rsp" << endl << indent(1) <<
+        "(pebble::OnRpcResponse& rsp" << endl << indent(1) <<
         ret_arg << ");" << endl;
     }
   }
@@ -3203,7 +3203,7 @@ void t_cpp_client_generator::generate_process_function(t_service* tservice,
     "::process_" << tfunction->get_name() <<
     "(" << endl << indent(1) <<
     "const uint8_t* buff, uint32_t buff_len," << endl << indent(1) <<
-    "cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)>& rsp)" <<
+    "pebble::OnRpcResponse& rsp)" <<
     endl;
   scope_up(out);
 
@@ -3238,13 +3238,14 @@ void t_cpp_client_generator::generate_process_function(t_service* tservice,
         type_ref   = "&";
       }
       out << indent() <<
-        "cxx::function<void(int32_t ret_code, " << type_const << type_name(tfunction->get_returntype()) << type_ref << " response)> tmp =" << endl << indent(1) <<
+        "pebble::Function<void(int32_t ret_code, " << type_const << type_name(tfunction->get_returntype()) << type_ref << " response)," << endl << indent(1) <<
+        "pebble::RPC_RESPONSE_INLINE_SIZE> tmp =" << endl << indent(1) <<
         "cxx::bind(&" << tservice->get_name() << "Handler::return_" << tfunction->get_name() << ", this," << endl << indent(2) <<
         "rsp, cxx::placeholders::_1, cxx::placeholders::_2);" << endl <<
         endl;
     } else {
       out << indent() <<
-        "cxx::function<void(int32_t ret_code)> tmp =" << endl << indent(1) <<
+        "pebble::Function<void(int32_t ret_code), pebble::RPC_RESPONSE_INLINE_SIZE> tmp =" << endl << indent(1) <<
         "cxx::bind(&" << tservice->get_name() << "Handler::return_" << tfunction->get_name() << ", this," << endl << indent(2) <<
         "rsp, cxx::placeholders::_1);" << endl <<
         endl;
@@ -3303,7 +3304,7 @@ void t_cpp_client_generator::generate_return_function  (t_service* tservice, t_f
   out <<
     "void " << tservice->get_name() << "Handler" <<
     "::return_" << tfunction->get_name() << "(" << endl << indent(1) <<
-    "cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)>& rsp" << endl << indent(1) <<
+    "pebble::OnRpcResponse& rsp" << endl << indent(1) <<
     ret_value << ")" <<
     endl;
   scope_up(out);
@@ -4217,7 +4218,7 @@ std::string t_cpp_client_generator::function_signature_if(t_function* tfunction,
   std::string args;
   std::string ret_sync;
   std::string ret_parallel;
-  std::string ret_async = "const cxx::function<void(int ret_code)>& cb";;
+  std::string ret_async = "const pebble::Function<void(int ret_code)>& cb";
   std::string ret_server;
 
   std::string type_ref;
@@ -4243,14 +4244,15 @@ std::string t_cpp_client_generator::function_signature_if(t_function* tfunction,
   if (!ttype->is_void()) {
     ret_sync   = type_name(ttype) + "* response";
     ret_parallel = type_name(ttype) + "* response, ";
-    ret_async  = "const cxx::function<void(int32_t ret_code, " + type_const + ns_prefix + type_name(ttype) + type_ref + " response)>& cb";
+    ret_async  = "const pebble::Function<void(int32_t ret_code, " + type_const + ns_prefix + type_name(ttype) + type_ref + " response)>& cb";
   }
 
   if (!tfunction->is_oneway()) {
     if (!ttype->is_void()) {
-      ret_server = "cxx::function<void(int32_t ret_code, " + type_const + ns_prefix + type_name(ttype) + type_ref + " response)>& rsp";
+      ret_server = "pebble::Function<void(int32_t ret_code, " + type_const + ns_prefix + type_name(ttype) + type_ref +
+        " response), pebble::RPC_RESPONSE_INLINE_SIZE>& rsp";
     } else {
-      ret_server = "cxx::function<void(int32_t ret_code)>& rsp";
+      ret_server = "pebble::Function<void(int32_t ret_code), pebble::RPC_RESPONSE_INLINE_SIZE>& rsp";
     }
   }
 
@@ -2673,12 +2673,19 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
       indent() << "// 设置路由函数，连接的选择交给路由回调函数处理，RPC请求通过路由回调函数选择的连接发送" << endl <<
       indent() << "// 设置路由回调函数后，不再使用SetHandle设置的连接句柄" << endl <<
       indent() << "void SetRouteFunction(const cxx::function<int64_t(uint64_t key)>& route_callback);" << endl << endl <<
+      indent() << "// 设置对冲请求的路由函数，第二个参数为原请求的连接句柄，返回另一个连接，<0表示不对冲" << endl <<
+      indent() << "// 如cxx::bind(&pebble::Router::GetBackupRoute, router, _1, _2)，只有轮询路由支持对冲" << endl <<
+      indent() << "void SetBackupRouteFunction(const cxx::function<int64_t(uint64_t key, int64_t exclude_handle)>& backup_route_callback);" << endl << endl <<
       indent() << "// 设置路由key，如使用取模或哈希路由策略时使用" << endl <<
       indent() << "void SetRouteKey(uint64_t route_key);" << endl << endl <<
       indent() << "// 设置广播的频道名字，设置了频道后Client将所有的RPC请求按广播处理，广播至channel_name" << endl <<
       indent() << "void SetBroadcast(const std::string& channel_name);" << endl << endl <<
       indent() << "// 设置RPC请求超时时间(单位ms)，未指定方法名时对所有方法生效，指定方法名时只对指定方法生效，默认的超时时间为10s" << endl <<
-      indent() << "int SetTimeout(uint32_t timeout_ms, const char* method_name = NULL);" << endl <<
+      indent() << "int SetTimeout(uint32_t timeout_ms, const char* method_name = NULL);" << endl << endl <<
+      indent() << "// 设置对冲请求，只对同步调用生效，需先设置对冲路由函数，只应对只读(幂等)的方法开启" << endl <<
+      indent() << "// 请求超过最近响应耗时的percentile分位未响应时，经对冲路由向另一个连接再发一次，先到的响应生效" << endl <<
+      indent() << "// 对冲请求数不超过请求数的max_extra_percent%，percentile为0时关闭，未指定方法名时对所有方法生效" << endl <<
+      indent() << "int SetHedge(uint32_t percentile, uint32_t max_extra_percent, const char* method_name = NULL);" << endl <<
       endl;
   }
 
@@ -2707,7 +2714,7 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
       std::string args = "int32_t ret, const uint8_t* buff, uint32_t buff_len";
       std::string ret_sync;
       std::string ret_parallel = ", int32_t* ret_code";
-      std::string ret_async(", cxx::function<void(int ret_code)>& cb");
+      std::string ret_async(", pebble::Function<void(int ret_code)>& cb");
       if (!(*f_iter)->get_returntype()->is_void()) {
         std::string type_ref;
         std::string type_const;
@@ -2717,7 +2724,7 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
         }
         ret_sync  = ", " + type_name((*f_iter)->get_returntype()) + "* response";
         ret_parallel = ", int32_t* ret_code, " + type_name((*f_iter)->get_returntype()) + "* response";
-        ret_async = ", cxx::function<void(int ret_code, " + type_const + type_name((*f_iter)->get_returntype())
+        ret_async = ", pebble::Function<void(int ret_code, " + type_const + type_name((*f_iter)->get_returntype())
             + type_ref + " response)>" + "& cb";
       }
 
@@ -2742,13 +2749,17 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
   if (tservice->get_extends() == NULL) {
     f_service_h_ << endl << "public:" << endl;
     f_service_h_ << indent(1) << "int64_t GetHandle();" << endl;
+    f_service_h_ << indent(1) << "int64_t GetBackupHandle(int64_t exclude_handle);" << endl;
+    f_service_h_ << indent(1) << "pebble::RpcHedge* GetHedge(const char* method_name);" << endl;
     f_service_h_ << endl << "protected:" << endl;
     f_service_h_ << indent(1) << "::pebble::PebbleRpc* m_client;" << endl;
     f_service_h_ << indent(1) << "int64_t m_handle;" << endl;
     f_service_h_ << indent(1) << "cxx::function<int64_t(uint64_t)> m_route_func;" << endl;
+    f_service_h_ << indent(1) << "cxx::function<int64_t(uint64_t, int64_t)> m_backup_route_func;" << endl;
     f_service_h_ << indent(1) << "uint64_t m_route_key;" << endl;
     f_service_h_ << indent(1) << "std::string m_channel_name;" << endl;
     f_service_h_ << indent(1) << "cxx::unordered_map<std::string, int32_t> m_methods;" << endl;
+    f_service_h_ << indent(1) << "cxx::unordered_map<std::string, cxx::shared_ptr<pebble::RpcHedge> > m_hedges;" << endl;
   }
 
   f_service_h_ <<
@@ -2797,6 +2808,11 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
       "}" << endl <<
       endl;
 
+    out << "void " << scope << "SetBackupRouteFunction(const cxx::function<int64_t(uint64_t key, int64_t exclude_handle)>& backup_route_func) {" << endl <<
+      indent(1) << "m_backup_route_func = backup_route_func;" << endl <<
+      "}" << endl <<
+      endl;
+
     out << "void " << scope << "SetRouteKey(uint64_t route_key) {" << endl <<
       indent(1) << "m_route_key = route_key;" << endl <<
       "}" << endl <<
@@ -2824,6 +2840,30 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
       "}" << endl <<
       endl;
 
+    out << "int " << scope << "SetHedge(uint32_t percentile, uint32_t max_extra_percent, const char* method_name) {" << endl <<
+      indent(1) << "if (percentile > 0 && !m_backup_route_func) {" << endl <<
+      indent(2) << "return pebble::kRPC_INVALID_PARAM;" << endl <<
+      indent(1) << "}" << endl <<
+      endl <<
+      indent(1) << "cxx::function<int64_t(int64_t)> route = cxx::bind(&" << scope << "GetBackupHandle, this, cxx::placeholders::_1);" << endl <<
+      indent(1) << "for (cxx::unordered_map<std::string, int32_t>::iterator it = m_methods.begin(); it != m_methods.end(); ++it) {" << endl <<
+      indent(2) << "if (method_name != NULL && it->first != method_name) {" << endl <<
+      indent(3) << "continue;" << endl <<
+      indent(2) << "}" << endl <<
+      indent(2) << "if (0 == percentile) {" << endl <<
+      indent(3) << "m_hedges.erase(it->first);" << endl <<
+      indent(2) << "} else {" << endl <<
+      indent(3) << "m_hedges[it->first].reset(new pebble::RpcHedge(route, percentile, max_extra_percent));" << endl <<
+      indent(2) << "}" << endl <<
+      indent(2) << "if (method_name != NULL) {" << endl <<
+      indent(3) << "return 0;" << endl <<
+      indent(2) << "}" << endl <<
+      indent(1) << "}" << endl <<
+      endl <<
+      indent(1) << "return method_name != NULL ? pebble::kRPC_UNSUPPORT_FUNCTION_NAME : 0;" << endl <<
+      "}" << endl <<
+      endl;
+
     out << "int64_t " << scope << "GetHandle() {" << endl <<
       indent(1) << "if (m_route_func) {" << endl <<
       indent(2) << "return m_route_func(m_route_key);" << endl <<
@@ -2832,6 +2872,25 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
       indent(1) << "return m_handle;" << endl <<
       "}" << endl <<
       endl;
+
+    out << "int64_t " << scope << "GetBackupHandle(int64_t exclude_handle) {" << endl <<
+      indent(1) << "if (m_backup_route_func) {" << endl <<
+      indent(2) << "return m_backup_route_func(m_route_key, exclude_handle);" << endl <<
+      indent(1) << "}" << endl <<
+      endl <<
+      indent(1) << "return -1;" << endl <<
+      "}" << endl <<
+      endl;
+
+    out << "pebble::RpcHedge* " << scope << "GetHedge(const char* method_name) {" << endl <<
+      indent(1) << "if (m_hedges.empty()) {" << endl <<
+      indent(2) << "return NULL;" << endl <<
+      indent(1) << "}" << endl <<
+      endl <<
+      indent(1) << "cxx::unordered_map<std::string, cxx::shared_ptr<pebble::RpcHedge> >::iterator it = m_hedges.find(method_name);" << endl <<
+      indent(1) << "return it != m_hedges.end() ? it->second.get() : NULL;" << endl <<
+      "}" << endl <<
+      endl;
   }
 
   for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
@@ -2898,7 +2957,7 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
       out << indent(1) <<
         "pebble::OnRpcResponse on_rsp = cxx::bind(&" << scope << "recv_" << funname << "_sync, this," << endl << indent(2) <<
         "cxx::placeholders::_1, cxx::placeholders::_2, cxx::placeholders::_3" << ret_sync << ");" << endl << indent(1) <<
-        "return m_client->SendRequestSync(GetHandle(), head, buff, buff_len, on_rsp, m_methods[\"" << funname << "\"]);" <<
+        "return m_client->SendRequestSync(GetHandle(), head, buff, buff_len, on_rsp, m_methods[\"" << funname << "\"], GetHedge(\"" << funname << "\"));" <<
         endl;
       out << indent() << "} else {" << endl << indent(1) <<
         "return m_client->BroadcastRequest(m_channel_name, head, buff, buff_len);" << endl << indent() <<
@@ -3210,7 +3269,7 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
         endl;
 
       // 响应函数实现 recv_functionname
-      std::string ret_async = ", cxx::function<void(int ret_code)>& cb";
+      std::string ret_async = ", pebble::Function<void(int ret_code)>& cb";
       std::string ret_value;
       if (!(*f_iter)->get_returntype()->is_void()) {
         std::string type_const;
@@ -3219,7 +3278,7 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
             type_const = "const ";
             type_ref   = "&";
         }
-        ret_async = ", cxx::function<void(int ret_code, " + type_const + type_name((*f_iter)->get_returntype()) + type_ref + " response)>& cb";
+        ret_async = ", pebble::Function<void(int ret_code, " + type_const + type_name((*f_iter)->get_returntype()) + type_ref + " response)>& cb";
         ret_value = ", response";
       }
       out << indent() <<
@@ -3449,7 +3508,7 @@ void ProcessorGenerator::generate_class_definition() {
     indent(out) <<
       "int32_t process_" << (*f_iter)->get_name() <<
       "(const uint8_t* buff, uint32_t buff_len, " << endl << indent(1) <<
-      "cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)>& rsp);" << endl;
+      "pebble::OnRpcResponse& rsp);" << endl;
 
     if (!(*f_iter)->is_oneway()) {
       string ret_arg = ", int32_t ret_code";
@@ -3463,7 +3522,7 @@ void ProcessorGenerator::generate_class_definition() {
         ret_arg += type_const + type_name((*f_iter)->get_returntype()) + type_ref + " response";
       }
       indent(out) << "void return_" << (*f_iter)->get_name() <<
-        "(cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)>& rsp" << endl << indent(1) <<
+        "(pebble::OnRpcResponse& rsp" << endl << indent(1) <<
         ret_arg << ");" << endl;
     }
   }
@@ -3718,7 +3777,7 @@ void t_cpp_generator::generate_process_function(t_service* tservice,
     "::process_" << tfunction->get_name() <<
     "(" << endl << indent(1) <<
     "const uint8_t* buff, uint32_t buff_len," << endl << indent(1) <<
-    "cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)>& rsp)" <<
+    "pebble::OnRpcResponse& rsp)" <<
     endl;
   scope_up(out);
 
@@ -3753,13 +3812,14 @@ void t_cpp_generator::generate_process_function(t_service* tservice,
         type_ref   = "&";
       }
       out << indent() <<
-        "cxx::function<void(int32_t ret_code, " << type_const << type_name(tfunction->get_returntype()) << type_ref << " response)> tmp =" << endl << indent(1) <<
+        "pebble::Function<void(int32_t ret_code, " << type_const << type_name(tfunction->get_returntype()) << type_ref << " response)," << endl << indent(1) <<
+        "pebble::RPC_RESPONSE_INLINE_SIZE> tmp =" << endl << indent(1) <<
         "cxx::bind(&" << tservice->get_name() << "Handler::return_" << tfunction->get_name() << ", this," << endl << indent(2) <<
         "rsp, cxx::placeholders::_1, cxx::placeholders::_2);" << endl <<
         endl;
     } else {
       out << indent() <<
-        "cxx::function<void(int32_t ret_code)> tmp =" << endl << indent(1) <<
+        "pebble::Function<void(int32_t ret_code), pebble::RPC_RESPONSE_INLINE_SIZE> tmp =" << endl << indent(1) <<
         "cxx::bind(&" << tservice->get_name() << "Handler::return_" << tfunction->get_name() << ", this," << endl << indent(2) <<
         "rsp, cxx::placeholders::_1);" << endl <<
         endl;
@@ -3818,7 +3878,7 @@ void t_cpp_generator::generate_return_function  (t_service* tservice, t_function
   out <<
     "void " << tservice->get_name() << "Handler" <<
     "::return_" << tfunction->get_name() << "(" << endl << indent(1) <<
-    "cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)>& rsp" << endl << indent(1) <<
+    "pebble::OnRpcResponse& rsp" << endl << indent(1) <<
     ret_value << ")" <<
     endl;
   scope_up(out);
@@ -4732,7 +4792,7 @@ std::string t_cpp_generator::function_signature_if(t_function* tfunction,
   std::string args;
   std::string ret_sync;
   std::string ret_parallel;
-  std::string ret_async = "const cxx::function<void(int ret_code)>& cb";;
+  std::string ret_async = "const pebble::Function<void(int ret_code)>& cb";
   std::string ret_server;
 
   std::string type_ref;
@@ -4758,14 +4818,15 @@ std::string t_cpp_generator::function_signature_if(t_function* tfunction,
   if (!ttype->is_void()) {
     ret_sync   = type_name(ttype) + "* response";
     ret_parallel = type_name(ttype) + "* response, ";
-    ret_async  = "const cxx::function<void(int32_t ret_code, " + type_const + ns_prefix + type_name(ttype) + type_ref + " response)>& cb";
+    ret_async  = "const pebble::Function<void(int32_t ret_code, " + type_const + ns_prefix + type_name(ttype) + type_ref + " response)>& cb";
   }
 
   if (!tfunction->is_oneway()) {
     if (!ttype->is_void()) {
-      ret_server = "cxx::function<void(int32_t ret_code, " + type_const + ns_prefix + type_name(ttype) + type_ref + " response)>& rsp";
+      ret_server = "pebble::Function<void(int32_t ret_code, " + type_const + ns_prefix + type_name(ttype) + type_ref +
+        " response), pebble::RPC_RESPONSE_INLINE_SIZE>& rsp";
     } else {
-      ret_server = "cxx::function<void(int32_t ret_code)>& rsp";
+      ret_server = "pebble::Function<void(int32_t ret_code), pebble::RPC_RESPONSE_INLINE_SIZE>& rsp";
     }
   }
 
@@ -175,7 +175,7 @@ void PrintINHeaderClientMethod(
         // 异步
         printer->Print(*vars,
             "virtual void $Method$(const $Request$& request, "
-            "const cxx::function<void(int32_t ret_code, const $Response$& response)>& cb) = 0;\n");
+            "const ::pebble::Function<void(int32_t ret_code, const $Response$& response)>& cb) = 0;\n");
     } else if (method->ClientOnlyStreaming()) {
         printer->Print(*vars, "// TODO: ClientOnlyStreaming for $Method$\n");
     } else if (method->ServerOnlyStreaming()) {
@@ -218,7 +218,7 @@ void PrintHeaderClientMethod(
             printer->Print(*vars, "/* $Method$异步调用，回调函数第一个参数为RPC调用结果，0为成功，非0失败 */\n");
             printer->Print(*vars,
                 "virtual void $Method$(const $Request$& request, "
-                "const cxx::function<void(int32_t ret_code, const $Response$& response)>& cb);\n");
+                "const ::pebble::Function<void(int32_t ret_code, const $Response$& response)>& cb);\n");
         } else if (method->ClientOnlyStreaming()) {
             printer->Print(*vars, "// TODO: ClientOnlyStreaming for $Method$\n");
         } else if (method->ServerOnlyStreaming()) {
@@ -238,7 +238,7 @@ void PrintHeaderClientMethod(
 #endif
             printer->Print(*vars,
                 "int32_t recv_$Method$(int32_t ret, const uint8_t* buff, uint32_t buff_len,"
-                " cxx::function<void(int ret_code, const $Response$& response)>& cb);\n");
+                " ::pebble::Function<void(int ret_code, const $Response$& response)>& cb);\n");
         } else if (method->ClientOnlyStreaming()) {
             printer->Print(*vars, "// TODO: ClientOnlyStreaming for $Method$\n");
         } else if (method->ServerOnlyStreaming()) {
@@ -269,7 +269,8 @@ void PrintHeaderServerMethod(
     if (method->NoStreaming()) {
         printer->Print(*vars,
             "virtual void $Method$(const $Request$& request,"
-            " cxx::function<void(int32_t ret_code, const $Response$& response)>& rsp) = 0;\n");
+            " ::pebble::Function<void(int32_t ret_code, const $Response$& response),"
+            " ::pebble::RPC_RESPONSE_INLINE_SIZE>& rsp) = 0;\n");
     } else if (method->ClientOnlyStreaming()) {
         printer->Print(*vars, "// TODO: ClientOnlyStreaming for $Method$\n");
     } else if (method->ServerOnlyStreaming()) {
@@ -290,9 +291,9 @@ void PrintINHeaderServerMethod(
     if (method->NoStreaming()) {
         printer->Print(*vars,
             "int32_t process_$Method$(const uint8_t* buff, uint32_t buff_len,"
-            " cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)>& rsp);\n");
+            " ::pebble::OnRpcResponse& rsp);\n");
         printer->Print(*vars,
-            "void return_$Method$(cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)>& rsp,"
+            "void return_$Method$(::pebble::OnRpcResponse& rsp,"
             " int32_t ret_code, const $Response$& response);\n");
     } else if (method->ClientOnlyStreaming()) {
         printer->Print(*vars, "// TODO: ClientOnlyStreaming for $Method$\n");
@@ -328,6 +329,8 @@ void PrintINHeaderService(Printer* printer, const Service* service,
     printer->Print(*vars, "$Service$ClientImp(::pebble::PebbleRpc* rpc);\n");
     printer->Print(*vars, "virtual ~$Service$ClientImp();\n\n");
     printer->Print("int64_t GetHandle();\n\n");
+    printer->Print("int64_t GetBackupHandle(int64_t exclude_handle);\n\n");
+    printer->Print("::pebble::RpcHedge* GetHedge(const char* method_name);\n\n");
 
     for (int i = 0; i < service->method_count(); ++i) {
         PrintHeaderClientMethod(printer, service->method(i).get(), vars, false);
@@ -339,11 +342,13 @@ void PrintINHeaderService(Printer* printer, const Service* service,
     printer->Print("::pebble::PebbleRpc* m_client;\n");
     printer->Print("int64_t m_handle;\n");
     printer->Print("cxx::function<int64_t(uint64_t)> m_route_func;\n");
+    printer->Print("cxx::function<int64_t(uint64_t, int64_t)> m_backup_route_func;\n");
     printer->Print("uint64_t m_route_key;\n");
 #ifndef __RPC_CLIENT__
     printer->Print("std::string m_channel_name;\n");
 #endif
     printer->Print("cxx::unordered_map<std::string, uint32_t> m_methods;\n");
+    printer->Print("cxx::unordered_map<std::string, cxx::shared_ptr< ::pebble::RpcHedge> > m_hedges;\n");
     printer->Outdent();
 
     printer->Print("};\n\n");
@@ -413,6 +418,9 @@ void PrintHeaderService(Printer* printer, const Service* service,
     printer->Print("/* 设置路由函数，连接的选择交给路由回调函数处理，RPC请求通过路由回调函数选择的连接发送 */\n");
     printer->Print("/* 设置路由回调函数后，不再使用SetHandle设置的连接句柄 */\n");
     printer->Print("void SetRouteFunction(const cxx::function<int64_t(uint64_t key)>& route_callback);\n\n");
+    printer->Print("/* 设置对冲请求的路由函数，第二个参数为原请求的连接句柄，返回另一个连接，<0表示不对冲 */\n");
+    printer->Print("/* 如cxx::bind(&pebble::Router::GetBackupRoute, router, _1, _2)，只有轮询路由支持对冲 */\n");
+    printer->Print("void SetBackupRouteFunction(const cxx::function<int64_t(uint64_t key, int64_t exclude_handle)>& backup_route_callback);\n\n");
     printer->Print("/* 设置路由key，如使用取模或哈希路由策略时使用 */\n");
     printer->Print("void SetRouteKey(uint64_t route_key);\n\n");
 #ifndef __RPC_CLIENT__
@@ -421,6 +429,10 @@ void PrintHeaderService(Printer* printer, const Service* service,
 #endif
     printer->Print("/* 设置RPC请求超时时间(单位ms)，未指定方法名时对所有方法生效，指定方法名时只对指定方法生效，默认的超时时间为10s */\n");
     printer->Print("int SetTimeout(uint32_t timeout_ms, const char* method_name = NULL);\n\n");
+    printer->Print("/* 设置对冲请求，只对同步调用生效，需先设置对冲路由函数，只应对只读(幂等)的方法开启 */\n");
+    printer->Print("/* 请求超过最近响应耗时的percentile分位未响应时，经对冲路由向另一个连接再发一次，先到的响应生效 */\n");
+    printer->Print("/* 对冲请求数不超过请求数的max_extra_percent%，percentile为0时关闭，未指定方法名时对所有方法生效 */\n");
+    printer->Print("int SetHedge(uint32_t percentile, uint32_t max_extra_percent, const char* method_name = NULL);\n\n");
 
     printer->Outdent();
 
@@ -681,7 +693,7 @@ void PrintSourceClientMethod(Printer* printer, const Method* method,
         printer->Indent();
         printer->Print(*vars, "::pebble::OnRpcResponse on_rsp = cxx::bind(&$Service$ClientImp::recv_$Method$_sync, m_imp,\n");
         printer->Print("    cxx::placeholders::_1, cxx::placeholders::_2, cxx::placeholders::_3, response);\n");
-        printer->Print(*vars, "return m_imp->m_client->SendRequestSync(m_imp->GetHandle(), __head, __buff, __size, on_rsp, m_imp->m_methods[\"$Method$\"]);\n");
+        printer->Print(*vars, "return m_imp->m_client->SendRequestSync(m_imp->GetHandle(), __head, __buff, __size, on_rsp, m_imp->m_methods[\"$Method$\"], m_imp->GetHedge(\"$Method$\"));\n");
         printer->Outdent();
         printer->Print("} else {\n");
         printer->Indent();
@@ -739,7 +751,7 @@ void PrintSourceClientMethod(Printer* printer, const Method* method,
         // 异步调用
         printer->Print(*vars,
             "void $Service$Client::$Method$(const $Request$& request, "
-            "const cxx::function<void(int32_t ret_code, const $Response$& response)>& cb) {\n");
+            "const ::pebble::Function<void(int32_t ret_code, const $Response$& response)>& cb) {\n");
         printer->Indent();
 
         printer->Print("::pebble::RpcHead __head;\n");
@@ -842,7 +854,7 @@ void PrintSourceClientMethod(Printer* printer, const Method* method,
         // 异步调用响应处理
         printer->Print(*vars,
             "int32_t $Service$ClientImp::recv_$Method$(int32_t ret, const uint8_t* buff, uint32_t buff_len,"
-            " cxx::function<void(int ret_code, const $Response$& response)>& cb) {\n");
+            " ::pebble::Function<void(int ret_code, const $Response$& response)>& cb) {\n");
         printer->Indent();
 
         printer->Print(*vars, "$Response$ __response;\n");
@@ -886,7 +898,7 @@ void PrintSourceServerMethod(Printer* printer, const Method* method,
 
     printer->Print(*vars,
         "int32_t __$Service$Skeleton::process_$Method$(const uint8_t* buff, uint32_t buff_len,"
-        " cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)>& rsp) {\n");
+        " ::pebble::OnRpcResponse& rsp) {\n");
     printer->Indent();
 
     printer->Print(*vars, "$Request$ __request;\n");
@@ -897,7 +909,8 @@ void PrintSourceServerMethod(Printer* printer, const Method* method,
     printer->Outdent();
     printer->Print("}\n\n");
 
-    printer->Print(*vars, "cxx::function<void(int32_t ret_code, const $Response$& response)> __rsp =\n");
+    printer->Print(*vars, "::pebble::Function<void(int32_t ret_code, const $Response$& response),"
+        " ::pebble::RPC_RESPONSE_INLINE_SIZE> __rsp =\n");
     printer->Print(*vars, "    cxx::bind(&__$Service$Skeleton::return_$Method$, this,\n");
     printer->Print("        rsp, cxx::placeholders::_1, cxx::placeholders::_2);\n\n");
 
@@ -908,7 +921,7 @@ void PrintSourceServerMethod(Printer* printer, const Method* method,
     printer->Print("}\n\n");
 
     printer->Print(*vars,
-        "void __$Service$Skeleton::return_$Method$(cxx::function<int32_t(int32_t ret, const uint8_t* buff, uint32_t buff_len)>& rsp,"
+        "void __$Service$Skeleton::return_$Method$(::pebble::OnRpcResponse& rsp,"
         " int32_t ret_code, const $Response$& response) {\n");
     printer->Indent();
 
@@ -960,6 +973,12 @@ void PrintSourceService(Printer* printer, const Service* service,
     printer->Outdent();
     printer->Print("}\n\n");
 
+    printer->Print(*vars, "void $Service$Client::SetBackupRouteFunction(const cxx::function<int64_t(uint64_t key, int64_t exclude_handle)>& backup_route_callback) {\n");
+    printer->Indent();
+    printer->Print("m_imp->m_backup_route_func = backup_route_callback;\n");
+    printer->Outdent();
+    printer->Print("}\n\n");
+
     printer->Print(*vars, "void $Service$Client::SetRouteKey(uint64_t route_key) {\n");
     printer->Indent();
     printer->Print("m_imp->m_route_key = route_key;\n");
@@ -1001,6 +1020,41 @@ void PrintSourceService(Printer* printer, const Service* service,
     printer->Outdent();
     printer->Print("}\n\n");
 
+    printer->Print(*vars, "int $Service$Client::SetHedge(uint32_t percentile, uint32_t max_extra_percent, const char* method_name) {\n");
+    printer->Indent();
+    printer->Print("if (percentile > 0 && !m_imp->m_backup_route_func) {\n");
+    printer->Indent();
+    printer->Print("return pebble::kRPC_INVALID_PARAM;\n");
+    printer->Outdent();
+    printer->Print("}\n\n");
+    printer->Print(*vars, "cxx::function<int64_t(int64_t)> route = cxx::bind(&$Service$ClientImp::GetBackupHandle, m_imp, cxx::placeholders::_1);\n");
+    printer->Print("for (cxx::unordered_map<std::string, uint32_t>::iterator it = m_imp->m_methods.begin(); it != m_imp->m_methods.end(); ++it) {\n");
+    printer->Indent();
+    printer->Print("if (method_name != NULL && it->first != method_name) {\n");
+    printer->Indent();
+    printer->Print("continue;\n");
+    printer->Outdent();
+    printer->Print("}\n");
+    printer->Print("if (0 == percentile) {\n");
+    printer->Indent();
+    printer->Print("m_imp->m_hedges.erase(it->first);\n");
+    printer->Outdent();
+    printer->Print("} else {\n");
+    printer->Indent();
+    printer->Print("m_imp->m_hedges[it->first].reset(new ::pebble::RpcHedge(route, percentile, max_extra_percent));\n");
+    printer->Outdent();
+    printer->Print("}\n");
+    printer->Print("if (method_name != NULL) {\n");
+    printer->Indent();
+    printer->Print("return 0;\n");
+    printer->Outdent();
+    printer->Print("}\n");
+    printer->Outdent();
+    printer->Print("}\n\n");
+    printer->Print("return method_name != NULL ? pebble::kRPC_UNSUPPORT_FUNCTION_NAME : 0;\n");
+    printer->Outdent();
+    printer->Print("}\n\n");
+
     for (int i = 0; i < service->method_count(); ++i) {
         PrintSourceClientMethod(printer, service->method(i).get(), vars, true);
     }
@@ -1032,6 +1086,29 @@ void PrintSourceService(Printer* printer, const Service* service,
     printer->Outdent();
     printer->Print("}\n\n");
 
+    printer->Print(*vars, "int64_t $Service$ClientImp::GetBackupHandle(int64_t exclude_handle) {\n");
+    printer->Indent();
+    printer->Print("if (m_backup_route_func) {\n");
+    printer->Indent();
+    printer->Print("return m_backup_route_func(m_route_key, exclude_handle);\n");
+    printer->Outdent();
+    printer->Print("}\n\n");
+    printer->Print("return -1;\n");
+    printer->Outdent();
+    printer->Print("}\n\n");
+
+    printer->Print(*vars, "::pebble::RpcHedge* $Service$ClientImp::GetHedge(const char* method_name) {\n");
+    printer->Indent();
+    printer->Print("if (m_hedges.empty()) {\n");
+    printer->Indent();
+    printer->Print("return NULL;\n");
+    printer->Outdent();
+    printer->Print("}\n\n");
+    printer->Print("cxx::unordered_map<std::string, cxx::shared_ptr< ::pebble::RpcHedge> >::iterator it = m_hedges.find(method_name);\n");
+    printer->Print("return it != m_hedges.end() ? it->second.get() : NULL;\n");
+    printer->Outdent();
+    printer->Print("}\n\n");
+
     for (int i = 0; i < service->method_count(); ++i) {
         PrintSourceClientMethod(printer, service->method(i).get(), vars, false);
     }